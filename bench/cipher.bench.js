@@ -0,0 +1,89 @@
+import { Buffer } from 'node:buffer';
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { afterAll, bench, describe } from 'vitest';
+
+import Database from '../lib/index.js';
+
+const PREPARE = `
+  CREATE TABLE t (
+    b BLOB
+  );
+`;
+
+const INSERT = `
+  INSERT INTO t (b) VALUES ($b);
+`;
+
+// 100MB in 16KB rows
+const BLOB = Buffer.alloc(16 * 1024, 0xaa);
+const ROW_COUNT = (100 * 1024 * 1024) / BLOB.length;
+
+const dir = mkdtempSync(join(tmpdir(), 'sqlcipher-bench-'));
+
+afterAll(() => {
+  rmSync(dir, { recursive: true });
+});
+
+let counter = 0;
+
+function open(ciphertext) {
+  counter += 1;
+  const db = new Database(join(dir, `db-${counter}.sqlite`), {
+    cacheStatements: true,
+  });
+  if (ciphertext) {
+    db.pragma(`key = 'hello world'`);
+  }
+  db.pragma('journal_mode = WAL');
+  db.pragma('wal_autocheckpoint = 0');
+  db.exec(PREPARE);
+  return db;
+}
+
+function bulkLoad(db) {
+  const insert = db.prepare(INSERT);
+  db.transaction(() => {
+    for (let i = 0; i < ROW_COUNT; i += 1) {
+      insert.run({ b: BLOB });
+    }
+  })();
+}
+
+describe.each([[false], [true]])('100MB, ciphertext=%j', (ciphertext) => {
+  let db;
+
+  bench(
+    'bulk load',
+    () => {
+      bulkLoad(db);
+    },
+    {
+      iterations: 5,
+      setup: () => {
+        db = open(ciphertext);
+      },
+      teardown: () => {
+        db.close();
+      },
+    },
+  );
+
+  bench(
+    'full checkpoint',
+    () => {
+      db.pragma('wal_checkpoint(TRUNCATE)');
+    },
+    {
+      iterations: 5,
+      setup: () => {
+        db = open(ciphertext);
+        bulkLoad(db);
+      },
+      teardown: () => {
+        db.close();
+      },
+    },
+  );
+});
@@ -0,0 +1,39 @@
+import { afterAll, bench, describe } from 'vitest';
+
+import Database from '../lib/index.js';
+
+const db = new Database();
+
+afterAll(() => {
+  db.close();
+});
+
+db.initTokenizer();
+db.exec(`
+  CREATE VIRTUAL TABLE names USING fts5(
+    name,
+    tokenize = 'signal_tokenizer prefix_index'
+  );
+`);
+
+const insert = db.prepare('INSERT INTO names (name) VALUES (?)');
+db.transaction(() => {
+  for (let i = 0; i < 20000; i += 1) {
+    insert.run([`Contact${i % 3000} Group${i % 700} Name${i}`]);
+  }
+})();
+db.buildPrefixIndex('names');
+
+const select = db.prepare(
+  `SELECT name FROM names WHERE names MATCH ? ORDER BY rank LIMIT 10`,
+);
+
+describe('complete a short prefix among 20000 names', () => {
+  bench(`MATCH 'prefix*'`, () => {
+    select.all(['co*']);
+  });
+
+  bench('completePrefix', () => {
+    db.completePrefix('co', 10);
+  });
+});
@@ -0,0 +1,48 @@
+import { bench, describe } from 'vitest';
+
+import Database from '../lib/index.js';
+
+// A schema with a few tables, indices and triggers, like a test fixture
+const SCHEMA = [];
+for (let i = 0; i < 50; i += 1) {
+  SCHEMA.push(`
+    CREATE TABLE t${i} (
+      id INTEGER PRIMARY KEY,
+      a TEXT NOT NULL,
+      b INTEGER,
+      c BLOB
+    );
+    CREATE INDEX t${i}_a ON t${i} (a);
+    CREATE INDEX t${i}_b ON t${i} (b, a);
+    CREATE TRIGGER t${i}_update AFTER UPDATE ON t${i} BEGIN
+      UPDATE t${i} SET b = b + 1 WHERE id = new.id;
+    END;
+    INSERT INTO t${i} (a, b) VALUES ('a', 1), ('b', 2), ('c', 3);
+  `);
+}
+const PREPARE = SCHEMA.join('\n');
+
+const source = new Database(':memory:');
+source.exec(PREPARE);
+const BUFFER = source.serialize();
+source.close();
+
+describe('create fixture', () => {
+  bench('exec', () => {
+    const db = new Database(':memory:');
+    db.exec(PREPARE);
+    db.close();
+  });
+
+  bench('deserialize', () => {
+    const db = new Database(':memory:');
+    db.deserialize(BUFFER);
+    db.close();
+  });
+
+  bench('deserialize readonly', () => {
+    const db = new Database(':memory:');
+    db.deserialize(BUFFER, { readonly: true });
+    db.close();
+  });
+});
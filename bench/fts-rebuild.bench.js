@@ -0,0 +1,44 @@
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { afterAll, bench, describe } from 'vitest';
+
+import Database from '../lib/index.js';
+
+const dir = mkdtempSync(join(tmpdir(), 'sqlcipher-bench-'));
+const db = new Database(join(dir, 'db.sqlite'));
+
+afterAll(() => {
+  db.close();
+  rmSync(dir, { recursive: true });
+});
+
+db.pragma('journal_mode = WAL');
+db.initTokenizer();
+db.exec(`
+  CREATE VIRTUAL TABLE fts USING fts5(body, tokenize = 'signal_tokenizer');
+`);
+
+const insert = db.prepare('INSERT INTO fts (body) VALUES (?)');
+db.transaction(() => {
+  for (let i = 0; i < 50000; i += 1) {
+    insert.run([
+      `Message ${i}: the quick brown fox jumps over the lazy dog, ` +
+        `see https://example.com/${i} for the rest.`,
+    ]);
+  }
+})();
+
+describe('rebuild the index of 50000 messages', () => {
+  bench('rebuild', () => {
+    db.exec(`INSERT INTO fts (fts) VALUES ('rebuild')`);
+  });
+
+  bench('rebuildFts threads=1', () => {
+    db.rebuildFts('fts', { threads: 1 });
+  });
+
+  bench('rebuildFts', () => {
+    db.rebuildFts('fts');
+  });
+});
@@ -0,0 +1,39 @@
+import { afterAll, bench, describe } from 'vitest';
+
+import Database from '../lib/index.js';
+
+const db = new Database();
+
+afterAll(() => {
+  db.close();
+});
+
+db.initTokenizer();
+db.exec(`
+  CREATE VIRTUAL TABLE fts USING fts5(body, tokenize = 'signal_tokenizer');
+`);
+
+const insert = db.prepare('INSERT INTO fts (body) VALUES (?)');
+db.transaction(() => {
+  for (let i = 0; i < 100000; i += 1) {
+    insert.run([
+      `Message ${i}: the quick brown fox ${'jumps '.repeat(i % 5)}over ` +
+        `the lazy dog ${i % 100}`,
+    ]);
+  }
+})();
+
+const select = db.prepare(
+  `SELECT rowid, bm25(fts) AS score FROM fts WHERE fts MATCH ?
+    ORDER BY score LIMIT 50`,
+);
+
+describe('top 50 of 100000 matches', () => {
+  bench('ORDER BY bm25()', () => {
+    select.all(['fox']);
+  });
+
+  bench('searchFts', () => {
+    db.searchFts('fts', 'fox', { limit: 50 });
+  });
+});
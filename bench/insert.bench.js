@@ -55,3 +55,33 @@ describe('INSERT INTO t', () => {
     },
   );
 });
+
+describe('INSERT INTO t in a transaction', () => {
+  const sdb = new Database(':memory:', { cacheStatements: true });
+  const bdb = new BDatabase(':memory:');
+
+  sdb.exec(PREPARE);
+  bdb.exec(PREPARE);
+
+  const sinsert = sdb.prepare(INSERT);
+  const binsert = bdb.prepare(INSERT);
+
+  const stransaction = sdb.transaction(() => {
+    sinsert.run({ a1: 1, a2: 2, a3: 3, b1: 'b1', b2: 'b2', b3: 'b3' });
+  });
+  const btransaction = bdb.transaction(() => {
+    binsert.run({ a1: 1, a2: 2, a3: 3, b1: 'b1', b2: 'b2', b3: 'b3' });
+  });
+
+  bench('@signalapp/sqlcipher', stransaction, {
+    teardown: () => {
+      sdb.exec(DELETE);
+    },
+  });
+
+  bench('@signalapp/better-sqlite', btransaction, {
+    teardown: () => {
+      bdb.exec(DELETE);
+    },
+  });
+});
@@ -0,0 +1,93 @@
+import { Buffer } from 'node:buffer';
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { afterAll, bench, describe } from 'vitest';
+
+import Database from '../lib/index.js';
+
+const PREPARE = `
+  CREATE TABLE t (
+    b BLOB
+  );
+`;
+
+const INSERT = `
+  INSERT INTO t (b) VALUES ($b);
+`;
+
+// Set `BENCH_DIR` to compare file systems (e.g. a tmpfs and an ext4 mount)
+const dir = mkdtempSync(
+  join(process.env.BENCH_DIR ?? tmpdir(), 'sqlcipher-bench-'),
+);
+
+afterAll(() => {
+  rmSync(dir, { recursive: true });
+});
+
+let counter = 0;
+
+function open(ioUring) {
+  counter += 1;
+  const db = new Database(join(dir, `db-${counter}.sqlite`), {
+    cacheStatements: true,
+    ioUring,
+  });
+  db.pragma(`key = 'hello world'`);
+  db.pragma('journal_mode = WAL');
+  db.pragma('synchronous = FULL');
+  db.pragma('wal_autocheckpoint = 0');
+  db.exec(PREPARE);
+  return db;
+}
+
+const SMALL_ROW = Buffer.alloc(100, 0xaa);
+
+// 50MB in 16KB rows
+const LARGE_ROW = Buffer.alloc(16 * 1024, 0xaa);
+const LARGE_ROW_COUNT = (50 * 1024 * 1024) / LARGE_ROW.length;
+
+describe.each([[false], [true]])('ioUring=%j', (ioUring) => {
+  let db;
+
+  bench(
+    '1000 small transactions',
+    () => {
+      const insert = db.prepare(INSERT);
+      for (let i = 0; i < 1000; i += 1) {
+        insert.run({ b: SMALL_ROW });
+      }
+    },
+    {
+      iterations: 5,
+      setup: () => {
+        db = open(ioUring);
+      },
+      teardown: () => {
+        db.close();
+      },
+    },
+  );
+
+  bench(
+    '50MB checkpoint',
+    () => {
+      db.pragma('wal_checkpoint(TRUNCATE)');
+    },
+    {
+      iterations: 5,
+      setup: () => {
+        db = open(ioUring);
+        const insert = db.prepare(INSERT);
+        db.transaction(() => {
+          for (let i = 0; i < LARGE_ROW_COUNT; i += 1) {
+            insert.run({ b: LARGE_ROW });
+          }
+        })();
+      },
+      teardown: () => {
+        db.close();
+      },
+    },
+  );
+});
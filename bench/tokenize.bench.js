@@ -0,0 +1,29 @@
+import { bench, describe } from 'vitest';
+
+import Database from '../lib/index.js';
+
+const MESSAGES = [];
+for (let i = 0; i < 10000; i += 1) {
+  MESSAGES.push(
+    `Message ${i}: the quick brown fox jumps over the lazy dog, ` +
+      `see https://example.com/${i} for the rest.`,
+  );
+}
+
+describe('tokenize 10000 messages', () => {
+  const db = new Database(':memory:');
+
+  bench('signalTokenize', () => {
+    for (const message of MESSAGES) {
+      db.signalTokenize(message);
+    }
+  });
+
+  bench('signalTokenizeBatch', () => {
+    db.signalTokenizeBatch(MESSAGES);
+  });
+
+  bench('signalTokenizeRanges', () => {
+    db.signalTokenizeRanges(MESSAGES);
+  });
+});
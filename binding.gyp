@@ -8,7 +8,28 @@
         'deps/extension/extension.gyp:extension',
         "<!(node -p \"require('node-addon-api').targets\"):node_addon_api",
       ],
-      'sources': ['src/addon.cc'],
+      'sources': [
+        'src/addon.cc',
+        'src/backup.cc',
+        'src/busy_handler.cc',
+        'src/checkpointer.cc',
+        'src/fts_indexer.cc',
+        'src/fts_merger.cc',
+        'src/fts_rebuild.cc',
+        'src/fts_top_k.cc',
+        'src/group_commit.cc',
+        'src/incremental_backup.cc',
+        'src/integrity.cc',
+        'src/interrupt_registry.cc',
+        'src/io_uring_vfs.cc',
+        'src/iostats_vfs.cc',
+        'src/prefix_index.cc',
+        'src/readahead_vfs.cc',
+        'src/rekey.cc',
+        'src/snapshot.cc',
+        'src/token_cache.cc',
+        'src/vfs_shim.cc',
+      ],
       'conditions': [
         ['OS=="linux"', {
           'ldflags': [
@@ -11,6 +11,7 @@ use hmac::{Hmac, Mac};
 use pbkdf2::pbkdf2_hmac;
 use rand_core::{OsRng, RngCore};
 use sha2::Sha512;
+use std::cell::RefCell;
 
 pub use signal_tokenizer;
 
@@ -20,6 +21,18 @@ mod sqlite;
 type Aes256CbcEnc = cbc::Encryptor<aes::Aes256>;
 type Aes256CbcDec = cbc::Decryptor<aes::Aes256>;
 
+// State of the key derivation capture on the current thread. See
+// `signal_sqlcipher_kdf_capture_start()`.
+enum KdfCapture {
+    Idle,
+    Armed,
+    Done { key: Vec<u8>, salt: Vec<u8> },
+}
+
+thread_local! {
+    static KDF_CAPTURE: RefCell<KdfCapture> = const { RefCell::new(KdfCapture::Idle) };
+}
+
 extern "C" fn activate(_ctx: *mut c_void) -> c_int {
     // Not called
     SQLITE_OK
@@ -134,9 +147,63 @@ extern "C" fn pbkdf(
     let salt = unsafe { core::slice::from_raw_parts(salt as *const c_uchar, salt_sz as usize) };
     let buf = unsafe { core::slice::from_raw_parts_mut(key as *mut c_uchar, key_sz as usize) };
     pbkdf2_hmac::<Sha512>(password, salt, workfactor as u32, buf);
+
+    // The first derivation after arming is the one of the encryption key. The
+    // following ones (HMAC key) are derived from it and thus not interesting.
+    KDF_CAPTURE.with(|capture| {
+        let mut capture = capture.borrow_mut();
+        if let KdfCapture::Armed = *capture {
+            *capture = KdfCapture::Done {
+                key: buf.to_vec(),
+                salt: salt.to_vec(),
+            };
+        }
+    });
     SQLITE_OK
 }
 
+/// Start recording the next key derivation on the calling thread.
+#[no_mangle]
+pub extern "C" fn signal_sqlcipher_kdf_capture_start() {
+    KDF_CAPTURE.with(|capture| capture.replace(KdfCapture::Armed));
+}
+
+/// Stop recording and copy out the derived key and its salt. Returns
+/// `SQLITE_ERROR` if no derivation happened since the start of the capture or
+/// if the sizes don't match.
+#[no_mangle]
+pub extern "C" fn signal_sqlcipher_kdf_capture_finish(
+    key: *mut c_uchar,
+    key_sz: c_int,
+    salt: *mut c_uchar,
+    salt_sz: c_int,
+) -> c_int {
+    let captured = KDF_CAPTURE.with(|capture| capture.replace(KdfCapture::Idle));
+    let KdfCapture::Done {
+        key: mut derived_key,
+        salt: derived_salt,
+    } = captured
+    else {
+        return SQLITE_ERROR;
+    };
+
+    let res = if key.is_null()
+        || salt.is_null()
+        || derived_key.len() != key_sz as usize
+        || derived_salt.len() != salt_sz as usize
+    {
+        SQLITE_ERROR
+    } else {
+        unsafe {
+            key.copy_from(derived_key.as_ptr(), derived_key.len());
+            salt.copy_from(derived_salt.as_ptr(), derived_salt.len());
+        }
+        SQLITE_OK
+    };
+    derived_key.fill(0);
+    res
+}
+
 extern "C" fn get_cipher(_ctx: *mut c_void) -> *const c_char {
     return "aes-256-cbc\0".as_bytes().as_ptr() as *const c_char;
 }
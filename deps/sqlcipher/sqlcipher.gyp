@@ -16,6 +16,10 @@
         'include_dirs': [
           '.',
         ],
+        # Exposes `sqlite3_key()` and friends in `sqlite3.h`
+        'defines': [
+          'SQLITE_HAS_CODEC',
+        ],
       },
       'cflags': ['-std=c99', '-w'],
       'xcode_settings': {
@@ -29,10 +33,8 @@
         'SQLITE_DEFAULT_MEMSTATUS=0',
         'SQLITE_OMIT_AUTOINIT',
         'SQLITE_OMIT_DEPRECATED',
-        'SQLITE_OMIT_DESERIALIZE',
         'SQLITE_OMIT_GET_TABLE',
         'SQLITE_OMIT_TCL_VARIABLE',
-        'SQLITE_OMIT_PROGRESS_CALLBACK',
         'SQLITE_OMIT_SHARED_CACHE',
         'SQLITE_OMIT_UTF16',
         'SQLITE_OMIT_COMPLETE',
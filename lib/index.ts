@@ -4,7 +4,7 @@
 import assert from 'node:assert';
 import { runInThisContext } from 'node:vm';
 import { fileURLToPath } from 'node:url';
-import { join, dirname } from 'node:path';
+import { join, dirname, resolve } from 'node:path';
 import { loadBindings } from './loadBindings.js';
 
 /** @internal */
@@ -39,14 +39,133 @@ const addon = loadBindings<{
     cache: Array<SqliteValue<Options>> | undefined,
     isGet: boolean,
   ): Array<SqliteValue<Options>>;
+  statementStepFor<Options extends StatementOptions>(
+    stmt: NativeStatement,
+    params: StatementParameters<Options> | null | undefined,
+    budgetMs: number | undefined,
+    vmSteps: number | undefined,
+    result: [boolean],
+  ): Array<RowType<Options>>;
+  statementReset(stmt: NativeStatement): void;
   statementClose(stmt: NativeStatement): void;
 
-  databaseOpen(path: string): NativeDatabase;
+  databaseOpen(path: string, vfs: string | undefined): NativeDatabase;
+  databaseOpenAsync(
+    path: string,
+    key: string | undefined,
+    cipherSettings: string | undefined,
+    vfs: string | undefined,
+  ): Promise<NativeDatabase>;
   databaseInitTokenizer(db: NativeDatabase): void;
   databaseExec(db: NativeDatabase, query: string): void;
+  databaseSerialize(db: NativeDatabase): Buffer;
+  databaseDeserialize(
+    db: NativeDatabase,
+    buffer: Uint8Array,
+    readonly: boolean,
+  ): void;
+  databaseArmDeadline(db: NativeDatabase, timeoutMs: number): void;
+  databaseDisarmDeadline(db: NativeDatabase): boolean;
+  databaseInterruptId(db: NativeDatabase): number;
+  databaseInterrupt(id: number): boolean;
+  databaseBegin(db: NativeDatabase, mode: number): void;
+  databaseCommit(db: NativeDatabase): void;
+  databaseRollback(db: NativeDatabase): void;
   databaseClose(db: NativeDatabase): void;
+  databaseIsOpen(db: NativeDatabase): boolean;
+  databaseExportRawKey(db: NativeDatabase): string;
+  databaseReadaheadStats(db: NativeDatabase): ReadaheadStats;
+  databaseIoStats(db: NativeDatabase): IoStats;
+  databaseQueueWrite(
+    db: NativeDatabase,
+    queries: ReadonlyArray<
+      readonly [string, StatementParameters<{ bigint: true }> | undefined]
+    >,
+    windowMs: number | undefined,
+    maxWrites: number | undefined,
+  ): Promise<void>;
+  databaseSetBusyHandler(
+    db: NativeDatabase,
+    timeoutMs: number,
+    initialDelayMs: number | undefined,
+    maxDelayMs: number | undefined,
+  ): void;
+  databaseBusyStats(db: NativeDatabase): BusyStats;
+  databaseStartCheckpointer(
+    db: NativeDatabase,
+    frames: number | undefined,
+    restartFrames: number | undefined,
+    idleMs: number | undefined,
+  ): void;
+  databaseCheckpointStats(db: NativeDatabase): CheckpointStats;
+  databaseStartDeferredIndexing(
+    db: NativeDatabase,
+    table: string,
+    content: string,
+    batchSize: number | undefined,
+    delayMs: number | undefined,
+    intervalMs: number | undefined,
+    mergePages: number | undefined,
+  ): void;
+  databaseIndexingStats(db: NativeDatabase): IndexingStats;
+  databaseStartFtsMerger(
+    db: NativeDatabase,
+    table: string,
+    idleMs: number | undefined,
+    budgetMs: number | undefined,
+  ): void;
+  databaseFtsMergeStats(db: NativeDatabase): FtsMergeStats;
+  databaseFtsStructure(db: NativeDatabase, table: string): FtsStructure;
+  databaseBackup(
+    db: NativeDatabase,
+    destPath: string,
+    key: string | null | undefined,
+    pagesPerStep: number | undefined,
+    sleepMs: number | undefined,
+    onProgress: ((copied: number, total: number) => void) | undefined,
+  ): Promise<void>;
+  databaseSnapshotTo(db: NativeDatabase, destPath: string): Promise<void>;
+  databaseBackupIncremental(
+    db: NativeDatabase,
+    deltaPath: string,
+    manifestPath: string,
+  ): Promise<IncrementalBackupStats>;
+  applyBackupDelta(targetPath: string, deltaPath: string): Promise<void>;
+  databaseRekeyAsync(
+    db: NativeDatabase,
+    key: string,
+    pagesPerStep: number | undefined,
+    onProgress: ((copied: number, total: number) => void) | undefined,
+  ): Promise<void>;
+  databaseVerifyIntegrity(
+    db: NativeDatabase,
+    threads: number | undefined,
+    onProgress: ((checked: number, total: number) => void) | undefined,
+  ): Promise<Array<number>>;
+  databaseRebuildFts(
+    db: NativeDatabase,
+    table: string,
+    threads: number | undefined,
+  ): RebuildFtsStats;
+  databaseSearchFts(
+    db: NativeDatabase,
+    table: string,
+    query: string,
+    limit: number,
+    weights: ReadonlyArray<number> | undefined,
+  ): SearchFtsResult;
+  databaseSignalTokenizeQuery(db: NativeDatabase, value: string): Array<string>;
+  databaseTokenCacheStats(db: NativeDatabase): TokenCacheStats;
+  databaseBuildPrefixIndex(db: NativeDatabase, table: string): number;
+  databaseCompletePrefix(
+    db: NativeDatabase,
+    prefix: string,
+    limit: number,
+  ): Array<PrefixCompletion>;
 
   signalTokenize(value: string): Array<string>;
+  signalTokenizeBatch(values: ReadonlyArray<string>): TokenizeBatchResult;
+  signalTokenizeRanges(values: ReadonlyArray<string>): TokenRangesResult;
 }>(import.meta.url, 'node_sqlcipher');
 
 export type StatementOptions = Readonly<{
@@ -92,6 +211,75 @@ export type SqliteValue<Options extends StatementOptions> =
   | null
   | (Options extends { bigint: true } ? bigint : never);
 
+/**
+ * Options of `.run()`/`.get()`/`.all()` methods of the statement.
+ */
+export type QueryOptions = Readonly<{
+  /**
+   * If set - the query is interrupted and the call throws if it doesn't
+   * complete within this many milliseconds. The deadline is checked every
+   * thousand SQLite virtual machine instructions.
+   */
+  timeoutMs?: number;
+}>;
+
+/**
+ * Budget of a single `.stepFor()` call. At least one of the fields has to be
+ * set.
+ */
+export type StepBudget = Readonly<{
+  /** Wall-clock time to spend on the slice in milliseconds */
+  budgetMs?: number;
+  /** Number of SQLite virtual machine instructions to run in the slice */
+  vmSteps?: number;
+}>;
+
+/**
+ * Return value of `.stepFor()`.
+ */
+export type StepResult<Row> = {
+  /** Rows produced in this slice */
+  rows: Array<Row>;
+  /** `true` once all rows of the query were returned */
+  done: boolean;
+};
+
+/** @internal */
+const MAX_INT32 = 0x7fffffff;
+
+/** @internal */
+function withDeadline<Result>(
+  db: NativeDatabase,
+  timeoutMs: number | undefined,
+  fn: () => Result,
+): Result {
+  if (timeoutMs === undefined) {
+    return fn();
+  }
+  if (
+    !Number.isInteger(timeoutMs) ||
+    timeoutMs < 0 ||
+    timeoutMs > MAX_INT32
+  ) {
+    throw new TypeError('Invalid timeoutMs option');
+  }
+
+  addon.databaseArmDeadline(db, timeoutMs);
+  let result: Result;
+  try {
+    result = fn();
+  } catch (error) {
+    if (addon.databaseDisarmDeadline(db)) {
+      throw new Error(`Query timed out after ${timeoutMs}ms`, {
+        cause: error,
+      });
+    }
+    throw error;
+  }
+  addon.databaseDisarmDeadline(db);
+  return result;
+}
+
 /**
  * Return value type of `.get()` and an element type of `.all()`
  */
@@ -110,7 +298,9 @@ class Statement<Options extends StatementOptions = object> {
   #cache: Array<SqliteValue<Options>> | undefined;
   #createRow: undefined | ((result: unknown) => RowType<Options>);
   #native: NativeStatement | undefined;
+  #db: NativeDatabase;
   #onClose: (() => void) | undefined;
+  #isStepping = false;
 
   /** @internal */
   constructor(
@@ -129,6 +319,7 @@ class Statement<Options extends StatementOptions = object> {
       bigint === true,
     );
 
+    this.#db = db;
     this.#onClose = onClose;
   }
 
@@ -137,15 +328,23 @@ class Statement<Options extends StatementOptions = object> {
    *
    * @param params - Parameters to be bound to query placeholders before
    *                 executing the statement.
+   * @param options - Query options.
    * @returns An object with `changes` and `lastInsertedRowid` integers.
    */
-  public run(params?: StatementParameters<Options>): RunResult {
-    if (this.#native === undefined) {
+  public run(
+    params?: StatementParameters<Options>,
+    { timeoutMs }: QueryOptions = {},
+  ): RunResult {
+    const native = this.#native;
+    if (native === undefined) {
       throw new Error('Statement closed');
     }
     const result: [number, number] = [0, 0];
     this.#checkParams(params);
-    addon.statementRun(this.#native, params, result);
+    this.#stopStepping(native);
+    withDeadline(this.#db, timeoutMs, () =>
+      addon.statementRun(native, params, result),
+    );
     return { changes: result[0], lastInsertRowid: result[1] };
   }
 
@@ -155,17 +354,23 @@ class Statement<Options extends StatementOptions = object> {
    *
    * @param params - Parameters to be bound to query placeholders before
    *                 executing the statement.
+   * @param options - Query options.
    * @returns A row object or a single column if `pluck: true` is set in the
    *          statement options.
    */
   public get<Row extends RowType<Options> = RowType<Options>>(
     params?: StatementParameters<Options>,
+    { timeoutMs }: QueryOptions = {},
   ): Row | undefined {
-    if (this.#native === undefined) {
+    const native = this.#native;
+    if (native === undefined) {
       throw new Error('Statement closed');
     }
     this.#checkParams(params);
-    const result = addon.statementStep(this.#native, params, this.#cache, true);
+    this.#stopStepping(native);
+    const result = withDeadline(this.#db, timeoutMs, () =>
+      addon.statementStep(native, params, this.#cache, true),
+    );
     if (result === undefined) {
       return undefined;
     }
@@ -182,17 +387,27 @@ class Statement<Options extends StatementOptions = object> {
    *
    * @param params - Parameters to be bound to query placeholders before
    *                 executing the statement.
+   * @param options - Query options.
    * @returns A list of row objects or single columns if `pluck: true` is set in
    *          the statement options.
    */
   public all<Row extends RowType<Options> = RowType<Options>>(
     params?: StatementParameters<Options>,
+    { timeoutMs }: QueryOptions = {},
+  ): Array<Row> {
+    return withDeadline(this.#db, timeoutMs, () => this.#all<Row>(params));
+  }
+
+  /** @internal */
+  #all<Row extends RowType<Options>>(
+    params: StatementParameters<Options> | undefined,
   ): Array<Row> {
     if (this.#native === undefined) {
       throw new Error('Statement closed');
     }
     const result = [];
     this.#checkParams(params);
+    this.#stopStepping(this.#native);
     let singleUseParams: StatementParameters<Options> | undefined | null =
       params;
     while (true) {
@@ -218,6 +433,69 @@ class Statement<Options extends StatementOptions = object> {
     return result as unknown as Array<Row>;
   }
 
+  /**
+   * Run the statement's query for a limited amount of time or work and return
+   * the rows produced so far. The next call continues where the previous one
+   * stopped until `done` is `true`, which makes it possible to interleave a
+   * long query with other work on the same thread.
+   *
+   * Slices end on row boundaries so each call returns at least one row (unless
+   * the query is done) and may overrun the budget by the time it takes to
+   * produce a single row.
+   *
+   * Calling `.run()`, `.get()` or `.all()` abandons the unfinished query.
+   *
+   * @param budget - Budget of this call.
+   * @param params - Parameters to be bound to query placeholders. Only used by
+   *                 the first call of the query.
+   * @returns Rows of this slice and whether the query is done.
+   */
+  public stepFor<Row extends RowType<Options> = RowType<Options>>(
+    { budgetMs, vmSteps }: StepBudget,
+    params?: StatementParameters<Options>,
+  ): StepResult<Row> {
+    const native = this.#native;
+    if (native === undefined) {
+      throw new Error('Statement closed');
+    }
+    if (budgetMs === undefined && vmSteps === undefined) {
+      throw new TypeError('Either budgetMs or vmSteps must be set');
+    }
+    if (
+      budgetMs !== undefined &&
+      (!Number.isInteger(budgetMs) || budgetMs < 0)
+    ) {
+      throw new TypeError('Invalid budgetMs');
+    }
+    if (vmSteps !== undefined && (!Number.isInteger(vmSteps) || vmSteps <= 0)) {
+      throw new TypeError('Invalid vmSteps');
+    }
+
+    let nativeParams: StatementParameters<Options> | undefined | null = null;
+    if (!this.#isStepping) {
+      this.#checkParams(params);
+      nativeParams = params;
+    }
+
+    const done: [boolean] = [false];
+    this.#isStepping = true;
+    let rows: Array<RowType<Options>>;
+    try {
+      rows = addon.statementStepFor(
+        native,
+        nativeParams,
+        budgetMs,
+        vmSteps,
+        done,
+      );
+    } catch (error) {
+      this.#stopStepping(native);
+      throw error;
+    }
+    this.#isStepping = !done[0];
+    return { rows: rows as Array<Row>, done: done[0] };
+  }
+
   /**
    * Close the statement and release the used memory.
    */
@@ -257,6 +535,15 @@ class Statement<Options extends StatementOptions = object> {
     return createRow;
   }
 
+  /** @internal */
+  #stopStepping(native: NativeStatement): void {
+    if (!this.#isStepping) {
+      return;
+    }
+    this.#isStepping = false;
+    addon.statementReset(native);
+  }
+
   /** @internal */
   #checkParams(params: StatementParameters<Options> | undefined): void {
     if (params === undefined) {
@@ -295,9 +582,6 @@ export type PragmaResult<Options extends PragmaOptions> = Options extends {
   ? RowType<{ pluck: true }> | undefined
   : Array<RowType<object>>;
 
-/** @internal */
-type TransactionStatement = Statement<{ persistent: true; pluck: true }>;
-
 export type DatabaseOptions = Readonly<{
   /**
    * If `true` - all statements are persistent by default (unless
@@ -307,233 +591,1799 @@ export type DatabaseOptions = Readonly<{
    * @see {@link StatementOptions}
    */
   cacheStatements?: boolean;
-}>;
-
-/**
- * A sqlite database class.
- */
-export default class Database {
-  #native: NativeDatabase | undefined;
-  #transactionDepth = 0;
-  #isCacheEnabled: boolean;
-  #statementCache = new Map<string, Statement>();
-
-  #transactionStmts:
-    | Readonly<{
-        begin: TransactionStatement;
-        rollback: TransactionStatement;
-        commit: TransactionStatement;
-
-        savepoint: TransactionStatement;
-        rollbackTo: TransactionStatement;
-        release: TransactionStatement;
-      }>
-    | undefined;
 
   /**
-   * Constructor
+   * If set - sequential reads of the database file (full table scans,
+   * `VACUUM`, FTS rebuilds) prefetch up to this many pages ahead on a
+   * background thread.
    *
-   * @param path - The path to the database file or ':memory:'/'' for opening
-   *               the in-memory database.
+   * Can be changed later with `PRAGMA readahead_pages = N`. Has no effect
+   * while `PRAGMA mmap_size` is positive.
+   *
+   * @see {@link Database.readaheadStats}
    */
-  constructor(path = ':memory:', { cacheStatements }: DatabaseOptions = {}) {
-    if (typeof path !== 'string') {
-      throw new TypeError('Invalid database path');
-    }
-    this.#native = addon.databaseOpen(path);
-    this.#isCacheEnabled = cacheStatements === true;
-  }
-
-  public initTokenizer(): void {
-    if (this.#native === undefined) {
-      throw new Error('Database closed');
-    }
-    addon.databaseInitTokenizer(this.#native);
-  }
+  readaheadPages?: number;
 
   /**
-   * Execute one or multiple SQL statements in a given `sql` string.
+   * If `true` - on Linux, writes to the write-ahead log are batched and
+   * submitted through io_uring together with the fsync of the commit, and
+   * checkpoints read the log with multiple reads in flight. Falls back to
+   * the regular file I/O when io_uring is not available.
    *
-   * @param sql - one or multiple SQL statements
+   * Only affects databases in WAL mode. Can't be combined with
+   * `readaheadPages`.
    */
-  public exec(sql: string): void {
-    if (this.#native === undefined) {
-      throw new Error('Database closed');
-    }
-    if (typeof sql !== 'string') {
-      throw new TypeError('Invalid sql argument');
-    }
-    addon.databaseExec(this.#native, sql);
-  }
+  ioUring?: boolean;
 
   /**
-   * Compile a single SQL statement.
+   * If `true` - count the I/O calls of the database and their latencies.
    *
-   * @param query - a single SQL statement.
-   * @param options - statement options.
-   * @returns Statement instance.
+   * Can't be combined with `readaheadPages` or `ioUring`.
    *
-   * @see {@link StatementOptions}
+   * @see {@link Database.ioStats}
    */
-  public prepare<Options extends StatementOptions = StatementOptions>(
-    query: string,
-    options: Options,
-  ): Statement<Options>;
+  ioStats?: boolean;
 
   /**
-   * Compile a single SQL statement.
+   * If set - wait for locks held by other connections (and processes)
+   * instead of failing with `SQLITE_BUSY` right away.
    *
-   * @param query - a single SQL statement.
-   * @returns Statement instance.
+   * @see {@link BusyTimeoutOptions}
+   * @see {@link Database.busyStats}
    */
-  public prepare(query: string): Statement<object>;
+  busyTimeout?: BusyTimeoutOptions;
 
-  public prepare<Options extends StatementOptions = StatementOptions>(
-    query: string,
-    options: Options = {} as Options,
-  ): Statement<Options> {
-    if (this.#native === undefined) {
-      throw new Error('Database closed');
-    }
-    if (typeof query !== 'string') {
-      throw new TypeError('Invalid query argument');
-    }
+  /**
+   * If set - checkpoint the write-ahead log on a background thread instead
+   * of in the commit that crosses the autocheckpoint threshold.
+   *
+   * @see {@link CheckpointerOptions}
+   * @see {@link Database.checkpointStats}
+   */
+  checkpointer?: CheckpointerOptions;
 
-    if (!this.#isCacheEnabled || options.persistent === false) {
-      return new Statement(this.#native, query, options);
-    }
+  /**
+   * Options of the write queue used by `db.queueWrite()`.
+   *
+   * @see {@link WriteQueueOptions}
+   */
+  writeQueue?: WriteQueueOptions;
+}>;
 
-    // Persistent statements are cached until closed.
-    const cacheKey = `${options.pluck}:${options.bigint}:${query}`;
-    const cached = this.#statementCache.get(cacheKey);
-    if (cached !== undefined) {
-      return cached;
-    }
+/**
+ * Options of the busy handler.
+ *
+ * Retries back off exponentially from `initialDelayMs` up to `maxDelayMs`,
+ * each delay randomly shortened by up to a half so that competing
+ * connections don't retry in lockstep.
+ */
+export type BusyTimeoutOptions = Readonly<{
+  /** Total time to wait for a lock */
+  timeoutMs: number;
 
-    const stmt = new Statement(
-      this.#native,
-      query,
-      {
-        persistent: true,
-        pluck: options.pluck,
-        bigint: options.bigint,
-      } as Options,
-      () => this.#statementCache.delete(cacheKey),
-    );
-    this.#statementCache.set(cacheKey, stmt);
-    return stmt;
-  }
+  /**
+   * Delay before the first retry, at least 1 millisecond.
+   *
+   * Defaults to 1 millisecond.
+   */
+  initialDelayMs?: number;
 
   /**
-   * Close the database and all associated statements.
+   * Maximum delay between retries, at least 1 millisecond.
+   *
+   * Defaults to 100 milliseconds.
    */
-  public close(): void {
-    if (this.#native === undefined) {
-      throw new Error('Database already closed');
-    }
+  maxDelayMs?: number;
+}>;
 
-    addon.databaseClose(this.#native);
-    this.#native = undefined;
-  }
+/**
+ * Counters returned by `db.busyStats()`.
+ */
+export type BusyStats = Readonly<{
+  /** Lock acquisitions that had to wait */
+  waits: number;
+  /** Retries after a delay */
+  retries: number;
+  /** Waits that reached `timeoutMs` and failed with `SQLITE_BUSY` */
+  timeouts: number;
+  /** Total time spent waiting */
+  totalWaitMicros: number;
+  /** Duration of the longest wait */
+  maxWaitMicros: number;
+}>;
 
+/**
+ * Options of the background checkpointer.
+ *
+ * The checkpointer runs a `PASSIVE` checkpoint every `frames` frames written
+ * to the WAL, a `RESTART` checkpoint instead once the WAL is larger than
+ * `restartFrames` frames, and truncates the WAL after `idleMs` without
+ * commits. Checkpoints never wait for other connections, ones that can't make
+ * progress are counted as starved.
+ */
+export type CheckpointerOptions = Readonly<{
   /**
-   * Run a pragma statement and return the result.
-   *
-   * @param source - pragma query source
-   * @param options - options to control the return value of `.pragma()`
-   * @returns Either multiple rows returned by the statement, or the first
-   *          column of the first row (or `undefined`) if `options` has
-   *          `simple: true`.
+   * Frames written since the last checkpoint that trigger the next one.
    *
-   * @see {@link PragmaOptions}
+   * Defaults to 1000.
    */
-  public pragma<Options extends PragmaOptions>(
-    source: string,
-    { simple }: Options,
-  ): PragmaResult<Options>;
+  frames?: number;
 
   /**
-   * Run a pragma statement and return the result.
+   * Size of the WAL in frames above which checkpoints restart the WAL.
    *
-   * @param source - pragma query source
-   * @returns Either multiple rows returned by the statement.
+   * Defaults to 10000.
    */
-  public pragma(source: string): PragmaResult<object>;
-
-  public pragma<Options extends PragmaOptions = object>(
-    source: string,
-    { simple }: Options = {} as Options,
-  ): PragmaResult<Options> {
-    if (typeof source !== 'string') {
-      throw new TypeError('Invalid pragma argument');
-    }
-    if (simple === true) {
-      const stmt = this.prepare(`PRAGMA ${source}`, { pluck: true });
-      return stmt.get() as unknown as PragmaResult<Options>;
-    }
-    const stmt = this.prepare(`PRAGMA ${source}`);
-    return stmt.all() as unknown as PragmaResult<Options>;
-  }
+  restartFrames?: number;
 
   /**
-   * Wrap `fn()` in a transaction.
+   * Time without commits after which the WAL is truncated.
    *
-   * @param fn - a function to be executed within a transaction.
-   * @returns The value returned by `fn()`.
+   * Defaults to 1000 milliseconds.
    */
-  public transaction<Params extends [], Result>(
-    fn: (...params: Params) => Result,
-  ): typeof fn {
-    return (...params: Params) => {
-      if (this.#transactionStmts === undefined) {
-        const options = { persistent: true as const, pluck: true as const };
-        this.#transactionStmts = {
-          begin: this.prepare('BEGIN', options),
-          rollback: this.prepare('ROLLBACK', options),
-          commit: this.prepare('COMMIT', options),
-
-          savepoint: this.prepare('SAVEPOINT signalappsqlcipher', options),
-          rollbackTo: this.prepare('ROLLBACK TO signalappsqlcipher', options),
-          release: this.prepare('RELEASE signalappsqlcipher', options),
-        };
-      }
+  idleMs?: number;
+}>;
 
-      this.#transactionDepth += 1;
-
-      let begin: TransactionStatement;
-      let rollback: TransactionStatement;
-      let commit: TransactionStatement;
-      if (this.#transactionDepth === 1) {
-        ({ begin, rollback, commit } = this.#transactionStmts);
-      } else {
-        ({
-          savepoint: begin,
-          rollbackTo: rollback,
-          release: commit,
-        } = this.#transactionStmts);
-      }
+/**
+ * Counters returned by `db.checkpointStats()`.
+ */
+export type CheckpointStats = Readonly<{
+  /** Frames in the WAL as of the last commit or checkpoint */
+  walFrames: number;
+  /** Size of these frames in bytes */
+  walBytes: number;
+  /** Completed `PASSIVE` checkpoints */
+  passive: number;
+  /** Completed `RESTART` checkpoints */
+  restart: number;
+  /** Completed `TRUNCATE` checkpoints */
+  truncate: number;
+  /**
+   * Checkpoints that made no progress because of readers, or couldn't
+   * restart or truncate the WAL
+   */
+  starved: number;
+  /** Checkpoints that failed with an error */
+  errors: number;
+  /** Frames copied into the database file */
+  checkpointedFrames: number;
+  /** Total time spent in checkpoints */
+  totalMicros: number;
+  /** Duration of the longest checkpoint */
+  maxMicros: number;
+  /** Duration of the last checkpoint */
+  lastMicros: number;
+}>;
 
-      begin.run();
-      try {
-        const result = fn(...params);
-        commit.run();
-        return result;
-      } catch (error) {
-        rollback.run();
-        throw error;
-      } finally {
-        this.#transactionDepth -= 1;
-      }
-    };
-  }
+/**
+ * Options of `db.startDeferredIndexing()`.
+ */
+export type DeferredIndexingOptions = Readonly<{
+  /**
+   * Table with the rows to index. The columns of the FTS5 table are read
+   * from the columns with the same names.
+   */
+  content: string;
 
   /**
-   * Tokenize a given sentence with a Signal-FTS5-Extension.
+   * Rows indexed per transaction.
    *
-   * @param value - a sentence
-   * @returns a list of word-like tokens.
-   *
-   * @see {@link https://github.com/signalapp/Signal-FTS5-Extension}
+   * Defaults to 500.
+   */
+  batchSize?: number;
+
+  /**
+   * Delay between a row queued by this connection and the next batch, so
+   * that the rows of a few transactions are indexed together.
+   *
+   * Defaults to 100 milliseconds.
+   */
+  delayMs?: number;
+
+  /**
+   * Interval at which the queue is checked for rows queued by other
+   * connections.
+   *
+   * Defaults to 1000 milliseconds.
+   */
+  intervalMs?: number;
+
+  /**
+   * Pages merged by an FTS5 `merge` command after every batch, or 0 to leave
+   * merges to `automerge`.
+   *
+   * Defaults to 0.
+   */
+  mergePages?: number;
+}>;
+
+/**
+ * Counters returned by `db.indexingStats()`.
+ */
+export type IndexingStats = Readonly<{
+  /** Rows in the queue as of the last batch */
+  queueDepth: number;
+  /** Time since the oldest of these rows was queued */
+  lagMs: number;
+  /** Rows added to the index */
+  indexedRows: number;
+  /** Committed batches */
+  batches: number;
+  /** Batches that failed with an error */
+  errors: number;
+  /** Total time spent in batches */
+  totalMicros: number;
+  /** Duration of the longest batch */
+  maxMicros: number;
+  /** Duration of the last batch */
+  lastMicros: number;
+}>;
+
+/**
+ * Options of `db.startFtsMerger()`.
+ */
+export type FtsMergerOptions = Readonly<{
+  /**
+   * Time without writes after which segments are merged.
+   *
+   * Defaults to 1000 milliseconds.
+   */
+  idleMs?: number;
+
+  /**
+   * Target duration of a merge step, and pause between two steps.
+   *
+   * Defaults to 10 milliseconds.
+   */
+  budgetMs?: number;
+}>;
+
+/**
+ * Segments of an FTS5 index returned by `db.ftsStructure()`.
+ */
+export type FtsStructure = Readonly<{
+  /** Segments of all levels */
+  segments: number;
+  levels: ReadonlyArray<
+    Readonly<{
+      /** Segments of the level */
+      segments: number;
+      /** Segments being merged into the next level */
+      merging: number;
+      /** Leaf pages of the segments */
+      pages: number;
+    }>
+  >;
+}>;
+
+/**
+ * Counters returned by `db.ftsMergeStats()`.
+ */
+export type FtsMergeStats = Readonly<{
+  /** Steps that merged segments */
+  steps: number;
+  /** Steps that failed with an error */
+  errors: number;
+  /** Pages merged by the next step */
+  pagesPerStep: number;
+  /** Total time spent in steps */
+  totalMicros: number;
+  /** Duration of the longest step */
+  maxMicros: number;
+  /** Duration of the last step */
+  lastMicros: number;
+  /** Segments as of the last step or write */
+  structure: FtsStructure;
+}>;
+
+/**
+ * Options of `db.transaction()`.
+ */
+export type TransactionOptions = Readonly<{
+  /**
+   * Locking mode of the outermost transaction:
+   *
+   * - `deferred` - locks are acquired by the first read and write.
+   * - `immediate` - the write lock is acquired right away, so writes in the
+   *   transaction don't fail with `SQLITE_BUSY` when another connection
+   *   writes first.
+   * - `exclusive` - like `immediate`, and in rollback journal modes also
+   *   prevents other connections from reading.
+   *
+   * Defaults to `deferred`.
+   */
+  mode?: 'deferred' | 'immediate' | 'exclusive';
+}>;
+
+/** @internal */
+const TRANSACTION_MODES: Record<string, number | undefined> = {
+  deferred: 0,
+  immediate: 1,
+  exclusive: 2,
+};
+
+/**
+ * Options of the write queue.
+ *
+ * The queue is shared by all connections to the same database file in the
+ * process, the options of the connection that queued the first write are
+ * used.
+ */
+export type WriteQueueOptions = Readonly<{
+  /**
+   * How long to wait for more writes after the first write of a group.
+   *
+   * Defaults to 2 milliseconds.
+   */
+  windowMs?: number;
+
+  /**
+   * Maximum number of writes committed together.
+   *
+   * Defaults to 256.
+   */
+  maxWrites?: number;
+}>;
+
+/**
+ * A query of `db.queueWrite()`: the SQL of a single statement, optionally
+ * with its parameters.
+ */
+export type QueuedQuery =
+  | string
+  | readonly [string, StatementParameters<{ bigint: true }>?];
+
+/**
+ * Counters returned by `db.readaheadStats()`.
+ */
+export type ReadaheadStats = Readonly<{
+  /** Reads of the database file */
+  reads: number;
+  /** Reads served from prefetched pages */
+  hits: number;
+  /** Pages read ahead by the background thread */
+  prefetchedPages: number;
+  /** Prefetched pages that were dropped without being read */
+  wastedPages: number;
+}>;
+
+/**
+ * Counters of one kind of I/O call.
+ */
+export type IoOpStats = Readonly<{
+  /** Number of calls */
+  count: number;
+  /** Bytes read or written */
+  bytes: number;
+  /** Total time spent in the calls */
+  totalMicros: number;
+  /**
+   * Latency histogram. `histogram[0]` counts calls that took less than 1us,
+   * `histogram[i]` calls that took from `2 ** (i - 1)` to `2 ** i` us. The
+   * last bucket counts all slower calls.
+   */
+  histogram: ReadonlyArray<number>;
+}>;
+
+/**
+ * I/O counters of one file type.
+ */
+export type FileIoStats = Readonly<{
+  reads: IoOpStats;
+  writes: IoOpStats;
+  /** `fsync()` calls, or memory barriers for `shm` */
+  syncs: IoOpStats;
+  /** File lock calls */
+  locks: IoOpStats;
+}>;
+
+/**
+ * Counters returned by `db.ioStats()`.
+ */
+export type IoStats = Readonly<{
+  /** Database file */
+  main: FileIoStats;
+  /** Write-ahead log */
+  wal: FileIoStats;
+  /** Rollback journal */
+  journal: FileIoStats;
+  /** Shared memory of the write-ahead log */
+  shm: FileIoStats;
+  /** Temporary files of all databases in the process */
+  temp: FileIoStats;
+}>;
+
+/**
+ * Options for `db.verifyIntegrity()`.
+ */
+export type VerifyIntegrityOptions = Readonly<{
+  /**
+   * Number of threads verifying pages in parallel.
+   *
+   * Defaults to and is capped at the number of CPUs.
+   */
+  threads?: number;
+
+  /**
+   * Called periodically with the number of verified pages and the total
+   * number of pages.
+   */
+  onProgress?: (checked: number, total: number) => void;
+}>;
+
+/**
+ * Options for `db.rekeyAsync()`.
+ */
+export type RekeyOptions = Readonly<{
+  /**
+   * Number of pages copied at a time. Locks on the database are released
+   * between the steps.
+   *
+   * Defaults to 1024.
+   */
+  pagesPerStep?: number;
+
+  /**
+   * Called after every step with the number of copied pages and the total
+   * number of pages.
+   */
+  onProgress?: (copied: number, total: number) => void;
+}>;
+
+/**
+ * Options for `db.backup()`.
+ */
+export type BackupOptions = Readonly<{
+  /**
+   * Key of the backup: a passphrase or a raw key (`x'...'`), or `null` for a
+   * plaintext backup.
+   *
+   * Defaults to the key of the database.
+   */
+  key?: string | null;
+
+  /**
+   * Number of pages copied at a time.
+   *
+   * Defaults to 1024.
+   */
+  pagesPerStep?: number;
+
+  /**
+   * Pause between the steps, limits the I/O bandwidth used by the backup.
+   *
+   * Defaults to 0.
+   */
+  sleepMs?: number;
+
+  /**
+   * Called after every step with the number of copied pages and the total
+   * number of pages.
+   */
+  onProgress?: (copied: number, total: number) => void;
+}>;
+
+/**
+ * Options for `db.rebuildFts()`.
+ */
+export type RebuildFtsOptions = Readonly<{
+  /**
+   * Number of threads tokenizing rows in parallel.
+   *
+   * Defaults to and is capped at the number of CPUs.
+   */
+  threads?: number;
+}>;
+
+/**
+ * Result of `db.rebuildFts()`.
+ */
+export type RebuildFtsStats = Readonly<{
+  /** Number of values tokenized in parallel */
+  cachedValues: number;
+  /**
+   * Number of values tokenized by FTS5 itself, e.g. all values of in-memory
+   * databases or of rows changed by the current transaction.
+   */
+  inlineValues: number;
+}>;
+
+/**
+ * Options for `db.searchFts()`.
+ */
+export type SearchFtsOptions = Readonly<{
+  /**
+   * Number of matches to return.
+   *
+   * Defaults to 50.
+   */
+  limit?: number;
+
+  /**
+   * Weight of every column, as the arguments of `bm25()`. Missing columns
+   * have a weight of 1.
+   */
+  weights?: ReadonlyArray<number>;
+}>;
+
+/**
+ * Result of `db.searchFts()`.
+ */
+export type SearchFtsResult = Readonly<{
+  /** Rowids of the best matches, best first */
+  rowids: Float64Array;
+  /** Scores of these matches as returned by `bm25()`, lower is better */
+  scores: Float64Array;
+}>;
+
+/**
+ * Counters returned by `db.tokenCacheStats()`.
+ */
+export type TokenCacheStats = Readonly<{
+  /** Queries found in the cache */
+  hits: number;
+  /** Queries tokenized, possibly in part */
+  misses: number;
+  /** Bytes of these queries passed to the tokenizer */
+  tokenizedBytes: number;
+}>;
+
+/**
+ * Completion returned by `db.completePrefix()`.
+ */
+export type PrefixCompletion = Readonly<{
+  /** Normalized term, as stored in the FTS5 index */
+  term: string;
+  /** Occurrences of the term in the table */
+  count: number;
+}>;
+
+/**
+ * Result of `db.signalTokenizeBatch()`.
+ */
+export type TokenizeBatchResult = Readonly<{
+  /** UTF-8 tokens of all values, back to back */
+  tokens: Buffer;
+  /**
+   * Token `i` is `tokens.subarray(offsets[i], offsets[i + 1])`, `offsets`
+   * has one more element than there are tokens.
+   */
+  offsets: Uint32Array;
+  /**
+   * Tokens of `values[j]` are `boundaries[j]` to `boundaries[j + 1] - 1`,
+   * `boundaries` has one more element than there are values.
+   */
+  boundaries: Uint32Array;
+}>;
+
+/**
+ * Result of `db.signalTokenizeRanges()`.
+ */
+export type TokenRangesResult = Readonly<{
+  /**
+   * Token `i` is `value.slice(ranges[2 * i], ranges[2 * i + 1])` in its
+   * value.
+   */
+  ranges: Uint32Array;
+  /**
+   * Tokens of `values[j]` are `boundaries[j]` to `boundaries[j + 1] - 1`,
+   * `boundaries` has one more element than there are values.
+   */
+  boundaries: Uint32Array;
+}>;
+
+/**
+ * Options for `db.deserialize()`.
+ */
+export type DeserializeOptions = Readonly<{
+  /**
+   * Open the database as read-only. The buffer is still copied, and can be
+   * modified, transferred or shared with other threads afterwards.
+   *
+   * Defaults to `false`.
+   */
+  readonly?: boolean;
+}>;
+
+/**
+ * Result of `db.backupIncremental()`.
+ */
+export type IncrementalBackupStats = Readonly<{
+  /** Number of pages in the database */
+  pageCount: number;
+  /** Number of pages written into the delta */
+  changedPages: number;
+  /** Size of the delta file */
+  deltaBytes: number;
+}>;
+
+/** @internal */
+const READAHEAD_VFS = 'signal-readahead';
+
+/** @internal */
+const IO_URING_VFS = 'signal-io-uring';
+
+/** @internal */
+const IO_STATS_VFS = 'signal-iostats';
+
+/** @internal */
+function checkBusyTimeout({ busyTimeout }: DatabaseOptions): void {
+  if (busyTimeout === undefined) {
+    return;
+  }
+  const { timeoutMs, initialDelayMs = 1, maxDelayMs = 1 } = busyTimeout;
+  for (const value of [timeoutMs, initialDelayMs, maxDelayMs]) {
+    if (!Number.isInteger(value) || value < 0 || value > MAX_INT32) {
+      throw new TypeError('Invalid busyTimeout');
+    }
+  }
+
+  // Retrying without a delay would spin
+  if (initialDelayMs < 1 || maxDelayMs < 1) {
+    throw new TypeError('Invalid busyTimeout');
+  }
+}
+
+/** @internal */
+function checkCheckpointer({ checkpointer }: DatabaseOptions): void {
+  if (checkpointer === undefined) {
+    return;
+  }
+  const { frames = 1, restartFrames = 1, idleMs = 0 } = checkpointer;
+  for (const value of [frames, restartFrames, idleMs]) {
+    if (!Number.isInteger(value) || value < 0 || value > MAX_INT32) {
+      throw new TypeError('Invalid checkpointer');
+    }
+  }
+  if (frames < 1 || restartFrames < 1) {
+    throw new TypeError('Invalid checkpointer');
+  }
+}
+
+/** @internal */
+function checkFtsMerger({
+  idleMs = 1,
+  budgetMs = 1,
+}: FtsMergerOptions): void {
+  for (const value of [idleMs, budgetMs]) {
+    if (!Number.isInteger(value) || value < 1 || value > MAX_INT32) {
+      throw new TypeError('Invalid FTS merger options');
+    }
+  }
+}
+
+/** @internal */
+function checkDeferredIndexing({
+  content,
+  batchSize = 1,
+  delayMs = 0,
+  intervalMs = 1,
+  mergePages = 0,
+}: DeferredIndexingOptions): void {
+  if (typeof content !== 'string') {
+    throw new TypeError('Invalid content option');
+  }
+  for (const value of [batchSize, delayMs, intervalMs, mergePages]) {
+    if (!Number.isInteger(value) || value < 0 || value > MAX_INT32) {
+      throw new TypeError('Invalid deferred indexing options');
+    }
+  }
+
+  // An empty batch never indexes anything, and polling without a delay
+  // would spin
+  if (batchSize < 1 || intervalMs < 1) {
+    throw new TypeError('Invalid deferred indexing options');
+  }
+}
+
+/** @internal */
+function checkTokenizeValues(values: ReadonlyArray<string>): void {
+  if (!Array.isArray(values)) {
+    throw new TypeError('Invalid values');
+  }
+  for (const value of values) {
+    if (typeof value !== 'string') {
+      throw new TypeError('Invalid values');
+    }
+  }
+}
+
+/** @internal */
+function getVfs({
+  readaheadPages,
+  ioUring,
+  ioStats,
+}: DatabaseOptions): string | undefined {
+  if (ioStats === true) {
+    if (readaheadPages !== undefined || ioUring === true) {
+      throw new TypeError(
+        "ioStats can't be combined with readaheadPages or ioUring",
+      );
+    }
+    return IO_STATS_VFS;
+  }
+  if (ioUring === true) {
+    if (readaheadPages !== undefined) {
+      throw new TypeError('readaheadPages and ioUring are mutually exclusive');
+    }
+    return IO_URING_VFS;
+  }
+  if (readaheadPages === undefined) {
+    return undefined;
+  }
+  if (!Number.isInteger(readaheadPages) || readaheadPages < 0) {
+    throw new TypeError('Invalid readaheadPages');
+  }
+  return READAHEAD_VFS;
+}
+
+/**
+ * SQLCipher settings applied right after the key, e.g.
+ * `{ cipher_compatibility: 3 }` or `{ kdf_iter: 64000 }`.
+ */
+export type CipherSettings = Readonly<Record<string, string | number>>;
+
+export type OpenOptions = DatabaseOptions &
+  Readonly<{
+    /**
+     * Passphrase for the database. The key derivation runs on a worker thread
+     * together with the rest of the opening.
+     */
+    key?: string;
+
+    /**
+     * Raw key previously returned by `db.exportRawKey()`. Opening with it
+     * skips the key derivation entirely. Mutually exclusive with `key`.
+     *
+     * @see {@link Database.exportRawKey}
+     */
+    rawKey?: string;
+
+    /**
+     * Cipher settings applied after `key` or `rawKey`.
+     *
+     * @see {@link CipherSettings}
+     */
+    cipherSettings?: CipherSettings;
+  }>;
+
+/** @internal */
+function formatCipherSettings(
+  settings: CipherSettings | undefined,
+): string | undefined {
+  if (settings === undefined) {
+    return undefined;
+  }
+
+  const lines = [];
+  for (const [name, value] of Object.entries(settings)) {
+    if (!/^[a-z_]+$/.test(name)) {
+      throw new TypeError(`Invalid cipher setting: ${name}`);
+    }
+    if (typeof value === 'number') {
+      lines.push(`PRAGMA ${name} = ${value};`);
+    } else if (typeof value === 'string') {
+      lines.push(`PRAGMA ${name} = '${value.replaceAll("'", "''")}';`);
+    } else {
+      throw new TypeError(`Invalid value for cipher setting: ${name}`);
+    }
+  }
+  return lines.join('\n');
+}
+
+/** @internal */
+const kOpenedNative = Symbol('openedNative');
+
+/**
+ * Connection opened by `openAsync()`, only constructible inside this module.
+ *
+ * @internal
+ */
+type OpenedNative = Readonly<{ [kOpenedNative]: NativeDatabase }>;
+
+/**
+ * A sqlite database class.
+ */
+export default class Database {
+  #native: NativeDatabase | undefined;
+  #isCacheEnabled: boolean;
+  #readaheadPages: number | undefined;
+  #busyTimeout: BusyTimeoutOptions | undefined;
+  #checkpointer: CheckpointerOptions | undefined;
+  #deferredIndexing:
+    | readonly [table: string, options: DeferredIndexingOptions]
+    | undefined;
+  #ftsMerger: readonly [table: string, options: FtsMergerOptions] | undefined;
+  #prefixIndexTable: string | undefined;
+  #writeQueue: WriteQueueOptions | undefined;
+  #statementCache = new Map<string, Statement>();
+
+  /**
+   * Constructor
+   *
+   * @param path - The path to the database file or ':memory:'/'' for opening
+   *               the in-memory database.
+   */
+  constructor(
+    path = ':memory:',
+    options: DatabaseOptions = {},
+    opened?: OpenedNative,
+  ) {
+    const native = opened?.[kOpenedNative];
+    try {
+      if (typeof path !== 'string') {
+        throw new TypeError('Invalid database path');
+      }
+      checkBusyTimeout(options);
+      checkCheckpointer(options);
+    } catch (error) {
+      if (native !== undefined) {
+        addon.databaseClose(native);
+      }
+      throw error;
+    }
+
+    this.#native = native ?? addon.databaseOpen(path, getVfs(options));
+    this.#isCacheEnabled = options.cacheStatements === true;
+
+    this.#readaheadPages = options.readaheadPages;
+    this.#busyTimeout = options.busyTimeout;
+    this.#checkpointer = options.checkpointer;
+    this.#writeQueue = options.writeQueue;
+    try {
+      this.#applyConnectionOptions();
+    } catch (error) {
+      // The connection would be unreachable otherwise
+      addon.databaseClose(this.#native);
+      this.#native = undefined;
+      throw error;
+    }
+  }
+
+  #applyConnectionOptions(): void {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (this.#readaheadPages !== undefined) {
+      this.pragma(`readahead_pages = ${this.#readaheadPages}`);
+    }
+    if (this.#busyTimeout !== undefined) {
+      const { timeoutMs, initialDelayMs, maxDelayMs } = this.#busyTimeout;
+      addon.databaseSetBusyHandler(
+        this.#native,
+        timeoutMs,
+        initialDelayMs,
+        maxDelayMs,
+      );
+    }
+    if (this.#checkpointer !== undefined) {
+      const { frames, restartFrames, idleMs } = this.#checkpointer;
+      addon.databaseStartCheckpointer(
+        this.#native,
+        frames,
+        restartFrames,
+        idleMs,
+      );
+    }
+    if (this.#deferredIndexing !== undefined) {
+      const [table, { content, batchSize, delayMs, intervalMs, mergePages }] =
+        this.#deferredIndexing;
+      addon.databaseStartDeferredIndexing(
+        this.#native,
+        table,
+        content,
+        batchSize,
+        delayMs,
+        intervalMs,
+        mergePages,
+      );
+    }
+    if (this.#ftsMerger !== undefined) {
+      const [table, { idleMs, budgetMs }] = this.#ftsMerger;
+      addon.databaseStartFtsMerger(this.#native, table, idleMs, budgetMs);
+    }
+    if (this.#prefixIndexTable !== undefined) {
+      addon.databaseBuildPrefixIndex(this.#native, this.#prefixIndexTable);
+    }
+  }
+
+  /**
+   * Open the database and derive the key (if any) on a worker thread.
+   *
+   * @param path - The path to the database file or ':memory:'/'' for opening
+   *               the in-memory database.
+   * @param options - database and encryption options.
+   * @returns A promise resolving with a ready to use database.
+   *
+   * @see {@link OpenOptions}
+   */
+  public static async openAsync(
+    path = ':memory:',
+    { key, rawKey, cipherSettings, ...options }: OpenOptions = {},
+  ): Promise<Database> {
+    if (typeof path !== 'string') {
+      throw new TypeError('Invalid database path');
+    }
+    if (key !== undefined && (typeof key !== 'string' || key === '')) {
+      throw new TypeError('Invalid key');
+    }
+    if (
+      rawKey !== undefined &&
+      (typeof rawKey !== 'string' || !/^x'[0-9a-fA-F]{96}'$/.test(rawKey))
+    ) {
+      throw new TypeError('Invalid raw key');
+    }
+    if (key !== undefined && rawKey !== undefined) {
+      throw new TypeError('Both key and raw key are provided');
+    }
+    if (
+      key === undefined &&
+      rawKey === undefined &&
+      cipherSettings !== undefined
+    ) {
+      throw new TypeError('Cipher settings require a key');
+    }
+    checkBusyTimeout(options);
+    checkCheckpointer(options);
+
+    // SQLCipher recognizes the raw key by its `x'...'` form.
+    const native = await addon.databaseOpenAsync(
+      path,
+      key ?? rawKey,
+      formatCipherSettings(cipherSettings),
+      getVfs(options),
+    );
+
+    return new Database(path, options, { [kOpenedNative]: native });
+  }
+
+  /**
+   * Return the key derived by SQLCipher from the passphrase given to
+   * `openAsync()`, together with the database salt.
+   *
+   * The result can be passed as `rawKey` to `openAsync()` to skip the costly
+   * key derivation on subsequent opens. It is as sensitive as the passphrase
+   * itself and should only be kept in secure storage.
+   *
+   * @returns SQLCipher's raw key in `x'...'` form.
+   *
+   * @see {@link OpenOptions}
+   */
+  public exportRawKey(): string {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseExportRawKey(this.#native);
+  }
+
+  /**
+   * Return the read-ahead counters of the database file.
+   *
+   * Only available if the database was opened with `readaheadPages`.
+   *
+   * @returns Read-ahead statistics.
+   *
+   * @see {@link DatabaseOptions}
+   */
+  public readaheadStats(): ReadaheadStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseReadaheadStats(this.#native);
+  }
+
+  /**
+   * Return the I/O counters and latency histograms of the database files.
+   *
+   * Only available if the database was opened with `ioStats`.
+   *
+   * @returns I/O statistics.
+   *
+   * @see {@link DatabaseOptions}
+   */
+  public ioStats(): IoStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseIoStats(this.#native);
+  }
+
+  /**
+   * An id of the connection for `Database.interrupt()`. Unlike the database
+   * itself, the id can be sent to other threads.
+   */
+  public get interruptId(): number {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseInterruptId(this.#native);
+  }
+
+  /**
+   * Interrupt the queries running on a connection, from any thread. The
+   * interrupted queries throw.
+   *
+   * @param id - `interruptId` of the database.
+   * @returns `false` if the database is closed.
+   */
+  public static interrupt(id: number): boolean {
+    if (!Number.isInteger(id) || id < 0) {
+      throw new TypeError('Invalid interrupt id');
+    }
+    return addon.databaseInterrupt(id);
+  }
+
+  /**
+   * Return the lock wait counters of the connection.
+   *
+   * Only available if the database was opened with `busyTimeout`.
+   *
+   * @returns Busy handler statistics.
+   *
+   * @see {@link DatabaseOptions}
+   */
+  public busyStats(): BusyStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseBusyStats(this.#native);
+  }
+
+  /**
+   * Return the counters of the background checkpointer.
+   *
+   * Only available if the database was opened with `checkpointer`.
+   *
+   * @returns Checkpointer statistics.
+   *
+   * @see {@link DatabaseOptions}
+   */
+  public checkpointStats(): CheckpointStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseCheckpointStats(this.#native);
+  }
+
+  /**
+   * Index the rows of an FTS5 table on a background connection instead of in
+   * the transactions that write them.
+   *
+   * Writers queue rows by inserting their rowids into `<table>_queue`
+   * (created if missing), typically from the insert trigger of the content
+   * table instead of inserting into the FTS5 table. Rows are indexed in
+   * batches, so searches miss them until then (see `lagMs` in
+   * `db.indexingStats()`). A trigger deleting a row should also delete it
+   * from the queue.
+   *
+   * For external-content tables, the `'delete'` command of a row that is
+   * still queued corrupts the index, since the row was never indexed. Delete
+   * and update triggers must skip these rows, e.g. with
+   * `WHERE old.rowid NOT IN (SELECT rowid FROM <table>_queue)`, before
+   * removing them from the queue.
+   *
+   * Batches hold the write lock of the database while they index rows, so
+   * writers on this and other connections should open the database with
+   * `busyTimeout`, or their writes may fail with `SQLITE_BUSY`.
+   *
+   * Replaces the previous deferred indexing of the database, if any.
+   *
+   * @param table - Name of the FTS5 table.
+   * @param options - Indexing options.
+   *
+   * @see {@link DeferredIndexingOptions}
+   * @see {@link Database.indexingStats}
+   */
+  public startDeferredIndexing(
+    table: string,
+    options: DeferredIndexingOptions,
+  ): void {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof table !== 'string') {
+      throw new TypeError('Invalid table');
+    }
+    checkDeferredIndexing(options);
+
+    // The previous indexing is stopped even if this one fails to start
+    this.#deferredIndexing = undefined;
+
+    const { content, batchSize, delayMs, intervalMs, mergePages } = options;
+    addon.databaseStartDeferredIndexing(
+      this.#native,
+      table,
+      content,
+      batchSize,
+      delayMs,
+      intervalMs,
+      mergePages,
+    );
+    this.#deferredIndexing = [table, options];
+  }
+
+  /**
+   * Return the counters of the deferred indexing.
+   *
+   * Only available after `db.startDeferredIndexing()`.
+   *
+   * @returns Indexing statistics.
+   */
+  public indexingStats(): IndexingStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseIndexingStats(this.#native);
+  }
+
+  /**
+   * Merge the segments of an FTS5 index on a background connection while the
+   * database is idle.
+   *
+   * Every FTS5 write adds a segment to the index, and `automerge` merges them
+   * in the transactions of the writers. With `automerge` set to 0 segments
+   * are only merged by this merger, in steps of about `budgetMs` once no
+   * connection wrote for `idleMs`, until no level has `usermerge` segments.
+   *
+   * A step holds the write lock for up to `budgetMs`. A write starting during
+   * a step fails with `SQLITE_BUSY` unless the database was opened with a
+   * `busyTimeout` long enough to wait for it.
+   *
+   * Replaces the previous merger of the database, if any.
+   *
+   * @param table - Name of the FTS5 table.
+   * @param options - Merger options.
+   *
+   * @see {@link FtsMergerOptions}
+   * @see {@link Database.ftsMergeStats}
+   */
+  public startFtsMerger(table: string, options: FtsMergerOptions = {}): void {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof table !== 'string') {
+      throw new TypeError('Invalid table');
+    }
+    checkFtsMerger(options);
+
+    // The previous merger is stopped even if this one fails to start
+    this.#ftsMerger = undefined;
+
+    const { idleMs, budgetMs } = options;
+    addon.databaseStartFtsMerger(this.#native, table, idleMs, budgetMs);
+    this.#ftsMerger = [table, options];
+  }
+
+  /**
+   * Return the counters of the FTS5 merger.
+   *
+   * Only available after `db.startFtsMerger()`.
+   *
+   * @returns Merger statistics.
+   */
+  public ftsMergeStats(): FtsMergeStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseFtsMergeStats(this.#native);
+  }
+
+  /**
+   * Return the segments of an FTS5 index, read from its structure record.
+   *
+   * @param table - Name of the FTS5 table.
+   * @returns Segments per level.
+   */
+  public ftsStructure(table: string): FtsStructure {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof table !== 'string') {
+      throw new TypeError('Invalid table');
+    }
+    return addon.databaseFtsStructure(this.#native, table);
+  }
+
+  /**
+   * Change the key of the database without blocking it, as a replacement for
+   * `PRAGMA rekey`.
+   *
+   * The database is copied into a new file encrypted with `key` on a worker
+   * thread, `pagesPerStep` pages at a time. The database stays readable and
+   * writable during the copy, but writes make the copy restart (and the
+   * promise rejects if it has to restart too many times). The promise also
+   * rejects if a transaction is open or a statement is in the middle of its
+   * rows (e.g. between `stmt.stepFor()` calls) when the copy starts or ends.
+   * Once done, the new file replaces the old one and the connection is
+   * reopened. Prepared statements remain valid, but other per-connection
+   * state (pragmas, temporary tables, attached databases) is lost. If the
+   * connection or the statements can't be opened again, the database is
+   * closed.
+   *
+   * The database must be opened with `Database.openAsync` if it is encrypted,
+   * and must not be opened by other connections. A plaintext database gets
+   * encrypted.
+   *
+   * @param key - New passphrase or raw key.
+   * @param options - Rekey options.
+   *
+   * @see {@link RekeyOptions}
+   */
+  public async rekeyAsync(
+    key: string,
+    { pagesPerStep, onProgress }: RekeyOptions = {},
+  ): Promise<void> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof key !== 'string' || key === '') {
+      throw new TypeError('Invalid key');
+    }
+    if (
+      pagesPerStep !== undefined &&
+      (!Number.isInteger(pagesPerStep) ||
+        pagesPerStep < 1 ||
+        pagesPerStep > MAX_INT32)
+    ) {
+      throw new TypeError('Invalid pagesPerStep option');
+    }
+    if (onProgress !== undefined && typeof onProgress !== 'function') {
+      throw new TypeError('Invalid onProgress option');
+    }
+
+    const native = this.#native;
+    try {
+      await addon.databaseRekeyAsync(native, key, pagesPerStep, onProgress);
+    } finally {
+      // The connection is opened again even if the file couldn't be
+      // replaced, and closed if that failed too.
+      if (this.#native === native && addon.databaseIsOpen(native)) {
+        this.#applyConnectionOptions();
+      }
+    }
+  }
+
+  /**
+   * Copy the database into `destPath` on a worker thread without blocking
+   * the database.
+   *
+   * The copy is written next to `destPath` and renamed over it once
+   * complete, so an existing file at `destPath` is only replaced by a
+   * complete backup. In WAL mode the backup is a consistent snapshot of the
+   * database taken at the start, and writes continue in the meantime. In
+   * rollback journal modes writes between the steps restart the copy.
+   *
+   * Backups that change whether the database is encrypted (with `key: null`
+   * for an encrypted database, or with a key for a plaintext one) are made in
+   * a single step with `sqlcipher_export()`, `pagesPerStep` and `sleepMs` are
+   * ignored for them.
+   *
+   * The database must be opened with `Database.openAsync` if it is encrypted.
+   *
+   * @param destPath - Path of the backup file.
+   * @param options - Backup options.
+   *
+   * @see {@link BackupOptions}
+   */
+  public async backup(
+    destPath: string,
+    { key, pagesPerStep, sleepMs, onProgress }: BackupOptions = {},
+  ): Promise<void> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof destPath !== 'string' || destPath === '') {
+      throw new TypeError('Invalid backup path');
+    }
+    if (key !== undefined && key !== null) {
+      if (typeof key !== 'string' || key === '') {
+        throw new TypeError('Invalid key');
+      }
+    }
+    if (
+      pagesPerStep !== undefined &&
+      (!Number.isInteger(pagesPerStep) ||
+        pagesPerStep < 1 ||
+        pagesPerStep > MAX_INT32)
+    ) {
+      throw new TypeError('Invalid pagesPerStep option');
+    }
+    if (
+      sleepMs !== undefined &&
+      (!Number.isInteger(sleepMs) || sleepMs < 0 || sleepMs > MAX_INT32)
+    ) {
+      throw new TypeError('Invalid sleepMs option');
+    }
+    if (onProgress !== undefined && typeof onProgress !== 'function') {
+      throw new TypeError('Invalid onProgress option');
+    }
+
+    await addon.databaseBackup(
+      this.#native,
+      resolve(destPath),
+      key,
+      pagesPerStep,
+      sleepMs,
+      onProgress,
+    );
+  }
+
+  /**
+   * Copy the database files into `destPath` on a worker thread without
+   * decrypting them, which is much faster than `db.backup()` for large
+   * encrypted databases. The copy has the same key as the database.
+   *
+   * The copy is a consistent snapshot of the database. In WAL mode writes
+   * continue during the copy, in rollback journal modes they wait for it to
+   * complete. On Linux the files are cloned on file systems supporting it
+   * (btrfs, XFS) and copied in the kernel otherwise.
+   *
+   * The database must be opened with `Database.openAsync` if it is encrypted.
+   *
+   * @param destPath - Path of the snapshot file.
+   */
+  public async snapshotTo(destPath: string): Promise<void> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof destPath !== 'string' || destPath === '') {
+      throw new TypeError('Invalid snapshot path');
+    }
+
+    await addon.databaseSnapshotTo(this.#native, resolve(destPath));
+  }
+
+  /**
+   * Write the pages that changed since the previous incremental backup into
+   * `deltaPath` on a worker thread, without decrypting them.
+   *
+   * `manifestPath` records a fingerprint of every page of the backup and is
+   * replaced once the delta is complete. Without a manifest the delta has
+   * every page and is a full backup. The database is restored by applying
+   * the full backup and then every delta in order with
+   * `Database.applyBackupDelta()`.
+   *
+   * Like `db.snapshotTo()` the backup is a consistent snapshot of the
+   * database and has the same key. The database must be opened with
+   * `Database.openAsync` if it is encrypted.
+   *
+   * @param deltaPath - Path of the delta file.
+   * @param manifestPath - Path of the manifest of the previous backup.
+   * @returns The number of pages in the database and in the delta.
+   */
+  public async backupIncremental(
+    deltaPath: string,
+    manifestPath: string,
+  ): Promise<IncrementalBackupStats> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof deltaPath !== 'string' || deltaPath === '') {
+      throw new TypeError('Invalid delta path');
+    }
+    if (typeof manifestPath !== 'string' || manifestPath === '') {
+      throw new TypeError('Invalid manifest path');
+    }
+
+    return addon.databaseBackupIncremental(
+      this.#native,
+      resolve(deltaPath),
+      resolve(manifestPath),
+    );
+  }
+
+  /**
+   * Apply a delta written by `db.backupIncremental()` to `targetPath` on a
+   * worker thread. A full backup creates `targetPath`, other deltas must be
+   * applied in order on top of it and are rejected otherwise.
+   *
+   * `targetPath` must not be open, and is left inconsistent if the process
+   * exits while the delta is being applied.
+   *
+   * @param targetPath - Path of the restored database.
+   * @param deltaPath - Path of the delta file.
+   */
+  public static async applyBackupDelta(
+    targetPath: string,
+    deltaPath: string,
+  ): Promise<void> {
+    if (typeof targetPath !== 'string' || targetPath === '') {
+      throw new TypeError('Invalid target path');
+    }
+    if (typeof deltaPath !== 'string' || deltaPath === '') {
+      throw new TypeError('Invalid delta path');
+    }
+
+    await addon.applyBackupDelta(resolve(targetPath), resolve(deltaPath));
+  }
+
+  /**
+   * Queue a write to be committed together with other small writes.
+   *
+   * The queries run on a separate connection in a background thread, in a
+   * savepoint of a transaction shared with other queued writes (from all
+   * connections to the same database file in the process, including ones on
+   * worker threads). The write is atomic: if any of its queries fails, all of
+   * them are rolled back and the promise rejects, without affecting the
+   * other writes of the group.
+   *
+   * The transaction is committed with `synchronous = FULL`, the promise
+   * resolves once the commit is durable.
+   *
+   * The database must be opened with `Database.openAsync` if it is encrypted.
+   *
+   * @param queries - Queries of the write, run in order.
+   *
+   * @see {@link WriteQueueOptions}
+   */
+  public queueWrite(queries: ReadonlyArray<QueuedQuery>): Promise<void> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (!Array.isArray(queries)) {
+      throw new TypeError('Invalid queries');
+    }
+    const normalized = queries.map((query) => {
+      if (typeof query === 'string') {
+        return [query, undefined] as const;
+      }
+      if (!Array.isArray(query) || typeof query[0] !== 'string') {
+        throw new TypeError('Invalid query');
+      }
+      const [sql, params] = query;
+      if (
+        params !== undefined &&
+        (params === null || typeof params !== 'object')
+      ) {
+        throw new TypeError('Invalid query parameters');
+      }
+      return [sql, params] as const;
+    });
+
+    const { windowMs, maxWrites } = this.#writeQueue ?? {};
+    if (
+      windowMs !== undefined &&
+      (!Number.isInteger(windowMs) || windowMs < 0 || windowMs > MAX_INT32)
+    ) {
+      throw new TypeError('Invalid windowMs option');
+    }
+    if (
+      maxWrites !== undefined &&
+      (!Number.isInteger(maxWrites) || maxWrites < 1 || maxWrites > MAX_INT32)
+    ) {
+      throw new TypeError('Invalid maxWrites option');
+    }
+
+    return addon.databaseQueueWrite(
+      this.#native,
+      normalized,
+      windowMs,
+      maxWrites,
+    );
+  }
+
+  /**
+   * Verify the HMACs of all pages in the database file on background threads.
+   * This is a parallel equivalent of `PRAGMA cipher_integrity_check` that
+   * doesn't block the database.
+   *
+   * Only available for encrypted databases opened with `Database.openAsync`.
+   *
+   * @param options - Verification options.
+   * @returns Sorted numbers of the corrupt pages. Empty if all pages are
+   *          valid.
+   *
+   * @see {@link VerifyIntegrityOptions}
+   */
+  public verifyIntegrity({
+    threads,
+    onProgress,
+  }: VerifyIntegrityOptions = {}): Promise<Array<number>> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (threads !== undefined && (!Number.isInteger(threads) || threads < 1)) {
+      throw new TypeError('Invalid threads option');
+    }
+    if (onProgress !== undefined && typeof onProgress !== 'function') {
+      throw new TypeError('Invalid onProgress option');
+    }
+    return addon.databaseVerifyIntegrity(this.#native, threads, onProgress);
+  }
+
+  public initTokenizer(): void {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    addon.databaseInitTokenizer(this.#native);
+  }
+
+  /**
+   * Rebuild the index of an FTS5 table using `signal_tokenizer`, like
+   * `INSERT INTO table(table) VALUES('rebuild')` but with the rows tokenized
+   * on background threads. The rebuild itself still blocks the database.
+   *
+   * Rows are only tokenized in parallel for on-disk databases in WAL mode,
+   * and for encrypted databases only if opened with `Database.openAsync`.
+   * Requires `db.initTokenizer()`.
+   *
+   * @param table - Name of the FTS5 table.
+   * @param options - Rebuild options.
+   * @returns Number of values tokenized in parallel and by FTS5.
+   *
+   * @see {@link RebuildFtsOptions}
+   */
+  public rebuildFts(
+    table: string,
+    { threads }: RebuildFtsOptions = {},
+  ): RebuildFtsStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof table !== 'string') {
+      throw new TypeError('Invalid table');
+    }
+    if (threads !== undefined && (!Number.isInteger(threads) || threads < 1)) {
+      throw new TypeError('Invalid threads option');
+    }
+    return addon.databaseRebuildFts(this.#native, table, threads);
+  }
+
+  /**
+   * Return the best matches of an FTS5 query, like
+   * `SELECT rowid, bm25(table) FROM table WHERE table MATCH query
+   * ORDER BY bm25(table), rowid LIMIT limit` but without reading or sorting
+   * the other matches.
+   *
+   * Requires `db.initTokenizer()`.
+   *
+   * @param table - Name of the FTS5 table.
+   * @param query - FTS5 query.
+   * @param options - Search options.
+   * @returns Rowids and scores of the matches.
+   *
+   * @see {@link SearchFtsOptions}
+   */
+  public searchFts(
+    table: string,
+    query: string,
+    { limit = 50, weights }: SearchFtsOptions = {},
+  ): SearchFtsResult {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof table !== 'string') {
+      throw new TypeError('Invalid table');
+    }
+    if (typeof query !== 'string') {
+      throw new TypeError('Invalid query');
+    }
+    if (!Number.isSafeInteger(limit) || limit < 1) {
+      throw new TypeError('Invalid limit option');
+    }
+    if (
+      weights !== undefined &&
+      (!Array.isArray(weights) ||
+        !weights.every((weight) => typeof weight === 'number'))
+    ) {
+      throw new TypeError('Invalid weights option');
+    }
+    return addon.databaseSearchFts(this.#native, table, query, limit, weights);
+  }
+
+  /**
+   * Execute one or multiple SQL statements in a given `sql` string.
+   *
+   * @param sql - one or multiple SQL statements
+   */
+  public exec(sql: string): void {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof sql !== 'string') {
+      throw new TypeError('Invalid sql argument');
+    }
+    addon.databaseExec(this.#native, sql);
+  }
+
+  /**
+   * Return the content of the main database as it would be stored in a
+   * database file, e.g. to create in-memory databases from it with
+   * `db.deserialize()`.
+   *
+   * The pages are never encrypted, even if the database is.
+   */
+  public serialize(): Buffer {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseSerialize(this.#native);
+  }
+
+  /**
+   * Replace the main database with an in-memory database holding the content
+   * of `buffer` (as returned by `db.serialize()`, or read from a plaintext
+   * database file).
+   *
+   * This is much faster than creating the same database with `db.exec()`.
+   * The buffer is always copied, so using it later doesn't affect the
+   * database. Prepared statements are prepared again on their next use.
+   *
+   * @param buffer - Content of the database.
+   * @param options - Deserialize options.
+   *
+   * @see {@link DeserializeOptions}
+   */
+  public deserialize(
+    buffer: Uint8Array,
+    { readonly = false }: DeserializeOptions = {},
+  ): void {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (!(buffer instanceof Uint8Array)) {
+      throw new TypeError('Invalid buffer');
+    }
+    if (typeof readonly !== 'boolean') {
+      throw new TypeError('Invalid readonly option');
+    }
+    addon.databaseDeserialize(this.#native, buffer, readonly);
+  }
+
+  /**
+   * Compile a single SQL statement.
+   *
+   * @param query - a single SQL statement.
+   * @param options - statement options.
+   * @returns Statement instance.
+   *
+   * @see {@link StatementOptions}
+   */
+  public prepare<Options extends StatementOptions = StatementOptions>(
+    query: string,
+    options: Options,
+  ): Statement<Options>;
+
+  /**
+   * Compile a single SQL statement.
+   *
+   * @param query - a single SQL statement.
+   * @returns Statement instance.
+   */
+  public prepare(query: string): Statement<object>;
+
+  public prepare<Options extends StatementOptions = StatementOptions>(
+    query: string,
+    options: Options = {} as Options,
+  ): Statement<Options> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof query !== 'string') {
+      throw new TypeError('Invalid query argument');
+    }
+
+    if (!this.#isCacheEnabled || options.persistent === false) {
+      return new Statement(this.#native, query, options);
+    }
+
+    // Persistent statements are cached until closed.
+    const cacheKey = `${options.pluck}:${options.bigint}:${query}`;
+    const cached = this.#statementCache.get(cacheKey);
+    if (cached !== undefined) {
+      return cached;
+    }
+
+    const stmt = new Statement(
+      this.#native,
+      query,
+      {
+        persistent: true,
+        pluck: options.pluck,
+        bigint: options.bigint,
+      } as Options,
+      () => this.#statementCache.delete(cacheKey),
+    );
+    this.#statementCache.set(cacheKey, stmt);
+    return stmt;
+  }
+
+  /**
+   * Close the database and all associated statements.
+   */
+  public close(): void {
+    if (this.#native === undefined) {
+      throw new Error('Database already closed');
+    }
+
+    addon.databaseClose(this.#native);
+    this.#native = undefined;
+  }
+
+  /**
+   * Run a pragma statement and return the result.
+   *
+   * @param source - pragma query source
+   * @param options - options to control the return value of `.pragma()`
+   * @returns Either multiple rows returned by the statement, or the first
+   *          column of the first row (or `undefined`) if `options` has
+   *          `simple: true`.
+   *
+   * @see {@link PragmaOptions}
+   */
+  public pragma<Options extends PragmaOptions>(
+    source: string,
+    { simple }: Options,
+  ): PragmaResult<Options>;
+
+  /**
+   * Run a pragma statement and return the result.
+   *
+   * @param source - pragma query source
+   * @returns Either multiple rows returned by the statement.
+   */
+  public pragma(source: string): PragmaResult<object>;
+
+  public pragma<Options extends PragmaOptions = object>(
+    source: string,
+    { simple }: Options = {} as Options,
+  ): PragmaResult<Options> {
+    if (typeof source !== 'string') {
+      throw new TypeError('Invalid pragma argument');
+    }
+    if (simple === true) {
+      const stmt = this.prepare(`PRAGMA ${source}`, { pluck: true });
+      return stmt.get() as unknown as PragmaResult<Options>;
+    }
+    const stmt = this.prepare(`PRAGMA ${source}`);
+    return stmt.all() as unknown as PragmaResult<Options>;
+  }
+
+  /**
+   * Wrap `fn()` in a transaction.
+   *
+   * Nested transactions use savepoints, `mode` is ignored for them.
+   *
+   * @param fn - a function to be executed within a transaction.
+   * @param options - transaction options.
+   * @returns The value returned by `fn()`.
+   *
+   * @see {@link TransactionOptions}
+   */
+  public transaction<Params extends [], Result>(
+    fn: (...params: Params) => Result,
+    { mode = 'deferred' }: TransactionOptions = {},
+  ): typeof fn {
+    const nativeMode = TRANSACTION_MODES[mode];
+    if (typeof nativeMode !== 'number') {
+      throw new TypeError('Invalid transaction mode');
+    }
+
+    return (...params: Params) => {
+      if (this.#native === undefined) {
+        throw new Error('Database closed');
+      }
+      const native = this.#native;
+
+      addon.databaseBegin(native, nativeMode);
+      try {
+        const result = fn(...params);
+        addon.databaseCommit(native);
+        return result;
+      } catch (error) {
+        addon.databaseRollback(native);
+        throw error;
+      }
+    };
+  }
+
+  /**
+   * Tokenize a given sentence with a Signal-FTS5-Extension.
+   *
+   * @param value - a sentence
+   * @returns a list of word-like tokens.
+   *
+   * @see {@link https://github.com/signalapp/Signal-FTS5-Extension}
    */
   public signalTokenize(value: string): Array<string> {
     if (typeof value !== 'string') {
@@ -542,6 +2392,136 @@ export default class Database {
 
     return addon.signalTokenize(value);
   }
+
+  /**
+   * Tokenize a search query like FTS5 queries of `signal_tokenizer` tables.
+   *
+   * The tokens of the last 64 queries of the connection are cached, and a
+   * query that extends or edits one of them (e.g. while the user is typing)
+   * is only tokenized from the last whitespace before the change. FTS5
+   * queries of the connection share the cache. Requires
+   * `db.initTokenizer()`.
+   *
+   * @param value - a search query
+   * @returns a list of word-like tokens.
+   *
+   * @see {@link Database.tokenCacheStats}
+   */
+  public signalTokenizeQuery(value: string): Array<string> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof value !== 'string') {
+      throw new TypeError('Invalid value');
+    }
+
+    return addon.databaseSignalTokenizeQuery(this.#native, value);
+  }
+
+  /**
+   * Return the counters of the query tokenization cache.
+   *
+   * @returns Cache statistics.
+   */
+  public tokenCacheStats(): TokenCacheStats {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    return addon.databaseTokenCacheStats(this.#native);
+  }
+
+  /**
+   * Load the terms of an FTS5 table and their number of occurrences from its
+   * `fts5vocab` into an in-memory index for `db.completePrefix()`.
+   *
+   * The `fts5vocab` table is kept as `temp.signal_prefix_index_vocab` to keep
+   * the counts up to date (see `db.completePrefix()`). Replaces the previous
+   * index, if any, which is removed even if this one can't be built.
+   * Requires `db.initTokenizer()`.
+   *
+   * @param table - Name of the FTS5 table.
+   * @returns Number of terms.
+   */
+  public buildPrefixIndex(table: string): number {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof table !== 'string') {
+      throw new TypeError('Invalid table');
+    }
+
+    this.#prefixIndexTable = undefined;
+    const termCount = addon.databaseBuildPrefixIndex(this.#native, table);
+    this.#prefixIndexTable = table;
+    return termCount;
+  }
+
+  /**
+   * Return the most frequent terms starting with the last token of `prefix`
+   * from the index of `db.buildPrefixIndex()`, without querying FTS5.
+   *
+   * The counts of the terms of documents indexed or deleted by this
+   * connection are read again from `fts5vocab` once their transaction ends,
+   * if the table was created with `tokenize = 'signal_tokenizer prefix_index'`.
+   * All counts are read again after other connections (including
+   * `db.queueWrite()` and `db.startDeferredIndexing()`) wrote to the
+   * database, so deleted terms are never suggested. In a transaction, some
+   * counts may include its documents until it ends.
+   *
+   * @param prefix - What the user typed so far.
+   * @param limit - Maximum number of completions.
+   * @returns Completions, most frequent first.
+   *
+   * @see {@link PrefixCompletion}
+   */
+  public completePrefix(
+    prefix: string,
+    limit = 10,
+  ): ReadonlyArray<PrefixCompletion> {
+    if (this.#native === undefined) {
+      throw new Error('Database closed');
+    }
+    if (typeof prefix !== 'string') {
+      throw new TypeError('Invalid prefix');
+    }
+    if (!Number.isSafeInteger(limit) || limit < 1) {
+      throw new TypeError('Invalid limit');
+    }
+    return addon.databaseCompletePrefix(this.#native, prefix, limit);
+  }
+
+  /**
+   * Tokenize many sentences at once like `db.signalTokenize()`. The tokens
+   * are returned in a single buffer instead of a string each.
+   *
+   * @param values - a list of sentences
+   * @returns tokens of all sentences and their offsets.
+   *
+   * @see {@link TokenizeBatchResult}
+   */
+  public signalTokenizeBatch(
+    values: ReadonlyArray<string>,
+  ): TokenizeBatchResult {
+    checkTokenizeValues(values);
+    return addon.signalTokenizeBatch(values);
+  }
+
+  /**
+   * Tokenize many sentences at once and return where the tokens are in the
+   * sentences (e.g. for highlighting) instead of the (normalized) tokens.
+   *
+   * @param values - a list of sentences
+   * @returns start and end of every token in its sentence, in UTF-16 code
+   * units.
+   *
+   * @see {@link TokenRangesResult}
+   */
+  public signalTokenizeRanges(
+    values: ReadonlyArray<string>,
+  ): TokenRangesResult {
+    checkTokenizeValues(values);
+    return addon.signalTokenizeRanges(values);
+  }
 }
 
 export { Database };
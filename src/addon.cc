@@ -2,13 +2,41 @@
 // SPDX-License-Identifier: AGPL-3.0-only
 
 #include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
 #include <list>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "addon.h"
 
+#include "backup.h"
+#include "busy_handler.h"
+#include "checkpointer.h"
+#include "fts_indexer.h"
+#include "fts_merger.h"
+#include "fts_rebuild.h"
+#include "fts_top_k.h"
+#include "group_commit.h"
+#include "incremental_backup.h"
+#include "integrity.h"
+#include "interrupt_registry.h"
+#include "io_uring_vfs.h"
+#include "iostats_vfs.h"
 #include "napi.h"
+#include "prefix_index.h"
+#include "readahead_vfs.h"
+#include "rekey.h"
 #include "signal-tokenizer.h"
+#include "snapshot.h"
 #include "sqlite3.h"
+#include "token_cache.h"
 
 // Signal Tokenizer
 
@@ -20,22 +48,111 @@ class SignalTokenizerModule {
 
   static fts5_tokenizer api_object;
 
+  // Set by `Database::RebuildFts` while an index is rebuilt
+  FtsRebuild* rebuild = nullptr;
+
+  // Queries tokenized by FTS5 and `Database::SignalTokenizeQuery`
+  TokenCache query_cache;
+
+  // Set by `Database::BuildPrefixIndex`, fed by the tables created with
+  // `tokenize = 'signal_tokenizer prefix_index'`
+  std::unique_ptr<PrefixIndex> prefix_index;
+
  private:
-  static int Create(void* p_ctx, char const**, int, Fts5Tokenizer** pp_out) {
+  // Tokenizer of a table
+  struct Instance {
+    SignalTokenizerModule* module;
+    bool is_prefix_indexed;
+  };
+
+  static int Create(void* p_ctx,
+                    char const** args,
+                    int arg_count,
+                    Fts5Tokenizer** pp_out) {
     SignalTokenizerModule* m = static_cast<SignalTokenizerModule*>(p_ctx);
-    *pp_out = reinterpret_cast<Fts5Tokenizer*>(m);
+    auto instance = new Instance{m, false};
+    for (int i = 0; i < arg_count; i++) {
+      if (sqlite3_stricmp(args[i], "prefix_index") == 0) {
+        instance->is_prefix_indexed = true;
+      }
+    }
+    *pp_out = reinterpret_cast<Fts5Tokenizer*>(instance);
     return SQLITE_OK;
   }
 
-  static void Delete(Fts5Tokenizer* tokenizer) {}
+  static void Delete(Fts5Tokenizer* tokenizer) {
+    delete reinterpret_cast<Instance*>(tokenizer);
+  }
+
+  static int Tokenize(Fts5Tokenizer* tokenizer,
+                      void* ctx,
+                      int flags,
+                      const char* text,
+                      int length,
+                      FtsRebuild::TokenCallback callback) {
+    auto instance = reinterpret_cast<Instance*>(tokenizer);
+    auto m = instance->module;
+
+    // Documents are tokenized the same way when they are deleted, which
+    // changes the counts of their terms too
+    PrefixIndex::Feed feed = {m->prefix_index.get(), ctx, callback};
+    if (flags == FTS5_TOKENIZE_DOCUMENT) {
+      if (instance->is_prefix_indexed && feed.index != nullptr) {
+        ctx = &feed;
+        callback = &PrefixIndex::Feed::AddToken;
+      }
+      if (m->rebuild != nullptr) {
+        return m->rebuild->Tokenize(ctx, text, length, callback);
+      }
+    }
+    if ((flags & FTS5_TOKENIZE_QUERY) != 0) {
+      return m->query_cache.Tokenize(ctx, flags, text, length, callback);
+    }
+    return signal_fts5_tokenize(tokenizer, ctx, flags, text, length, callback);
+  }
 };
 
 fts5_tokenizer SignalTokenizerModule::api_object = {
     &Create,
     &Delete,
-    signal_fts5_tokenize,
+    &Tokenize,
 };
 
+int RegisterSignalTokenizer(sqlite3* handle, SignalTokenizerModule** module) {
+  sqlite3_stmt* stmt = nullptr;
+  int r = sqlite3_prepare_v2(handle, "SELECT fts5(?1)", -1, &stmt, nullptr);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+
+  fts5_api* fts5 = nullptr;
+  sqlite3_bind_pointer(stmt, 1, reinterpret_cast<void*>(&fts5), "fts5_api_ptr",
+                       nullptr);
+  sqlite3_step(stmt);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+  assert(fts5 != nullptr);
+
+  auto m = new SignalTokenizerModule();
+  r = fts5->xCreateTokenizer(fts5, "signal_tokenizer", m,
+                             &SignalTokenizerModule::api_object,
+                             &SignalTokenizerModule::Destroy);
+  if (r != SQLITE_OK) {
+    delete m;
+    return r;
+  }
+  r = FtsTopK::Register(fts5);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+  if (module != nullptr) {
+    *module = m;
+  }
+  return SQLITE_OK;
+}
+
 static int SignalTokenizeCallback(void* tokens_ptr,
                                   int _flags,
                                   char const* token,
@@ -73,123 +190,1956 @@ static Napi::Value SignalTokenize(const Napi::CallbackInfo& info) {
   return result;
 }
 
+// Tokens of a batch of values, without an allocation per token
+struct TokenBatch {
+  // UTF-8 tokens back to back
+  std::string data;
+
+  // Start of every token in `data` followed by the end of the last one
+  std::vector<uint32_t> offsets = {0};
+
+  // Start and end of every token in its value, in UTF-8 bytes until
+  // converted by `ToUtf16Ranges`
+  std::vector<uint32_t> ranges;
+
+  // Index of the first token of every value followed by the token count
+  std::vector<uint32_t> boundaries;
+};
+
+static int SignalTokenizeBatchCallback(void* batch_ptr,
+                                       int _flags,
+                                       char const* token,
+                                       int len,
+                                       int _start,
+                                       int _end) {
+  auto batch = reinterpret_cast<TokenBatch*>(batch_ptr);
+  batch->data.append(token, len);
+  batch->offsets.push_back(static_cast<uint32_t>(batch->data.size()));
+  return SQLITE_OK;
+}
+
+static int SignalTokenizeRangesCallback(void* batch_ptr,
+                                        int _flags,
+                                        char const* _token,
+                                        int _len,
+                                        int start,
+                                        int end) {
+  auto batch = reinterpret_cast<TokenBatch*>(batch_ptr);
+  batch->ranges.push_back(static_cast<uint32_t>(start));
+  batch->ranges.push_back(static_cast<uint32_t>(end));
+  return SQLITE_OK;
+}
+
+// Converts the UTF-8 byte offsets of `ranges` (starting at `first`) into
+// UTF-16 code unit offsets in `utf8`, so that they index JS strings. Offsets
+// are mostly increasing and are converted in a single pass over the value.
+static void ToUtf16Ranges(const std::vector<char>& utf8,
+                          size_t length,
+                          std::vector<uint32_t>* ranges,
+                          size_t first) {
+  size_t byte = 0;
+  uint32_t unit = 0;
+  for (size_t i = first; i < ranges->size(); i++) {
+    size_t target = std::min<size_t>((*ranges)[i], length);
+    if (target < byte) {
+      byte = 0;
+      unit = 0;
+    }
+    while (byte < target) {
+      auto lead = static_cast<uint8_t>(utf8[byte]);
+      if (lead < 0x80) {
+        byte += 1;
+      } else if (lead < 0xe0) {
+        byte += 2;
+      } else if (lead < 0xf0) {
+        byte += 3;
+      } else {
+        // Surrogate pair
+        byte += 4;
+        unit += 1;
+      }
+      unit += 1;
+    }
+    (*ranges)[i] = unit;
+  }
+}
+
+static Napi::Value SignalTokenizeValues(const Napi::CallbackInfo& info,
+                                        bool is_ranges) {
+  auto env = info.Env();
+
+  auto values = info[0].As<Napi::Array>();
+  assert(values.IsArray());
+
+  TokenBatch batch;
+  std::vector<char> utf8;
+  uint32_t count = values.Length();
+  batch.boundaries.reserve(count + 1);
+  for (uint32_t i = 0; i < count; i++) {
+    Napi::Value value = values[i];
+    batch.boundaries.push_back(
+        static_cast<uint32_t>(is_ranges ? batch.ranges.size() / 2
+                                        : batch.offsets.size() - 1));
+
+    // Reuses the same buffer for all values
+    size_t length;
+    NAPI_THROW_IF_FAILED(
+        env, napi_get_value_string_utf8(env, value, nullptr, 0, &length),
+        Napi::Value());
+    utf8.resize(length + 1);
+    NAPI_THROW_IF_FAILED(env,
+                         napi_get_value_string_utf8(env, value, utf8.data(),
+                                                    utf8.size(), &length),
+                         Napi::Value());
+
+    size_t first = batch.ranges.size();
+    int status = signal_fts5_tokenize(
+        nullptr, &batch, 0, utf8.data(), static_cast<int>(length),
+        is_ranges ? SignalTokenizeRangesCallback : SignalTokenizeBatchCallback);
+    if (status != SQLITE_OK) {
+      NAPI_THROW(Napi::Error::New(env, "Failed to tokenize"), Napi::Value());
+    }
+    if (is_ranges) {
+      ToUtf16Ranges(utf8, length, &batch.ranges, first);
+    }
+  }
+  batch.boundaries.push_back(static_cast<uint32_t>(
+      is_ranges ? batch.ranges.size() / 2 : batch.offsets.size() - 1));
+
+  auto copy = [&](const std::vector<uint32_t>& from) {
+    auto array = Napi::Uint32Array::New(env, from.size());
+    if (!from.empty()) {
+      memcpy(array.Data(), from.data(), from.size() * sizeof(uint32_t));
+    }
+    return array;
+  };
+
+  auto result = Napi::Object::New(env);
+  if (is_ranges) {
+    result["ranges"] = copy(batch.ranges);
+  } else {
+    result["tokens"] = Napi::Buffer<char>::Copy(env, batch.data.data(),
+                                                batch.data.size());
+    result["offsets"] = copy(batch.offsets);
+  }
+  result["boundaries"] = copy(batch.boundaries);
+  return result;
+}
+
+static Napi::Value SignalTokenizeBatch(const Napi::CallbackInfo& info) {
+  return SignalTokenizeValues(info, false);
+}
+
+static Napi::Value SignalTokenizeRanges(const Napi::CallbackInfo& info) {
+  return SignalTokenizeValues(info, true);
+}
+
 // Utils
 
-Napi::Error FormatError(Napi::Env env, const char* format, ...) {
-  va_list args;
+static std::string FormatStringV(const char* format, va_list args) {
+  va_list copy;
 
   // Get buffer size
-  va_start(args, format);
-  auto size = vsnprintf(nullptr, 0, format, args);
-  va_end(args);
+  va_copy(copy, args);
+  auto size = vsnprintf(nullptr, 0, format, copy);
+  va_end(copy);
 
   // Allocate and fill the string
   auto buf = new char[size + 1];
-  va_start(args, format);
   vsnprintf(buf, size + 1, format, args);
-  va_end(args);
 
-  auto err = Napi::Error::New(env, std::string(buf, size));
+  auto str = std::string(buf, size);
   delete[] buf;
-  return err;
+  return str;
+}
+
+std::string FormatString(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  auto str = FormatStringV(format, args);
+  va_end(args);
+  return str;
+}
+
+Napi::Error FormatError(Napi::Env env, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  auto str = FormatStringV(format, args);
+  va_end(args);
+  return Napi::Error::New(env, str);
+}
+
+// Formats the last error of the connection. Unlike `ThrowSqliteError` it does
+// not need a JS environment and thus can be called from worker threads.
+std::string SqliteErrorMessage(sqlite3* handle) {
+  const char* msg = sqlite3_errmsg(handle);
+  int offset = sqlite3_error_offset(handle);
+  int extended = sqlite3_extended_errcode(handle);
+  if (offset == -1) {
+    return FormatString("sqlite error(%d): %s", extended, msg);
+  }
+  return FormatString("sqlite error(%d): %s, offset: %d", extended, msg,
+                      offset);
+}
+
+// ConnectionConfig
+
+ConnectionConfig::~ConnectionConfig() {
+  SecureZero(raw_key.data(), raw_key.size());
+}
+
+int ConnectionConfig::Open(sqlite3** handle,
+                           int flags,
+                           const char* vfs,
+                           std::string* error) const {
+  int r = sqlite3_open_v2(path.c_str(), handle, flags, vfs);
+  if (r != SQLITE_OK) {
+    *error = FormatString("sqlite open error: %s", sqlite3_errstr(r));
+  }
+
+  if (r == SQLITE_OK) {
+    r = sqlite3_extended_result_codes(*handle, 1);
+  }
+  if (r == SQLITE_OK && !raw_key.empty()) {
+    r = sqlite3_key_v2(*handle, "main", raw_key.data(), raw_key.size());
+  }
+  if (r == SQLITE_OK && !cipher_settings.empty()) {
+    r = sqlite3_exec(*handle, cipher_settings.c_str(), nullptr, nullptr,
+                     nullptr);
+  }
+  if (r != SQLITE_OK) {
+    if (error->empty()) {
+      *error = SqliteErrorMessage(*handle);
+    }
+    sqlite3_close(*handle);
+    *handle = nullptr;
+  }
+  return r;
+}
+
+// Empty string for `undefined`
+static std::string OptionalUtf8Value(Napi::Value value) {
+  if (value.IsUndefined()) {
+    return std::string();
+  }
+  return value.As<Napi::String>().Utf8Value();
+}
+
+// `memset()` that the compiler is not allowed to optimize away
+void SecureZero(void* data, size_t size) {
+  volatile uint8_t* p = static_cast<volatile uint8_t*>(data);
+  while (size--) {
+    *p++ = 0;
+  }
+}
+
+// Formats SQLCipher's raw key with an explicit salt: `x'<key><salt>'`
+static std::string FormatRawKey(const uint8_t* key,
+                                size_t key_len,
+                                const uint8_t* salt,
+                                size_t salt_len) {
+  static const char* kHex = "0123456789abcdef";
+
+  std::string result = "x'";
+  result.reserve(3 + 2 * (key_len + salt_len));
+  for (size_t i = 0; i < key_len; i++) {
+    result.push_back(kHex[key[i] >> 4]);
+    result.push_back(kHex[key[i] & 0xf]);
+  }
+  for (size_t i = 0; i < salt_len; i++) {
+    result.push_back(kHex[salt[i] >> 4]);
+    result.push_back(kHex[salt[i] & 0xf]);
+  }
+  result.push_back('\'');
+  return result;
+}
+
+bool IsRawKey(const std::string& key) {
+  return key.rfind("x'", 0) == 0;
+}
+
+// AES-256 key and SQLCipher's salt sizes
+static constexpr size_t kKeySize = 32;
+static constexpr size_t kSaltSize = 16;
+
+int DeriveRawKey(sqlite3* handle, std::string* raw_key) {
+  // Reading the schema derives the key and verifies it against the first
+  // page of the database.
+  signal_sqlcipher_kdf_capture_start();
+  int r = sqlite3_exec(handle, "SELECT count(*) FROM sqlite_schema", nullptr,
+                       nullptr, nullptr);
+  if (r != SQLITE_OK) {
+    signal_sqlcipher_kdf_capture_finish(nullptr, 0, nullptr, 0);
+    return r;
+  }
+
+  uint8_t derived_key[kKeySize];
+  uint8_t salt[kSaltSize];
+  r = signal_sqlcipher_kdf_capture_finish(derived_key, sizeof(derived_key),
+                                          salt, sizeof(salt));
+  if (r != SQLITE_OK) {
+    // Nothing was read from an empty database and so the key wasn't
+    // derived yet. Writing the header makes SQLCipher generate the salt and
+    // derive the key.
+    signal_sqlcipher_kdf_capture_start();
+    r = sqlite3_exec(handle, "PRAGMA user_version = 0", nullptr, nullptr,
+                     nullptr);
+    if (r != SQLITE_OK) {
+      signal_sqlcipher_kdf_capture_finish(nullptr, 0, nullptr, 0);
+      return r;
+    }
+    r = signal_sqlcipher_kdf_capture_finish(derived_key, sizeof(derived_key),
+                                            salt, sizeof(salt));
+  }
+
+  // Not fatal, the database is still usable, but `raw_key` stays empty.
+  if (r == SQLITE_OK) {
+    *raw_key =
+        FormatRawKey(derived_key, sizeof(derived_key), salt, sizeof(salt));
+  }
+  SecureZero(derived_key, sizeof(derived_key));
+  return SQLITE_OK;
+}
+
+int QueryInt(sqlite3* handle, const char* sql, int* result) {
+  sqlite3_stmt* stmt;
+  int r = sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+  r = sqlite3_step(stmt);
+  if (r == SQLITE_ROW) {
+    *result = sqlite3_column_int(stmt, 0);
+    r = SQLITE_OK;
+  } else if (r == SQLITE_DONE) {
+    r = SQLITE_ERROR;
+  }
+  sqlite3_finalize(stmt);
+  return r;
+}
+
+bool IsWalMode(sqlite3* handle) {
+  sqlite3_stmt* stmt;
+  if (sqlite3_prepare_v2(handle, "PRAGMA journal_mode", -1, &stmt, nullptr) !=
+      SQLITE_OK) {
+    return false;
+  }
+  bool is_wal = false;
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    auto mode = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    is_wal = mode != nullptr && strcmp(mode, "wal") == 0;
+  }
+  sqlite3_finalize(stmt);
+  return is_wal;
+}
+
+std::string QuoteIdentifier(const std::string& name) {
+  std::string result = "\"";
+  for (char c : name) {
+    if (c == '"') {
+      result += c;
+    }
+    result += c;
+  }
+  result += '"';
+  return result;
 }
 
 // Database
 
 Napi::Object Database::Init(Napi::Env env, Napi::Object exports) {
   exports["databaseOpen"] = Napi::Function::New(env, &Database::Open);
+  exports["databaseOpenAsync"] = Napi::Function::New(env, &Database::OpenAsync);
   exports["databaseInitTokenizer"] =
       Napi::Function::New(env, &Database::InitTokenizer);
+  exports["databaseRebuildFts"] =
+      Napi::Function::New(env, &Database::RebuildFts);
+  exports["databaseSearchFts"] =
+      Napi::Function::New(env, &Database::SearchFts);
+  exports["databaseSignalTokenizeQuery"] =
+      Napi::Function::New(env, &Database::SignalTokenizeQuery);
+  exports["databaseTokenCacheStats"] =
+      Napi::Function::New(env, &Database::TokenCacheStats);
+  exports["databaseBuildPrefixIndex"] =
+      Napi::Function::New(env, &Database::BuildPrefixIndex);
+  exports["databaseCompletePrefix"] =
+      Napi::Function::New(env, &Database::CompletePrefix);
   exports["databaseClose"] = Napi::Function::New(env, &Database::Close);
+  exports["databaseIsOpen"] = Napi::Function::New(env, &Database::IsOpen);
+  exports["databaseExportRawKey"] =
+      Napi::Function::New(env, &Database::ExportRawKey);
+  exports["databaseReadaheadStats"] =
+      Napi::Function::New(env, &Database::ReadaheadStats);
+  exports["databaseIoStats"] = Napi::Function::New(env, &Database::IoStats);
+  exports["databaseVerifyIntegrity"] =
+      Napi::Function::New(env, &Database::VerifyIntegrity);
+  exports["databaseQueueWrite"] =
+      Napi::Function::New(env, &Database::QueueWrite);
+  exports["databaseSetBusyHandler"] =
+      Napi::Function::New(env, &Database::SetBusyHandler);
+  exports["databaseBusyStats"] =
+      Napi::Function::New(env, &Database::BusyStats);
+  exports["databaseStartCheckpointer"] =
+      Napi::Function::New(env, &Database::StartCheckpointer);
+  exports["databaseCheckpointStats"] =
+      Napi::Function::New(env, &Database::CheckpointStats);
+  exports["databaseStartDeferredIndexing"] =
+      Napi::Function::New(env, &Database::StartDeferredIndexing);
+  exports["databaseIndexingStats"] =
+      Napi::Function::New(env, &Database::IndexingStats);
+  exports["databaseStartFtsMerger"] =
+      Napi::Function::New(env, &Database::StartFtsMerger);
+  exports["databaseFtsMergeStats"] =
+      Napi::Function::New(env, &Database::FtsMergeStats);
+  exports["databaseFtsStructure"] =
+      Napi::Function::New(env, &Database::FtsStructureStats);
+  exports["databaseBackup"] = Napi::Function::New(env, &Database::Backup);
+  exports["databaseSnapshotTo"] =
+      Napi::Function::New(env, &Database::SnapshotTo);
+  exports["databaseBackupIncremental"] =
+      Napi::Function::New(env, &Database::BackupIncremental);
+  exports["applyBackupDelta"] =
+      Napi::Function::New(env, &Database::ApplyBackupDelta);
+  exports["databaseRekeyAsync"] =
+      Napi::Function::New(env, &Database::RekeyAsync);
+  exports["databaseBegin"] = Napi::Function::New(env, &Database::Begin);
+  exports["databaseCommit"] = Napi::Function::New(env, &Database::Commit);
+  exports["databaseRollback"] = Napi::Function::New(env, &Database::Rollback);
   exports["databaseExec"] = Napi::Function::New(env, &Database::Exec);
+  exports["databaseSerialize"] =
+      Napi::Function::New(env, &Database::Serialize);
+  exports["databaseDeserialize"] =
+      Napi::Function::New(env, &Database::Deserialize);
+  exports["databaseArmDeadline"] =
+      Napi::Function::New(env, &Database::ArmDeadline);
+  exports["databaseDisarmDeadline"] =
+      Napi::Function::New(env, &Database::DisarmDeadline);
+  exports["databaseInterruptId"] =
+      Napi::Function::New(env, &Database::InterruptId);
+  exports["databaseInterrupt"] = Napi::Function::New(env, &Database::Interrupt);
   return exports;
 }
 
-Database::Database(Napi::Env env, sqlite3* handle) : handle_(handle) {
-  auto external = Napi::External<Database>::New(
-      env, this, [](Napi::Env env, Database* db) { delete db; });
-  self_ref_ = Napi::Persistent(external);
-}
+Database::Database(Napi::Env env, sqlite3* handle)
+    : handle_(handle), interrupt_id_(InterruptRegistry::Register(handle)) {
+  auto external = Napi::External<Database>::New(
+      env, this, [](Napi::Env env, Database* db) { delete db; });
+  self_ref_ = Napi::Persistent(external);
+}
+
+Database::~Database() {
+  ClearRawKey();
+  ReleaseWriteQueue();
+  checkpointer_.reset();
+  fts_indexer_.reset();
+  fts_merger_.reset();
+  InterruptRegistry::Unregister(interrupt_id_);
+
+  // Manually closed
+  if (handle_ == nullptr) {
+    return;
+  }
+
+  FinalizeTransactionStatements();
+  int r = sqlite3_close(handle_);
+  if (r != SQLITE_OK) {
+    fprintf(stderr, "Cleanup: sqlite3_close failure\n");
+    abort();
+  }
+  handle_ = nullptr;
+}
+
+Database* Database::FromExternal(const Napi::Value value) {
+  auto external = value.As<Napi::External<Database>>();
+
+  auto db = external.Data();
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(value.Env(), "Database closed"), nullptr);
+  }
+
+  return db;
+}
+
+Napi::Value Database::Open(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto path = info[0].As<Napi::String>();
+  auto vfs = info[1];
+  assert(path.IsString());
+  assert(vfs.IsString() || vfs.IsUndefined());
+
+  auto path_utf8 = path.Utf8Value();
+  auto vfs_utf8 = OptionalUtf8Value(vfs);
+
+  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+
+  sqlite3* handle = nullptr;
+  int r = sqlite3_open_v2(path_utf8.c_str(), &handle, flags,
+                          vfs_utf8.empty() ? nullptr : vfs_utf8.c_str());
+  if (r != SQLITE_OK) {
+    NAPI_THROW(FormatError(env, "sqlite open error: %s", sqlite3_errstr(r)),
+               Napi::Value());
+  }
+
+  auto db = new Database(env, handle);
+
+  r = sqlite3_extended_result_codes(handle, 1);
+  if (r != SQLITE_OK) {
+    return db->ThrowSqliteError(env, r);
+  }
+
+  return db->self_ref_.Value();
+}
+
+// Opens the database on a libuv worker thread. When a key is given, the schema
+// is read before resolving so that SQLCipher's (intentionally slow) key
+// derivation runs off the main thread as well.
+class OpenWorker : public Napi::AsyncWorker {
+ public:
+  OpenWorker(Napi::Env env,
+             std::string path,
+             std::string key,
+             std::string cipher_settings,
+             std::string vfs)
+      : Napi::AsyncWorker(env),
+        deferred_(Napi::Promise::Deferred::New(env)),
+        path_(std::move(path)),
+        key_(std::move(key)),
+        cipher_settings_(std::move(cipher_settings)),
+        vfs_(std::move(vfs)) {}
+
+  ~OpenWorker() {
+    SecureZero(key_.data(), key_.size());
+
+    // Rejected or never resolved
+    if (handle_ != nullptr) {
+      sqlite3_close(handle_);
+    }
+  }
+
+  inline Napi::Promise Promise() { return deferred_.Promise(); }
+
+ protected:
+  void Execute() override {
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+
+    int r = sqlite3_open_v2(path_.c_str(), &handle_, flags,
+                            vfs_.empty() ? nullptr : vfs_.c_str());
+    if (r != SQLITE_OK) {
+      SetError(FormatString("sqlite open error: %s", sqlite3_errstr(r)));
+      return;
+    }
+
+    r = sqlite3_extended_result_codes(handle_, 1);
+    if (r != SQLITE_OK) {
+      SetError(SqliteErrorMessage(handle_));
+      return;
+    }
+
+    if (key_.empty()) {
+      return;
+    }
+
+    r = sqlite3_key_v2(handle_, "main", key_.data(), key_.size());
+    if (r != SQLITE_OK) {
+      SetError(SqliteErrorMessage(handle_));
+      return;
+    }
+
+    if (!cipher_settings_.empty()) {
+      r = sqlite3_exec(handle_, cipher_settings_.c_str(), nullptr, nullptr,
+                       nullptr);
+      if (r != SQLITE_OK) {
+        SetError(SqliteErrorMessage(handle_));
+        return;
+      }
+    }
+
+    // Raw keys skip the derivation, there is nothing to capture. Reading the
+    // schema still verifies the key.
+    if (IsRawKey(key_)) {
+      raw_key_ = key_;
+      r = sqlite3_exec(handle_, "SELECT count(*) FROM sqlite_schema", nullptr,
+                       nullptr, nullptr);
+    } else {
+      r = DeriveRawKey(handle_, &raw_key_);
+    }
+    if (r != SQLITE_OK) {
+      SetError(SqliteErrorMessage(handle_));
+    }
+  }
+
+  void OnOK() override {
+    auto db = new Database(Env(), handle_);
+    db->raw_key_ = std::move(raw_key_);
+    db->cipher_settings_ = std::move(cipher_settings_);
+    handle_ = nullptr;
+    deferred_.Resolve(db->self_ref_.Value());
+  }
+
+  void OnError(const Napi::Error& e) override { deferred_.Reject(e.Value()); }
+
+ private:
+  Napi::Promise::Deferred deferred_;
+  std::string path_;
+  std::string key_;
+  std::string cipher_settings_;
+  std::string vfs_;
+  std::string raw_key_;
+  sqlite3* handle_ = nullptr;
+};
+
+Napi::Value Database::OpenAsync(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto path = info[0].As<Napi::String>();
+  auto key = info[1];
+  auto cipher_settings = info[2];
+  auto vfs = info[3];
+
+  assert(path.IsString());
+  assert(key.IsString() || key.IsUndefined());
+  assert(cipher_settings.IsString() || cipher_settings.IsUndefined());
+  assert(vfs.IsString() || vfs.IsUndefined());
+
+  auto worker = new OpenWorker(env, path.Utf8Value(), OptionalUtf8Value(key),
+                               OptionalUtf8Value(cipher_settings),
+                               OptionalUtf8Value(vfs));
+  auto promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+Napi::Value Database::VerifyIntegrity(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto threads = info[1];
+  auto on_progress = info[2];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(threads.IsNumber() || threads.IsUndefined());
+  assert(on_progress.IsFunction() || on_progress.IsUndefined());
+
+  // HMACs are keyed with a key derived from the raw key
+  if (db->raw_key_.empty()) {
+    NAPI_THROW(Napi::Error::New(env, "Raw key is not available"),
+               Napi::Value());
+  }
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  // More threads than CPUs don't verify faster
+  int max_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  int thread_count = max_threads;
+  if (threads.IsNumber()) {
+    thread_count = static_cast<int>(std::clamp<int64_t>(
+        threads.As<Napi::Number>().Int64Value(), 1, max_threads));
+  }
+
+  auto worker = new IntegrityWorker(
+      env, std::move(config), thread_count,
+      on_progress.IsFunction() ? on_progress.As<Napi::Function>()
+                               : Napi::Function());
+  auto promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+Napi::Value Database::RekeyAsync(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto key = info[1].As<Napi::String>();
+  auto pages_per_step = info[2];
+  auto on_progress = info[3];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(key.IsString());
+  assert(pages_per_step.IsNumber() || pages_per_step.IsUndefined());
+  assert(on_progress.IsFunction() || on_progress.IsUndefined());
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+
+  // The file can't be replaced until the transaction ends
+  if (db->is_in_transaction()) {
+    NAPI_THROW(
+        Napi::Error::New(env, "Cannot rekey the database in a transaction"),
+        Napi::Value());
+  }
+  if (db->HasBusyStatement()) {
+    NAPI_THROW(Napi::Error::New(
+                   env, "Cannot rekey the database while a statement runs"),
+               Napi::Value());
+  }
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  auto worker = new RekeyWorker(
+      env, info[0].As<Napi::External<Database>>(), std::move(config),
+      key.Utf8Value(),
+      pages_per_step.IsNumber() ? pages_per_step.As<Napi::Number>().Int32Value()
+                                : RekeyWorker::kDefaultPagesPerStep,
+      on_progress.IsFunction() ? on_progress.As<Napi::Function>()
+                               : Napi::Function());
+  auto promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+Napi::Value Database::Backup(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto dest_path = info[1].As<Napi::String>();
+  auto key = info[2];
+  auto pages_per_step = info[3];
+  auto sleep_ms = info[4];
+  auto on_progress = info[5];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  // `undefined` keeps the key of the database, `null` for plaintext
+  assert(dest_path.IsString());
+  assert(key.IsString() || key.IsNull() || key.IsUndefined());
+  assert(pages_per_step.IsNumber() || pages_per_step.IsUndefined());
+  assert(sleep_ms.IsNumber() || sleep_ms.IsUndefined());
+  assert(on_progress.IsFunction() || on_progress.IsUndefined());
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  auto path = dest_path.Utf8Value();
+  if (path == config.path) {
+    NAPI_THROW(Napi::Error::New(env, "Can't back up the database onto itself"),
+               Napi::Value());
+  }
+
+  auto dest_key = BackupWorker::kSameKey;
+  if (key.IsString()) {
+    dest_key = BackupWorker::kNewKey;
+  } else if (key.IsNull()) {
+    dest_key = BackupWorker::kNoKey;
+  }
+
+  auto worker = new BackupWorker(
+      env, std::move(config), std::move(path), dest_key,
+      key.IsString() ? key.As<Napi::String>().Utf8Value() : std::string(),
+      pages_per_step.IsNumber() ? pages_per_step.As<Napi::Number>().Int32Value()
+                                : BackupWorker::kDefaultPagesPerStep,
+      sleep_ms.IsNumber() ? sleep_ms.As<Napi::Number>().Int32Value() : 0,
+      on_progress.IsFunction() ? on_progress.As<Napi::Function>()
+                               : Napi::Function());
+  auto promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+Napi::Value Database::SnapshotTo(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto dest_path = info[1].As<Napi::String>();
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(dest_path.IsString());
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  auto path = dest_path.Utf8Value();
+  if (path == config.path) {
+    NAPI_THROW(
+        Napi::Error::New(env, "Can't snapshot the database onto itself"),
+        Napi::Value());
+  }
+
+  auto worker = new SnapshotWorker(env, std::move(config), std::move(path));
+  auto promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+Napi::Value Database::BackupIncremental(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto delta_path = info[1].As<Napi::String>();
+  auto manifest_path = info[2].As<Napi::String>();
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(delta_path.IsString());
+  assert(manifest_path.IsString());
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  auto worker = new IncrementalBackupWorker(
+      env, std::move(config), delta_path.Utf8Value(),
+      manifest_path.Utf8Value());
+  auto promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+Napi::Value Database::ApplyBackupDelta(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto target_path = info[0].As<Napi::String>();
+  auto delta_path = info[1].As<Napi::String>();
+
+  assert(target_path.IsString());
+  assert(delta_path.IsString());
+
+  auto worker = new ApplyDeltaWorker(env, target_path.Utf8Value(),
+                                     delta_path.Utf8Value());
+  auto promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+Napi::Value Database::QueueWrite(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto queries = info[1];
+  auto window_ms = info[2];
+  auto max_writes = info[3];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(queries.IsArray());
+  assert(window_ms.IsNumber() || window_ms.IsUndefined());
+  assert(max_writes.IsNumber() || max_writes.IsUndefined());
+
+  if (db->write_queue_ == nullptr) {
+    ConnectionConfig config;
+    if (!db->GetConnectionConfig(env, &config)) {
+      return Napi::Value();
+    }
+
+    GroupCommitQueue::Options options;
+    if (window_ms.IsNumber()) {
+      options.window_ms = static_cast<int>(std::clamp<int64_t>(
+          window_ms.As<Napi::Number>().Int64Value(), 0, INT32_MAX));
+    }
+    // A group of no writes would never drain the queue
+    if (max_writes.IsNumber()) {
+      options.max_writes = static_cast<size_t>(std::clamp<int64_t>(
+          max_writes.As<Napi::Number>().Int64Value(), 1, INT32_MAX));
+    }
+
+    // The writer uses the same VFS (e.g. io_uring)
+    sqlite3_vfs* vfs = nullptr;
+    sqlite3_file_control(db->handle_, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+
+    std::string error;
+    db->write_queue_ = GroupCommitQueue::Get(
+        config, vfs != nullptr ? vfs->zName : nullptr, options, &error);
+    if (db->write_queue_ == nullptr) {
+      NAPI_THROW(Napi::Error::New(env, error), Napi::Value());
+    }
+    db->write_queue_client_ = WriteQueueClient::New(env);
+  }
+
+  return db->write_queue_client_->Push(env, db->write_queue_.get(), queries);
+}
+
+Napi::Value Database::SetBusyHandler(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto timeout_ms = info[1].As<Napi::Number>();
+  auto initial_delay_ms = info[2];
+  auto max_delay_ms = info[3];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(timeout_ms.IsNumber());
+  assert(initial_delay_ms.IsNumber() || initial_delay_ms.IsUndefined());
+  assert(max_delay_ms.IsNumber() || max_delay_ms.IsUndefined());
+
+  BusyHandler::Options options;
+  options.timeout_ms = timeout_ms.Int32Value();
+  if (initial_delay_ms.IsNumber()) {
+    options.initial_delay_ms = initial_delay_ms.As<Napi::Number>().Int32Value();
+  }
+  if (max_delay_ms.IsNumber()) {
+    options.max_delay_ms = max_delay_ms.As<Napi::Number>().Int32Value();
+  }
+
+  if (db->busy_handler_ == nullptr) {
+    db->busy_handler_ = std::make_unique<BusyHandler>();
+  }
+  int r = db->busy_handler_->Install(db->handle_, options);
+  if (r != SQLITE_OK) {
+    return db->ThrowSqliteError(env, r);
+  }
+  return Napi::Value();
+}
+
+Napi::Value Database::BusyStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  if (db->busy_handler_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Busy handler is not enabled"),
+               Napi::Value());
+  }
+
+  const auto& stats = db->busy_handler_->stats();
+  auto result = Napi::Object::New(env);
+  result["waits"] = static_cast<double>(stats.waits);
+  result["retries"] = static_cast<double>(stats.retries);
+  result["timeouts"] = static_cast<double>(stats.timeouts);
+  result["totalWaitMicros"] = static_cast<double>(stats.total_wait_us);
+  result["maxWaitMicros"] = static_cast<double>(stats.max_wait_us);
+  return result;
+}
+
+Napi::Value Database::StartCheckpointer(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto frames = info[1];
+  auto restart_frames = info[2];
+  auto idle_ms = info[3];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(frames.IsNumber() || frames.IsUndefined());
+  assert(restart_frames.IsNumber() || restart_frames.IsUndefined());
+  assert(idle_ms.IsNumber() || idle_ms.IsUndefined());
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  Checkpointer::Options options;
+  if (frames.IsNumber()) {
+    options.frames = frames.As<Napi::Number>().Int32Value();
+  }
+  if (restart_frames.IsNumber()) {
+    options.restart_frames = restart_frames.As<Napi::Number>().Int32Value();
+  }
+  if (idle_ms.IsNumber()) {
+    options.idle_ms = idle_ms.As<Napi::Number>().Int32Value();
+  }
+
+  // Stop the previous checkpointer first, the WAL hook is replaced
+  db->checkpointer_.reset();
+
+  // The checkpointer uses the same VFS (e.g. io_uring)
+  sqlite3_vfs* vfs = nullptr;
+  sqlite3_file_control(db->handle_, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+
+  std::string error;
+  db->checkpointer_ =
+      Checkpointer::Start(db->handle_, config,
+                          vfs != nullptr ? vfs->zName : nullptr, options,
+                          &error);
+  if (db->checkpointer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, error), Napi::Value());
+  }
+  return Napi::Value();
+}
+
+Napi::Value Database::CheckpointStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  if (db->checkpointer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Checkpointer is not enabled"),
+               Napi::Value());
+  }
+
+  auto stats = db->checkpointer_->stats();
+  auto result = Napi::Object::New(env);
+  result["walFrames"] = static_cast<double>(stats.wal_frames);
+  result["walBytes"] = static_cast<double>(stats.wal_frames * stats.frame_size);
+  result["passive"] = static_cast<double>(stats.passive);
+  result["restart"] = static_cast<double>(stats.restart);
+  result["truncate"] = static_cast<double>(stats.truncate);
+  result["starved"] = static_cast<double>(stats.starved);
+  result["errors"] = static_cast<double>(stats.errors);
+  result["checkpointedFrames"] =
+      static_cast<double>(stats.checkpointed_frames);
+  result["totalMicros"] = static_cast<double>(stats.total_us);
+  result["maxMicros"] = static_cast<double>(stats.max_us);
+  result["lastMicros"] = static_cast<double>(stats.last_us);
+  return result;
+}
+
+Napi::Value Database::StartDeferredIndexing(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto table = info[1].As<Napi::String>();
+  auto content = info[2].As<Napi::String>();
+  auto batch_size = info[3];
+  auto delay_ms = info[4];
+  auto interval_ms = info[5];
+  auto merge_pages = info[6];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(table.IsString());
+  assert(content.IsString());
+  assert(batch_size.IsNumber() || batch_size.IsUndefined());
+  assert(delay_ms.IsNumber() || delay_ms.IsUndefined());
+  assert(interval_ms.IsNumber() || interval_ms.IsUndefined());
+  assert(merge_pages.IsNumber() || merge_pages.IsUndefined());
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  FtsIndexer::Options options;
+  options.content = content.Utf8Value();
+  if (batch_size.IsNumber()) {
+    options.batch_size = batch_size.As<Napi::Number>().Int32Value();
+  }
+  if (delay_ms.IsNumber()) {
+    options.delay_ms = delay_ms.As<Napi::Number>().Int32Value();
+  }
+  if (interval_ms.IsNumber()) {
+    options.interval_ms = interval_ms.As<Napi::Number>().Int32Value();
+  }
+  if (merge_pages.IsNumber()) {
+    options.merge_pages = merge_pages.As<Napi::Number>().Int32Value();
+  }
+
+  // Stop the previous indexer first, the update hook is replaced
+  db->fts_indexer_.reset();
+
+  sqlite3_vfs* vfs = nullptr;
+  sqlite3_file_control(db->handle_, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+
+  std::string error;
+  db->fts_indexer_ = FtsIndexer::Start(
+      db->handle_, config, vfs != nullptr ? vfs->zName : nullptr,
+      table.Utf8Value(), options, &error);
+  if (db->fts_indexer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, error), Napi::Value());
+  }
+  return Napi::Value();
+}
+
+Napi::Value Database::IndexingStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  if (db->fts_indexer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Deferred indexing is not enabled"),
+               Napi::Value());
+  }
+
+  auto stats = db->fts_indexer_->stats();
+  int64_t lag_ms = 0;
+  if (stats.queue_depth != 0) {
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+    lag_ms = std::max<int64_t>(now - stats.oldest_queued_ms, 0);
+  }
+
+  auto result = Napi::Object::New(env);
+  result["queueDepth"] = static_cast<double>(stats.queue_depth);
+  result["lagMs"] = static_cast<double>(lag_ms);
+  result["indexedRows"] = static_cast<double>(stats.indexed_rows);
+  result["batches"] = static_cast<double>(stats.batches);
+  result["errors"] = static_cast<double>(stats.errors);
+  result["totalMicros"] = static_cast<double>(stats.total_us);
+  result["maxMicros"] = static_cast<double>(stats.max_us);
+  result["lastMicros"] = static_cast<double>(stats.last_us);
+  return result;
+}
+
+static Napi::Object FtsStructureToObject(Napi::Env env,
+                                         const FtsStructure& structure) {
+  auto levels = Napi::Array::New(env, structure.levels.size());
+  for (uint32_t i = 0; i < structure.levels.size(); i++) {
+    const auto& level = structure.levels[i];
+    auto value = Napi::Object::New(env);
+    value["segments"] = static_cast<double>(level.segments);
+    value["merging"] = static_cast<double>(level.merging);
+    value["pages"] = static_cast<double>(level.pages);
+    levels[i] = value;
+  }
+
+  auto result = Napi::Object::New(env);
+  result["segments"] = static_cast<double>(structure.segments);
+  result["levels"] = levels;
+  return result;
+}
+
+Napi::Value Database::StartFtsMerger(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto table = info[1].As<Napi::String>();
+  auto idle_ms = info[2];
+  auto budget_ms = info[3];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(table.IsString());
+  assert(idle_ms.IsNumber() || idle_ms.IsUndefined());
+  assert(budget_ms.IsNumber() || budget_ms.IsUndefined());
+
+  ConnectionConfig config;
+  if (!db->GetConnectionConfig(env, &config)) {
+    return Napi::Value();
+  }
+
+  FtsMerger::Options options;
+  if (idle_ms.IsNumber()) {
+    options.idle_ms = idle_ms.As<Napi::Number>().Int32Value();
+  }
+  if (budget_ms.IsNumber()) {
+    options.budget_ms = budget_ms.As<Napi::Number>().Int32Value();
+  }
+
+  db->fts_merger_.reset();
+
+  sqlite3_vfs* vfs = nullptr;
+  sqlite3_file_control(db->handle_, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+
+  std::string error;
+  db->fts_merger_ =
+      FtsMerger::Start(config, vfs != nullptr ? vfs->zName : nullptr,
+                       table.Utf8Value(), options, &error);
+  if (db->fts_merger_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, error), Napi::Value());
+  }
+  return Napi::Value();
+}
+
+Napi::Value Database::FtsMergeStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  if (db->fts_merger_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "FTS merger is not enabled"),
+               Napi::Value());
+  }
+
+  auto stats = db->fts_merger_->stats();
+  auto result = Napi::Object::New(env);
+  result["steps"] = static_cast<double>(stats.steps);
+  result["errors"] = static_cast<double>(stats.errors);
+  result["pagesPerStep"] = static_cast<double>(stats.pages);
+  result["totalMicros"] = static_cast<double>(stats.total_us);
+  result["maxMicros"] = static_cast<double>(stats.max_us);
+  result["lastMicros"] = static_cast<double>(stats.last_us);
+  result["structure"] = FtsStructureToObject(env, stats.structure);
+  return result;
+}
+
+Napi::Value Database::FtsStructureStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto table = info[1].As<Napi::String>();
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(table.IsString());
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+
+  FtsStructure structure;
+  int r = ReadFtsStructure(db->handle_, table.Utf8Value(), &structure);
+  if (r == SQLITE_CORRUPT) {
+    NAPI_THROW(Napi::Error::New(env, "Invalid FTS5 structure record"),
+               Napi::Value());
+  }
+  if (r != SQLITE_OK) {
+    return db->ThrowSqliteError(env, r);
+  }
+  return FtsStructureToObject(env, structure);
+}
+
+Napi::Value Database::InitTokenizer(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  db->RegisterTokenizer(env);
+  return Napi::Value();
+}
+
+Napi::Value Database::RebuildFts(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto table = info[1].As<Napi::String>();
+  auto threads = info[2];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(table.IsString());
+  assert(threads.IsNumber() || threads.IsUndefined());
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+  if (db->tokenizer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Tokenizer is not initialized"),
+               Napi::Value());
+  }
+
+  // More threads than CPUs don't tokenize faster
+  int max_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  int thread_count = max_threads;
+  if (threads.IsNumber()) {
+    thread_count = static_cast<int>(std::clamp<int64_t>(
+        threads.As<Napi::Number>().Int64Value(), 1, max_threads));
+  }
+
+  auto name = QuoteIdentifier(table.Utf8Value());
+  auto sql = "INSERT INTO " + name + "(" + name + ") VALUES('rebuild')";
+
+  ConnectionConfig config;
+  const char* path = sqlite3_db_filename(db->handle_, "main");
+  config.path = path != nullptr ? path : "";
+  config.raw_key = db->raw_key_;
+  config.cipher_settings = db->cipher_settings_;
+
+  FtsRebuild rebuild(std::move(config), std::move(name), thread_count);
+  if (path != nullptr && path[0] != '\0' && IsWalMode(db->handle_)) {
+    rebuild.Start();
+  }
+
+  db->tokenizer_->rebuild = &rebuild;
+  int r = sqlite3_exec(db->handle_, sql.c_str(), nullptr, nullptr, nullptr);
+  db->tokenizer_->rebuild = nullptr;
+  if (r != SQLITE_OK) {
+    return db->ThrowSqliteError(env, r);
+  }
+
+  auto result = Napi::Object::New(env);
+  result["cachedValues"] = static_cast<double>(rebuild.cached_values());
+  result["inlineValues"] = static_cast<double>(rebuild.inline_values());
+  return result;
+}
+
+Napi::Value Database::SearchFts(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto table = info[1].As<Napi::String>();
+  auto query = info[2].As<Napi::String>();
+  auto limit = info[3].As<Napi::Number>();
+  auto weights = info[4];
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(table.IsString());
+  assert(query.IsString());
+  assert(limit.IsNumber());
+  assert(weights.IsArray() || weights.IsUndefined());
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+  if (db->tokenizer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Tokenizer is not initialized"),
+               Napi::Value());
+  }
+
+  std::vector<double> column_weights;
+  if (weights.IsArray()) {
+    auto array = weights.As<Napi::Array>();
+    column_weights.reserve(array.Length());
+    for (uint32_t i = 0; i < array.Length(); i++) {
+      column_weights.push_back(array.Get(i).As<Napi::Number>().DoubleValue());
+    }
+  }
+
+  FtsTopK top_k(static_cast<size_t>(limit.Int64Value()),
+                std::move(column_weights));
+  std::vector<FtsTopK::Match> matches;
+  int r = top_k.Search(db->handle_, table.Utf8Value(), query.Utf8Value(),
+                       &matches);
+  if (r != SQLITE_OK) {
+    return db->ThrowSqliteError(env, r);
+  }
+
+  auto rowids = Napi::Float64Array::New(env, matches.size());
+  auto scores = Napi::Float64Array::New(env, matches.size());
+  for (size_t i = 0; i < matches.size(); i++) {
+    rowids[i] = static_cast<double>(matches[i].rowid);
+    scores[i] = matches[i].score;
+  }
+
+  auto result = Napi::Object::New(env);
+  result["rowids"] = rowids;
+  result["scores"] = scores;
+  return result;
+}
+
+Napi::Value Database::SignalTokenizeQuery(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto value = info[1].As<Napi::String>();
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(value.IsString());
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+  if (db->tokenizer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Tokenizer is not initialized"),
+               Napi::Value());
+  }
+
+  auto utf8 = value.Utf8Value();
+  std::vector<std::string> tokens;
+
+  // The cache is shared with the queries of the connection
+  auto mutex = sqlite3_db_mutex(db->handle_);
+  sqlite3_mutex_enter(mutex);
+  int r = db->tokenizer_->query_cache.Tokenize(
+      &tokens, FTS5_TOKENIZE_QUERY, utf8.data(), static_cast<int>(utf8.size()),
+      SignalTokenizeCallback);
+  sqlite3_mutex_leave(mutex);
+  if (r != SQLITE_OK) {
+    NAPI_THROW(Napi::Error::New(env, "Failed to tokenize"), Napi::Value());
+  }
+
+  auto result = Napi::Array::New(env, tokens.size());
+  for (uint32_t i = 0; i < tokens.size(); i++) {
+    result[i] = Napi::String::New(env, tokens[i]);
+  }
+  return result;
+}
+
+Napi::Value Database::TokenCacheStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+  if (db->tokenizer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Tokenizer is not initialized"),
+               Napi::Value());
+  }
+
+  auto mutex = sqlite3_db_mutex(db->handle_);
+  sqlite3_mutex_enter(mutex);
+  auto stats = db->tokenizer_->query_cache.stats();
+  sqlite3_mutex_leave(mutex);
+
+  auto result = Napi::Object::New(env);
+  result["hits"] = static_cast<double>(stats.hits);
+  result["misses"] = static_cast<double>(stats.misses);
+  result["tokenizedBytes"] = static_cast<double>(stats.tokenized_bytes);
+  return result;
+}
+
+Napi::Value Database::BuildPrefixIndex(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto table = info[1].As<Napi::String>();
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(table.IsString());
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+  if (db->tokenizer_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Tokenizer is not initialized"),
+               Napi::Value());
+  }
+
+  // The previous index is removed even if the new one can't be built, since
+  // its `fts5vocab` table is replaced
+  auto index = std::make_unique<PrefixIndex>();
+  std::string error;
+  int r = index->Build(db->handle_, table.Utf8Value(), &error);
+  if (r != SQLITE_OK) {
+    index.reset();
+  }
+
+  // The terms of a transaction are marked dirty once it ends
+  auto mutex = sqlite3_db_mutex(db->handle_);
+  sqlite3_mutex_enter(mutex);
+  sqlite3_commit_hook(db->handle_,
+                      index != nullptr ? &PrefixIndex::CommitHook : nullptr,
+                      index.get());
+  sqlite3_rollback_hook(
+      db->handle_, index != nullptr ? &PrefixIndex::RollbackHook : nullptr,
+      index.get());
+  db->tokenizer_->prefix_index = std::move(index);
+  sqlite3_mutex_leave(mutex);
+  if (r != SQLITE_OK) {
+    NAPI_THROW(Napi::Error::New(env, error), Napi::Value());
+  }
+
+  auto term_count = db->tokenizer_->prefix_index->term_count();
+  return Napi::Number::New(env, static_cast<double>(term_count));
+}
+
+static int LastTokenCallback(void* token_ptr,
+                             int _flags,
+                             char const* token,
+                             int len,
+                             int _start,
+                             int _end) {
+  static_cast<std::string*>(token_ptr)->assign(token, len);
+  return SQLITE_OK;
+}
+
+Napi::Value Database::CompletePrefix(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  auto prefix = info[1].As<Napi::String>();
+  auto limit = info[2].As<Napi::Number>();
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  assert(prefix.IsString());
+  assert(limit.IsNumber());
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+  if (db->tokenizer_ == nullptr || db->tokenizer_->prefix_index == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Prefix index is not built"),
+               Napi::Value());
+  }
+
+  auto utf8 = prefix.Utf8Value();
+  std::string token;
+  std::vector<PrefixIndex::Completion> completions;
+
+  // The last token of `prefix` is completed, normalized like the terms
+  auto index = db->tokenizer_->prefix_index.get();
+  std::string error;
+  auto mutex = sqlite3_db_mutex(db->handle_);
+  sqlite3_mutex_enter(mutex);
+  int r = index->Refresh(db->handle_, &error);
+  if (r == SQLITE_OK) {
+    r = db->tokenizer_->query_cache.Tokenize(
+        &token, FTS5_TOKENIZE_QUERY | FTS5_TOKENIZE_PREFIX, utf8.data(),
+        static_cast<int>(utf8.size()), LastTokenCallback);
+    if (r != SQLITE_OK) {
+      error = "Failed to tokenize";
+    }
+  }
+  if (r == SQLITE_OK && !token.empty()) {
+    completions =
+        index->Complete(token, static_cast<size_t>(limit.Int64Value()));
+  }
+  sqlite3_mutex_leave(mutex);
+  if (r != SQLITE_OK) {
+    NAPI_THROW(Napi::Error::New(env, error), Napi::Value());
+  }
+
+  auto result = Napi::Array::New(env, completions.size());
+  for (uint32_t i = 0; i < completions.size(); i++) {
+    auto completion = Napi::Object::New(env);
+    completion["term"] = Napi::String::New(env, completions[i].term);
+    completion["count"] = static_cast<double>(completions[i].count);
+    result[i] = completion;
+  }
+  return result;
+}
+
+bool Database::RegisterTokenizer(Napi::Env env) {
+  int r = RegisterSignalTokenizer(handle_, &tokenizer_);
+  if (r != SQLITE_OK) {
+    ThrowSqliteError(env, r);
+    return false;
+  }
+
+  has_tokenizer_ = true;
+  return true;
+}
+
+bool Database::ReplaceFile(Napi::Env env,
+                           const std::string& new_path,
+                           std::string raw_key) {
+  // Closing the connection would silently roll back the transaction
+  if (is_in_transaction()) {
+    NAPI_THROW(
+        Napi::Error::New(env, "Cannot replace the database in a transaction"),
+        false);
+  }
+
+  // Its next step would silently start over on the new connection
+  if (HasBusyStatement()) {
+    NAPI_THROW(Napi::Error::New(
+                   env, "Cannot replace the database while a statement runs"),
+               false);
+  }
+
+  std::string path = sqlite3_db_filename(handle_, "main");
+
+  // Reopen with the same VFS (e.g. read-ahead)
+  sqlite3_vfs* vfs = nullptr;
+  sqlite3_file_control(handle_, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+  std::string vfs_name = vfs != nullptr ? vfs->zName : "";
+
+  // The writer connection of the queue and the connections of the
+  // checkpointer, the indexer and the merger have the old file open
+  ReleaseWriteQueue();
+  checkpointer_.reset();
+  fts_indexer_.reset();
+  fts_merger_.reset();
+
+  // Statements are prepared again on the new connection
+  std::vector<std::string> queries;
+  queries.reserve(statements_.size());
+  for (const auto& stmt : statements_) {
+    queries.emplace_back(sqlite3_sql(stmt->handle_));
+    sqlite3_finalize(stmt->handle_);
+    stmt->handle_ = nullptr;
+  }
+
+  FinalizeTransactionStatements();
+
+  // Closing checkpoints and removes the WAL of the old file so that it won't
+  // be replayed on top of the new one.
+  InterruptRegistry::SetHandle(interrupt_id_, nullptr);
+  int r = sqlite3_close(handle_);
+  if (r != SQLITE_OK) {
+    // Still open, keep using it
+    InterruptRegistry::SetHandle(interrupt_id_, handle_);
+    ThrowSqliteError(env, r);
+    if (PrepareStatements(queries) != SQLITE_OK) {
+      Abandon();
+    }
+    return false;
+  }
+  handle_ = nullptr;
+  tokenizer_ = nullptr;
+
+  ConnectionConfig config;
+  config.path = path;
+  config.cipher_settings = cipher_settings_;
+
+  // The old file is opened again if it couldn't be replaced
+  std::string error;
+  if (rename(new_path.c_str(), path.c_str()) == 0) {
+    config.raw_key = std::move(raw_key);
+  } else {
+    error = FormatString("Failed to replace the database file: %s",
+                         strerror(errno));
+    config.raw_key = raw_key_;
+  }
+
+  std::string open_error;
+  r = config.Open(&handle_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                  vfs_name.empty() ? nullptr : vfs_name.c_str(), &open_error);
+  if (r != SQLITE_OK) {
+    // `Open` closes the connection on failure
+    handle_ = nullptr;
+    Abandon();
+    NAPI_THROW(Napi::Error::New(env, error.empty() ? open_error : error),
+               false);
+  }
+
+  ClearRawKey();
+  raw_key_ = config.raw_key;
+  InterruptRegistry::SetHandle(interrupt_id_, handle_);
+
+  // Before the statements, which might read tables using the tokenizer
+  if (has_tokenizer_) {
+    r = RegisterSignalTokenizer(handle_, &tokenizer_);
+  }
+  if (r == SQLITE_OK) {
+    r = PrepareStatements(queries);
+  }
+  if (r != SQLITE_OK) {
+    ThrowSqliteError(env, r);
+    Abandon();
+    return false;
+  }
+
+  if (!error.empty()) {
+    NAPI_THROW(Napi::Error::New(env, error), false);
+  }
+  return true;
+}
+
+bool Database::HasBusyStatement() {
+  for (auto stmt = sqlite3_next_stmt(handle_, nullptr); stmt != nullptr;
+       stmt = sqlite3_next_stmt(handle_, stmt)) {
+    if (sqlite3_stmt_busy(stmt)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int Database::PrepareStatements(const std::vector<std::string>& queries) {
+  auto iter = statements_.begin();
+  for (const auto& query : queries) {
+    auto stmt = *iter++;
+    int r = sqlite3_prepare_v3(
+        handle_, query.c_str(), query.size(),
+        stmt->is_persistent_ ? SQLITE_PREPARE_PERSISTENT : 0, &stmt->handle_,
+        nullptr);
+    if (r != SQLITE_OK) {
+      return r;
+    }
+  }
+  return SQLITE_OK;
+}
+
+void Database::Abandon() {
+  for (const auto& stmt : statements_) {
+    sqlite3_finalize(stmt->handle_);
+    stmt->handle_ = nullptr;
+    stmt->db_ = nullptr;
+  }
+  statements_.clear();
+  FinalizeTransactionStatements();
+
+  InterruptRegistry::SetHandle(interrupt_id_, nullptr);
+  if (handle_ != nullptr) {
+    // Everything is finalized, so this can't fail
+    sqlite3_close(handle_);
+    handle_ = nullptr;
+  }
+  tokenizer_ = nullptr;
+  ClearRawKey();
+}
+
+Napi::Value Database::Close(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  // Close all active statements (otherwise `sqlite3_close()` is going to error)
+  for (const auto& stmt : db->statements_) {
+    int r = sqlite3_finalize(stmt->handle_);
+    if (r != SQLITE_OK) {
+      return db->ThrowSqliteError(env, r);
+    }
+    stmt->handle_ = nullptr;
+    stmt->db_ = nullptr;
+  }
+  db->statements_.clear();
+  db->FinalizeTransactionStatements();
+  db->checkpointer_.reset();
+  db->fts_indexer_.reset();
+  db->fts_merger_.reset();
+
+  InterruptRegistry::SetHandle(db->interrupt_id_, nullptr);
+  int r = sqlite3_close(db->handle_);
+  if (r != SQLITE_OK) {
+    InterruptRegistry::SetHandle(db->interrupt_id_, db->handle_);
+    return db->ThrowSqliteError(env, r);
+  }
+  db->handle_ = nullptr;
+  db->ClearRawKey();
+  db->ReleaseWriteQueue();
+  return Napi::Value();
+}
+
+Napi::Value Database::IsOpen(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  // Doesn't throw if closed, unlike `FromExternal`
+  auto db = info[0].As<Napi::External<Database>>().Data();
+  return Napi::Boolean::New(env, db->handle_ != nullptr);
+}
+
+Napi::Value Database::ExportRawKey(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  if (db->raw_key_.empty()) {
+    NAPI_THROW(Napi::Error::New(env, "Raw key is not available"),
+               Napi::Value());
+  }
+
+  return Napi::String::New(env, db->raw_key_);
+}
+
+Napi::Value Database::ReadaheadStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  ReadaheadVfs::Stats stats;
+  if (!ReadaheadVfs::GetStats(db->handle_, &stats)) {
+    NAPI_THROW(Napi::Error::New(env, "Read-ahead is not enabled"),
+               Napi::Value());
+  }
+
+  auto result = Napi::Object::New(env);
+  result["reads"] = static_cast<double>(stats.reads);
+  result["hits"] = static_cast<double>(stats.hits);
+  result["prefetchedPages"] = static_cast<double>(stats.prefetched_pages);
+  result["wastedPages"] = static_cast<double>(stats.wasted_pages);
+  return result;
+}
+
+static Napi::Object IoOpStatsToObject(Napi::Env env,
+                                      const IoStatsVfs::OpStats& stats) {
+  auto histogram = Napi::Array::New(env, IoStatsVfs::kBuckets);
+  for (uint32_t i = 0; i < IoStatsVfs::kBuckets; i++) {
+    histogram[i] = static_cast<double>(stats.histogram[i]);
+  }
+
+  auto result = Napi::Object::New(env);
+  result["count"] = static_cast<double>(stats.count);
+  result["bytes"] = static_cast<double>(stats.bytes);
+  result["totalMicros"] = static_cast<double>(stats.total_us);
+  result["histogram"] = histogram;
+  return result;
+}
+
+Napi::Value Database::IoStats(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  IoStatsVfs::Stats stats;
+  if (!IoStatsVfs::GetStats(db->handle_, &stats)) {
+    NAPI_THROW(Napi::Error::New(env, "I/O stats are not enabled"),
+               Napi::Value());
+  }
+
+  static const char* kFileTypes[] = {"main", "wal", "journal", "shm", "temp"};
+  static const char* kOps[] = {"reads", "writes", "syncs", "locks"};
+
+  auto result = Napi::Object::New(env);
+  for (int type = 0; type < IoStatsVfs::kFileTypeCount; type++) {
+    auto file = Napi::Object::New(env);
+    for (int op = 0; op < IoStatsVfs::kOpCount; op++) {
+      file[kOps[op]] = IoOpStatsToObject(env, stats.ops[type][op]);
+    }
+    result[kFileTypes[type]] = file;
+  }
+  return result;
+}
+
+Napi::Value Database::Exec(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
 
-Database::~Database() {
-  // Manually closed
-  if (handle_ == nullptr) {
-    return;
+  auto db = FromExternal(info[0]);
+  auto query = info[1].As<Napi::String>();
+  assert(query.IsString());
+
+  if (db == nullptr) {
+    return Napi::Value();
   }
 
-  int r = sqlite3_close(handle_);
+  auto query_utf8 = query.Utf8Value();
+
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
+
+  int r =
+      sqlite3_exec(db->handle_, query_utf8.c_str(), nullptr, nullptr, nullptr);
   if (r != SQLITE_OK) {
-    fprintf(stderr, "Cleanup: sqlite3_close failure\n");
-    abort();
+    return db->ThrowSqliteError(env, r);
   }
-  handle_ = nullptr;
+  return Napi::Value();
 }
 
-Database* Database::FromExternal(const Napi::Value value) {
-  auto external = value.As<Napi::External<Database>>();
+Napi::Value Database::Serialize(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
 
-  auto db = external.Data();
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
 
   if (db->handle_ == nullptr) {
-    NAPI_THROW(Napi::Error::New(value.Env(), "Database closed"), nullptr);
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
   }
 
-  return db;
+  // Deserialized databases are contiguous in memory and only need to be
+  // copied into the buffer
+  sqlite3_int64 size = 0;
+  auto data = sqlite3_serialize(db->handle_, "main", &size,
+                                SQLITE_SERIALIZE_NOCOPY);
+  if (data != nullptr) {
+    return Napi::Buffer<uint8_t>::Copy(env, data, size);
+  }
+
+  // Pages of other databases are read into memory that the buffer takes
+  // over, or copied once more where external buffers aren't allowed
+  data = sqlite3_serialize(db->handle_, "main", &size, 0);
+  if (data == nullptr) {
+    if (size == 0) {
+      return Napi::Buffer<uint8_t>::New(env, 0);
+    }
+    return db->ThrowSqliteError(env, SQLITE_NOMEM);
+  }
+  return Napi::Buffer<uint8_t>::NewOrCopy(
+      env, data, size, [](Napi::Env, uint8_t* data) { sqlite3_free(data); });
 }
 
-Napi::Value Database::Open(const Napi::CallbackInfo& info) {
+Napi::Value Database::Deserialize(const Napi::CallbackInfo& info) {
   auto env = info.Env();
 
-  auto path = info[0].As<Napi::String>();
-  assert(path.IsString());
+  auto db = FromExternal(info[0]);
+  auto buffer = info[1].As<Napi::Uint8Array>();
+  auto readonly = info[2].As<Napi::Boolean>();
+  if (db == nullptr) {
+    return Napi::Value();
+  }
 
-  auto path_utf8 = path.Utf8Value();
+  assert(buffer.IsTypedArray());
+  assert(readonly.IsBoolean());
 
-  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+  if (db->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  }
 
-  sqlite3* handle = nullptr;
-  int r = sqlite3_open_v2(path_utf8.c_str(), &handle, flags, nullptr);
-  if (r != SQLITE_OK) {
-    NAPI_THROW(FormatError(env, "sqlite open error: %s", sqlite3_errstr(r)),
-               Napi::Value());
+  // The buffer is always copied: JavaScript could detach or resize its
+  // memory, or change it from another thread, while SQLite reads it.
+  auto size = static_cast<sqlite3_int64>(buffer.ByteLength());
+  auto data = static_cast<uint8_t*>(sqlite3_malloc64(size > 0 ? size : 1));
+  if (data == nullptr) {
+    return db->ThrowSqliteError(env, SQLITE_NOMEM);
   }
+  memcpy(data, buffer.Data(), size);
 
-  auto db = new Database(env, handle);
+  unsigned int flags = SQLITE_DESERIALIZE_FREEONCLOSE;
+  if (readonly.Value()) {
+    flags |= SQLITE_DESERIALIZE_READONLY;
+  } else {
+    // Writable databases grow and are freed by SQLite
+    flags |= SQLITE_DESERIALIZE_RESIZEABLE;
+  }
 
-  r = sqlite3_extended_result_codes(handle, 1);
+  // `data` is freed by SQLite even on failure
+  int r = sqlite3_deserialize(db->handle_, "main", data, size, size, flags);
   if (r != SQLITE_OK) {
     return db->ThrowSqliteError(env, r);
   }
-
-  return db->self_ref_.Value();
+  return Napi::Value();
 }
 
-Napi::Value Database::InitTokenizer(const Napi::CallbackInfo& info) {
+Napi::Value Database::Begin(const Napi::CallbackInfo& info) {
   auto env = info.Env();
 
   auto db = FromExternal(info[0]);
+  auto mode = info[1].As<Napi::Number>();
   if (db == nullptr) {
     return Napi::Value();
   }
 
-  fts5_api* fts5 = db->GetFTS5API(env);
+  assert(mode.IsNumber());
 
-  if (fts5 == nullptr) {
-    return Napi::Value();
+  TransactionStatement which = kSavepoint;
+  if (db->transaction_depth_ == 0) {
+    switch (mode.Int32Value()) {
+      case 1:
+        which = kBeginImmediate;
+        break;
+      case 2:
+        which = kBeginExclusive;
+        break;
+      default:
+        which = kBegin;
+        break;
+    }
   }
-  SignalTokenizerModule* icu = new SignalTokenizerModule();
-  int r =
-      fts5->xCreateTokenizer(fts5, "signal_tokenizer", icu, &icu->api_object,
-                             &SignalTokenizerModule::Destroy);
+
+  int r = db->RunTransactionStatement(which);
   if (r != SQLITE_OK) {
-    delete icu;
     return db->ThrowSqliteError(env, r);
   }
-
+  db->transaction_depth_++;
   return Napi::Value();
 }
 
-Napi::Value Database::Close(const Napi::CallbackInfo& info) {
+Napi::Value Database::Commit(const Napi::CallbackInfo& info) {
   auto env = info.Env();
 
   auto db = FromExternal(info[0]);
@@ -197,86 +2147,188 @@ Napi::Value Database::Close(const Napi::CallbackInfo& info) {
     return Napi::Value();
   }
 
-  // Close all active statements (otherwise `sqlite3_close()` is going to error)
-  for (const auto& stmt : db->statements_) {
-    int r = sqlite3_finalize(stmt->handle_);
-    if (r != SQLITE_OK) {
-      return db->ThrowSqliteError(env, r);
-    }
-    stmt->handle_ = nullptr;
-    stmt->db_ = nullptr;
+  if (db->transaction_depth_ == 0) {
+    NAPI_THROW(Napi::Error::New(env, "No transaction is active"),
+               Napi::Value());
   }
-  db->statements_.clear();
 
-  int r = sqlite3_close(db->handle_);
+  // On failure the transaction stays open until `Rollback`
+  int r = db->RunTransactionStatement(db->transaction_depth_ == 1 ? kCommit
+                                                                  : kRelease);
   if (r != SQLITE_OK) {
     return db->ThrowSqliteError(env, r);
   }
-  db->handle_ = nullptr;
+  db->transaction_depth_--;
   return Napi::Value();
 }
 
-Napi::Value Database::Exec(const Napi::CallbackInfo& info) {
+Napi::Value Database::Rollback(const Napi::CallbackInfo& info) {
   auto env = info.Env();
 
   auto db = FromExternal(info[0]);
-  auto query = info[1].As<Napi::String>();
-  assert(query.IsString());
-
   if (db == nullptr) {
     return Napi::Value();
   }
 
-  auto query_utf8 = query.Utf8Value();
+  if (db->transaction_depth_ == 0) {
+    NAPI_THROW(Napi::Error::New(env, "No transaction is active"),
+               Napi::Value());
+  }
+  db->transaction_depth_--;
 
-  if (db->handle_ == nullptr) {
-    NAPI_THROW(Napi::Error::New(env, "Database closed"), Napi::Value());
+  // Some errors (e.g. `SQLITE_FULL`) roll back the whole transaction on their
+  // own, there is nothing left to roll back.
+  if (sqlite3_get_autocommit(db->handle_)) {
+    return Napi::Value();
   }
 
-  int r =
-      sqlite3_exec(db->handle_, query_utf8.c_str(), nullptr, nullptr, nullptr);
+  int r;
+  if (db->transaction_depth_ == 0) {
+    r = db->RunTransactionStatement(kRollback);
+  } else {
+    r = db->RunTransactionStatement(kRollbackTo);
+    if (r == SQLITE_OK) {
+      r = db->RunTransactionStatement(kRelease);
+    }
+  }
   if (r != SQLITE_OK) {
     return db->ThrowSqliteError(env, r);
   }
   return Napi::Value();
 }
 
-Napi::Value Database::ThrowSqliteError(Napi::Env env, int error) {
-  assert(handle_ != nullptr);
-  const char* msg = sqlite3_errmsg(handle_);
-  int offset = sqlite3_error_offset(handle_);
-  int extended = sqlite3_extended_errcode(handle_);
-  if (offset == -1) {
-    NAPI_THROW(FormatError(env, "sqlite error(%d): %s", extended, msg),
-               Napi::Value());
-  } else {
-    NAPI_THROW(FormatError(env, "sqlite error(%d): %s, offset: %d", extended,
-                           msg, offset),
-               Napi::Value());
+int Database::RunTransactionStatement(TransactionStatement which) {
+  static const char* kQueries[kTransactionStatementCount] = {
+      "BEGIN",
+      "BEGIN IMMEDIATE",
+      "BEGIN EXCLUSIVE",
+      "COMMIT",
+      "ROLLBACK",
+      "SAVEPOINT signalappsqlcipher",
+      "RELEASE signalappsqlcipher",
+      "ROLLBACK TO signalappsqlcipher",
+  };
+
+  auto& stmt = transaction_stmts_[which];
+  if (stmt == nullptr) {
+    int r = sqlite3_prepare_v3(handle_, kQueries[which], -1,
+                               SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if (r != SQLITE_OK) {
+      return r;
+    }
+  }
+
+  int r = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  return r == SQLITE_DONE ? SQLITE_OK : r;
+}
+
+void Database::FinalizeTransactionStatements() {
+  for (auto& stmt : transaction_stmts_) {
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
   }
+  transaction_depth_ = 0;
 }
 
-fts5_api* Database::GetFTS5API(Napi::Env env) {
-  sqlite3_stmt* stmt_ = nullptr;
+// VM instructions between two checks of the deadline
+static constexpr int kDeadlineCheckInterval = 1000;
 
-  int r = sqlite3_prepare(handle_, "SELECT fts5(?1)", -1, &stmt_, 0);
-  if (r != SQLITE_OK) {
-    ThrowSqliteError(env, r);
-    return nullptr;
+int Database::DeadlineProgress(void* db_ptr) {
+  auto db = static_cast<Database*>(db_ptr);
+  if (std::chrono::steady_clock::now() < db->deadline_) {
+    return 0;
   }
 
-  fts5_api* fts5 = nullptr;
-  sqlite3_bind_pointer(stmt_, 1, reinterpret_cast<void*>(&fts5), "fts5_api_ptr",
-                       nullptr);
-  sqlite3_step(stmt_);
-  r = sqlite3_finalize(stmt_);
-  if (r != SQLITE_OK) {
-    ThrowSqliteError(env, r);
-    return nullptr;
+  // Non-zero interrupts the running statement
+  db->has_deadline_passed_ = true;
+  return 1;
+}
+
+Napi::Value Database::ArmDeadline(const Napi::CallbackInfo& info) {
+  auto db = FromExternal(info[0]);
+  auto timeout_ms = info[1].As<Napi::Number>();
+  if (db == nullptr) {
+    return Napi::Value();
   }
 
-  assert(fts5 != nullptr);
-  return fts5;
+  assert(timeout_ms.IsNumber());
+  db->deadline_ = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeout_ms.Int64Value());
+  db->has_deadline_passed_ = false;
+
+  // Checked by the statement itself rather than interrupted from another
+  // thread, so that a deadline passing after the statement returned (and
+  // before it is disarmed) can't interrupt other statements.
+  sqlite3_progress_handler(db->handle_, kDeadlineCheckInterval,
+                           &Database::DeadlineProgress, db);
+  return Napi::Value();
+}
+
+Napi::Value Database::DisarmDeadline(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  sqlite3_progress_handler(db->handle_, 0, nullptr, nullptr);
+  bool has_passed = db->has_deadline_passed_;
+  db->has_deadline_passed_ = false;
+  return Napi::Boolean::New(env, has_passed);
+}
+
+Napi::Value Database::InterruptId(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto db = FromExternal(info[0]);
+  if (db == nullptr) {
+    return Napi::Value();
+  }
+
+  return Napi::Number::New(env, db->interrupt_id_);
+}
+
+Napi::Value Database::Interrupt(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+  auto id = info[0].As<Napi::Number>();
+  assert(id.IsNumber());
+
+  return Napi::Boolean::New(env, InterruptRegistry::Interrupt(id.Uint32Value()));
+}
+
+Napi::Value Database::ThrowSqliteError(Napi::Env env, int error) {
+  assert(handle_ != nullptr);
+  NAPI_THROW(Napi::Error::New(env, SqliteErrorMessage(handle_)),
+             Napi::Value());
+}
+
+bool Database::GetConnectionConfig(Napi::Env env, ConnectionConfig* config) {
+  const char* path = sqlite3_db_filename(handle_, "main");
+  if (path == nullptr || path[0] == '\0') {
+    NAPI_THROW(Napi::Error::New(env, "Not supported for in-memory databases"),
+               false);
+  }
+
+  config->path = path;
+  config->raw_key = raw_key_;
+  config->cipher_settings = cipher_settings_;
+  return true;
+}
+
+void Database::ClearRawKey() {
+  SecureZero(raw_key_.data(), raw_key_.size());
+  raw_key_.clear();
+}
+
+void Database::ReleaseWriteQueue() {
+  // Pending writes are still committed and their promises settled
+  if (write_queue_client_ != nullptr) {
+    write_queue_client_->Release();
+    write_queue_client_ = nullptr;
+  }
+  write_queue_.reset();
 }
 
 std::list<Statement*>::const_iterator Database::TrackStatement(
@@ -302,6 +2354,8 @@ Napi::Object Statement::Init(Napi::Env env, Napi::Object exports) {
   exports["statementClose"] = Napi::Function::New(env, &Statement::Close);
   exports["statementRun"] = Napi::Function::New(env, &Statement::Run);
   exports["statementStep"] = Napi::Function::New(env, &Statement::Step);
+  exports["statementStepFor"] = Napi::Function::New(env, &Statement::StepFor);
+  exports["statementReset"] = Napi::Function::New(env, &Statement::ResetJS);
   return exports;
 }
 
@@ -509,12 +2563,7 @@ Napi::Value Statement::Step(const Napi::CallbackInfo& info) {
   // In non-persistent mode - construct the JS object with column names as keys
   // and row values as values.
   if (!stmt->is_persistent_) {
-    auto result = Napi::Object::New(env);
-    for (int i = 0; i < column_count; i++) {
-      result[sqlite3_column_name(stmt->handle_, i)] =
-          stmt->GetColumnValue(env, i);
-    }
-    return result;
+    return stmt->GetRowObject(env);
   }
 
   // Track when the statement gets recompiled due to a schema change. When it
@@ -540,6 +2589,148 @@ Napi::Value Statement::Step(const Napi::CallbackInfo& info) {
   return result;
 }
 
+namespace {
+
+// Time budget checks happen every this many VM instructions
+constexpr int kSliceCheckInterval = 1000;
+
+struct Slice {
+  std::chrono::steady_clock::time_point deadline;
+  bool has_deadline;
+  int64_t vm_steps;
+  int64_t interval;
+  int64_t ops = 0;
+  bool is_exhausted = false;
+};
+
+int SliceProgress(void* arg) {
+  auto slice = static_cast<Slice*>(arg);
+  slice->ops += slice->interval;
+  if (slice->vm_steps > 0 && slice->ops >= slice->vm_steps) {
+    slice->is_exhausted = true;
+  }
+  if (slice->has_deadline &&
+      std::chrono::steady_clock::now() >= slice->deadline) {
+    slice->is_exhausted = true;
+  }
+
+  // Never abort, the slice ends at the next row
+  return 0;
+}
+
+}  // namespace
+
+Napi::Value Statement::StepFor(const Napi::CallbackInfo& info) {
+  auto env = info.Env();
+
+  auto stmt = FromExternal(info[0]);
+  if (stmt == nullptr) {
+    return Napi::Value();
+  }
+
+  auto params = info[1];
+  auto budget_ms = info[2];
+  auto vm_steps = info[3];
+  auto result = info[4].As<Napi::Array>();
+
+  // `null` continues the previous slice with the bound parameters
+  assert(params.IsObject() || params.IsUndefined() || params.IsNull());
+  assert(budget_ms.IsNumber() || budget_ms.IsUndefined());
+  assert(vm_steps.IsNumber() || vm_steps.IsUndefined());
+  assert(result.IsArray());
+
+  if (stmt->handle_ == nullptr) {
+    NAPI_THROW(Napi::Error::New(env, "Statement closed"), Napi::Value());
+  }
+
+  if (!params.IsNull()) {
+    stmt->Reset();
+    if (!stmt->BindParams(env, params)) {
+      // BindParams threw an exception
+      return Napi::Value();
+    }
+  }
+
+  int column_count = sqlite3_column_count(stmt->handle_);
+  if (stmt->is_pluck_ && column_count != 1) {
+    stmt->Reset();
+    NAPI_THROW(Napi::Error::New(env, "Invalid column count for pluck"),
+               Napi::Value());
+  }
+
+  Slice slice;
+  slice.has_deadline = budget_ms.IsNumber();
+  if (slice.has_deadline) {
+    slice.deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(budget_ms.As<Napi::Number>().Int64Value());
+  }
+  slice.vm_steps =
+      vm_steps.IsNumber() ? vm_steps.As<Napi::Number>().Int64Value() : 0;
+  slice.interval = kSliceCheckInterval;
+  if (slice.vm_steps > 0 && slice.vm_steps < slice.interval) {
+    slice.interval = slice.vm_steps;
+  }
+
+  auto db_handle = stmt->db_->handle();
+  sqlite3_progress_handler(db_handle, static_cast<int>(slice.interval),
+                           SliceProgress, &slice);
+
+  // At least one row is returned per slice so that the iteration always
+  // progresses.
+  auto rows = Napi::Array::New(env);
+  uint32_t row_count = 0;
+  int r;
+  while (true) {
+    r = sqlite3_step(stmt->handle_);
+    if (r != SQLITE_ROW) {
+      break;
+    }
+
+    rows[row_count++] = stmt->is_pluck_ ? stmt->GetColumnValue(env, 0)
+                                        : stmt->GetRowObject(env);
+    if (slice.is_exhausted) {
+      break;
+    }
+  }
+
+  sqlite3_progress_handler(db_handle, 0, nullptr, nullptr);
+
+  if (r == SQLITE_ROW) {
+    result[0u] = false;
+    return rows;
+  }
+
+  AutoResetStatement _(stmt, true);
+  if (r != SQLITE_DONE) {
+    return stmt->db_->ThrowSqliteError(env, r);
+  }
+  result[0u] = true;
+  return rows;
+}
+
+Napi::Value Statement::ResetJS(const Napi::CallbackInfo& info) {
+  auto stmt = FromExternal(info[0]);
+  if (stmt == nullptr) {
+    return Napi::Value();
+  }
+
+  if (stmt->handle_ != nullptr) {
+    stmt->Reset();
+  }
+  return Napi::Value();
+}
+
+Napi::Value Statement::GetRowObject(Napi::Env env) {
+  int column_count = sqlite3_column_count(handle_);
+
+  auto result = Napi::Object::New(env);
+  for (int i = 0; i < column_count; i++) {
+    result[sqlite3_column_name(handle_, i)] = GetColumnValue(env, i);
+  }
+  return result;
+}
+
 bool Statement::BindParams(Napi::Env env, Napi::Value params) {
   int key_count = sqlite3_bind_parameter_count(handle_);
 
@@ -723,9 +2914,34 @@ AutoResetStatement::~AutoResetStatement() {
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
   sqlite3_initialize();
 
+  int r = ReadaheadVfs::Register();
+  if (r != SQLITE_OK) {
+    NAPI_THROW(FormatError(env, "Failed to register %s VFS: %s",
+                           ReadaheadVfs::kName, sqlite3_errstr(r)),
+               exports);
+  }
+
+  r = IoUringVfs::Register();
+  if (r != SQLITE_OK) {
+    NAPI_THROW(FormatError(env, "Failed to register %s VFS: %s",
+                           IoUringVfs::kName, sqlite3_errstr(r)),
+               exports);
+  }
+
+  r = IoStatsVfs::Register();
+  if (r != SQLITE_OK) {
+    NAPI_THROW(FormatError(env, "Failed to register %s VFS: %s",
+                           IoStatsVfs::kName, sqlite3_errstr(r)),
+               exports);
+  }
+
   Database::Init(env, exports);
   Statement::Init(env, exports);
   exports["signalTokenize"] = Napi::Function::New(env, &SignalTokenize);
+  exports["signalTokenizeBatch"] =
+      Napi::Function::New(env, &SignalTokenizeBatch);
+  exports["signalTokenizeRanges"] =
+      Napi::Function::New(env, &SignalTokenizeRanges);
   return exports;
 }
 
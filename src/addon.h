@@ -2,13 +2,74 @@
 // SPDX-License-Identifier: AGPL-3.0-only
 
 #ifndef SRC_ADDON_H_
+#define SRC_ADDON_H_
 
+#include <chrono>
 #include <list>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "napi.h"
 #include "sqlite3.h"
 
+class BusyHandler;
+class Checkpointer;
+class FtsIndexer;
+class FtsMerger;
+class GroupCommitQueue;
+class SignalTokenizerModule;
 class Statement;
+class WriteQueueClient;
+
+// Utils
+
+std::string FormatString(const char* format, ...);
+std::string SqliteErrorMessage(sqlite3* handle);
+void SecureZero(void* data, size_t size);
+
+// Whether `key` is a raw key (`x'...'`) rather than a passphrase
+bool IsRawKey(const std::string& key);
+
+// Derives the key of a connection keyed with a passphrase and returns it
+// together with the salt as a raw key. `raw_key` is left empty if the key
+// couldn't be captured.
+int DeriveRawKey(sqlite3* handle, std::string* raw_key);
+
+// Runs a query returning a single integer
+int QueryInt(sqlite3* handle, const char* sql, int* result);
+
+// Whether the main database of `handle` is in WAL mode
+bool IsWalMode(sqlite3* handle);
+
+// `"name"` with quotes doubled, for use as an identifier in SQL
+std::string QuoteIdentifier(const std::string& name);
+
+// Registers `signal_tokenizer` and the `signal_top_k` auxiliary function
+// with FTS5. `module` (if not null) is set to the tokenizer, which is owned by
+// the connection.
+int RegisterSignalTokenizer(sqlite3* handle, SignalTokenizerModule** module);
+
+// Everything needed to open another connection to the same database from a
+// background thread.
+struct ConnectionConfig {
+  // Absolute path of the main database file
+  std::string path;
+
+  // Raw key (see `Database::raw_key_`) or empty for plaintext databases
+  std::string raw_key;
+
+  // `PRAGMA` statements to run after applying the key
+  std::string cipher_settings;
+
+  ~ConnectionConfig();
+
+  // On failure returns an error code, sets `error` and closes the connection.
+  int Open(sqlite3** handle,
+           int flags,
+           const char* vfs,
+           std::string* error) const;
+};
 
 class Database {
  public:
@@ -21,20 +82,157 @@ class Database {
 
   inline sqlite3* handle() { return handle_; }
 
+  // Includes transactions started with SQL instead of `Begin`
+  inline bool is_in_transaction() {
+    return !sqlite3_get_autocommit(handle_) || transaction_depth_ > 0;
+  }
+
+  // Returns `false` and throws if the database can't be opened from another
+  // thread (e.g. in-memory databases).
+  bool GetConnectionConfig(Napi::Env env, ConnectionConfig* config);
+
+  // Closes the connection, moves `new_path` over the database file and opens
+  // it again with `raw_key` (and the original cipher settings). Open
+  // statements are prepared again on the new connection, other per-connection
+  // state (pragmas, temporary tables, attached databases) is lost. Refused in
+  // a transaction, which closing would roll back, and while a statement is
+  // in the middle of its rows.
+  //
+  // Returns `false` and throws on failure. If the file couldn't be replaced,
+  // the old one is opened again. If no connection could be opened or the
+  // statements couldn't be prepared again, the database is closed.
+  bool ReplaceFile(Napi::Env env,
+                   const std::string& new_path,
+                   std::string raw_key);
+
  protected:
   Database(Napi::Env env, sqlite3* handle);
   ~Database();
 
   static Database* FromExternal(const Napi::Value value);
   static Napi::Value Open(const Napi::CallbackInfo& info);
+  static Napi::Value OpenAsync(const Napi::CallbackInfo& info);
   static Napi::Value InitTokenizer(const Napi::CallbackInfo& info);
+  static Napi::Value RebuildFts(const Napi::CallbackInfo& info);
+  static Napi::Value SearchFts(const Napi::CallbackInfo& info);
+  static Napi::Value SignalTokenizeQuery(const Napi::CallbackInfo& info);
+  static Napi::Value TokenCacheStats(const Napi::CallbackInfo& info);
+  static Napi::Value BuildPrefixIndex(const Napi::CallbackInfo& info);
+  static Napi::Value CompletePrefix(const Napi::CallbackInfo& info);
   static Napi::Value Close(const Napi::CallbackInfo& info);
+  static Napi::Value IsOpen(const Napi::CallbackInfo& info);
+  static Napi::Value ExportRawKey(const Napi::CallbackInfo& info);
+  static Napi::Value ReadaheadStats(const Napi::CallbackInfo& info);
+  static Napi::Value IoStats(const Napi::CallbackInfo& info);
+  static Napi::Value VerifyIntegrity(const Napi::CallbackInfo& info);
+  static Napi::Value Backup(const Napi::CallbackInfo& info);
+  static Napi::Value SnapshotTo(const Napi::CallbackInfo& info);
+  static Napi::Value BackupIncremental(const Napi::CallbackInfo& info);
+  static Napi::Value ApplyBackupDelta(const Napi::CallbackInfo& info);
+  static Napi::Value RekeyAsync(const Napi::CallbackInfo& info);
+  static Napi::Value QueueWrite(const Napi::CallbackInfo& info);
+  static Napi::Value SetBusyHandler(const Napi::CallbackInfo& info);
+  static Napi::Value BusyStats(const Napi::CallbackInfo& info);
+  static Napi::Value StartCheckpointer(const Napi::CallbackInfo& info);
+  static Napi::Value CheckpointStats(const Napi::CallbackInfo& info);
+  static Napi::Value StartDeferredIndexing(const Napi::CallbackInfo& info);
+  static Napi::Value IndexingStats(const Napi::CallbackInfo& info);
+  static Napi::Value StartFtsMerger(const Napi::CallbackInfo& info);
+  static Napi::Value FtsMergeStats(const Napi::CallbackInfo& info);
+  static Napi::Value FtsStructureStats(const Napi::CallbackInfo& info);
   static Napi::Value Exec(const Napi::CallbackInfo& info);
-
-  fts5_api* GetFTS5API(Napi::Env env);
+  static Napi::Value Serialize(const Napi::CallbackInfo& info);
+  static Napi::Value Deserialize(const Napi::CallbackInfo& info);
+  static Napi::Value Begin(const Napi::CallbackInfo& info);
+  static Napi::Value Commit(const Napi::CallbackInfo& info);
+  static Napi::Value Rollback(const Napi::CallbackInfo& info);
+  static Napi::Value ArmDeadline(const Napi::CallbackInfo& info);
+  static Napi::Value DisarmDeadline(const Napi::CallbackInfo& info);
+  static Napi::Value InterruptId(const Napi::CallbackInfo& info);
+  static Napi::Value Interrupt(const Napi::CallbackInfo& info);
+
+  enum TransactionStatement {
+    kBegin,
+    kBeginImmediate,
+    kBeginExclusive,
+    kCommit,
+    kRollback,
+    kSavepoint,
+    kRelease,
+    kRollbackTo,
+    kTransactionStatementCount,
+  };
+
+  // Runs one of the cached transaction control statements
+  int RunTransactionStatement(TransactionStatement which);
+  void FinalizeTransactionStatements();
+
+  bool RegisterTokenizer(Napi::Env env);
+
+  // A statement was stepped but not reset, e.g. between `stepFor` calls
+  bool HasBusyStatement();
+
+  // Prepares `statements_` again with their `queries`, in the same order
+  int PrepareStatements(const std::vector<std::string>& queries);
+
+  // Closes the connection and all statements after a failed `ReplaceFile`
+  void Abandon();
+
+  void ClearRawKey();
+  void ReleaseWriteQueue();
+
+  // Progress handler of `ArmDeadline`
+  static int DeadlineProgress(void* db_ptr);
 
   sqlite3* handle_;
 
+  // Armed by `ArmDeadline`, checked by `DeadlineProgress` while a statement
+  // runs
+  std::chrono::steady_clock::time_point deadline_;
+  bool has_deadline_passed_ = false;
+
+  // Id of the connection in `InterruptRegistry`, stays the same when the
+  // connection is reopened.
+  uint32_t interrupt_id_;
+
+  // SQLCipher's raw key (`x'...'`, derived key followed by the salt) if the
+  // database was opened with `OpenAsync` and a key. Empty otherwise.
+  std::string raw_key_;
+
+  // Cipher settings given to `OpenAsync`
+  std::string cipher_settings_;
+
+  // `true` if `InitTokenizer` was called, the tokenizer has to be registered
+  // again when the connection is replaced.
+  bool has_tokenizer_ = false;
+
+  // Registered by `RegisterTokenizer`, owned by the connection
+  SignalTokenizerModule* tokenizer_ = nullptr;
+
+  // Prepared on first use, finalized before the connection is closed
+  sqlite3_stmt* transaction_stmts_[kTransactionStatementCount] = {};
+
+  // Number of `Begin` calls without a matching `Commit` or `Rollback`. Nested
+  // transactions use savepoints.
+  int transaction_depth_ = 0;
+
+  // Installed by `SetBusyHandler`
+  std::unique_ptr<BusyHandler> busy_handler_;
+
+  // Started by `StartCheckpointer`, stopped before the connection is closed
+  std::unique_ptr<Checkpointer> checkpointer_;
+
+  // Started by `StartDeferredIndexing`, stopped before the connection is
+  // closed
+  std::unique_ptr<FtsIndexer> fts_indexer_;
+
+  // Started by `StartFtsMerger`, stopped before the connection is closed
+  std::unique_ptr<FtsMerger> fts_merger_;
+
+  // Created on the first `QueueWrite` call
+  std::shared_ptr<GroupCommitQueue> write_queue_;
+  WriteQueueClient* write_queue_client_ = nullptr;
+
   // A reference to the `external` object. Initially only a weak reference, it
   // gets it's ref count incremented on every `TrackStatement` call (new
   // statement creation) and decremented on every `UntrackStatement` (statement
@@ -44,6 +242,8 @@ class Database {
   // All currently open statements for this database. Used to close all open
   // statements when closing the database.
   std::list<Statement*> statements_;
+
+  friend class OpenWorker;
 };
 
 class AutoResetStatement {
@@ -128,6 +328,8 @@ class Statement {
   static Napi::Value Close(const Napi::CallbackInfo& info);
   static Napi::Value Run(const Napi::CallbackInfo& info);
   static Napi::Value Step(const Napi::CallbackInfo& info);
+  static Napi::Value StepFor(const Napi::CallbackInfo& info);
+  static Napi::Value ResetJS(const Napi::CallbackInfo& info);
 
   bool BindParams(Napi::Env env, Napi::Value params);
 
@@ -137,6 +339,9 @@ class Statement {
 
   Napi::Value GetColumnValue(Napi::Env env, int column);
 
+  // Returns the current row as a JS object with column names as keys
+  Napi::Value GetRowObject(Napi::Env env);
+
   Database* db_;
   sqlite3_stmt* handle_;
 
@@ -0,0 +1,213 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "backup.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+// Delay before retrying a step when the source is locked
+static constexpr int kBusyDelayMs = 10;
+
+BackupWorker::BackupWorker(Napi::Env env,
+                           ConnectionConfig config,
+                           std::string dest_path,
+                           DestinationKey dest_key,
+                           std::string key,
+                           int pages_per_step,
+                           int sleep_ms,
+                           Napi::Function on_progress)
+    : Napi::AsyncProgressWorker<uint64_t>(env),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      config_(std::move(config)),
+      dest_path_(std::move(dest_path)),
+      temp_path_(dest_path_ + "-backup"),
+      // A step of no pages would never finish the backup
+      pages_per_step_(pages_per_step > 0 ? pages_per_step
+                                         : kDefaultPagesPerStep),
+      sleep_ms_(std::max(0, sleep_ms)) {
+  if (dest_key == kSameKey) {
+    key_ = config_.raw_key;
+  } else if (dest_key == kNewKey) {
+    key_ = std::move(key);
+  }
+  if (!on_progress.IsEmpty() && on_progress.IsFunction()) {
+    on_progress_ = Napi::Persistent(on_progress);
+  }
+}
+
+BackupWorker::~BackupWorker() {
+  SecureZero(key_.data(), key_.size());
+}
+
+void BackupWorker::Execute(const ExecutionProgress& progress) {
+  bool is_export = config_.raw_key.empty() != key_.empty();
+
+  // `ATTACH` needs a writable connection
+  sqlite3* source;
+  std::string error;
+  if (config_.Open(&source,
+                   is_export ? SQLITE_OPEN_READWRITE : SQLITE_OPEN_READONLY,
+                   nullptr, &error) != SQLITE_OK) {
+    SetError(error);
+    return;
+  }
+
+  // Leftovers of an interrupted backup
+  remove(temp_path_.c_str());
+  remove((temp_path_ + "-journal").c_str());
+
+  bool is_done = is_export ? Export(source, progress) : Copy(source, progress);
+  sqlite3_close(source);
+  if (!is_done) {
+    return;
+  }
+
+  if (rename(temp_path_.c_str(), dest_path_.c_str()) != 0) {
+    SetError(FormatString("Failed to replace the backup file: %s",
+                          strerror(errno)));
+  }
+}
+
+bool BackupWorker::Copy(sqlite3* source, const ExecutionProgress& progress) {
+  // Pin a snapshot of the database for the duration of the copy. Writers
+  // aren't blocked by readers in WAL mode.
+  if (IsWalMode(source)) {
+    int count;
+    int r = sqlite3_exec(source, "BEGIN", nullptr, nullptr, nullptr);
+    if (r == SQLITE_OK) {
+      r = QueryInt(source, "SELECT count(*) FROM sqlite_schema", &count);
+    }
+    if (r != SQLITE_OK) {
+      SetError(SqliteErrorMessage(source));
+      return false;
+    }
+  }
+
+  sqlite3* dest;
+  int r = sqlite3_open_v2(temp_path_.c_str(), &dest,
+                          SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+  if (r != SQLITE_OK) {
+    SetError(FormatString("sqlite open error: %s", sqlite3_errstr(r)));
+    sqlite3_close(dest);
+    return false;
+  }
+
+  r = sqlite3_extended_result_codes(dest, 1);
+  if (r == SQLITE_OK && !key_.empty()) {
+    r = sqlite3_key_v2(dest, "main", key_.data(), key_.size());
+  }
+  if (r == SQLITE_OK && !key_.empty() && !config_.cipher_settings.empty()) {
+    r = sqlite3_exec(dest, config_.cipher_settings.c_str(), nullptr, nullptr,
+                     nullptr);
+  }
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(dest));
+    sqlite3_close(dest);
+    return false;
+  }
+
+  sqlite3_backup* backup = sqlite3_backup_init(dest, "main", source, "main");
+  if (backup == nullptr) {
+    SetError(SqliteErrorMessage(dest));
+    sqlite3_close(dest);
+    return false;
+  }
+
+  do {
+    r = sqlite3_backup_step(backup, pages_per_step_);
+    if (r == SQLITE_OK || r == SQLITE_DONE) {
+      uint64_t total = sqlite3_backup_pagecount(backup);
+      uint64_t data[2] = {total - sqlite3_backup_remaining(backup), total};
+      progress.Send(data, 2);
+      if (r == SQLITE_OK && sleep_ms_ > 0) {
+        sqlite3_sleep(sleep_ms_);
+      }
+    } else if (r == SQLITE_BUSY || r == SQLITE_LOCKED) {
+      sqlite3_sleep(kBusyDelayMs);
+      r = SQLITE_OK;
+    }
+  } while (r == SQLITE_OK);
+
+  // Errors of `sqlite3_backup_step()` are reported on the destination
+  sqlite3_backup_finish(backup);
+  if (r != SQLITE_DONE) {
+    SetError(SqliteErrorMessage(dest));
+    sqlite3_close(dest);
+    return false;
+  }
+  sqlite3_close(dest);
+  return true;
+}
+
+bool BackupWorker::Export(sqlite3* source, const ExecutionProgress& progress) {
+  int total;
+  int r = QueryInt(source, "PRAGMA page_count", &total);
+
+  sqlite3_stmt* attach = nullptr;
+  if (r == SQLITE_OK) {
+    r = sqlite3_prepare_v2(source, "ATTACH DATABASE ? AS backup KEY ?", -1,
+                           &attach, nullptr);
+  }
+  if (r == SQLITE_OK) {
+    r = sqlite3_bind_text(attach, 1, temp_path_.data(), temp_path_.size(),
+                          SQLITE_STATIC);
+  }
+  if (r == SQLITE_OK) {
+    r = sqlite3_bind_text(attach, 2, key_.data(), key_.size(), SQLITE_STATIC);
+  }
+  if (r == SQLITE_OK) {
+    r = sqlite3_step(attach);
+    if (r == SQLITE_DONE) {
+      r = SQLITE_OK;
+    }
+  }
+  sqlite3_finalize(attach);
+
+  // Runs in a single transaction on both databases
+  if (r == SQLITE_OK) {
+    r = sqlite3_exec(source, "SELECT sqlcipher_export('backup')", nullptr,
+                     nullptr, nullptr);
+    if (r == SQLITE_OK) {
+      r = sqlite3_exec(source, "DETACH DATABASE backup", nullptr, nullptr,
+                       nullptr);
+    }
+  }
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(source));
+    return false;
+  }
+
+  uint64_t data[2] = {static_cast<uint64_t>(total),
+                      static_cast<uint64_t>(total)};
+  progress.Send(data, 2);
+  return true;
+}
+
+void BackupWorker::OnProgress(const uint64_t* data, size_t count) {
+  if (on_progress_.IsEmpty() || count != 2) {
+    return;
+  }
+
+  auto env = Env();
+  Napi::HandleScope scope(env);
+  on_progress_.Call({Napi::Number::New(env, static_cast<double>(data[0])),
+                     Napi::Number::New(env, static_cast<double>(data[1]))});
+}
+
+void BackupWorker::OnOK() {
+  deferred_.Resolve(Env().Undefined());
+}
+
+void BackupWorker::OnError(const Napi::Error& e) {
+  Cleanup();
+  deferred_.Reject(e.Value());
+}
+
+void BackupWorker::Cleanup() {
+  remove(temp_path_.c_str());
+  remove((temp_path_ + "-journal").c_str());
+}
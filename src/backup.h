@@ -0,0 +1,78 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_BACKUP_H_
+#define SRC_BACKUP_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "addon.h"
+#include "napi.h"
+#include "sqlite3.h"
+
+// Copies the database into another file on a worker thread, from a side
+// connection, without blocking the main connection.
+//
+// The copy is written to `dest_path + "-backup"` and renamed over
+// `dest_path` once complete, so `dest_path` either has the previous backup or
+// the new one. The destination can be encrypted with the key of the
+// database, with another key, or not at all.
+//
+// The database is copied with the backup API, `pages_per_step` pages at a
+// time with a `sleep_ms` pause in between. In WAL mode the source
+// connection keeps a read transaction open for the whole copy so that the
+// copy is a consistent snapshot that isn't restarted by concurrent writes. In
+// rollback journal modes locks are released between the steps and writes
+// restart the copy. The backup API can't change whether pages are encrypted,
+// so copies from encrypted databases to plaintext files (and the other way
+// around) use `sqlcipher_export()` in a single step instead.
+class BackupWorker : public Napi::AsyncProgressWorker<uint64_t> {
+ public:
+  static constexpr int kDefaultPagesPerStep = 1024;
+
+  enum DestinationKey {
+    // The raw key and cipher settings of the database
+    kSameKey,
+    kNoKey,
+    kNewKey,
+  };
+
+  BackupWorker(Napi::Env env,
+               ConnectionConfig config,
+               std::string dest_path,
+               DestinationKey dest_key,
+               std::string key,
+               int pages_per_step,
+               int sleep_ms,
+               Napi::Function on_progress);
+  ~BackupWorker();
+
+  inline Napi::Promise Promise() { return deferred_.Promise(); }
+
+ protected:
+  void Execute(const ExecutionProgress& progress) override;
+  void OnProgress(const uint64_t* data, size_t count) override;
+  void OnOK() override;
+  void OnError(const Napi::Error& e) override;
+
+ private:
+  // Both return `false` and call `SetError` on failure
+  bool Copy(sqlite3* source, const ExecutionProgress& progress);
+  bool Export(sqlite3* source, const ExecutionProgress& progress);
+
+  void Cleanup();
+
+  Napi::Promise::Deferred deferred_;
+  Napi::FunctionReference on_progress_;
+  ConnectionConfig config_;
+  std::string dest_path_;
+  std::string temp_path_;
+  int pages_per_step_;
+  int sleep_ms_;
+
+  // Passphrase or raw key of the destination, empty for plaintext
+  std::string key_;
+};
+
+#endif  // SRC_BACKUP_H_
@@ -0,0 +1,60 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "busy_handler.h"
+
+#include <algorithm>
+#include <thread>
+
+BusyHandler::BusyHandler() : random_(std::random_device()()) {}
+
+int BusyHandler::Install(sqlite3* handle, const Options& options) {
+  options_ = options;
+  return sqlite3_busy_handler(handle, Callback, this);
+}
+
+int BusyHandler::Callback(void* arg, int count) {
+  return static_cast<BusyHandler*>(arg)->Wait(count) ? 1 : 0;
+}
+
+bool BusyHandler::Wait(int count) {
+  using std::chrono::microseconds;
+  using std::chrono::steady_clock;
+
+  auto now = steady_clock::now();
+  if (count == 0) {
+    start_ = now;
+    current_wait_us_ = 0;
+    stats_.waits++;
+  }
+
+  auto elapsed_us =
+      std::chrono::duration_cast<microseconds>(now - start_).count();
+  int64_t remaining_us =
+      static_cast<int64_t>(options_.timeout_ms) * 1000 - elapsed_us;
+  if (remaining_us <= 0) {
+    stats_.timeouts++;
+    return false;
+  }
+
+  // Avoid overflowing the shift, the delay is capped anyway
+  int64_t delay_us = static_cast<int64_t>(options_.initial_delay_ms) * 1000
+                     << std::min(count, 20);
+  delay_us = std::min(delay_us,
+                      static_cast<int64_t>(options_.max_delay_ms) * 1000);
+
+  // Spread the retries of competing connections
+  std::uniform_int_distribution<int64_t> jitter(delay_us / 2, delay_us);
+  delay_us = std::min(jitter(random_), remaining_us);
+
+  std::this_thread::sleep_for(microseconds(delay_us));
+
+  auto slept_us = std::chrono::duration_cast<microseconds>(
+                      steady_clock::now() - now)
+                      .count();
+  stats_.retries++;
+  stats_.total_wait_us += slept_us;
+  current_wait_us_ += slept_us;
+  stats_.max_wait_us = std::max(stats_.max_wait_us, current_wait_us_);
+  return true;
+}
@@ -0,0 +1,66 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_BUSY_HANDLER_H_
+#define SRC_BUSY_HANDLER_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <random>
+
+#include "sqlite3.h"
+
+// A busy handler retrying with exponential backoff and jitter until a
+// deadline, counting how often and how long the connection waited for locks.
+//
+// The n-th retry of a wait sleeps for a random duration between half and all
+// of `min(initial_delay_ms * 2^n, max_delay_ms)`, never past the deadline.
+// Only called on the thread using the connection, so no locking is needed.
+class BusyHandler {
+ public:
+  struct Options {
+    // Total time to wait for a lock before failing with `SQLITE_BUSY`
+    int timeout_ms = 5000;
+    int initial_delay_ms = 1;
+    int max_delay_ms = 100;
+  };
+
+  struct Stats {
+    // Lock acquisitions that had to wait
+    uint64_t waits;
+
+    // Sleeps between retries
+    uint64_t retries;
+
+    // Waits that reached the deadline and failed with `SQLITE_BUSY`
+    uint64_t timeouts;
+
+    // Time spent sleeping, in total and during the longest wait
+    uint64_t total_wait_us;
+    uint64_t max_wait_us;
+  };
+
+  BusyHandler();
+
+  // Installs the handler on `handle` with `options`, replacing any busy
+  // handler or timeout. Stats are kept.
+  int Install(sqlite3* handle, const Options& options);
+
+  inline const Stats& stats() const { return stats_; }
+
+ private:
+  static int Callback(void* arg, int count);
+
+  // Returns `false` when the deadline is reached
+  bool Wait(int count);
+
+  Options options_;
+  Stats stats_ = {};
+  std::minstd_rand random_;
+
+  // Start of the current wait (`count == 0`)
+  std::chrono::steady_clock::time_point start_;
+  uint64_t current_wait_us_ = 0;
+};
+
+#endif  // SRC_BUSY_HANDLER_H_
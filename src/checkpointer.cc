@@ -0,0 +1,219 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "checkpointer.h"
+
+#include <string.h>
+#include <algorithm>
+
+// Restored when the checkpointer is stopped, same as SQLite's default
+static constexpr int kDefaultAutocheckpoint = 1000;
+
+// Frame header in front of every page in the WAL
+static constexpr int kFrameHeaderSize = 24;
+
+std::unique_ptr<Checkpointer> Checkpointer::Start(
+    sqlite3* db,
+    const ConnectionConfig& config,
+    const char* vfs,
+    const Options& options,
+    std::string* error) {
+  sqlite3* handle = nullptr;
+  int r = config.Open(&handle, SQLITE_OPEN_READWRITE, vfs, error);
+  if (r != SQLITE_OK) {
+    return nullptr;
+  }
+
+  // Reading the schema verifies the key
+  int count = 0;
+  int page_size = 0;
+  r = QueryInt(handle, "SELECT count(*) FROM sqlite_schema", &count);
+  if (r == SQLITE_OK) {
+    r = QueryInt(handle, "PRAGMA page_size", &page_size);
+  }
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+    sqlite3_close(handle);
+    return nullptr;
+  }
+
+  std::unique_ptr<Checkpointer> checkpointer(
+      new Checkpointer(db, handle, options));
+  checkpointer->stats_.frame_size = page_size + kFrameHeaderSize;
+  checkpointer->thread_ = std::thread(&Checkpointer::Run, checkpointer.get());
+
+  // Replaces the autocheckpoint
+  sqlite3_wal_hook(db, WalHook, checkpointer.get());
+  return checkpointer;
+}
+
+Checkpointer::Checkpointer(sqlite3* db,
+                           sqlite3* handle,
+                           const Options& options)
+    : db_(db),
+      handle_(handle),
+      options_(options),
+      checkpoint_at_(options.frames) {}
+
+Checkpointer::~Checkpointer() {
+  sqlite3_wal_autocheckpoint(db_, kDefaultAutocheckpoint);
+
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+
+  sqlite3_close(handle_);
+}
+
+Checkpointer::Stats Checkpointer::stats() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return stats_;
+}
+
+int Checkpointer::WalHook(void* arg,
+                          sqlite3* db,
+                          const char* name,
+                          int frames) {
+  // Attached databases keep their (lack of) checkpoints
+  if (strcmp(name, "main") != 0) {
+    return SQLITE_OK;
+  }
+
+  auto checkpointer = static_cast<Checkpointer*>(arg);
+  bool should_notify;
+  {
+    std::lock_guard<std::mutex> lock(checkpointer->mu_);
+    auto wal_frames = static_cast<uint64_t>(frames);
+
+    // The WAL was restarted
+    if (wal_frames < checkpointer->stats_.wal_frames) {
+      checkpointer->backfilled_ = 0;
+      checkpointer->checkpoint_at_ = checkpointer->options_.frames;
+    }
+
+    // Wake up the thread to start the idle timer or for a checkpoint. A
+    // running timer is extended when it expires.
+    should_notify = !checkpointer->is_dirty_;
+    if (wal_frames >= checkpointer->checkpoint_at_) {
+      checkpointer->is_requested_ = true;
+      checkpointer->checkpoint_at_ = wal_frames + checkpointer->options_.frames;
+      should_notify = true;
+    }
+
+    checkpointer->stats_.wal_frames = wal_frames;
+    checkpointer->is_dirty_ = true;
+    checkpointer->last_commit_ = std::chrono::steady_clock::now();
+  }
+  if (should_notify) {
+    checkpointer->cv_.notify_all();
+  }
+  return SQLITE_OK;
+}
+
+void Checkpointer::Run() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stop_) {
+    if (is_requested_) {
+      is_requested_ = false;
+      bool is_large =
+          stats_.wal_frames >= static_cast<uint64_t>(options_.restart_frames);
+      lock.unlock();
+      Checkpoint(is_large ? SQLITE_CHECKPOINT_RESTART
+                          : SQLITE_CHECKPOINT_PASSIVE);
+      lock.lock();
+      continue;
+    }
+
+    if (!is_dirty_) {
+      cv_.wait(lock);
+      continue;
+    }
+
+    auto idle_deadline =
+        last_commit_ + std::chrono::milliseconds(options_.idle_ms);
+    if (std::chrono::steady_clock::now() < idle_deadline) {
+      cv_.wait_until(lock, idle_deadline);
+      continue;
+    }
+
+    // Retried after the next commit if starved
+    is_dirty_ = false;
+    lock.unlock();
+    Checkpoint(SQLITE_CHECKPOINT_TRUNCATE);
+    lock.lock();
+  }
+}
+
+void Checkpointer::Checkpoint(int mode) {
+  using std::chrono::microseconds;
+  using std::chrono::steady_clock;
+
+  auto start = steady_clock::now();
+  int log = -1;
+  int checkpointed = -1;
+  int r =
+      sqlite3_wal_checkpoint_v2(handle_, "main", mode, &log, &checkpointed);
+
+  // The connection opens the WAL on its first read after the database
+  // switched to WAL mode
+  if (r == SQLITE_OK && log < 0) {
+    int count;
+    r = QueryInt(handle_, "SELECT count(*) FROM sqlite_schema", &count);
+    if (r == SQLITE_OK) {
+      r = sqlite3_wal_checkpoint_v2(handle_, "main", mode, &log,
+                                    &checkpointed);
+    }
+  }
+  uint64_t us =
+      std::chrono::duration_cast<microseconds>(steady_clock::now() - start)
+          .count();
+
+  std::lock_guard<std::mutex> lock(mu_);
+  if (r != SQLITE_OK && r != SQLITE_BUSY) {
+    stats_.errors++;
+    return;
+  }
+
+  stats_.total_us += us;
+  stats_.max_us = std::max(stats_.max_us, us);
+  stats_.last_us = us;
+
+  // Checkpoints copy frames up to the oldest snapshot of the readers (which
+  // includes the main connection while it writes), partial progress is fine.
+  uint64_t previous = backfilled_;
+  bool is_stuck = checkpointed < log && checkpointed >= 0 &&
+                  static_cast<uint64_t>(checkpointed) <= previous;
+  if (r == SQLITE_BUSY || is_stuck) {
+    stats_.starved++;
+  } else if (mode == SQLITE_CHECKPOINT_PASSIVE) {
+    stats_.passive++;
+  } else if (mode == SQLITE_CHECKPOINT_RESTART) {
+    stats_.restart++;
+  } else {
+    stats_.truncate++;
+  }
+
+  // Not in WAL mode
+  if (log < 0) {
+    return;
+  }
+
+  // Frames written by the main connection in the meantime are reported by
+  // the next commit.
+  if (checkpointed > 0) {
+    auto frames = static_cast<uint64_t>(checkpointed);
+    stats_.checkpointed_frames += frames - std::min(frames, previous);
+    backfilled_ = frames;
+  }
+  // Truncating checkpoints report an empty WAL
+  if (mode == SQLITE_CHECKPOINT_TRUNCATE && r == SQLITE_OK) {
+    stats_.checkpointed_frames +=
+        stats_.wal_frames - std::min(stats_.wal_frames, previous);
+    stats_.wal_frames = 0;
+    backfilled_ = 0;
+    checkpoint_at_ = options_.frames;
+  }
+}
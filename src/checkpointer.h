@@ -0,0 +1,117 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_CHECKPOINTER_H_
+#define SRC_CHECKPOINTER_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "addon.h"
+#include "sqlite3.h"
+
+// Checkpoints the WAL of a connection on a background thread, from its own
+// connection, instead of inline in whichever commit crosses the
+// autocheckpoint threshold.
+//
+// The thread is woken up by the WAL hook of the connection (which replaces
+// the autocheckpoint) once `frames` frames were written since the last
+// checkpoint, and runs a `PASSIVE` checkpoint that never blocks readers or
+// writers. Once the WAL grows past `restart_frames` a `RESTART` checkpoint is
+// attempted instead so that the next writer starts over at the beginning of
+// the file, and after `idle_ms` without commits the WAL is truncated. The
+// checkpointer connection has no busy handler: a `RESTART` or `TRUNCATE`
+// checkpoint that would have to wait for readers or writers fails right away
+// and is counted as starved.
+class Checkpointer {
+ public:
+  struct Options {
+    int frames = 1000;
+    int restart_frames = 10000;
+    int idle_ms = 1000;
+  };
+
+  struct Stats {
+    // Frames in the WAL as of the last commit or checkpoint
+    uint64_t wal_frames;
+
+    // Size of a WAL frame (page and frame header)
+    uint64_t frame_size;
+
+    // Completed checkpoints by mode
+    uint64_t passive;
+    uint64_t restart;
+    uint64_t truncate;
+
+    // Checkpoints that made no progress because of readers, or couldn't
+    // restart or truncate the WAL
+    uint64_t starved;
+
+    // Checkpoints that failed with an error other than `SQLITE_BUSY`
+    uint64_t errors;
+
+    uint64_t checkpointed_frames;
+
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t last_us;
+  };
+
+  // Opens the checkpointer connection and installs the WAL hook on `db`.
+  // Returns `nullptr` and sets `error` on failure.
+  static std::unique_ptr<Checkpointer> Start(sqlite3* db,
+                                             const ConnectionConfig& config,
+                                             const char* vfs,
+                                             const Options& options,
+                                             std::string* error);
+
+  // Stops the thread and restores the default autocheckpoint of the
+  // connection.
+  ~Checkpointer();
+
+  Stats stats();
+
+ private:
+  Checkpointer(sqlite3* db, sqlite3* handle, const Options& options);
+
+  static int WalHook(void* arg, sqlite3* db, const char* name, int frames);
+
+  void Run();
+  void Checkpoint(int mode);
+
+  // Connection whose WAL hook is installed
+  sqlite3* db_;
+
+  // Checkpointer connection, used on the thread only
+  sqlite3* handle_;
+
+  Options options_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+
+  // Frames copied back by the last checkpoint, reset when the WAL is
+  // restarted
+  uint64_t backfilled_ = 0;
+
+  // Size of the WAL (in frames) at which the WAL hook requests the next
+  // checkpoint. Advanced by `frames` on every request so that a checkpoint
+  // starved by a long-running reader is not retried on every commit.
+  uint64_t checkpoint_at_;
+  bool is_requested_ = false;
+
+  // A checkpoint is needed once the idle timer expires
+  bool is_dirty_ = false;
+  std::chrono::steady_clock::time_point last_commit_;
+
+  Stats stats_ = {};
+  std::thread thread_;
+};
+
+#endif  // SRC_CHECKPOINTER_H_
@@ -0,0 +1,280 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "fts_indexer.h"
+
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+std::unique_ptr<FtsIndexer> FtsIndexer::Start(sqlite3* db,
+                                              const ConnectionConfig& config,
+                                              const char* vfs,
+                                              const std::string& table,
+                                              const Options& options,
+                                              std::string* error) {
+  sqlite3* handle = nullptr;
+  int r = config.Open(&handle, SQLITE_OPEN_READWRITE, vfs, error);
+  if (r != SQLITE_OK) {
+    return nullptr;
+  }
+  std::string queue = table + "_queue";
+  std::unique_ptr<FtsIndexer> indexer(
+      new FtsIndexer(db, handle, queue, options));
+
+  // The table can't be read without its tokenizer
+  r = RegisterSignalTokenizer(handle, nullptr);
+
+  // Columns of the FTS5 table, also read from `content`
+  std::string columns;
+  sqlite3_stmt* stmt = nullptr;
+  if (r == SQLITE_OK) {
+    r = sqlite3_prepare_v2(handle, "SELECT name FROM pragma_table_info(?1)",
+                           -1, &stmt, nullptr);
+  }
+  if (r == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, table.c_str(), table.size(), SQLITE_STATIC);
+    while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+      auto name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+      columns += ", " + QuoteIdentifier(name != nullptr ? name : "");
+    }
+    r = sqlite3_finalize(stmt);
+  }
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+    return nullptr;
+  }
+  if (columns.empty()) {
+    *error = FormatString("no such table: %s", table.c_str());
+    return nullptr;
+  }
+
+  // Created by `db` (which queues the rows), the indexer connection would
+  // have to wait for its transaction
+  std::string create =
+      "CREATE TABLE IF NOT EXISTS " + QuoteIdentifier(queue) +
+      " (rowid INTEGER PRIMARY KEY, queued_at INTEGER NOT NULL DEFAULT "
+      "(CAST(unixepoch('subsec') * 1000 AS INTEGER)))";
+  if (sqlite3_exec(db, create.c_str(), nullptr, nullptr, nullptr) !=
+      SQLITE_OK) {
+    *error = SqliteErrorMessage(db);
+    return nullptr;
+  }
+
+  auto fts = QuoteIdentifier(table);
+  auto quoted_queue = QuoteIdentifier(queue);
+  std::string queries[kQueryCount];
+  queries[kBound] = "SELECT max(rowid) FROM (SELECT rowid FROM " +
+                    quoted_queue + " ORDER BY rowid LIMIT ?1)";
+  queries[kInsert] = "INSERT INTO " + fts + "(rowid" + columns +
+                     ") SELECT rowid" + columns + " FROM " +
+                     QuoteIdentifier(options.content) +
+                     " WHERE rowid IN (SELECT rowid FROM " + quoted_queue +
+                     " WHERE rowid <= ?1)";
+  queries[kDelete] = "DELETE FROM " + quoted_queue + " WHERE rowid <= ?1";
+  queries[kMerge] =
+      "INSERT INTO " + fts + "(" + fts + ", rank) VALUES('merge', ?1)";
+  queries[kDepth] = "SELECT count(*), min(queued_at) FROM " + quoted_queue;
+  for (int i = 0; i < kQueryCount; i++) {
+    r = sqlite3_prepare_v3(handle, queries[i].c_str(), queries[i].size(),
+                           SQLITE_PREPARE_PERSISTENT, &indexer->stmts_[i],
+                           nullptr);
+    if (r != SQLITE_OK) {
+      *error = SqliteErrorMessage(handle);
+      return nullptr;
+    }
+  }
+
+  // A batch waits for the transactions of other connections
+  sqlite3_busy_timeout(handle, options.interval_ms);
+
+  indexer->thread_ = std::thread(&FtsIndexer::Run, indexer.get());
+  sqlite3_update_hook(db, UpdateHook, indexer.get());
+  return indexer;
+}
+
+FtsIndexer::FtsIndexer(sqlite3* db,
+                       sqlite3* handle,
+                       std::string queue,
+                       const Options& options)
+    : db_(db), handle_(handle), queue_(std::move(queue)), options_(options) {}
+
+FtsIndexer::~FtsIndexer() {
+  if (thread_.joinable()) {
+    sqlite3_update_hook(db_, nullptr, nullptr);
+
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  for (auto stmt : stmts_) {
+    sqlite3_finalize(stmt);
+  }
+  sqlite3_close(handle_);
+}
+
+FtsIndexer::Stats FtsIndexer::stats() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return stats_;
+}
+
+void FtsIndexer::UpdateHook(void* arg,
+                            int op,
+                            const char* database,
+                            const char* table,
+                            sqlite3_int64 rowid) {
+  auto indexer = static_cast<FtsIndexer*>(arg);
+  if (op != SQLITE_INSERT || strcmp(database, "main") != 0 ||
+      sqlite3_stricmp(table, indexer->queue_.c_str()) != 0) {
+    return;
+  }
+
+  bool should_notify;
+  {
+    std::lock_guard<std::mutex> lock(indexer->mu_);
+    should_notify = !indexer->is_queued_;
+    indexer->is_queued_ = true;
+  }
+  if (should_notify) {
+    indexer->cv_.notify_all();
+  }
+}
+
+void FtsIndexer::Run() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stop_) {
+    lock.unlock();
+    bool is_done = IndexBatch();
+    lock.lock();
+    if (!is_done) {
+      continue;
+    }
+
+    if (!is_queued_) {
+      cv_.wait_for(lock, std::chrono::milliseconds(options_.interval_ms),
+                   [this] { return stop_ || is_queued_; });
+    }
+    if (is_queued_) {
+      // Rows queued in the meantime are indexed in the same batch
+      cv_.wait_for(lock, std::chrono::milliseconds(options_.delay_ms),
+                   [this] { return stop_; });
+      is_queued_ = false;
+    }
+  }
+}
+
+bool FtsIndexer::IndexBatch() {
+  using std::chrono::microseconds;
+  using std::chrono::steady_clock;
+
+  auto start = steady_clock::now();
+  uint64_t indexed_rows = 0;
+  uint64_t dequeued_rows = 0;
+  int r = RunBatch(&indexed_rows, &dequeued_rows);
+  uint64_t us =
+      std::chrono::duration_cast<microseconds>(steady_clock::now() - start)
+          .count();
+
+  ReadDepth();
+
+  std::lock_guard<std::mutex> lock(mu_);
+  // Busy batches are retried on the next wake up
+  if (r != SQLITE_OK) {
+    if ((r & 0xff) != SQLITE_BUSY) {
+      stats_.errors++;
+    }
+    return true;
+  }
+  if (dequeued_rows == 0) {
+    return true;
+  }
+
+  stats_.indexed_rows += indexed_rows;
+  stats_.batches++;
+  stats_.total_us += us;
+  stats_.max_us = std::max(stats_.max_us, us);
+  stats_.last_us = us;
+  return dequeued_rows < static_cast<uint64_t>(options_.batch_size);
+}
+
+int FtsIndexer::ReadBound(sqlite3_int64* bound, bool* has_rows) {
+  auto stmt = stmts_[kBound];
+  sqlite3_bind_int(stmt, 1, options_.batch_size);
+  int r = sqlite3_step(stmt);
+  if (r == SQLITE_ROW) {
+    *has_rows = sqlite3_column_type(stmt, 0) != SQLITE_NULL;
+    *bound = sqlite3_column_int64(stmt, 0);
+    r = SQLITE_OK;
+  }
+  sqlite3_reset(stmt);
+  return r;
+}
+
+int FtsIndexer::RunBatch(uint64_t* indexed_rows, uint64_t* dequeued_rows) {
+  // Polls only read the queue, so that they don't take the write lock from
+  // the writers of other connections
+  sqlite3_int64 bound = 0;
+  bool has_rows = false;
+  int r = ReadBound(&bound, &has_rows);
+  if (r != SQLITE_OK || !has_rows) {
+    return r;
+  }
+
+  r = sqlite3_exec(handle_, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+
+  // Last rowid of the batch, which may have been dequeued in the meantime
+  has_rows = false;
+  r = ReadBound(&bound, &has_rows);
+
+  // Rows deleted since they were queued are skipped
+  auto stmt = stmts_[kInsert];
+  if (r == SQLITE_OK && has_rows) {
+    sqlite3_bind_int64(stmt, 1, bound);
+    r = sqlite3_step(stmt);
+    *indexed_rows = static_cast<uint64_t>(sqlite3_changes64(handle_));
+    sqlite3_reset(stmt);
+  }
+  if (r == SQLITE_DONE) {
+    stmt = stmts_[kDelete];
+    sqlite3_bind_int64(stmt, 1, bound);
+    r = sqlite3_step(stmt);
+    *dequeued_rows = static_cast<uint64_t>(sqlite3_changes64(handle_));
+    sqlite3_reset(stmt);
+  }
+  if (r == SQLITE_DONE && options_.merge_pages > 0) {
+    stmt = stmts_[kMerge];
+    sqlite3_bind_int(stmt, 1, options_.merge_pages);
+    r = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  if (r == SQLITE_DONE) {
+    r = SQLITE_OK;
+  }
+
+  if (r == SQLITE_OK) {
+    r = sqlite3_exec(handle_, "COMMIT", nullptr, nullptr, nullptr);
+  }
+  if (r != SQLITE_OK) {
+    sqlite3_exec(handle_, "ROLLBACK", nullptr, nullptr, nullptr);
+    *indexed_rows = 0;
+    *dequeued_rows = 0;
+  }
+  return r;
+}
+
+void FtsIndexer::ReadDepth() {
+  auto stmt = stmts_[kDepth];
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    std::lock_guard<std::mutex> lock(mu_);
+    stats_.queue_depth = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+    stats_.oldest_queued_ms = sqlite3_column_int64(stmt, 1);
+  }
+  sqlite3_reset(stmt);
+}
@@ -0,0 +1,133 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_FTS_INDEXER_H_
+#define SRC_FTS_INDEXER_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "addon.h"
+#include "sqlite3.h"
+
+// Indexes the rows of an FTS5 table on a background thread, from its own
+// connection, instead of inline in the transaction that writes them.
+//
+// Writers only insert the rowids of new rows into the queue table
+// `<table>_queue` (e.g. from the insert trigger of the content table), which
+// is created by `Start`. The thread reads the columns of the FTS5 table from
+// the rows of `content` with the same rowids, `batch_size` rows per
+// transaction, and optionally runs an FTS5 `merge` of `merge_pages` pages
+// after every batch.
+//
+// The queue is read before the write lock is taken, so that polls don't
+// block the writers of other connections. Batches do, so these should wait
+// with a busy handler.
+//
+// The thread is woken up `delay_ms` after the connection queued a row
+// (through its update hook), so that the rows of a few transactions are
+// indexed together. Rows queued by other connections are found by polling
+// every `interval_ms`.
+class FtsIndexer {
+ public:
+  struct Options {
+    std::string content;
+    int batch_size = 500;
+    int delay_ms = 100;
+    int interval_ms = 1000;
+    int merge_pages = 0;
+  };
+
+  struct Stats {
+    // Rows in the queue as of the last batch or poll
+    uint64_t queue_depth;
+
+    // `queued_at` of the oldest of these rows, in milliseconds since the
+    // epoch
+    int64_t oldest_queued_ms;
+
+    uint64_t indexed_rows;
+    uint64_t batches;
+
+    // Batches that failed with an error other than `SQLITE_BUSY`
+    uint64_t errors;
+
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t last_us;
+  };
+
+  // Creates the queue table, opens the indexer connection and installs the
+  // update hook on `db`. Returns `nullptr` and sets `error` on failure.
+  static std::unique_ptr<FtsIndexer> Start(sqlite3* db,
+                                           const ConnectionConfig& config,
+                                           const char* vfs,
+                                           const std::string& table,
+                                           const Options& options,
+                                           std::string* error);
+
+  // Stops the thread and removes the update hook
+  ~FtsIndexer();
+
+  Stats stats();
+
+ private:
+  enum Query {
+    kBound,
+    kInsert,
+    kDelete,
+    kMerge,
+    kDepth,
+    kQueryCount,
+  };
+
+  FtsIndexer(sqlite3* db,
+             sqlite3* handle,
+             std::string queue,
+             const Options& options);
+
+  static void UpdateHook(void* arg,
+                         int op,
+                         const char* database,
+                         const char* table,
+                         sqlite3_int64 rowid);
+
+  void Run();
+
+  // Returns `false` if there are more rows to index
+  bool IndexBatch();
+  int RunBatch(uint64_t* indexed_rows, uint64_t* dequeued_rows);
+
+  // Last rowid of the next batch, `has_rows` is `false` if the queue is empty
+  int ReadBound(sqlite3_int64* bound, bool* has_rows);
+  void ReadDepth();
+
+  // Connection whose update hook is installed
+  sqlite3* db_;
+
+  // Indexer connection, used on the thread only
+  sqlite3* handle_;
+  sqlite3_stmt* stmts_[kQueryCount] = {};
+
+  // Unquoted name of the queue table
+  std::string queue_;
+
+  Options options_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+
+  // A row was queued by `db_`
+  bool is_queued_ = false;
+
+  Stats stats_ = {};
+  std::thread thread_;
+};
+
+#endif  // SRC_FTS_INDEXER_H_
@@ -0,0 +1,307 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "fts_merger.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+
+// Row of `%_data` with the structure record
+constexpr int kStructureRowid = 10;
+
+// Marks structure records with segment origins (since SQLite 3.44)
+constexpr uint8_t kStructureV2[] = {0xff, 0x00, 0x00, 0x01};
+
+// Limits of the pages merged by a step
+constexpr int kInitialPages = 64;
+constexpr int kMaxPages = 16384;
+
+// Reads an SQLite varint. Returns the number of bytes read, or 0 if the
+// varint doesn't end before `end`.
+size_t GetVarint(const uint8_t* p, const uint8_t* end, uint64_t* value) {
+  uint64_t result = 0;
+  for (size_t i = 0; i < 9 && p + i < end; i++) {
+    if (i == 8) {
+      *value = (result << 8) | p[i];
+      return 9;
+    }
+    result = (result << 7) | (p[i] & 0x7f);
+    if ((p[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+bool ParseStructure(const uint8_t* data, size_t size, FtsStructure* result) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + size;
+
+  // Cookie
+  if (size < 4) {
+    return false;
+  }
+  p += 4;
+
+  bool is_v2 = static_cast<size_t>(end - p) >= sizeof(kStructureV2) &&
+               memcmp(p, kStructureV2, sizeof(kStructureV2)) == 0;
+  if (is_v2) {
+    p += sizeof(kStructureV2);
+  }
+
+  // Level count, segment count, write counter and (v2) origin counter
+  uint64_t header[4];
+  for (int i = 0; i < (is_v2 ? 4 : 3); i++) {
+    size_t n = GetVarint(p, end, &header[i]);
+    if (n == 0) {
+      return false;
+    }
+    p += n;
+  }
+  // Same limit as FTS5 (`FTS5_MAX_SEGMENT`)
+  if (header[0] > 2000 || header[1] > 2000) {
+    return false;
+  }
+
+  result->segments = static_cast<uint32_t>(header[1]);
+  result->levels.resize(header[0]);
+  for (auto& level : result->levels) {
+    uint64_t merging;
+    uint64_t segments;
+    size_t n = GetVarint(p, end, &merging);
+    size_t m = n == 0 ? 0 : GetVarint(p + n, end, &segments);
+    if (m == 0 || segments > 2000) {
+      return false;
+    }
+    p += n + m;
+
+    level.segments = static_cast<uint32_t>(segments);
+    level.merging = static_cast<uint32_t>(merging);
+    level.pages = 0;
+
+    // Segment id, first and last leaf page and (v2) origins, tombstone
+    // pages, tombstone entries and entries
+    for (uint64_t i = 0; i < segments; i++) {
+      uint64_t fields[8];
+      for (int j = 0; j < (is_v2 ? 8 : 3); j++) {
+        n = GetVarint(p, end, &fields[j]);
+        if (n == 0) {
+          return false;
+        }
+        p += n;
+      }
+      if (fields[2] >= fields[1]) {
+        level.pages += fields[2] - fields[1] + 1;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int ReadFtsStructure(sqlite3* handle,
+                     const std::string& table,
+                     FtsStructure* structure) {
+  std::string sql = "SELECT block FROM " + QuoteIdentifier(table + "_data") +
+                    " WHERE id = ?1";
+  sqlite3_stmt* stmt = nullptr;
+  int r = sqlite3_prepare_v2(handle, sql.c_str(), sql.size(), &stmt, nullptr);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+
+  *structure = FtsStructure();
+  sqlite3_bind_int(stmt, 1, kStructureRowid);
+  r = sqlite3_step(stmt);
+  if (r == SQLITE_ROW) {
+    auto data = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0));
+    int size = sqlite3_column_bytes(stmt, 0);
+    r = ParseStructure(data, size, structure) ? SQLITE_OK : SQLITE_CORRUPT;
+  } else if (r == SQLITE_DONE) {
+    // Not written yet
+    r = SQLITE_OK;
+  }
+  sqlite3_finalize(stmt);
+  return r;
+}
+
+std::unique_ptr<FtsMerger> FtsMerger::Start(const ConnectionConfig& config,
+                                            const char* vfs,
+                                            const std::string& table,
+                                            const Options& options,
+                                            std::string* error) {
+  sqlite3* handle = nullptr;
+  int r = config.Open(&handle, SQLITE_OPEN_READWRITE, vfs, error);
+  if (r != SQLITE_OK) {
+    return nullptr;
+  }
+
+  // The table can't be written without its tokenizer
+  r = RegisterSignalTokenizer(handle, nullptr);
+
+  auto fts = QuoteIdentifier(table);
+  auto sql = "INSERT INTO " + fts + "(" + fts + ", rank) VALUES('merge', ?1)";
+  sqlite3_stmt* merge = nullptr;
+  if (r == SQLITE_OK) {
+    r = sqlite3_prepare_v3(handle, sql.c_str(), sql.size(),
+                           SQLITE_PREPARE_PERSISTENT, &merge, nullptr);
+  }
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+    sqlite3_close(handle);
+    return nullptr;
+  }
+
+  std::unique_ptr<FtsMerger> merger(
+      new FtsMerger(handle, merge, table, options));
+  merger->stats_.pages = kInitialPages;
+  merger->UpdateStructure();
+  merger->thread_ = std::thread(&FtsMerger::Run, merger.get());
+  return merger;
+}
+
+FtsMerger::FtsMerger(sqlite3* handle,
+                     sqlite3_stmt* merge,
+                     std::string table,
+                     const Options& options)
+    : handle_(handle),
+      merge_(merge),
+      table_(std::move(table)),
+      options_(options) {}
+
+FtsMerger::~FtsMerger() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+
+  sqlite3_finalize(merge_);
+  sqlite3_close(handle_);
+}
+
+FtsMerger::Stats FtsMerger::stats() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return stats_;
+}
+
+void FtsMerger::Run() {
+  auto idle = std::chrono::milliseconds(options_.idle_ms);
+  auto pause = std::chrono::milliseconds(options_.budget_ms);
+
+  // Segments written before the merger started might have to be merged
+  bool is_dirty = true;
+  int version = DataVersion();
+
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!cv_.wait_for(lock, idle, [this] { return stop_; })) {
+    lock.unlock();
+
+    int current = DataVersion();
+    if (current != version) {
+      version = current;
+      is_dirty = true;
+      UpdateStructure();
+    } else if (is_dirty) {
+      // Until there is nothing left to merge or another connection writes.
+      // Failed steps are retried once idle again.
+      while (true) {
+        bool has_merged = false;
+        if (Step(&has_merged) != SQLITE_OK) {
+          break;
+        }
+        if (!has_merged) {
+          is_dirty = false;
+          break;
+        }
+
+        lock.lock();
+        bool is_stopped = cv_.wait_for(lock, pause, [this] { return stop_; });
+        lock.unlock();
+        if (is_stopped) {
+          break;
+        }
+
+        current = DataVersion();
+        if (current != version) {
+          version = current;
+          break;
+        }
+      }
+    }
+
+    lock.lock();
+  }
+}
+
+int FtsMerger::Step(bool* has_merged) {
+  using std::chrono::microseconds;
+  using std::chrono::steady_clock;
+
+  int pages;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    pages = stats_.pages;
+  }
+
+  auto start = steady_clock::now();
+  auto changes = sqlite3_total_changes64(handle_);
+  sqlite3_bind_int(merge_, 1, pages);
+  int r = sqlite3_step(merge_);
+  sqlite3_reset(merge_);
+  uint64_t us =
+      std::chrono::duration_cast<microseconds>(steady_clock::now() - start)
+          .count();
+
+  if (r != SQLITE_DONE) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if ((r & 0xff) != SQLITE_BUSY) {
+      stats_.errors++;
+    }
+    return r;
+  }
+
+  // Fewer than 2 changes if there was nothing to merge
+  *has_merged = sqlite3_total_changes64(handle_) - changes >= 2;
+  if (!*has_merged) {
+    return SQLITE_OK;
+  }
+  UpdateStructure();
+
+  std::lock_guard<std::mutex> lock(mu_);
+  stats_.steps++;
+  stats_.total_us += us;
+  stats_.max_us = std::max(stats_.max_us, us);
+  stats_.last_us = us;
+
+  // Aim for steps between half the budget and the budget
+  uint64_t budget_us = static_cast<uint64_t>(options_.budget_ms) * 1000;
+  if (us > budget_us) {
+    stats_.pages = std::max(stats_.pages / 2, 1);
+  } else if (us < budget_us / 2) {
+    stats_.pages = std::min(stats_.pages * 2, kMaxPages);
+  }
+  return SQLITE_OK;
+}
+
+void FtsMerger::UpdateStructure() {
+  FtsStructure structure;
+  if (ReadFtsStructure(handle_, table_, &structure) != SQLITE_OK) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  stats_.structure = std::move(structure);
+}
+
+int FtsMerger::DataVersion() {
+  int version = 0;
+  QueryInt(handle_, "PRAGMA data_version", &version);
+  return version;
+}
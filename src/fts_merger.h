@@ -0,0 +1,119 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_FTS_MERGER_H_
+#define SRC_FTS_MERGER_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "addon.h"
+#include "sqlite3.h"
+
+// Segments of an FTS5 index, as stored in its structure record
+struct FtsStructure {
+  struct Level {
+    uint32_t segments;
+
+    // Segments of the level being merged into the next one
+    uint32_t merging;
+
+    // Leaf pages of the segments
+    uint64_t pages;
+  };
+
+  uint32_t segments = 0;
+  std::vector<Level> levels;
+};
+
+// Reads the structure record of the FTS5 table `table` (row 10 of
+// `<table>_data`). Returns `SQLITE_CORRUPT` if the record can't be parsed.
+int ReadFtsStructure(sqlite3* handle,
+                     const std::string& table,
+                     FtsStructure* structure);
+
+// Merges the segments of an FTS5 index on a background thread, from its own
+// connection, in small steps while the database is idle, so that searches
+// don't slow down as segments accumulate and a full `optimize` is never
+// needed.
+//
+// The database is idle once `PRAGMA data_version` stayed the same for
+// `idle_ms` after a write. Each step is an FTS5 `merge` command in its own
+// transaction, with a number of pages adjusted after every step so that
+// steps take about `budget_ms`. Steps are separated by the same time so that
+// writers get the lock in between, and stop once the index has no level
+// with `usermerge` segments left or another connection writes. Writers that
+// overlap a step still need a busy handler to wait for it.
+class FtsMerger {
+ public:
+  struct Options {
+    int idle_ms = 1000;
+    int budget_ms = 10;
+  };
+
+  struct Stats {
+    // Steps that merged segments
+    uint64_t steps;
+
+    // Steps that failed with an error other than `SQLITE_BUSY`
+    uint64_t errors;
+
+    // Pages per step of the last step
+    int pages;
+
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t last_us;
+
+    // As of the last step or write seen by the merger
+    FtsStructure structure;
+  };
+
+  // Opens the merger connection. Returns `nullptr` and sets `error` on
+  // failure.
+  static std::unique_ptr<FtsMerger> Start(const ConnectionConfig& config,
+                                          const char* vfs,
+                                          const std::string& table,
+                                          const Options& options,
+                                          std::string* error);
+
+  ~FtsMerger();
+
+  Stats stats();
+
+ private:
+  FtsMerger(sqlite3* handle,
+            sqlite3_stmt* merge,
+            std::string table,
+            const Options& options);
+
+  void Run();
+
+  // Sets `has_merged` to `false` if there was nothing to merge
+  int Step(bool* has_merged);
+  void UpdateStructure();
+
+  // `PRAGMA data_version`, changes with every commit of other connections
+  int DataVersion();
+
+  // Merger connection, used on the thread only
+  sqlite3* handle_;
+  sqlite3_stmt* merge_;
+
+  std::string table_;
+  Options options_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+
+  Stats stats_ = {};
+  std::thread thread_;
+};
+
+#endif  // SRC_FTS_MERGER_H_
@@ -0,0 +1,269 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "fts_rebuild.h"
+
+#include <string.h>
+#include <utility>
+
+#include "signal-tokenizer.h"
+
+namespace {
+
+// A chunk is handed to a thread once it has this many rows or bytes
+constexpr size_t kChunkRows = 256;
+constexpr size_t kChunkBytes = 1 << 20;
+
+// Chunks read ahead of the rebuild per thread
+constexpr size_t kChunksPerThread = 4;
+
+// Rows searched for a document that isn't the next value, e.g. after rows
+// deleted by an open transaction of the main connection. The search doesn't
+// go past the chunk following the current one, so that it never waits for a
+// chunk that can't be read before the current one is consumed.
+constexpr size_t kSearchRows = 16;
+
+}  // namespace
+
+struct FtsRebuild::Chunk {
+  struct Token {
+    uint32_t offset;
+    int length;
+    int flags;
+    int start;
+    int end;
+  };
+
+  // Values of the rows back to back
+  std::string text;
+
+  // Start of every value in `text` followed by the end of the last one
+  std::vector<uint32_t> text_offsets = {0};
+
+  // Tokens of all values, `Token::offset` is the start in `token_data`
+  std::string token_data;
+  std::vector<Token> tokens;
+
+  // Index of the first token of every value followed by the token count
+  std::vector<uint32_t> boundaries;
+
+  bool is_tokenized = false;
+  int status = SQLITE_OK;
+
+  inline size_t value_count() const { return text_offsets.size() - 1; }
+
+  bool Matches(size_t value, const char* data, int length) const {
+    size_t start = text_offsets[value];
+    size_t size = text_offsets[value + 1] - start;
+    return status == SQLITE_OK && size == static_cast<size_t>(length) &&
+           (size == 0 || memcmp(text.data() + start, data, size) == 0);
+  }
+
+  int Replay(size_t value, void* ctx, TokenCallback callback) const {
+    for (uint32_t i = boundaries[value]; i < boundaries[value + 1]; i++) {
+      const Token& token = tokens[i];
+      int r = callback(ctx, token.flags, token_data.data() + token.offset,
+                       token.length, token.start, token.end);
+      if (r != SQLITE_OK) {
+        return r;
+      }
+    }
+    return SQLITE_OK;
+  }
+
+  static int AddToken(void* chunk_ptr,
+                      int flags,
+                      const char* token,
+                      int length,
+                      int start,
+                      int end) {
+    auto chunk = static_cast<Chunk*>(chunk_ptr);
+    chunk->tokens.push_back(
+        {static_cast<uint32_t>(chunk->token_data.size()), length, flags,
+         start, end});
+    chunk->token_data.append(token, length);
+    return SQLITE_OK;
+  }
+
+  void Tokenize() {
+    boundaries.reserve(text_offsets.size());
+    for (size_t i = 0; i < value_count() && status == SQLITE_OK; i++) {
+      boundaries.push_back(static_cast<uint32_t>(tokens.size()));
+      status = signal_fts5_tokenize(
+          nullptr, this, FTS5_TOKENIZE_DOCUMENT, text.data() + text_offsets[i],
+          static_cast<int>(text_offsets[i + 1] - text_offsets[i]), &AddToken);
+    }
+    boundaries.push_back(static_cast<uint32_t>(tokens.size()));
+  }
+};
+
+FtsRebuild::FtsRebuild(ConnectionConfig config, std::string table, int threads)
+    : config_(std::move(config)), table_(std::move(table)), threads_(threads) {}
+
+FtsRebuild::~FtsRebuild() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_stopping_ = true;
+  }
+  cv_.notify_all();
+
+  if (reader_.joinable()) {
+    reader_.join();
+  }
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void FtsRebuild::Start() {
+  reader_ = std::thread(&FtsRebuild::Read, this);
+  for (int i = 0; i < threads_; i++) {
+    workers_.emplace_back(&FtsRebuild::Work, this);
+  }
+}
+
+int FtsRebuild::Tokenize(void* ctx,
+                         const char* text,
+                         int length,
+                         TokenCallback callback) {
+  // Values of `UNINDEXED` and `NULL` columns are read but never tokenized, so
+  // the document is searched for in the following values
+  size_t index = 0;
+  size_t value = value_;
+  for (size_t skipped = 0;;) {
+    Chunk* chunk = WaitForChunk(index);
+    // `column_count_` is set before the first chunk is added
+    if (chunk == nullptr || skipped == kSearchRows * column_count_) {
+      break;
+    }
+    if (value == chunk->value_count()) {
+      if (index == 1) {
+        break;
+      }
+      index++;
+      value = 0;
+      continue;
+    }
+
+    if (chunk->Matches(value, text, length)) {
+      if (index != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        chunks_.erase(chunks_.begin(), chunks_.begin() + index);
+        cv_.notify_all();
+      }
+      value_ = value + 1;
+      cached_values_++;
+      return chunk->Replay(value, ctx, callback);
+    }
+    value++;
+    skipped++;
+  }
+
+  inline_values_++;
+  return signal_fts5_tokenize(nullptr, ctx, FTS5_TOKENIZE_DOCUMENT, text,
+                              length, callback);
+}
+
+FtsRebuild::Chunk* FtsRebuild::WaitForChunk(size_t index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (index < chunks_.size()) {
+      if (chunks_[index]->is_tokenized) {
+        return chunks_[index].get();
+      }
+    } else if (is_read_done_) {
+      return nullptr;
+    }
+    cv_.wait(lock);
+  }
+}
+
+void FtsRebuild::Read() {
+  sqlite3* handle = nullptr;
+  sqlite3_stmt* stmt = nullptr;
+  std::string error;
+
+  // Documents are tokenized inline if the table can't be read
+  if (config_.Open(&handle, SQLITE_OPEN_READONLY, nullptr, &error) ==
+          SQLITE_OK &&
+      RegisterSignalTokenizer(handle, nullptr) == SQLITE_OK) {
+    std::string sql = "SELECT * FROM " + table_ + " ORDER BY rowid";
+    sqlite3_prepare_v2(handle, sql.c_str(), -1, &stmt, nullptr);
+  }
+
+  if (stmt != nullptr) {
+    int columns = sqlite3_column_count(stmt);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      column_count_ = static_cast<size_t>(columns);
+    }
+
+    size_t max_chunks = kChunksPerThread * static_cast<size_t>(threads_);
+    auto chunk = std::make_unique<Chunk>();
+    size_t rows = 0;
+    bool has_row = true;
+    while (has_row) {
+      has_row = sqlite3_step(stmt) == SQLITE_ROW;
+      if (has_row) {
+        for (int i = 0; i < columns; i++) {
+          auto text = sqlite3_column_text(stmt, i);
+          int length = sqlite3_column_bytes(stmt, i);
+          if (length > 0) {
+            chunk->text.append(reinterpret_cast<const char*>(text), length);
+          }
+          chunk->text_offsets.push_back(
+              static_cast<uint32_t>(chunk->text.size()));
+        }
+        rows++;
+      }
+
+      if (rows == 0 ||
+          (has_row && rows < kChunkRows && chunk->text.size() < kChunkBytes)) {
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!is_stopping_ && chunks_.size() >= max_chunks) {
+        cv_.wait(lock);
+      }
+      if (is_stopping_) {
+        break;
+      }
+      pending_.push_back(chunk.get());
+      chunks_.push_back(std::move(chunk));
+      cv_.notify_all();
+
+      chunk = std::make_unique<Chunk>();
+      rows = 0;
+    }
+  }
+
+  sqlite3_finalize(stmt);
+  sqlite3_close(handle);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  is_read_done_ = true;
+  cv_.notify_all();
+}
+
+void FtsRebuild::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    while (!is_stopping_ && !is_read_done_ && pending_.empty()) {
+      cv_.wait(lock);
+    }
+    if (is_stopping_ || pending_.empty()) {
+      return;
+    }
+
+    Chunk* chunk = pending_.front();
+    pending_.pop_front();
+
+    lock.unlock();
+    chunk->Tokenize();
+    lock.lock();
+
+    chunk->is_tokenized = true;
+    cv_.notify_all();
+  }
+}
@@ -0,0 +1,92 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_FTS_REBUILD_H_
+#define SRC_FTS_REBUILD_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "addon.h"
+#include "sqlite3.h"
+
+// Tokenizes the rows of a `signal_tokenizer` FTS5 table on `threads` threads
+// while `INSERT INTO t(t) VALUES('rebuild')` runs on the main connection.
+//
+// A side connection reads the columns of the table in rowid order, which is
+// the order in which FTS5 tokenizes them during a rebuild, and the threads
+// tokenize chunks of rows with `signal_fts5_tokenize`. The tokenizer of the
+// main connection calls `Tokenize` for every document, which replays the
+// cached tokens if the document is the value that was read. Other documents
+// (e.g. rows written by an open transaction of the main connection) are
+// tokenized inline, so the index is the same as after a serial rebuild.
+//
+// The side connection only sees the committed state of WAL databases without
+// blocking the writer, otherwise (and for in-memory databases) `Start` isn't
+// called and every document is tokenized inline.
+class FtsRebuild {
+ public:
+  using TokenCallback = int (*)(void*, int, const char*, int, int, int);
+
+  // `table` is the quoted name of the FTS5 table
+  FtsRebuild(ConnectionConfig config, std::string table, int threads);
+  ~FtsRebuild();
+
+  FtsRebuild(const FtsRebuild&) = delete;
+  FtsRebuild& operator=(const FtsRebuild&) = delete;
+
+  void Start();
+
+  // `xTokenize` of a document, called on the main connection's thread
+  int Tokenize(void* ctx, const char* text, int length, TokenCallback callback);
+
+  inline uint64_t cached_values() const { return cached_values_; }
+  inline uint64_t inline_values() const { return inline_values_; }
+
+ private:
+  struct Chunk;
+
+  void Read();
+  void Work();
+
+  // Waits until the chunk at `index` of `chunks_` is tokenized. Returns
+  // `nullptr` if all chunks were read.
+  Chunk* WaitForChunk(size_t index);
+
+  ConnectionConfig config_;
+  std::string table_;
+  int threads_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+
+  // Chunks that weren't consumed yet, in rowid order
+  std::deque<std::unique_ptr<Chunk>> chunks_;
+
+  // Chunks waiting for a thread
+  std::deque<Chunk*> pending_;
+
+  bool is_read_done_ = false;
+  bool is_stopping_ = false;
+
+  // Number of columns of the table, documents are only searched for in the
+  // next row
+  size_t column_count_ = 0;
+
+  // First value of `chunks_.front()` that wasn't consumed
+  size_t value_ = 0;
+
+  uint64_t cached_values_ = 0;
+  uint64_t inline_values_ = 0;
+
+  std::thread reader_;
+  std::vector<std::thread> workers_;
+};
+
+#endif  // SRC_FTS_REBUILD_H_
@@ -0,0 +1,184 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "fts_top_k.h"
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+
+#include "addon.h"
+
+namespace {
+
+// Parameters of `bm25()`
+constexpr double kK1 = 1.2;
+constexpr double kB = 0.75;
+
+constexpr char kPointerType[] = "signal_top_k";
+
+// Same order as `ORDER BY bm25(...), rowid`. Makes `heap_.front()` the
+// worst match.
+bool IsBetter(const FtsTopK::Match& a, const FtsTopK::Match& b) {
+  return a.score < b.score || (a.score == b.score && a.rowid < b.rowid);
+}
+
+int CountRow(const Fts5ExtensionApi*, Fts5Context*, void* count) {
+  (*static_cast<sqlite3_int64*>(count))++;
+  return SQLITE_OK;
+}
+
+}  // namespace
+
+FtsTopK::FtsTopK(size_t limit, std::vector<double> weights)
+    : limit_(limit), weights_(std::move(weights)) {}
+
+int FtsTopK::Register(fts5_api* fts5) {
+  return fts5->xCreateFunction(fts5, kPointerType, nullptr, &Function,
+                               nullptr);
+}
+
+int FtsTopK::Search(sqlite3* handle,
+                    const std::string& table,
+                    const std::string& query,
+                    std::vector<Match>* matches) {
+  heap_.clear();
+  heap_.reserve(std::min<size_t>(limit_, 1024));
+  is_prepared_ = false;
+
+  auto fts = QuoteIdentifier(table);
+  std::string sql = "SELECT signal_top_k(" + fts + ", ?2) FROM " + fts +
+                    " WHERE " + fts + " MATCH ?1";
+  sqlite3_stmt* stmt = nullptr;
+  int r = sqlite3_prepare_v2(handle, sql.c_str(), sql.size(), &stmt, nullptr);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+
+  sqlite3_bind_text(stmt, 1, query.c_str(), query.size(), SQLITE_STATIC);
+  sqlite3_bind_pointer(stmt, 2, this, kPointerType, nullptr);
+  while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+  }
+  sqlite3_finalize(stmt);
+  if (r != SQLITE_DONE) {
+    return r;
+  }
+
+  *matches = std::move(heap_);
+  std::sort(matches->begin(), matches->end(), IsBetter);
+  return SQLITE_OK;
+}
+
+void FtsTopK::Function(const Fts5ExtensionApi* api,
+                       Fts5Context* fts,
+                       sqlite3_context* ctx,
+                       int argc,
+                       sqlite3_value** argv) {
+  auto top_k = argc == 1 ? static_cast<FtsTopK*>(
+                               sqlite3_value_pointer(argv[0], kPointerType))
+                         : nullptr;
+  if (top_k == nullptr) {
+    sqlite3_result_error(ctx, "signal_top_k: no collector", -1);
+    return;
+  }
+
+  int r = top_k->Add(api, fts);
+  if (r != SQLITE_OK) {
+    sqlite3_result_error_code(ctx, r);
+  }
+}
+
+int FtsTopK::Prepare(const Fts5ExtensionApi* api, Fts5Context* fts) {
+  sqlite3_int64 rows = 0;
+  sqlite3_int64 tokens = 0;
+  int r = api->xRowCount(fts, &rows);
+  if (r == SQLITE_OK) {
+    r = api->xColumnTotalSize(fts, -1, &tokens);
+  }
+  if (r != SQLITE_OK) {
+    return r;
+  }
+  average_size_ = static_cast<double>(tokens) / static_cast<double>(rows);
+
+  int phrases = api->xPhraseCount(fts);
+  idf_.assign(phrases, 0);
+  frequencies_.assign(phrases, 0);
+  for (int i = 0; i < phrases; i++) {
+    sqlite3_int64 hits = 0;
+    r = api->xQueryPhrase(fts, i, &hits, &CountRow);
+    if (r != SQLITE_OK) {
+      return r;
+    }
+
+    // Same as `bm25()`, which keeps terms matching more than half of the
+    // rows slightly relevant
+    double idf = log((rows - hits + 0.5) / (hits + 0.5));
+    idf_[i] = idf > 0 ? idf : 1e-6;
+  }
+
+  is_prepared_ = true;
+  return SQLITE_OK;
+}
+
+int FtsTopK::Add(const Fts5ExtensionApi* api, Fts5Context* fts) {
+  int r;
+  if (!is_prepared_ && (r = Prepare(api, fts)) != SQLITE_OK) {
+    return r;
+  }
+
+  for (size_t i = 0; i < frequencies_.size(); i++) {
+    double frequency = 0;
+    Fts5PhraseIter iter;
+    int column;
+    int offset;
+    r = api->xPhraseFirst(fts, static_cast<int>(i), &iter, &column, &offset);
+    if (r != SQLITE_OK) {
+      return r;
+    }
+    while (column >= 0) {
+      frequency += static_cast<size_t>(column) < weights_.size()
+                       ? weights_[column]
+                       : 1.0;
+      api->xPhraseNext(fts, &iter, &column, &offset);
+    }
+    frequencies_[i] = frequency;
+  }
+
+  // Best score of a row with these frequencies, reached if the row has no
+  // other tokens
+  if (heap_.size() == limit_) {
+    double bound = 0;
+    for (size_t i = 0; i < frequencies_.size(); i++) {
+      double f = frequencies_[i];
+      bound += idf_[i] * ((f * (kK1 + 1)) / (f + kK1 * (1 - kB)));
+    }
+    // Rows are visited in rowid order, so ties don't enter the heap either
+    if (-bound >= heap_.front().score) {
+      return SQLITE_OK;
+    }
+  }
+
+  int size = 0;
+  r = api->xColumnSize(fts, -1, &size);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+
+  double score = 0;
+  double norm = kK1 * (1 - kB + kB * size / average_size_);
+  for (size_t i = 0; i < frequencies_.size(); i++) {
+    double f = frequencies_[i];
+    score += idf_[i] * ((f * (kK1 + 1)) / (f + norm));
+  }
+
+  Match match = {api->xRowid(fts), -1.0 * score};
+  if (heap_.size() < limit_) {
+    heap_.push_back(match);
+    std::push_heap(heap_.begin(), heap_.end(), IsBetter);
+  } else if (IsBetter(match, heap_.front())) {
+    std::pop_heap(heap_.begin(), heap_.end(), IsBetter);
+    heap_.back() = match;
+    std::push_heap(heap_.begin(), heap_.end(), IsBetter);
+  }
+  return SQLITE_OK;
+}
@@ -0,0 +1,73 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_FTS_TOP_K_H_
+#define SRC_FTS_TOP_K_H_
+
+#include <string>
+#include <vector>
+
+#include "sqlite3.h"
+
+// Keeps the `limit` best matches of an FTS5 query by BM25, so that ranked
+// searches don't have to return and sort every match.
+//
+// `Search` runs `SELECT signal_top_k(t, ?2) FROM t WHERE t MATCH ?1`, which
+// calls the `signal_top_k` auxiliary function for every match with the
+// collector bound to `?2`. The function computes the same score as `bm25()`
+// with `weights` as column weights, from the instances of the phrases
+// (`xPhraseFirst`) and the size of the row. The size is only read if the
+// row can enter the heap given the frequencies of its phrases, and no
+// column is ever read.
+class FtsTopK {
+ public:
+  struct Match {
+    sqlite3_int64 rowid;
+
+    // As returned by `bm25()`, lower is better
+    double score;
+  };
+
+  FtsTopK(size_t limit, std::vector<double> weights);
+
+  FtsTopK(const FtsTopK&) = delete;
+  FtsTopK& operator=(const FtsTopK&) = delete;
+
+  // Registers the `signal_top_k` auxiliary function
+  static int Register(fts5_api* fts5);
+
+  // `table` is the unquoted name of the FTS5 table. Returns the matches best
+  // first in `matches`.
+  int Search(sqlite3* handle,
+             const std::string& table,
+             const std::string& query,
+             std::vector<Match>* matches);
+
+ private:
+  static void Function(const Fts5ExtensionApi* api,
+                       Fts5Context* fts,
+                       sqlite3_context* ctx,
+                       int argc,
+                       sqlite3_value** argv);
+
+  // Reads the statistics of the query, once per search
+  int Prepare(const Fts5ExtensionApi* api, Fts5Context* fts);
+  int Add(const Fts5ExtensionApi* api, Fts5Context* fts);
+
+  size_t limit_;
+  std::vector<double> weights_;
+
+  // Min-heap by relevance, `heap_.front()` is the worst match kept
+  std::vector<Match> heap_;
+
+  bool is_prepared_ = false;
+  double average_size_ = 0;
+
+  // Inverse document frequency of every phrase
+  std::vector<double> idf_;
+
+  // Weighted frequency of every phrase in the current row
+  std::vector<double> frequencies_;
+};
+
+#endif  // SRC_FTS_TOP_K_H_
@@ -0,0 +1,521 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "group_commit.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+// Writes of other connections are waited for instead of failing the group
+static constexpr int kBusyTimeoutMs = 5000;
+
+// Prepared statements are kept for reuse, up to this many
+static constexpr size_t kMaxStatements = 64;
+
+static std::mutex registry_mu;
+static std::map<std::string, std::weak_ptr<GroupCommitQueue>>* registry =
+    new std::map<std::string, std::weak_ptr<GroupCommitQueue>>();
+
+std::shared_ptr<GroupCommitQueue> GroupCommitQueue::Get(
+    const ConnectionConfig& config,
+    const char* vfs,
+    const Options& options,
+    std::string* error) {
+  std::lock_guard<std::mutex> lock(registry_mu);
+
+  auto& entry = (*registry)[config.path];
+  auto queue = entry.lock();
+  if (queue != nullptr) {
+    return queue;
+  }
+
+  sqlite3* handle = nullptr;
+  int r = config.Open(&handle, SQLITE_OPEN_READWRITE, vfs, error);
+  if (r != SQLITE_OK) {
+    return nullptr;
+  }
+
+  // Commits of the writer are durable regardless of the journal mode, the
+  // cost of the sync is shared by the whole group.
+  r = sqlite3_exec(handle, "PRAGMA synchronous = FULL", nullptr, nullptr,
+                   nullptr);
+  if (r == SQLITE_OK) {
+    r = sqlite3_busy_timeout(handle, kBusyTimeoutMs);
+  }
+  if (r == SQLITE_OK) {
+    // Writes to FTS tables (and their triggers) tokenize
+    r = RegisterSignalTokenizer(handle, nullptr);
+  }
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+    sqlite3_close(handle);
+    return nullptr;
+  }
+
+  queue.reset(new GroupCommitQueue(config.path, handle, options));
+  entry = queue;
+  return queue;
+}
+
+GroupCommitQueue::GroupCommitQueue(std::string path,
+                                   sqlite3* handle,
+                                   const Options& options)
+    : path_(std::move(path)), handle_(handle), options_(options) {
+  sqlite3_commit_hook(handle_, &GroupCommitQueue::CommitHook, this);
+  thread_ = std::thread(&GroupCommitQueue::Run, this);
+}
+
+GroupCommitQueue::~GroupCommitQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+
+  // Pending writes are committed before the thread exits
+  thread_.join();
+
+  for (const auto& entry : statements_) {
+    sqlite3_finalize(entry.second);
+  }
+  sqlite3_close(handle_);
+
+  std::lock_guard<std::mutex> lock(registry_mu);
+  auto it = registry->find(path_);
+  if (it != registry->end() && it->second.expired()) {
+    registry->erase(it);
+  }
+}
+
+void GroupCommitQueue::Push(std::vector<Query> queries, DoneCallback done) {
+  bool is_full;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    pending_.push_back({std::move(queries), std::move(done), ""});
+    is_full = pending_.size() == 1 || pending_.size() >= options_.max_writes;
+  }
+
+  // Wake up the writer for the first write of a group (to start the window)
+  // and once the group is full.
+  if (is_full) {
+    cv_.notify_all();
+  }
+}
+
+void GroupCommitQueue::Run() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+    if (pending_.empty()) {
+      break;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(options_.window_ms);
+    cv_.wait_until(lock, deadline, [this] {
+      return stop_ || pending_.size() >= options_.max_writes;
+    });
+
+    std::vector<Write> group;
+    size_t count = std::min(pending_.size(), options_.max_writes);
+    group.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      group.emplace_back(std::move(pending_.front()));
+      pending_.pop_front();
+    }
+
+    lock.unlock();
+    Commit(&group);
+    for (auto& write : group) {
+      write.done(std::move(write.error));
+    }
+    lock.lock();
+  }
+}
+
+void GroupCommitQueue::Commit(std::vector<Write>* group) {
+  std::vector<Write*> writes;
+  writes.reserve(group->size());
+  for (auto& write : *group) {
+    writes.push_back(&write);
+  }
+
+  // Every retry has at least one write less
+  while (!writes.empty()) {
+    writes = TryCommit(writes);
+  }
+}
+
+std::vector<GroupCommitQueue::Write*> GroupCommitQueue::TryCommit(
+    const std::vector<Write*>& writes) {
+  int r = sqlite3_exec(handle_, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
+  if (r != SQLITE_OK) {
+    auto error = SqliteErrorMessage(handle_);
+    for (auto write : writes) {
+      write->error = error;
+    }
+    return {};
+  }
+
+  for (size_t i = 0; i < writes.size(); i++) {
+    auto write = writes[i];
+    r = sqlite3_exec(handle_, "SAVEPOINT write", nullptr, nullptr, nullptr);
+    if (r != SQLITE_OK) {
+      write->error = SqliteErrorMessage(handle_);
+    } else {
+      for (const auto& query : write->queries) {
+        if (!Execute(query, &write->error)) {
+          break;
+        }
+      }
+    }
+
+    // The write rolled back the whole transaction (e.g. SQLITE_FULL, an I/O
+    // error, `OR ROLLBACK` or `RAISE(ROLLBACK)`), including the writes before
+    // it. Nothing was committed (see `CommitHook`), so the other writes are
+    // retried in a new transaction.
+    if (sqlite3_get_autocommit(handle_)) {
+      if (write->error.empty()) {
+        write->error = "Write ended the transaction";
+      }
+      std::vector<Write*> retry;
+      for (auto other : writes) {
+        if (other->error.empty()) {
+          retry.push_back(other);
+        }
+      }
+      return retry;
+    }
+
+    if (!write->error.empty()) {
+      sqlite3_exec(handle_, "ROLLBACK TO write", nullptr, nullptr, nullptr);
+    }
+    sqlite3_exec(handle_, "RELEASE write", nullptr, nullptr, nullptr);
+  }
+
+  is_committing_ = true;
+  r = sqlite3_exec(handle_, "COMMIT", nullptr, nullptr, nullptr);
+  is_committing_ = false;
+  if (r != SQLITE_OK) {
+    auto error = SqliteErrorMessage(handle_);
+    if (!sqlite3_get_autocommit(handle_)) {
+      sqlite3_exec(handle_, "ROLLBACK", nullptr, nullptr, nullptr);
+    }
+    for (auto write : writes) {
+      if (write->error.empty()) {
+        write->error = error;
+      }
+    }
+  }
+  return {};
+}
+
+int GroupCommitQueue::CommitHook(void* queue_ptr) {
+  auto queue = static_cast<GroupCommitQueue*>(queue_ptr);
+
+  // Non-zero turns the commit into a rollback
+  return queue->is_committing_ ? 0 : 1;
+}
+
+bool GroupCommitQueue::Execute(const Query& query, std::string* error) {
+  auto stmt = Prepare(query.sql, error);
+  if (stmt == nullptr) {
+    return false;
+  }
+
+  bool ok = Bind(stmt, query, error);
+  if (ok) {
+    int r;
+    do {
+      r = sqlite3_step(stmt);
+    } while (r == SQLITE_ROW);
+
+    if (r != SQLITE_DONE) {
+      *error = SqliteErrorMessage(handle_);
+      ok = false;
+    }
+  }
+
+  // Bound text and blobs are owned by `query`
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+  return ok;
+}
+
+sqlite3_stmt* GroupCommitQueue::Prepare(const std::string& sql,
+                                        std::string* error) {
+  auto it = statements_.find(sql);
+  if (it != statements_.end()) {
+    return it->second;
+  }
+
+  if (statements_.size() >= kMaxStatements) {
+    for (const auto& entry : statements_) {
+      sqlite3_finalize(entry.second);
+    }
+    statements_.clear();
+  }
+
+  sqlite3_stmt* stmt = nullptr;
+  const char* tail = nullptr;
+  int r = sqlite3_prepare_v3(handle_, sql.c_str(), sql.size(),
+                             SQLITE_PREPARE_PERSISTENT, &stmt, &tail);
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle_);
+    return nullptr;
+  }
+  if (stmt == nullptr) {
+    *error = "Empty query";
+    return nullptr;
+  }
+  if (Statement::HasTail(tail)) {
+    sqlite3_finalize(stmt);
+    *error = "Can't prepare more than one statement";
+    return nullptr;
+  }
+
+  statements_.emplace(sql, stmt);
+  return stmt;
+}
+
+static int BindValue(sqlite3_stmt* stmt,
+                     int column,
+                     const GroupCommitQueue::Value& value) {
+  switch (value.type) {
+    case SQLITE_INTEGER:
+      return sqlite3_bind_int64(stmt, column, value.integer);
+    case SQLITE_FLOAT:
+      return sqlite3_bind_double(stmt, column, value.real);
+    case SQLITE_TEXT:
+      return sqlite3_bind_text(stmt, column, value.bytes.data(),
+                               value.bytes.size(), SQLITE_STATIC);
+    case SQLITE_BLOB:
+      return sqlite3_bind_blob(stmt, column, value.bytes.data(),
+                               value.bytes.size(), SQLITE_STATIC);
+    default:
+      return sqlite3_bind_null(stmt, column);
+  }
+}
+
+bool GroupCommitQueue::Bind(sqlite3_stmt* stmt,
+                            const Query& query,
+                            std::string* error) {
+  int key_count = sqlite3_bind_parameter_count(stmt);
+
+  if (query.names.empty()) {
+    int value_count = static_cast<int>(query.values.size());
+    if (value_count != key_count) {
+      *error = FormatString("Expected %d parameters, got %d", key_count,
+                            value_count);
+      return false;
+    }
+  }
+
+  for (int i = 1; i <= key_count; i++) {
+    auto name = sqlite3_bind_parameter_name(stmt, i);
+
+    const Value* value = nullptr;
+    if (query.names.empty()) {
+      if (name != nullptr) {
+        *error = FormatString("Unexpected named param %s at %d", name, i);
+        return false;
+      }
+      value = &query.values[i - 1];
+    } else {
+      if (name == nullptr) {
+        *error = FormatString("Unexpected anonymous param at %d", i);
+        return false;
+      }
+
+      // Skip "$"
+      name = name + 1;
+      for (size_t j = 0; j < query.names.size(); j++) {
+        if (query.names[j] == name) {
+          value = &query.values[j];
+          break;
+        }
+      }
+      if (value == nullptr) {
+        *error = FormatString("Missing param %s", name);
+        return false;
+      }
+    }
+
+    if (BindValue(stmt, i, *value) != SQLITE_OK) {
+      *error = SqliteErrorMessage(handle_);
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+// WriteQueueClient
+//
+
+WriteQueueClient* WriteQueueClient::New(Napi::Env env) {
+  auto client = new WriteQueueClient();
+  client->tsfn_ = Tsfn::New(env, "WriteQueue", 0, 1, client,
+                            [](Napi::Env, WriteQueueClient* client) {
+                              delete client;
+                            });
+
+  // Referenced only while writes are pending
+  client->tsfn_.Unref(env);
+  return client;
+}
+
+// Returns an error message for values that can't be bound
+static const char* ConvertValue(Napi::Value param,
+                                GroupCommitQueue::Value* value) {
+  switch (param.Type()) {
+    case napi_null:
+      value->type = SQLITE_NULL;
+      return nullptr;
+    case napi_number:
+      value->type = SQLITE_FLOAT;
+      value->real = param.As<Napi::Number>().DoubleValue();
+      return nullptr;
+    case napi_string:
+      value->type = SQLITE_TEXT;
+      value->bytes = param.As<Napi::String>().Utf8Value();
+      return nullptr;
+    case napi_bigint: {
+      bool lossless;
+      value->type = SQLITE_INTEGER;
+      value->integer = param.As<Napi::BigInt>().Int64Value(&lossless);
+      if (!lossless) {
+        return "failed to convert bigint to int64";
+      }
+      return nullptr;
+    }
+    case napi_object:
+      if (param.IsTypedArray()) {
+        auto val = param.As<Napi::TypedArray>();
+
+        auto data = val.ArrayBuffer();
+        const char* view = reinterpret_cast<const char*>(data.Data());
+
+        value->type = SQLITE_BLOB;
+        value->bytes.assign(view + val.ByteOffset(), val.ByteLength());
+        return nullptr;
+      }
+      return "unexpected type `object`";
+    case napi_boolean:
+      return "unexpected type `boolean`";
+    case napi_undefined:
+      return "unexpected type `undefined`";
+    default:
+      return "unknown parameter type";
+  }
+}
+
+static bool ConvertQuery(Napi::Env env,
+                         Napi::Value sql,
+                         Napi::Value params,
+                         GroupCommitQueue::Query* query) {
+  assert(sql.IsString());
+  query->sql = sql.As<Napi::String>().Utf8Value();
+
+  if (params.IsUndefined()) {
+    return true;
+  }
+
+  if (params.IsArray()) {
+    auto list = params.As<Napi::Array>();
+    query->values.resize(list.Length());
+    for (uint32_t i = 0; i < list.Length(); i++) {
+      auto error = ConvertValue(list[i], &query->values[i]);
+      if (error != nullptr) {
+        NAPI_THROW(Napi::Error::New(
+                       env, FormatString("Failed to bind param %d, error %s",
+                                         i + 1, error)),
+                   false);
+      }
+    }
+    return true;
+  }
+
+  auto obj = params.As<Napi::Object>();
+  auto keys = obj.GetPropertyNames();
+  query->values.resize(keys.Length());
+  query->names.resize(keys.Length());
+  for (uint32_t i = 0; i < keys.Length(); i++) {
+    auto name = keys.Get(i).As<Napi::String>().Utf8Value();
+    auto error = ConvertValue(obj.Get(name.c_str()), &query->values[i]);
+    if (error != nullptr) {
+      NAPI_THROW(Napi::Error::New(
+                     env, FormatString("Failed to bind param %s, error %s",
+                                       name.c_str(), error)),
+                 false);
+    }
+    query->names[i] = std::move(name);
+  }
+  return true;
+}
+
+Napi::Value WriteQueueClient::Push(Napi::Env env,
+                                   GroupCommitQueue* queue,
+                                   Napi::Value queries) {
+  assert(queries.IsArray());
+  auto list = queries.As<Napi::Array>();
+
+  std::vector<GroupCommitQueue::Query> converted(list.Length());
+  for (uint32_t i = 0; i < list.Length(); i++) {
+    auto pair = list.Get(i).As<Napi::Array>();
+    if (!ConvertQuery(env, pair.Get(0u), pair.Get(1u), &converted[i])) {
+      return Napi::Value();
+    }
+  }
+
+  auto result = new Result{Napi::Promise::Deferred::New(env), ""};
+  auto promise = result->deferred.Promise();
+
+  if (pending_ == 0) {
+    tsfn_.Ref(env);
+  }
+  pending_++;
+
+  // Released by the writer thread once the write is done, keeps the client
+  // alive if the database is closed in the meantime.
+  tsfn_.Acquire();
+
+  queue->Push(std::move(converted),
+              [tsfn = tsfn_, result](std::string error) {
+                result->error = std::move(error);
+                if (tsfn.BlockingCall(result) != napi_ok) {
+                  delete result;
+                }
+                tsfn.Release();
+              });
+  return promise;
+}
+
+void WriteQueueClient::Release() {
+  tsfn_.Release();
+}
+
+void WriteQueueClient::CallJs(Napi::Env env,
+                              Napi::Function callback,
+                              WriteQueueClient* client,
+                              Result* result) {
+  // The environment is being torn down
+  if (env == nullptr) {
+    delete result;
+    return;
+  }
+
+  if (result->error.empty()) {
+    result->deferred.Resolve(env.Undefined());
+  } else {
+    result->deferred.Reject(Napi::Error::New(env, result->error).Value());
+  }
+  delete result;
+
+  client->pending_--;
+  if (client->pending_ == 0) {
+    client->tsfn_.Unref(env);
+  }
+}
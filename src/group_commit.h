@@ -0,0 +1,145 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_GROUP_COMMIT_H_
+#define SRC_GROUP_COMMIT_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "addon.h"
+#include "napi.h"
+#include "sqlite3.h"
+
+// A write queue shared by all connections to the same database file in the
+// process, including connections opened on worker threads.
+//
+// Queued writes are executed by a writer thread on its own connection and
+// committed in groups: the thread waits up to `window_ms` after the first
+// write of a group for more writes (or until there are `max_writes` of them)
+// and runs them all in a single transaction, paying for one commit and one
+// fsync. Every write runs in its own savepoint so a failing write is rolled
+// back without affecting the rest of the group. A write that rolls back the
+// whole transaction fails, and the rest of the group is retried in a new one.
+// Writes can't commit the transaction themselves.
+class GroupCommitQueue {
+ public:
+  struct Options {
+    int window_ms = 2;
+    size_t max_writes = 256;
+  };
+
+  // A bound parameter, copied out of JS values
+  struct Value {
+    int type = SQLITE_NULL;
+    int64_t integer = 0;
+    double real = 0;
+
+    // Text and blobs
+    std::string bytes;
+  };
+
+  struct Query {
+    std::string sql;
+    std::vector<Value> values;
+
+    // Empty for positional parameters, otherwise the name of every value
+    // (without the prefix)
+    std::vector<std::string> names;
+  };
+
+  // Called on the writer thread once the group of the write is committed
+  // (`error` is empty) or after the write was rolled back.
+  using DoneCallback = std::function<void(std::string error)>;
+
+  // Returns the queue of `config.path`, creating it if needed. The options of
+  // an existing queue are not changed.
+  static std::shared_ptr<GroupCommitQueue> Get(const ConnectionConfig& config,
+                                               const char* vfs,
+                                               const Options& options,
+                                               std::string* error);
+
+  ~GroupCommitQueue();
+
+  void Push(std::vector<Query> queries, DoneCallback done);
+
+ private:
+  struct Write {
+    std::vector<Query> queries;
+    DoneCallback done;
+    std::string error;
+  };
+
+  GroupCommitQueue(std::string path, sqlite3* handle, const Options& options);
+
+  void Run();
+  void Commit(std::vector<Write>* group);
+
+  // Runs `writes` in one transaction. Returns the writes to retry if one of
+  // them ended the transaction.
+  std::vector<Write*> TryCommit(const std::vector<Write*>& writes);
+
+  // Only lets the commits of `TryCommit` through
+  static int CommitHook(void* queue_ptr);
+  bool Execute(const Query& query, std::string* error);
+  sqlite3_stmt* Prepare(const std::string& sql, std::string* error);
+  bool Bind(sqlite3_stmt* stmt, const Query& query, std::string* error);
+
+  std::string path_;
+  sqlite3* handle_;
+  Options options_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<Write> pending_;
+  bool stop_ = false;
+  std::thread thread_;
+
+  // Writer thread only
+  std::map<std::string, sqlite3_stmt*> statements_;
+  bool is_committing_ = false;
+};
+
+// Delivers the results of the writes queued by a `Database` to its JS thread
+// and keeps the event loop alive while any of them are pending.
+class WriteQueueClient {
+ public:
+  static WriteQueueClient* New(Napi::Env env);
+
+  // Queues `queries` (an array of `[sql, params]` pairs) as one write and
+  // returns a promise for its commit. Returns an empty value and throws on
+  // invalid queries.
+  Napi::Value Push(Napi::Env env,
+                   GroupCommitQueue* queue,
+                   Napi::Value queries);
+
+  // Called when the database is closed. The client is destroyed once all
+  // pending writes are done.
+  void Release();
+
+ private:
+  struct Result {
+    Napi::Promise::Deferred deferred;
+    std::string error;
+  };
+
+  static void CallJs(Napi::Env env,
+                     Napi::Function callback,
+                     WriteQueueClient* client,
+                     Result* result);
+
+  using Tsfn = Napi::TypedThreadSafeFunction<WriteQueueClient, Result, CallJs>;
+
+  Tsfn tsfn_;
+  size_t pending_ = 0;
+};
+
+#endif  // SRC_GROUP_COMMIT_H_
@@ -0,0 +1,597 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "incremental_backup.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unordered_map>
+#include <utility>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif  // defined(_WIN32)
+
+namespace {
+
+// Manifest: magic, page size, flags, page count, then a little-endian 64-bit
+// fingerprint per page
+constexpr char kManifestMagic[8] = {'S', 'Q', 'L', 'C', 'M', 'A', 'N', '1'};
+constexpr size_t kManifestHeaderSize = 24;
+
+// Delta: magic, page size, flags, page count, page count of the previous
+// backup, record count, then records of a page number, the fingerprint of
+// the page in the previous backup and the page
+constexpr char kDeltaMagic[8] = {'S', 'Q', 'L', 'C', 'D', 'L', 'T', '1'};
+constexpr size_t kDeltaHeaderSize = 32;
+constexpr size_t kRecordHeaderSize = 16;
+
+// Fingerprints are the end of the reserved bytes of the pages
+constexpr uint32_t kEncryptedFlag = 1;
+
+constexpr size_t kWalHeaderSize = 32;
+constexpr size_t kWalFrameHeaderSize = 24;
+constexpr uint32_t kWalMagic = 0x377f0682;
+
+uint32_t Load32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) |
+         (static_cast<uint32_t>(data[1]) << 8) |
+         (static_cast<uint32_t>(data[2]) << 16) |
+         (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint64_t Load64(const uint8_t* data) {
+  return Load32(data) | (static_cast<uint64_t>(Load32(data + 4)) << 32);
+}
+
+uint32_t Load32BE(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+void Store32(uint8_t* data, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    data[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+void Store64(uint8_t* data, uint64_t value) {
+  Store32(data, static_cast<uint32_t>(value));
+  Store32(data + 4, static_cast<uint32_t>(value >> 32));
+}
+
+uint64_t Fingerprint(const uint8_t* page, uint32_t size, bool is_encrypted) {
+  if (is_encrypted) {
+    return Load64(page + size - 8);
+  }
+
+  // FNV-1a over 64-bit words, with a shift so that changes in the high bits
+  // of a word can't cancel out
+  uint64_t hash = 0xcbf29ce484222325;
+  for (uint32_t i = 0; i < size; i += 8) {
+    hash ^= Load64(page + i);
+    hash *= 0x100000001b3;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+bool Seek(FILE* file, uint64_t offset) {
+#if defined(_WIN32)
+  return _fseeki64(file, static_cast<int64_t>(offset), SEEK_SET) == 0;
+#else
+  return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif  // defined(_WIN32)
+}
+
+bool Read(FILE* file, void* data, size_t size) {
+  return fread(data, 1, size, file) == size;
+}
+
+bool Write(FILE* file, const void* data, size_t size) {
+  return fwrite(data, 1, size, file) == size;
+}
+
+int64_t FileSize(FILE* file) {
+#if defined(_WIN32)
+  return _fseeki64(file, 0, SEEK_END) == 0 ? _ftelli64(file) : -1;
+#else
+  return fseeko(file, 0, SEEK_END) == 0 ? ftello(file) : -1;
+#endif  // defined(_WIN32)
+}
+
+bool Truncate(FILE* file, uint64_t size) {
+#if defined(_WIN32)
+  return fflush(file) == 0 &&
+         _chsize_s(_fileno(file), static_cast<int64_t>(size)) == 0;
+#else
+  return fflush(file) == 0 &&
+         ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif  // defined(_WIN32)
+}
+
+bool Sync(FILE* file) {
+#if defined(_WIN32)
+  return fflush(file) == 0 && _commit(_fileno(file)) == 0;
+#else
+  return fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif  // defined(_WIN32)
+}
+
+// Cumulative checksum of the WAL format
+void WalChecksum(const uint8_t* data,
+                 size_t size,
+                 bool is_big_endian,
+                 uint32_t checksum[2]) {
+  for (size_t i = 0; i < size; i += 8) {
+    const uint8_t* words = data + i;
+    uint32_t x0 = is_big_endian ? Load32BE(words) : Load32(words);
+    uint32_t x1 = is_big_endian ? Load32BE(words + 4) : Load32(words + 4);
+    checksum[0] += x0 + checksum[1];
+    checksum[1] += x1 + checksum[0];
+  }
+}
+
+// Maps the pages in the WAL to the offset of their last frame up to the last
+// valid commit, and sets `page_count` to the size of the database as of that
+// commit. Frames with stale salts, broken checksums or after the last commit
+// are ignored like in WAL recovery. `salts` are copied from the WAL header.
+bool ReadWal(const std::string& path,
+             uint32_t page_size,
+             std::unordered_map<uint32_t, uint64_t>* frames,
+             uint32_t* page_count,
+             uint8_t salts[8],
+             std::string* error) {
+  FILE* wal = fopen(path.c_str(), "rb");
+  if (wal == nullptr) {
+    if (errno == ENOENT) {
+      return true;
+    }
+    *error = FormatString("Failed to open %s: %s", path.c_str(),
+                          strerror(errno));
+    return false;
+  }
+
+  // A torn header is being written by a writer restarting the WAL, which only
+  // happens once all of its frames were checkpointed
+  uint8_t header[kWalHeaderSize] = {};
+  uint32_t checksum[2] = {0, 0};
+  bool is_valid = Read(wal, header, sizeof(header)) &&
+                  (Load32BE(header) & ~1u) == kWalMagic;
+  bool is_big_endian = (Load32BE(header) & 1) != 0;
+  if (is_valid) {
+    // 65536 is stored as 1
+    uint32_t wal_page_size = Load32BE(header + 8);
+    is_valid = wal_page_size == page_size ||
+               (wal_page_size == 1 && page_size == 65536);
+  }
+  if (is_valid) {
+    WalChecksum(header, 24, is_big_endian, checksum);
+    is_valid = checksum[0] == Load32BE(header + 24) &&
+               checksum[1] == Load32BE(header + 28);
+  }
+
+  std::unordered_map<uint32_t, uint64_t> pending;
+  std::vector<uint8_t> frame(kWalFrameHeaderSize + page_size);
+  uint64_t offset = kWalHeaderSize;
+  while (is_valid && Read(wal, frame.data(), frame.size())) {
+    uint32_t pgno = Load32BE(frame.data());
+    if (pgno == 0 || memcmp(frame.data() + 8, header + 16, 8) != 0) {
+      break;
+    }
+
+    WalChecksum(frame.data(), 8, is_big_endian, checksum);
+    WalChecksum(frame.data() + kWalFrameHeaderSize, page_size, is_big_endian,
+                checksum);
+    if (checksum[0] != Load32BE(frame.data() + 16) ||
+        checksum[1] != Load32BE(frame.data() + 20)) {
+      break;
+    }
+
+    pending[pgno] = offset + kWalFrameHeaderSize;
+    uint32_t commit_page_count = Load32BE(frame.data() + 4);
+    if (commit_page_count != 0) {
+      for (auto& entry : pending) {
+        (*frames)[entry.first] = entry.second;
+      }
+      pending.clear();
+      *page_count = commit_page_count;
+    }
+    offset += frame.size();
+  }
+
+  memcpy(salts, header + 16, 8);
+  bool is_done = ferror(wal) == 0;
+  if (!is_done) {
+    *error = FormatString("Failed to read %s: %s", path.c_str(),
+                          strerror(errno));
+  }
+  fclose(wal);
+  return is_done;
+}
+
+}  // namespace
+
+IncrementalBackupWorker::IncrementalBackupWorker(Napi::Env env,
+                                                 ConnectionConfig config,
+                                                 std::string delta_path,
+                                                 std::string manifest_path)
+    : Napi::AsyncWorker(env),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      config_(std::move(config)),
+      delta_path_(std::move(delta_path)),
+      manifest_path_(std::move(manifest_path)),
+      is_encrypted_(!config_.raw_key.empty()) {}
+
+void IncrementalBackupWorker::Execute() {
+  sqlite3* source;
+  std::string error;
+  if (config_.Open(&source, SQLITE_OPEN_READONLY, nullptr, &error) !=
+      SQLITE_OK) {
+    SetError(error);
+    return;
+  }
+
+  // Leftovers of an interrupted backup
+  Cleanup();
+
+  bool is_done = WriteDelta(source);
+  sqlite3_close(source);
+  if (!is_done) {
+    return;
+  }
+
+  // The manifest is replaced last: if the process is interrupted before, the
+  // next delta is computed against the previous backup again
+  if (rename((delta_path_ + "-tmp").c_str(), delta_path_.c_str()) != 0) {
+    SetError(
+        FormatString("Failed to replace the delta file: %s", strerror(errno)));
+    return;
+  }
+  WriteManifest();
+}
+
+bool IncrementalBackupWorker::WriteDelta(sqlite3* source) {
+  int count;
+  int page_size;
+  int page_count;
+  int r = sqlite3_exec(source, "BEGIN", nullptr, nullptr, nullptr);
+  if (r == SQLITE_OK) {
+    r = QueryInt(source, "SELECT count(*) FROM sqlite_schema", &count);
+  }
+  if (r == SQLITE_OK) {
+    r = QueryInt(source, "PRAGMA page_size", &page_size);
+  }
+  if (r == SQLITE_OK) {
+    r = QueryInt(source, "PRAGMA page_count", &page_count);
+  }
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(source));
+    return false;
+  }
+
+  page_size_ = page_size;
+  bool is_restarted = false;
+  bool is_done = ReadManifest() &&
+                 WritePages(page_count, IsWalMode(source), &is_restarted);
+
+  // Writers only restart the WAL once all of its frames were checkpointed
+  // and while no reader uses it, so the read transaction reads the database
+  // file only, which can't be checkpointed into until it ends
+  if (is_done && is_restarted) {
+    is_done = WritePages(page_count, false, &is_restarted);
+  }
+  sqlite3_exec(source, "COMMIT", nullptr, nullptr, nullptr);
+  return is_done;
+}
+
+bool IncrementalBackupWorker::ReadManifest() {
+  FILE* manifest = fopen(manifest_path_.c_str(), "rb");
+  if (manifest == nullptr) {
+    if (errno == ENOENT) {
+      return true;
+    }
+    SetError(FormatString("Failed to open %s: %s", manifest_path_.c_str(),
+                          strerror(errno)));
+    return false;
+  }
+
+  uint8_t header[kManifestHeaderSize];
+  bool is_valid = Read(manifest, header, sizeof(header)) &&
+                  memcmp(header, kManifestMagic, sizeof(kManifestMagic)) == 0;
+
+  // A manifest of a database with another page size or key is ignored and
+  // the delta is a full backup
+  uint32_t flags = is_encrypted_ ? kEncryptedFlag : 0;
+  if (is_valid && Load32(header + 8) == page_size_ &&
+      Load32(header + 12) == flags) {
+    std::vector<uint8_t> data(static_cast<size_t>(Load32(header + 16)) * 8);
+    is_valid = Read(manifest, data.data(), data.size());
+    for (size_t i = 0; is_valid && i < data.size(); i += 8) {
+      base_.push_back(Load64(data.data() + i));
+    }
+  }
+  fclose(manifest);
+
+  if (!is_valid) {
+    base_.clear();
+    SetError("Invalid backup manifest");
+  }
+  return is_valid;
+}
+
+bool IncrementalBackupWorker::WritePages(uint32_t page_count,
+                                         bool is_wal,
+                                         bool* is_restarted) {
+  *is_restarted = false;
+  std::unordered_map<uint32_t, uint64_t> frames;
+  uint8_t salts[8];
+  std::string error;
+  if (is_wal && !ReadWal(config_.path + "-wal", page_size_, &frames,
+                         &page_count, salts, &error)) {
+    SetError(error);
+    return false;
+  }
+
+  auto delta_path = delta_path_ + "-tmp";
+  FILE* db = fopen(config_.path.c_str(), "rb");
+  FILE* wal = nullptr;
+  if (db != nullptr && !frames.empty()) {
+    wal = fopen((config_.path + "-wal").c_str(), "rb");
+  }
+  FILE* delta = nullptr;
+  if (db != nullptr && (frames.empty() || wal != nullptr)) {
+    delta = fopen(delta_path.c_str(), "wb");
+  }
+  if (delta == nullptr) {
+    SetError(FormatString("Failed to open the database or the delta: %s",
+                          strerror(errno)));
+    if (wal != nullptr) {
+      fclose(wal);
+    }
+    if (db != nullptr) {
+      fclose(db);
+    }
+    return false;
+  }
+
+  uint8_t header[kDeltaHeaderSize] = {};
+  std::vector<uint8_t> record(kRecordHeaderSize + page_size_);
+  uint8_t* page = record.data() + kRecordHeaderSize;
+  uint32_t base_page_count = static_cast<uint32_t>(base_.size());
+  uint32_t records = 0;
+
+  // Pages that aren't in the WAL are read sequentially, without seeking
+  uint64_t db_offset = 0;
+  fingerprints_.assign(page_count, 0);
+  bool is_read = true;
+  bool is_written = Write(delta, header, sizeof(header));
+  for (uint32_t pgno = 1; is_read && is_written && pgno <= page_count;
+       pgno++) {
+    auto it = frames.find(pgno);
+    if (it != frames.end()) {
+      is_read = Seek(wal, it->second) && Read(wal, page, page_size_);
+    } else {
+      uint64_t offset = static_cast<uint64_t>(pgno - 1) * page_size_;
+      is_read = (db_offset == offset || Seek(db, offset)) &&
+                Read(db, page, page_size_);
+      db_offset = offset + page_size_;
+    }
+    if (!is_read) {
+      SetError(FormatString("Failed to read page %u of the database", pgno));
+      break;
+    }
+
+    uint64_t fingerprint = Fingerprint(page, page_size_, is_encrypted_);
+    fingerprints_[pgno - 1] = fingerprint;
+    if (pgno <= base_page_count && base_[pgno - 1] == fingerprint) {
+      continue;
+    }
+
+    Store32(record.data(), pgno);
+    Store32(record.data() + 4, 0);
+    Store64(record.data() + 8, pgno <= base_page_count ? base_[pgno - 1] : 0);
+    is_written = Write(delta, record.data(), record.size());
+    records++;
+  }
+
+  // Frames are only overwritten after a writer restarted the WAL, which
+  // changes the salts of its header first
+  if (is_read && is_written && wal != nullptr) {
+    uint8_t wal_header[kWalHeaderSize];
+    *is_restarted = !Seek(wal, 0) || !Read(wal, wal_header, kWalHeaderSize) ||
+                    memcmp(wal_header + 16, salts, 8) != 0;
+  }
+
+  if (is_read && is_written && !*is_restarted) {
+    memcpy(header, kDeltaMagic, sizeof(kDeltaMagic));
+    Store32(header + 8, page_size_);
+    Store32(header + 12, is_encrypted_ ? kEncryptedFlag : 0);
+    Store32(header + 16, page_count);
+    Store32(header + 20, base_page_count);
+    Store32(header + 24, records);
+    is_written = Seek(delta, 0) && Write(delta, header, sizeof(header)) &&
+                 Sync(delta);
+  }
+  is_written = fclose(delta) == 0 && is_written;
+  if (is_read && !is_written) {
+    SetError(FormatString("Failed to write the delta: %s", strerror(errno)));
+  }
+  if (wal != nullptr) {
+    fclose(wal);
+  }
+  fclose(db);
+
+  changed_pages_ = records;
+  delta_bytes_ = kDeltaHeaderSize + static_cast<uint64_t>(records) *
+                                        record.size();
+  return is_read && is_written;
+}
+
+bool IncrementalBackupWorker::WriteManifest() {
+  auto temp_path = manifest_path_ + "-tmp";
+  FILE* manifest = fopen(temp_path.c_str(), "wb");
+  if (manifest == nullptr) {
+    SetError(FormatString("Failed to create %s: %s", temp_path.c_str(),
+                          strerror(errno)));
+    return false;
+  }
+
+  std::vector<uint8_t> data(kManifestHeaderSize + fingerprints_.size() * 8);
+  memcpy(data.data(), kManifestMagic, sizeof(kManifestMagic));
+  Store32(data.data() + 8, page_size_);
+  Store32(data.data() + 12, is_encrypted_ ? kEncryptedFlag : 0);
+  Store32(data.data() + 16, static_cast<uint32_t>(fingerprints_.size()));
+  Store32(data.data() + 20, 0);
+  for (size_t i = 0; i < fingerprints_.size(); i++) {
+    Store64(data.data() + kManifestHeaderSize + i * 8, fingerprints_[i]);
+  }
+
+  bool is_done = Write(manifest, data.data(), data.size()) && Sync(manifest);
+  is_done = fclose(manifest) == 0 && is_done;
+  if (is_done) {
+    is_done = rename(temp_path.c_str(), manifest_path_.c_str()) == 0;
+  }
+  if (!is_done) {
+    SetError(FormatString("Failed to write the manifest: %s", strerror(errno)));
+  }
+  return is_done;
+}
+
+void IncrementalBackupWorker::OnOK() {
+  auto env = Env();
+  auto result = Napi::Object::New(env);
+  result["pageCount"] = static_cast<double>(fingerprints_.size());
+  result["changedPages"] = static_cast<double>(changed_pages_);
+  result["deltaBytes"] = static_cast<double>(delta_bytes_);
+  deferred_.Resolve(result);
+}
+
+void IncrementalBackupWorker::OnError(const Napi::Error& e) {
+  Cleanup();
+  deferred_.Reject(e.Value());
+}
+
+void IncrementalBackupWorker::Cleanup() {
+  remove((delta_path_ + "-tmp").c_str());
+  remove((manifest_path_ + "-tmp").c_str());
+}
+
+ApplyDeltaWorker::ApplyDeltaWorker(Napi::Env env,
+                                   std::string target_path,
+                                   std::string delta_path)
+    : Napi::AsyncWorker(env),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      target_path_(std::move(target_path)),
+      delta_path_(std::move(delta_path)) {}
+
+void ApplyDeltaWorker::Execute() {
+  FILE* delta = fopen(delta_path_.c_str(), "rb");
+  if (delta == nullptr) {
+    SetError(FormatString("Failed to open %s: %s", delta_path_.c_str(),
+                          strerror(errno)));
+    return;
+  }
+  Apply(delta);
+  fclose(delta);
+}
+
+bool ApplyDeltaWorker::Apply(FILE* delta) {
+  uint8_t header[kDeltaHeaderSize];
+  if (!Read(delta, header, sizeof(header)) ||
+      memcmp(header, kDeltaMagic, sizeof(kDeltaMagic)) != 0) {
+    SetError("Invalid backup delta");
+    return false;
+  }
+
+  uint32_t page_size = Load32(header + 8);
+  bool is_encrypted = (Load32(header + 12) & kEncryptedFlag) != 0;
+  uint32_t page_count = Load32(header + 16);
+  uint32_t base_page_count = Load32(header + 20);
+  uint32_t records = Load32(header + 24);
+  if (page_size < 512 || page_size > 65536 ||
+      (page_size & (page_size - 1)) != 0) {
+    SetError("Invalid backup delta");
+    return false;
+  }
+
+  // Only full backups can be applied to a new file
+  FILE* target = fopen(target_path_.c_str(), "r+b");
+  if (target == nullptr && errno == ENOENT && base_page_count == 0) {
+    target = fopen(target_path_.c_str(), "w+b");
+  }
+  if (target == nullptr) {
+    SetError(FormatString("Failed to open %s: %s", target_path_.c_str(),
+                          strerror(errno)));
+    return false;
+  }
+
+  std::vector<uint8_t> record(kRecordHeaderSize + page_size);
+  uint8_t* page = record.data() + kRecordHeaderSize;
+  auto record_offset = [&](uint32_t i) {
+    return kDeltaHeaderSize + static_cast<uint64_t>(i) * record.size();
+  };
+
+  // Check the whole delta before writing anything
+  const char* problem = nullptr;
+  if (base_page_count != 0 &&
+      FileSize(target) !=
+          static_cast<int64_t>(base_page_count) * page_size) {
+    problem = "Backup delta doesn't match the target";
+  }
+  for (uint32_t i = 0; problem == nullptr && i < records; i++) {
+    if (!Seek(delta, record_offset(i)) ||
+        !Read(delta, record.data(), kRecordHeaderSize)) {
+      problem = "Invalid backup delta";
+      break;
+    }
+
+    uint32_t pgno = Load32(record.data());
+    if (pgno == 0 || pgno > page_count) {
+      problem = "Invalid backup delta";
+    } else if (pgno <= base_page_count &&
+               (!Seek(target, static_cast<uint64_t>(pgno - 1) * page_size) ||
+                !Read(target, page, page_size) ||
+                Fingerprint(page, page_size, is_encrypted) !=
+                    Load64(record.data() + 8))) {
+      problem = "Backup delta doesn't match the target";
+    }
+  }
+  if (problem != nullptr) {
+    SetError(problem);
+    fclose(target);
+    return false;
+  }
+
+  bool is_done = true;
+  for (uint32_t i = 0; is_done && i < records; i++) {
+    is_done = Seek(delta, record_offset(i)) &&
+              Read(delta, record.data(), record.size());
+    if (is_done) {
+      uint32_t pgno = Load32(record.data());
+      is_done = Seek(target, static_cast<uint64_t>(pgno - 1) * page_size) &&
+                Write(target, page, page_size);
+    }
+  }
+  if (is_done) {
+    is_done = Truncate(target, static_cast<uint64_t>(page_count) * page_size) &&
+              Sync(target);
+  }
+  is_done = fclose(target) == 0 && is_done;
+  if (!is_done) {
+    SetError(FormatString("Failed to apply the delta to %s: %s",
+                          target_path_.c_str(), strerror(errno)));
+  }
+  return is_done;
+}
+
+void ApplyDeltaWorker::OnOK() {
+  deferred_.Resolve(Env().Undefined());
+}
+
+void ApplyDeltaWorker::OnError(const Napi::Error& e) {
+  deferred_.Reject(e.Value());
+}
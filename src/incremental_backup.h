@@ -0,0 +1,102 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_INCREMENTAL_BACKUP_H_
+#define SRC_INCREMENTAL_BACKUP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "addon.h"
+#include "napi.h"
+#include "sqlite3.h"
+
+// Writes the pages of the database that changed since the previous backup
+// into a delta file on a worker thread, without decrypting them.
+//
+// The manifest at `manifest_path` has a fingerprint of every page as of the
+// previous backup. For encrypted databases the fingerprint is the end of the
+// HMAC that SQLCipher stores in every page (or of the IV if HMACs are
+// disabled), both of which change whenever the page is written, so pages are
+// not hashed. Pages of plaintext databases are hashed. Without a manifest
+// every page is written and the delta is a full backup. The manifest is
+// replaced once the delta is complete.
+//
+// Like `SnapshotWorker`, a side connection keeps a read transaction open so
+// that the database file followed by the WAL contains a complete state of
+// the database. Instead of being copied, the WAL is parsed: the last frame of
+// every page up to the last valid commit overrides the page in the database
+// file.
+class IncrementalBackupWorker : public Napi::AsyncWorker {
+ public:
+  IncrementalBackupWorker(Napi::Env env,
+                          ConnectionConfig config,
+                          std::string delta_path,
+                          std::string manifest_path);
+
+  inline Napi::Promise Promise() { return deferred_.Promise(); }
+
+ protected:
+  void Execute() override;
+  void OnOK() override;
+  void OnError(const Napi::Error& e) override;
+
+ private:
+  // All return `false` and call `SetError` on failure
+  bool WriteDelta(sqlite3* source);
+  bool ReadManifest();
+  // Sets `is_restarted` if the WAL was restarted while the pages were read,
+  // the delta is incomplete in that case
+  bool WritePages(uint32_t page_count, bool is_wal, bool* is_restarted);
+  bool WriteManifest();
+
+  void Cleanup();
+
+  Napi::Promise::Deferred deferred_;
+  ConnectionConfig config_;
+  std::string delta_path_;
+  std::string manifest_path_;
+
+  uint32_t page_size_ = 0;
+  bool is_encrypted_;
+
+  // Fingerprints of the previous and of the new backup, indexed by page
+  // number minus one
+  std::vector<uint64_t> base_;
+  std::vector<uint64_t> fingerprints_;
+
+  uint64_t changed_pages_ = 0;
+  uint64_t delta_bytes_ = 0;
+};
+
+// Writes the pages of a delta into the file restored from the previous
+// backups (or into a new file for a full backup) on a worker thread. The
+// previous content of the changed pages is checked against the fingerprints
+// in the delta before anything is written, so deltas applied out of order
+// are rejected. The target is left inconsistent if the process is
+// interrupted while writing.
+class ApplyDeltaWorker : public Napi::AsyncWorker {
+ public:
+  ApplyDeltaWorker(Napi::Env env,
+                   std::string target_path,
+                   std::string delta_path);
+
+  inline Napi::Promise Promise() { return deferred_.Promise(); }
+
+ protected:
+  void Execute() override;
+  void OnOK() override;
+  void OnError(const Napi::Error& e) override;
+
+ private:
+  // Returns `false` and calls `SetError` on failure
+  bool Apply(FILE* delta);
+
+  Napi::Promise::Deferred deferred_;
+  std::string target_path_;
+  std::string delta_path_;
+};
+
+#endif  // SRC_INCREMENTAL_BACKUP_H_
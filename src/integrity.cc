@@ -0,0 +1,422 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "integrity.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "signal-tokenizer.h"
+
+namespace {
+
+// From sqlcipher.h
+constexpr int kHmacSha512 = 2;
+constexpr int kPbkdf2HmacSha512 = 2;
+
+// Size of the salt stored in front of the first page, unless the connection
+// has a plaintext header
+constexpr int kFileHeaderSize = 16;
+
+// AES-256 key and salt sizes
+constexpr size_t kKeySize = 32;
+constexpr size_t kSaltSize = 16;
+
+// Pages handed out to a thread at a time
+constexpr uint64_t kChunkPages = 256;
+
+constexpr auto kProgressInterval = std::chrono::milliseconds(100);
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Reads a byte returned as hex by a pragma, e.g. `cipher_hmac_salt_mask`
+int QueryHexByte(sqlite3* handle, const char* sql, uint8_t* result) {
+  sqlite3_stmt* stmt;
+  int r = sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+  r = sqlite3_step(stmt);
+  if (r == SQLITE_ROW) {
+    auto hex = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    int hi = -1;
+    int lo = -1;
+    if (hex != nullptr && sqlite3_column_bytes(stmt, 0) == 2) {
+      hi = HexValue(hex[0]);
+      lo = HexValue(hex[1]);
+    }
+    if (hi >= 0 && lo >= 0) {
+      *result = static_cast<uint8_t>((hi << 4) | lo);
+      r = SQLITE_OK;
+    } else {
+      r = SQLITE_MISMATCH;
+    }
+  } else if (r == SQLITE_DONE) {
+    // Unknown pragma
+    r = SQLITE_MISMATCH;
+  }
+  sqlite3_finalize(stmt);
+  return r;
+}
+
+// Decodes `x'<key><salt>'`
+bool ParseRawKey(const std::string& raw_key, uint8_t* key, uint8_t* salt) {
+  if (raw_key.size() != 3 + 2 * (kKeySize + kSaltSize)) {
+    return false;
+  }
+  const char* hex = raw_key.data() + 2;
+  for (size_t i = 0; i < kKeySize + kSaltSize; i++) {
+    int hi = HexValue(hex[2 * i]);
+    int lo = HexValue(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    uint8_t byte = static_cast<uint8_t>((hi << 4) | lo);
+    if (i < kKeySize) {
+      key[i] = byte;
+    } else {
+      salt[i - kKeySize] = byte;
+    }
+  }
+  return true;
+}
+
+// Read-only handle on the main database file
+class PageReader {
+ public:
+  explicit PageReader(sqlite3_vfs* vfs) : vfs_(vfs) {}
+
+  ~PageReader() {
+    if (open_) {
+      file_->pMethods->xClose(file_);
+    }
+    free(file_);
+  }
+
+  int Open(const char* path) {
+    file_ = static_cast<sqlite3_file*>(calloc(1, vfs_->szOsFile));
+    if (file_ == nullptr) {
+      return SQLITE_NOMEM;
+    }
+    int out_flags;
+    int r = vfs_->xOpen(vfs_, path, file_,
+                        SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READONLY, &out_flags);
+    // `xClose` must be called even if `xOpen` failed as long as `pMethods` is
+    // set.
+    open_ = file_->pMethods != nullptr;
+    return r;
+  }
+
+  int FileSize(sqlite3_int64* size) {
+    return file_->pMethods->xFileSize(file_, size);
+  }
+
+  int Read(void* buf, int size, sqlite3_int64 offset) {
+    return file_->pMethods->xRead(file_, buf, size, offset);
+  }
+
+ private:
+  sqlite3_vfs* vfs_;
+  sqlite3_file* file_ = nullptr;
+  bool open_ = false;
+};
+
+struct PageVerifier {
+  SqlCipherProvider provider;
+  uint8_t hmac_key[kKeySize];
+  int page_size;
+
+  // Offset of the data in the first page
+  int header_size;
+
+  int reserve_size;
+  int iv_size;
+  int hmac_size;
+
+  ~PageVerifier() { SecureZero(hmac_key, sizeof(hmac_key)); }
+
+  // See `sqlcipher_page_cipher`. Returns `false` for corrupt pages.
+  bool Verify(uint32_t pgno, const uint8_t* page, uint8_t* hmac_out) {
+    // Never written
+    if (std::all_of(page, page + page_size, [](uint8_t b) { return b == 0; })) {
+      return true;
+    }
+
+    int offset = pgno == 1 ? header_size : 0;
+    const uint8_t* data = page + offset;
+    int size = page_size - offset - reserve_size;
+    const uint8_t* hmac = data + size + iv_size;
+
+    uint8_t pgno_le[4] = {
+        static_cast<uint8_t>(pgno),
+        static_cast<uint8_t>(pgno >> 8),
+        static_cast<uint8_t>(pgno >> 16),
+        static_cast<uint8_t>(pgno >> 24),
+    };
+    int r = provider.hmac(nullptr, kHmacSha512, hmac_key, sizeof(hmac_key),
+                          data, size + iv_size, pgno_le, sizeof(pgno_le),
+                          hmac_out);
+    return r == SQLITE_OK && memcmp(hmac, hmac_out, hmac_size) == 0;
+  }
+};
+
+}  // namespace
+
+IntegrityWorker::IntegrityWorker(Napi::Env env,
+                                 ConnectionConfig config,
+                                 int threads,
+                                 Napi::Function on_progress)
+    : Napi::AsyncProgressWorker<uint64_t>(env),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      config_(std::move(config)),
+      threads_(threads) {
+  if (!on_progress.IsEmpty() && on_progress.IsFunction()) {
+    on_progress_ = Napi::Persistent(on_progress);
+  }
+}
+
+void IntegrityWorker::Execute(const ExecutionProgress& progress) {
+  PageVerifier verifier;
+
+  std::string error;
+  sqlite3* handle;
+  int r = config_.Open(&handle, SQLITE_OPEN_READONLY, nullptr, &error);
+  if (r != SQLITE_OK) {
+    SetError(error);
+    return;
+  }
+  auto close = std::unique_ptr<sqlite3, int (*)(sqlite3*)>(handle,
+                                                           sqlite3_close_v2);
+
+  // Settings used by SQLCipher for the HMAC key and the page layout. The salt
+  // mask is process-wide, the others are per connection.
+  int use_hmac = 0;
+  uint8_t hmac_salt_mask = 0;
+  int fast_kdf_iter = 0;
+  int plaintext_header_size = 0;
+  r = QueryInt(handle, "PRAGMA cipher_use_hmac", &use_hmac);
+  if (r == SQLITE_OK) {
+    r = QueryInt(handle, "PRAGMA cipher_page_size", &verifier.page_size);
+  }
+  if (r == SQLITE_OK) {
+    r = QueryHexByte(handle, "PRAGMA cipher_hmac_salt_mask", &hmac_salt_mask);
+  }
+  if (r == SQLITE_OK) {
+    r = QueryInt(handle, "PRAGMA fast_kdf_iter", &fast_kdf_iter);
+  }
+  if (r == SQLITE_OK) {
+    r = QueryInt(handle, "PRAGMA cipher_plaintext_header_size",
+                 &plaintext_header_size);
+  }
+  if (r == SQLITE_MISMATCH || (r == SQLITE_OK && fast_kdf_iter < 1)) {
+    SetError("Unsupported cipher settings");
+    return;
+  }
+  if (r == SQLITE_OK) {
+    // Keep the read transaction open until the end of the check. Reading the
+    // schema verifies the key too.
+    r = sqlite3_exec(handle, "BEGIN; SELECT count(*) FROM sqlite_schema",
+                     nullptr, nullptr, nullptr);
+  }
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(handle));
+    return;
+  }
+  if (!use_hmac) {
+    SetError("HMAC is disabled for this database");
+    return;
+  }
+  verifier.header_size =
+      plaintext_header_size > 0 ? plaintext_header_size : kFileHeaderSize;
+
+  uint8_t key[kKeySize];
+  uint8_t salt[kSaltSize];
+  if (!ParseRawKey(config_.raw_key, key, salt)) {
+    SetError("Invalid raw key");
+    return;
+  }
+
+  // Derive the HMAC key the same way SQLCipher does, see
+  // `sqlcipher_cipher_ctx_key_derive`
+  uint8_t hmac_salt[kSaltSize];
+  for (size_t i = 0; i < kSaltSize; i++) {
+    hmac_salt[i] = salt[i] ^ hmac_salt_mask;
+  }
+  signal_crypto_provider_setup(&verifier.provider);
+  r = verifier.provider.pbkdf(nullptr, kPbkdf2HmacSha512, key, sizeof(key),
+                              hmac_salt, sizeof(hmac_salt), fast_kdf_iter,
+                              sizeof(verifier.hmac_key), verifier.hmac_key);
+  SecureZero(key, sizeof(key));
+  if (r != SQLITE_OK) {
+    SetError("Failed to derive the HMAC key");
+    return;
+  }
+
+  verifier.iv_size = verifier.provider.get_iv_sz(nullptr);
+  verifier.hmac_size = verifier.provider.get_hmac_sz(nullptr, kHmacSha512);
+  int block_size = verifier.provider.get_block_sz(nullptr);
+  verifier.reserve_size = verifier.iv_size + verifier.hmac_size;
+  verifier.reserve_size =
+      (verifier.reserve_size + block_size - 1) / block_size * block_size;
+  if (verifier.header_size + verifier.reserve_size >= verifier.page_size) {
+    SetError("Unsupported cipher settings");
+    return;
+  }
+
+  sqlite3_vfs* vfs = sqlite3_vfs_find(nullptr);
+  const char* path = sqlite3_db_filename(handle, "main");
+
+  sqlite3_int64 file_size;
+  {
+    PageReader reader(vfs);
+    r = reader.Open(path);
+    if (r == SQLITE_OK) {
+      r = reader.FileSize(&file_size);
+    }
+    if (r != SQLITE_OK) {
+      SetError(FormatString("Failed to open the database file: %s",
+                            sqlite3_errstr(r)));
+      return;
+    }
+  }
+  page_count_ = file_size / verifier.page_size;
+
+  std::atomic<uint64_t> next_page(0);
+  std::atomic<uint64_t> checked(0);
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  int running = threads_;
+  int thread_error = SQLITE_OK;
+  std::vector<uint32_t> mismatches;
+
+  auto run = [&]() {
+    PageReader reader(vfs);
+    std::vector<uint8_t> page(verifier.page_size);
+    std::vector<uint8_t> hmac(verifier.hmac_size);
+    std::vector<uint32_t> local_mismatches;
+
+    int status = reader.Open(path);
+    while (status == SQLITE_OK) {
+      uint64_t start = next_page.fetch_add(kChunkPages);
+      if (start >= page_count_) {
+        break;
+      }
+      uint64_t end = std::min(start + kChunkPages, page_count_);
+      for (uint64_t i = start; i < end && status == SQLITE_OK; i++) {
+        status = reader.Read(page.data(), verifier.page_size,
+                             i * verifier.page_size);
+        uint32_t pgno = static_cast<uint32_t>(i + 1);
+        if (status == SQLITE_OK &&
+            !verifier.Verify(pgno, page.data(), hmac.data())) {
+          local_mismatches.push_back(pgno);
+        }
+      }
+      checked.fetch_add(end - start, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (status != SQLITE_OK && thread_error == SQLITE_OK) {
+      thread_error = status;
+    }
+    mismatches.insert(mismatches.end(), local_mismatches.begin(),
+                      local_mismatches.end());
+    running--;
+    done_cv.notify_one();
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads_; i++) {
+    workers.emplace_back(run);
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!done_cv.wait_for(lock, kProgressInterval,
+                             [&] { return running == 0; })) {
+      uint64_t data[2] = {checked.load(std::memory_order_relaxed),
+                          page_count_};
+      progress.Send(data, 2);
+    }
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  if (thread_error != SQLITE_OK) {
+    SetError(FormatString("Failed to read the database file: %s",
+                          sqlite3_errstr(thread_error)));
+    return;
+  }
+
+  // A concurrent checkpoint might have been writing the page while it was
+  // read. Check once more before reporting it.
+  if (!mismatches.empty()) {
+    PageReader reader(vfs);
+    std::vector<uint8_t> page(verifier.page_size);
+    std::vector<uint8_t> hmac(verifier.hmac_size);
+
+    r = reader.Open(path);
+    for (uint32_t pgno : mismatches) {
+      if (r == SQLITE_OK) {
+        r = reader.Read(page.data(), verifier.page_size,
+                        static_cast<sqlite3_int64>(pgno - 1) *
+                            verifier.page_size);
+      }
+      if (r != SQLITE_OK) {
+        SetError(FormatString("Failed to read the database file: %s",
+                              sqlite3_errstr(r)));
+        return;
+      }
+      if (!verifier.Verify(pgno, page.data(), hmac.data())) {
+        corrupt_pages_.push_back(pgno);
+      }
+    }
+    std::sort(corrupt_pages_.begin(), corrupt_pages_.end());
+  }
+
+  uint64_t data[2] = {page_count_, page_count_};
+  progress.Send(data, 2);
+}
+
+void IntegrityWorker::OnProgress(const uint64_t* data, size_t count) {
+  if (on_progress_.IsEmpty() || count != 2) {
+    return;
+  }
+
+  auto env = Env();
+  Napi::HandleScope scope(env);
+  on_progress_.Call({Napi::Number::New(env, static_cast<double>(data[0])),
+                     Napi::Number::New(env, static_cast<double>(data[1]))});
+}
+
+void IntegrityWorker::OnOK() {
+  auto env = Env();
+  auto result = Napi::Array::New(env, corrupt_pages_.size());
+  uint32_t i = 0;
+  for (uint32_t pgno : corrupt_pages_) {
+    result[i++] = Napi::Number::New(env, pgno);
+  }
+  deferred_.Resolve(result);
+}
+
+void IntegrityWorker::OnError(const Napi::Error& e) {
+  deferred_.Reject(e.Value());
+}
@@ -0,0 +1,52 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_INTEGRITY_H_
+#define SRC_INTEGRITY_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "addon.h"
+#include "napi.h"
+#include "sqlite3.h"
+
+// Parallel equivalent of `PRAGMA cipher_integrity_check` for the main database
+// file.
+//
+// Pages are read through the default VFS (never with a raw file descriptor:
+// closing one would drop the process' POSIX locks on the database) and their
+// HMACs are recomputed with the crypto provider on `threads` threads. A side
+// connection holds a read transaction for the duration of the check so that
+// the file isn't truncated under the readers. Checkpoints can still rewrite
+// pages in place, so mismatches are read and verified a second time before
+// being reported.
+//
+// Resolves with the sorted numbers of the corrupt pages.
+class IntegrityWorker : public Napi::AsyncProgressWorker<uint64_t> {
+ public:
+  IntegrityWorker(Napi::Env env,
+                  ConnectionConfig config,
+                  int threads,
+                  Napi::Function on_progress);
+
+  inline Napi::Promise Promise() { return deferred_.Promise(); }
+
+ protected:
+  void Execute(const ExecutionProgress& progress) override;
+  void OnProgress(const uint64_t* data, size_t count) override;
+  void OnOK() override;
+  void OnError(const Napi::Error& e) override;
+
+ private:
+  Napi::Promise::Deferred deferred_;
+  Napi::FunctionReference on_progress_;
+  ConnectionConfig config_;
+  int threads_;
+
+  uint64_t page_count_ = 0;
+  std::vector<uint32_t> corrupt_pages_;
+};
+
+#endif  // SRC_INTEGRITY_H_
@@ -0,0 +1,49 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "interrupt_registry.h"
+
+#include <map>
+#include <mutex>
+
+namespace {
+
+// Never freed, ids can be interrupted from threads outliving the addon
+std::mutex& mu = *new std::mutex();
+std::map<uint32_t, sqlite3*>* handles = new std::map<uint32_t, sqlite3*>();
+uint32_t next_id = 1;
+
+}  // namespace
+
+uint32_t InterruptRegistry::Register(sqlite3* handle) {
+  std::lock_guard<std::mutex> lock(mu);
+  uint32_t id = next_id++;
+  (*handles)[id] = handle;
+  return id;
+}
+
+void InterruptRegistry::SetHandle(uint32_t id, sqlite3* handle) {
+  std::lock_guard<std::mutex> lock(mu);
+  auto it = handles->find(id);
+  if (it != handles->end()) {
+    it->second = handle;
+  }
+}
+
+void InterruptRegistry::Unregister(uint32_t id) {
+  std::lock_guard<std::mutex> lock(mu);
+  handles->erase(id);
+}
+
+bool InterruptRegistry::Interrupt(uint32_t id) {
+  std::lock_guard<std::mutex> lock(mu);
+  auto it = handles->find(id);
+  if (it == handles->end() || it->second == nullptr) {
+    return false;
+  }
+
+  // `sqlite3_interrupt` is safe to call from any thread while the connection
+  // is open, and `Unregister` waits for the lock.
+  sqlite3_interrupt(it->second);
+  return true;
+}
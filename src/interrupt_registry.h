@@ -0,0 +1,30 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_INTERRUPT_REGISTRY_H_
+#define SRC_INTERRUPT_REGISTRY_H_
+
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+// Interrupts running queries of connections on request from any thread.
+//
+// Connections are registered under an id that stays valid (and safe to pass
+// to other threads) after the connection is closed: interrupting an id
+// without a connection does nothing.
+class InterruptRegistry {
+ public:
+  static uint32_t Register(sqlite3* handle);
+
+  // Replaces the connection of `id` (e.g. after reopening), `nullptr` while
+  // there is none
+  static void SetHandle(uint32_t id, sqlite3* handle);
+
+  static void Unregister(uint32_t id);
+
+  // Returns `false` if there is no connection with `id`
+  static bool Interrupt(uint32_t id);
+};
+
+#endif  // SRC_INTERRUPT_REGISTRY_H_
@@ -0,0 +1,765 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "io_uring_vfs.h"
+
+#include <mutex>
+
+#include "vfs_shim.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_IO_URING 1
+#endif
+#endif  // defined(__linux__)
+
+namespace {
+
+sqlite3_vfs io_uring_vfs;
+
+#if defined(HAVE_IO_URING)
+
+// Submission queue size of the ring of each WAL file
+constexpr unsigned kRingEntries = 64;
+
+// Pending writes are submitted once either limit is reached
+constexpr size_t kMaxPendingWrites = 32;
+constexpr size_t kMaxPendingBytes = 4 * 1024 * 1024;
+
+// Contiguous writes (frame headers and pages) are coalesced up to this size
+constexpr size_t kMaxWriteSize = 1024 * 1024;
+
+// Checkpoint read window: `kReadDepth` reads of `kReadChunk` bytes in flight
+constexpr int kReadDepth = 8;
+constexpr int kReadChunk = 64 * 1024;
+
+// `WAL_CKPT_LOCK` in wal.c
+constexpr int kCheckpointLock = 1;
+
+// WAL frame headers are written on their own, followed by the page. The
+// database size after the commit (bytes 4 to 7) is only set in the header of
+// the last frame of a transaction.
+constexpr int kFrameHeaderSize = 24;
+
+// `user_data` of the fsync entry
+constexpr uint64_t kFsyncTag = ~0ULL;
+
+sqlite3_vfs* base_vfs = nullptr;
+
+// Indexed by the `iVersion` of the underlying file's methods so that we never
+// advertise methods that the underlying file doesn't have.
+sqlite3_io_methods io_methods[4];
+
+struct Completion {
+  uint64_t user_data;
+  int32_t res;
+};
+
+// Minimal io_uring wrapper on top of the raw system calls. Not thread-safe,
+// each ring is used by a single connection.
+class Ring {
+ public:
+  ~Ring() {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) {
+      munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != nullptr) {
+      munmap(sq_ptr_, sq_size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  bool Init(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      return false;
+    }
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+
+    sq_ptr_ = Map(sq_size_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == nullptr) {
+      return false;
+    }
+    cq_ptr_ = single_mmap ? sq_ptr_ : Map(cq_size_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == nullptr) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+    if (sqes_ == nullptr) {
+      return false;
+    }
+
+    auto sq = static_cast<uint8_t*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    auto cq = static_cast<uint8_t*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    capacity_ = params.sq_entries;
+    return true;
+  }
+
+  inline unsigned capacity() const { return capacity_; }
+
+  // Returns a zeroed entry. At most `capacity()` entries can be queued
+  // between two `SubmitAndWait()` calls.
+  io_uring_sqe* Queue() {
+    unsigned index = (*sq_tail_ + queued_) & sq_mask_;
+    queued_++;
+
+    sq_array_[index] = index;
+    auto sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  // Submits the queued entries and waits for `wait` completions. Returns
+  // `-errno` on failure, the completions reaped so far are still in `out`.
+  //
+  // On failure the entries that weren't submitted are dropped, and the
+  // submitted ones are waited for, so that the kernel is done with their
+  // buffers and their completions aren't reaped by the next call.
+  int SubmitAndWait(unsigned wait, std::vector<Completion>* out) {
+    unsigned to_submit = queued_;
+    __atomic_store_n(sq_tail_, *sq_tail_ + queued_, __ATOMIC_RELEASE);
+    queued_ = 0;
+
+    unsigned submitted = 0;
+    unsigned reaped = 0;
+    while (true) {
+      reaped += Reap(out);
+      if (to_submit == 0 && reaped >= wait) {
+        return 0;
+      }
+
+      unsigned min_complete = reaped < wait ? wait - reaped : 0;
+      long r = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+                       min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr,
+                       0);
+      if (r < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          continue;
+        }
+        int error = -errno;
+
+        // Without `IORING_SETUP_SQPOLL` the kernel only reads the submission
+        // queue from `io_uring_enter`, which consumed everything before head
+        __atomic_store_n(sq_tail_, __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELEASE);
+        Drain(submitted, reaped, out);
+        return error;
+      }
+      submitted += static_cast<unsigned>(r);
+      to_submit -= std::min(static_cast<unsigned>(r), to_submit);
+    }
+  }
+
+ private:
+  void* Map(size_t size, off_t offset) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  // Waits until `reaped` reaches `submitted`. Completions are posted to the
+  // ring even if `io_uring_enter` keeps failing, so it is polled instead.
+  void Drain(unsigned submitted,
+             unsigned reaped,
+             std::vector<Completion>* out) {
+    while (reaped < submitted) {
+      long r = syscall(__NR_io_uring_enter, fd_, 0, submitted - reaped,
+                       IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        sched_yield();
+      }
+      reaped += Reap(out);
+    }
+  }
+
+  unsigned Reap(std::vector<Completion>* out) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned count = tail - head;
+    for (; head != tail; head++) {
+      auto cqe = &cqes_[head & cq_mask_];
+      out->push_back({cqe->user_data, cqe->res});
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  int fd_ = -1;
+  unsigned capacity_ = 0;
+  unsigned queued_ = 0;
+
+  void* sq_ptr_ = nullptr;
+  size_t sq_size_ = 0;
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* sq_array_ = nullptr;
+
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  void* cq_ptr_ = nullptr;
+  size_t cq_size_ = 0;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+};
+
+struct UringFile {
+  sqlite3_file base;
+  sqlite3_file* real;
+
+  // Main database files: key in the registry and the WAL file of the same
+  // connection.
+  const char* db_name = nullptr;
+  UringFile* wal = nullptr;
+
+  // WAL files: the main database file of the same connection
+  UringFile* main = nullptr;
+
+  // WAL files only, pass-through if `ring` is not set. `fd` is a separate
+  // descriptor for the ring: SQLite never locks the WAL file itself so closing
+  // it doesn't drop any POSIX locks.
+  std::unique_ptr<Ring> ring;
+  int fd = -1;
+
+  // The first `xSync` goes through the default VFS which also syncs the
+  // directory of a newly created file.
+  bool synced = false;
+
+  struct Write {
+    sqlite3_int64 offset;
+    std::vector<uint8_t> data;
+  };
+  std::vector<Write> pending;
+  size_t pending_bytes = 0;
+
+  // The last write was the header of a commit frame
+  bool is_commit_header = false;
+
+  // Set while the connection holds the checkpoint lock
+  bool checkpointing = false;
+  std::vector<uint8_t> window;
+  sqlite3_int64 window_offset = 0;
+
+  void DropWindow() { std::vector<uint8_t>().swap(window); }
+};
+
+constexpr int kFileSize =
+    (sizeof(UringFile) + alignof(max_align_t) - 1) &
+    ~(alignof(max_align_t) - 1);
+
+inline UringFile* Cast(sqlite3_file* f) {
+  return reinterpret_cast<UringFile*>(f);
+}
+
+// Main database files by their `sqlite3_filename`. The name passed to `xOpen`
+// of the WAL file points into the same allocation, which makes it possible to
+// find the main database file of the same connection.
+std::mutex registry_mu;
+std::map<const char*, UringFile*>* registry =
+    new std::map<const char*, UringFile*>();
+
+bool WriteFully(int fd, const uint8_t* data, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Submits the pending writes, followed by an fsync linked to them if
+// `sync_flags` is non-zero, and waits for their completion. Anything that
+// didn't complete in the ring (e.g. unsupported opcodes on older kernels) is
+// done synchronously instead.
+int Flush(UringFile* file, int sync_flags) {
+  bool sync = sync_flags != 0;
+  if (file->pending.empty() && !sync) {
+    return SQLITE_OK;
+  }
+
+  auto& pending = file->pending;
+  auto ring = file->ring.get();
+  std::vector<bool> written(pending.size(), false);
+  bool fsynced = false;
+
+  std::vector<Completion> completions;
+  size_t next = 0;
+  do {
+    // Leave room for the fsync
+    size_t end = std::min(pending.size(), next + ring->capacity() - 1);
+    bool link = sync && end == pending.size();
+
+    unsigned count = 0;
+    for (size_t i = next; i < end; i++) {
+      auto sqe = ring->Queue();
+      sqe->opcode = IORING_OP_WRITE;
+      sqe->fd = file->fd;
+      sqe->addr = reinterpret_cast<uint64_t>(pending[i].data.data());
+      sqe->len = static_cast<uint32_t>(pending[i].data.size());
+      sqe->off = static_cast<uint64_t>(pending[i].offset);
+      sqe->user_data = i;
+
+      // A failed write cancels the rest of the chain, the fsync included
+      if (link) {
+        sqe->flags = IOSQE_IO_LINK;
+      }
+      count++;
+    }
+    if (link) {
+      auto sqe = ring->Queue();
+      sqe->opcode = IORING_OP_FSYNC;
+      sqe->fd = file->fd;
+      // The unix VFS uses `fdatasync()` on Linux as well
+      sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+      sqe->user_data = kFsyncTag;
+      count++;
+    }
+
+    completions.clear();
+    int r = ring->SubmitAndWait(count, &completions);
+    for (const auto& c : completions) {
+      if (c.user_data == kFsyncTag) {
+        fsynced = c.res == 0;
+        continue;
+      }
+      auto size = pending[c.user_data].data.size();
+      if (c.res >= 0 && static_cast<size_t>(c.res) == size) {
+        written[c.user_data] = true;
+      }
+    }
+    if (r != 0) {
+      break;
+    }
+    next = end;
+  } while (next < pending.size());
+
+  int rc = SQLITE_OK;
+  for (size_t i = 0; i < pending.size(); i++) {
+    if (!written[i] && !WriteFully(file->fd, pending[i].data.data(),
+                                   pending[i].data.size(), pending[i].offset)) {
+      rc = SQLITE_IOERR_WRITE;
+    }
+  }
+  if (rc == SQLITE_OK && sync && !fsynced) {
+    if (fdatasync(file->fd) != 0) {
+      rc = SQLITE_IOERR_FSYNC;
+    }
+  }
+
+  pending.clear();
+  file->pending_bytes = 0;
+  return rc;
+}
+
+// Flushes the pending writes before an operation that needs them on disk
+inline int FlushWal(UringFile* file) {
+  if (!file->ring) {
+    return SQLITE_OK;
+  }
+  return Flush(file, 0);
+}
+
+// Reads `kReadDepth * kReadChunk` bytes starting at `offset` into the window
+void FillWindow(UringFile* file, sqlite3_int64 offset) {
+  file->window.resize(kReadDepth * kReadChunk);
+  file->window_offset = offset;
+
+  for (int i = 0; i < kReadDepth; i++) {
+    auto sqe = file->ring->Queue();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file->fd;
+    sqe->addr =
+        reinterpret_cast<uint64_t>(file->window.data() + i * kReadChunk);
+    sqe->len = kReadChunk;
+    sqe->off = static_cast<uint64_t>(offset + i * kReadChunk);
+    sqe->user_data = i;
+  }
+
+  std::vector<Completion> completions;
+  int32_t results[kReadDepth];
+  std::fill(results, results + kReadDepth, -1);
+  file->ring->SubmitAndWait(kReadDepth, &completions);
+  for (const auto& c : completions) {
+    results[c.user_data] = c.res;
+  }
+
+  // Keep the contiguous prefix, reads past the end of the file are short
+  size_t size = 0;
+  for (int i = 0; i < kReadDepth && results[i] > 0; i++) {
+    size += results[i];
+    if (results[i] < kReadChunk) {
+      break;
+    }
+  }
+  file->window.resize(size);
+}
+
+//
+// sqlite3_io_methods
+//
+
+int Close(sqlite3_file* f) {
+  auto file = Cast(f);
+  int rc = FlushWal(file);
+  {
+    std::lock_guard<std::mutex> lock(registry_mu);
+    if (file->db_name != nullptr) {
+      registry->erase(file->db_name);
+    }
+    if (file->wal != nullptr) {
+      file->wal->main = nullptr;
+    }
+    if (file->main != nullptr) {
+      file->main->wal = nullptr;
+    }
+  }
+  if (file->fd >= 0) {
+    close(file->fd);
+  }
+
+  int close_rc = file->real->pMethods->xClose(file->real);
+  file->~UringFile();
+  return rc != SQLITE_OK ? rc : close_rc;
+}
+
+int Read(sqlite3_file* f, void* buf, int amt, sqlite3_int64 offset) {
+  auto file = Cast(f);
+  int rc = FlushWal(file);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  if (file->checkpointing) {
+    auto in_window = [file, amt, offset] {
+      auto end = file->window_offset +
+                 static_cast<sqlite3_int64>(file->window.size());
+      return offset >= file->window_offset && offset + amt <= end;
+    };
+    if (!in_window()) {
+      FillWindow(file, offset);
+    }
+    if (in_window()) {
+      memcpy(buf, file->window.data() + (offset - file->window_offset), amt);
+      return SQLITE_OK;
+    }
+  }
+  return file->real->pMethods->xRead(file->real, buf, amt, offset);
+}
+
+int Write(sqlite3_file* f, const void* buf, int amt, sqlite3_int64 offset) {
+  auto file = Cast(f);
+  if (!file->ring) {
+    return file->real->pMethods->xWrite(file->real, buf, amt, offset);
+  }
+  file->DropWindow();
+
+  auto data = static_cast<const uint8_t*>(buf);
+
+  // The page of a commit frame completes the transaction, which is published
+  // in the wal-index right after (even without `xSync`), so its frames have
+  // to be on disk and errors reported to the commit
+  bool is_commit = file->is_commit_header;
+  file->is_commit_header =
+      amt == kFrameHeaderSize && (data[4] | data[5] | data[6] | data[7]) != 0;
+
+  auto& pending = file->pending;
+  if (!pending.empty() &&
+      pending.back().offset +
+              static_cast<sqlite3_int64>(pending.back().data.size()) ==
+          offset &&
+      pending.back().data.size() + amt <= kMaxWriteSize) {
+    pending.back().data.insert(pending.back().data.end(), data, data + amt);
+  } else {
+    pending.push_back({offset, std::vector<uint8_t>(data, data + amt)});
+  }
+  file->pending_bytes += amt;
+
+  if (is_commit || pending.size() >= kMaxPendingWrites ||
+      file->pending_bytes >= kMaxPendingBytes) {
+    return Flush(file, 0);
+  }
+  return SQLITE_OK;
+}
+
+int Truncate(sqlite3_file* f, sqlite3_int64 size) {
+  auto file = Cast(f);
+  int rc = FlushWal(file);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  file->DropWindow();
+  return file->real->pMethods->xTruncate(file->real, size);
+}
+
+int Sync(sqlite3_file* f, int flags) {
+  auto file = Cast(f);
+  if (!file->ring || !file->synced) {
+    int rc = FlushWal(file);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    file->synced = true;
+    return file->real->pMethods->xSync(file->real, flags);
+  }
+  return Flush(file, flags);
+}
+
+int FileSize(sqlite3_file* f, sqlite3_int64* size) {
+  auto file = Cast(f);
+  int rc = FlushWal(file);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  return file->real->pMethods->xFileSize(file->real, size);
+}
+
+int Lock(sqlite3_file* f, int level) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xLock(real, level);
+}
+
+int Unlock(sqlite3_file* f, int level) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xUnlock(real, level);
+}
+
+int CheckReservedLock(sqlite3_file* f, int* out) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xCheckReservedLock(real, out);
+}
+
+int FileControl(sqlite3_file* f, int op, void* arg) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xFileControl(real, op, arg);
+}
+
+int SectorSize(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xSectorSize(real);
+}
+
+int DeviceCharacteristics(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xDeviceCharacteristics(real);
+}
+
+int ShmMap(sqlite3_file* f, int page, int size, int extend, void volatile** p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xShmMap(real, page, size, extend, p);
+}
+
+int ShmLock(sqlite3_file* f, int offset, int n, int flags) {
+  auto file = Cast(f);
+  int rc = file->real->pMethods->xShmLock(file->real, offset, n, flags);
+
+  auto wal = file->wal;
+  if (rc == SQLITE_OK && wal != nullptr && wal->ring &&
+      offset == kCheckpointLock && n == 1) {
+    wal->checkpointing = (flags & SQLITE_SHM_LOCK) != 0;
+    wal->DropWindow();
+  }
+  return rc;
+}
+
+void ShmBarrier(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  real->pMethods->xShmBarrier(real);
+}
+
+int ShmUnmap(sqlite3_file* f, int delete_flag) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xShmUnmap(real, delete_flag);
+}
+
+int Fetch(sqlite3_file* f, sqlite3_int64 offset, int amt, void** p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xFetch(real, offset, amt, p);
+}
+
+int Unfetch(sqlite3_file* f, sqlite3_int64 offset, void* p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xUnfetch(real, offset, p);
+}
+
+//
+// sqlite3_vfs
+//
+
+// Falls back to pass-through on any failure
+void InitWal(UringFile* file, const char* name, int flags) {
+  int mode = (flags & SQLITE_OPEN_READONLY) ? O_RDONLY : O_RDWR;
+  int fd = open(name, mode | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  auto ring = std::unique_ptr<Ring>(new Ring());
+  if (!ring->Init(kRingEntries)) {
+    close(fd);
+    return;
+  }
+  file->fd = fd;
+  file->ring = std::move(ring);
+
+  std::lock_guard<std::mutex> lock(registry_mu);
+  auto it = registry->find(sqlite3_filename_database(name));
+  if (it != registry->end()) {
+    file->main = it->second;
+    it->second->wal = file;
+  }
+}
+
+int Open(sqlite3_vfs* vfs,
+         sqlite3_filename name,
+         sqlite3_file* f,
+         int flags,
+         int* out_flags) {
+  auto file = new (f) UringFile();
+  file->real =
+      reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(f) + kFileSize);
+
+  int rc = base_vfs->xOpen(base_vfs, name, file->real, flags, out_flags);
+
+  // `xClose` is called only if `pMethods` is set
+  if (file->real->pMethods == nullptr) {
+    file->~UringFile();
+    f->pMethods = nullptr;
+    return rc;
+  }
+
+  f->pMethods = &io_methods[std::min(file->real->pMethods->iVersion, 3)];
+  if (rc != SQLITE_OK || name == nullptr) {
+    return rc;
+  }
+
+  if (flags & SQLITE_OPEN_MAIN_DB) {
+    std::lock_guard<std::mutex> lock(registry_mu);
+    file->db_name = name;
+    (*registry)[name] = file;
+  } else if (flags & SQLITE_OPEN_WAL) {
+    InitWal(file, name, flags);
+  }
+  return rc;
+}
+
+void InitMethods() {
+  sqlite3_io_methods m = {
+      3,
+      Close,
+      Read,
+      Write,
+      Truncate,
+      Sync,
+      FileSize,
+      Lock,
+      Unlock,
+      CheckReservedLock,
+      FileControl,
+      SectorSize,
+      DeviceCharacteristics,
+      ShmMap,
+      ShmLock,
+      ShmBarrier,
+      ShmUnmap,
+      Fetch,
+      Unfetch,
+  };
+  for (int version = 1; version <= 3; version++) {
+    io_methods[version] = m;
+    io_methods[version].iVersion = version;
+  }
+  io_methods[0] = io_methods[1];
+}
+
+bool IsIoUringAvailable() {
+  Ring ring;
+  return ring.Init(1);
+}
+
+#endif  // defined(HAVE_IO_URING)
+
+}  // namespace
+
+int IoUringVfs::Register() {
+  static std::once_flag once;
+  static int rc = SQLITE_OK;
+
+  std::call_once(once, [] {
+    sqlite3_vfs* base = sqlite3_vfs_find(nullptr);
+    if (base == nullptr) {
+      rc = SQLITE_ERROR;
+      return;
+    }
+
+#if defined(HAVE_IO_URING)
+    if (IsIoUringAvailable()) {
+      base_vfs = base;
+      InitMethods();
+
+      InitShimVfs(&io_uring_vfs, base);
+      io_uring_vfs.szOsFile = kFileSize + base->szOsFile;
+      io_uring_vfs.zName = kName;
+      io_uring_vfs.xOpen = Open;
+
+      rc = sqlite3_vfs_register(&io_uring_vfs, 0);
+      return;
+    }
+#endif  // defined(HAVE_IO_URING)
+
+    // Alias of the default VFS
+    io_uring_vfs = *base;
+    io_uring_vfs.zName = kName;
+    io_uring_vfs.pNext = nullptr;
+    rc = sqlite3_vfs_register(&io_uring_vfs, 0);
+  });
+
+  return rc;
+}
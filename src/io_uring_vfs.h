@@ -0,0 +1,31 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_IO_URING_VFS_H_
+#define SRC_IO_URING_VFS_H_
+
+#include "sqlite3.h"
+
+// A VFS shim around the default VFS that moves WAL I/O to io_uring on Linux.
+//
+// - WAL frame writes are copied, coalesced and submitted in batches instead of
+//   one `pwrite()` per frame header and page. The batch is flushed once the
+//   page of a commit frame is written, so that the commit fails if its frames
+//   can't be written before it is published in the wal-index. It is also
+//   flushed before any other operation on the WAL file, and on `xSync` where
+//   the fsync is linked to the writes of the batch.
+// - While the connection holds the checkpoint lock, WAL reads are served from
+//   a window filled with several reads in flight at once.
+//
+// Other files are not affected. Without io_uring (other platforms, old
+// kernels, seccomp filters) the VFS is registered as an alias of the default
+// VFS.
+class IoUringVfs {
+ public:
+  static constexpr const char* kName = "signal-io-uring";
+
+  // Registers the VFS (as non-default). Safe to call multiple times.
+  static int Register();
+};
+
+#endif  // SRC_IO_URING_VFS_H_
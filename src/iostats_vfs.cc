@@ -0,0 +1,363 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "iostats_vfs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include "vfs_shim.h"
+
+namespace {
+
+sqlite3_vfs* base_vfs = nullptr;
+sqlite3_vfs iostats_vfs;
+
+// Indexed by the `iVersion` of the underlying file's methods so that we never
+// advertise methods that the underlying file doesn't have.
+sqlite3_io_methods io_methods[4];
+
+struct AtomicOpStats {
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> total_us{0};
+  std::atomic<uint64_t> histogram[IoStatsVfs::kBuckets] = {};
+};
+
+struct FileStats {
+  AtomicOpStats ops[IoStatsVfs::kFileTypeCount][IoStatsVfs::kOpCount];
+};
+
+// Temporary files and journals that can't be attributed to a connection
+FileStats* process_stats = new FileStats();
+
+struct StatsFile {
+  sqlite3_file base;
+  sqlite3_file* real;
+  IoStatsVfs::FileType type;
+
+  // Shared by the files of a connection, owned by its main database file
+  std::shared_ptr<FileStats> stats;
+
+  // Main database files: key in the registry
+  const char* db_name = nullptr;
+};
+
+constexpr int kFileSize =
+    (sizeof(StatsFile) + alignof(max_align_t) - 1) &
+    ~(alignof(max_align_t) - 1);
+
+inline StatsFile* Cast(sqlite3_file* f) {
+  return reinterpret_cast<StatsFile*>(f);
+}
+
+// Main database files by their `sqlite3_filename`. WAL and journal names
+// point into the same allocation, which makes it possible to find the main
+// database file of the same connection.
+std::mutex registry_mu;
+std::map<const char*, StatsFile*>* registry =
+    new std::map<const char*, StatsFile*>();
+
+int Bucket(uint64_t us) {
+  int bucket = 0;
+  while (us != 0 && bucket < IoStatsVfs::kBuckets - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+// Times a call and records it on destruction
+class Timer {
+ public:
+  Timer(StatsFile* file, IoStatsVfs::FileType type, IoStatsVfs::Op op,
+        uint64_t bytes = 0)
+      : stats_(&file->stats->ops[type][op]),
+        bytes_(bytes),
+        start_(std::chrono::steady_clock::now()) {}
+
+  Timer(StatsFile* file, IoStatsVfs::Op op, uint64_t bytes = 0)
+      : Timer(file, file->type, op, bytes) {}
+
+  ~Timer() {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start_)
+                  .count();
+    stats_->count.fetch_add(1, std::memory_order_relaxed);
+    stats_->bytes.fetch_add(bytes_, std::memory_order_relaxed);
+    stats_->total_us.fetch_add(us, std::memory_order_relaxed);
+    stats_->histogram[Bucket(us)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  AtomicOpStats* stats_;
+  uint64_t bytes_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+//
+// sqlite3_io_methods
+//
+
+int Close(sqlite3_file* f) {
+  auto file = Cast(f);
+  if (file->db_name != nullptr) {
+    std::lock_guard<std::mutex> lock(registry_mu);
+    registry->erase(file->db_name);
+  }
+  int rc = file->real->pMethods->xClose(file->real);
+  file->~StatsFile();
+  return rc;
+}
+
+int Read(sqlite3_file* f, void* buf, int amt, sqlite3_int64 offset) {
+  auto file = Cast(f);
+  Timer timer(file, IoStatsVfs::kRead, amt);
+  return file->real->pMethods->xRead(file->real, buf, amt, offset);
+}
+
+int Write(sqlite3_file* f, const void* buf, int amt, sqlite3_int64 offset) {
+  auto file = Cast(f);
+  Timer timer(file, IoStatsVfs::kWrite, amt);
+  return file->real->pMethods->xWrite(file->real, buf, amt, offset);
+}
+
+int Truncate(sqlite3_file* f, sqlite3_int64 size) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xTruncate(real, size);
+}
+
+int Sync(sqlite3_file* f, int flags) {
+  auto file = Cast(f);
+  Timer timer(file, IoStatsVfs::kSync);
+  return file->real->pMethods->xSync(file->real, flags);
+}
+
+int FileSize(sqlite3_file* f, sqlite3_int64* size) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xFileSize(real, size);
+}
+
+int Lock(sqlite3_file* f, int level) {
+  auto file = Cast(f);
+  Timer timer(file, IoStatsVfs::kLock);
+  return file->real->pMethods->xLock(file->real, level);
+}
+
+int Unlock(sqlite3_file* f, int level) {
+  auto file = Cast(f);
+  Timer timer(file, IoStatsVfs::kLock);
+  return file->real->pMethods->xUnlock(file->real, level);
+}
+
+int CheckReservedLock(sqlite3_file* f, int* out) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xCheckReservedLock(real, out);
+}
+
+int FileControl(sqlite3_file* f, int op, void* arg) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xFileControl(real, op, arg);
+}
+
+int SectorSize(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xSectorSize(real);
+}
+
+int DeviceCharacteristics(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xDeviceCharacteristics(real);
+}
+
+int ShmMap(sqlite3_file* f, int page, int size, int extend, void volatile** p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xShmMap(real, page, size, extend, p);
+}
+
+int ShmLock(sqlite3_file* f, int offset, int n, int flags) {
+  auto file = Cast(f);
+  Timer timer(file, IoStatsVfs::kShm, IoStatsVfs::kLock);
+  return file->real->pMethods->xShmLock(file->real, offset, n, flags);
+}
+
+void ShmBarrier(sqlite3_file* f) {
+  auto file = Cast(f);
+  Timer timer(file, IoStatsVfs::kShm, IoStatsVfs::kSync);
+  file->real->pMethods->xShmBarrier(file->real);
+}
+
+int ShmUnmap(sqlite3_file* f, int delete_flag) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xShmUnmap(real, delete_flag);
+}
+
+// Memory-mapped reads are not counted, they don't go through the VFS
+int Fetch(sqlite3_file* f, sqlite3_int64 offset, int amt, void** p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xFetch(real, offset, amt, p);
+}
+
+int Unfetch(sqlite3_file* f, sqlite3_int64 offset, void* p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xUnfetch(real, offset, p);
+}
+
+//
+// sqlite3_vfs
+//
+
+IoStatsVfs::FileType GetFileType(int flags) {
+  if (flags & SQLITE_OPEN_MAIN_DB) {
+    return IoStatsVfs::kMain;
+  }
+  if (flags & SQLITE_OPEN_WAL) {
+    return IoStatsVfs::kWal;
+  }
+  if (flags & (SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_SUPER_JOURNAL)) {
+    return IoStatsVfs::kJournal;
+  }
+  return IoStatsVfs::kTemp;
+}
+
+// Shares the stats of the connection that opened `name` as its main database
+void AttachStats(StatsFile* file, const char* name, int flags) {
+  if (file->type == IoStatsVfs::kMain) {
+    file->stats = std::make_shared<FileStats>();
+    file->db_name = name;
+
+    std::lock_guard<std::mutex> lock(registry_mu);
+    (*registry)[name] = file;
+    return;
+  }
+
+  // Only WAL and main journal names are guaranteed to be allocated together
+  // with the database name.
+  if (flags & (SQLITE_OPEN_WAL | SQLITE_OPEN_MAIN_JOURNAL)) {
+    std::lock_guard<std::mutex> lock(registry_mu);
+    auto it = registry->find(sqlite3_filename_database(name));
+    if (it != registry->end()) {
+      file->stats = it->second->stats;
+      return;
+    }
+  }
+
+  // Never freed
+  file->stats = std::shared_ptr<FileStats>(process_stats, [](FileStats*) {});
+}
+
+int Open(sqlite3_vfs* vfs,
+         sqlite3_filename name,
+         sqlite3_file* f,
+         int flags,
+         int* out_flags) {
+  auto file = new (f) StatsFile();
+  file->real =
+      reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(f) + kFileSize);
+  file->type = name == nullptr ? IoStatsVfs::kTemp : GetFileType(flags);
+  AttachStats(file, name, flags);
+
+  int rc = base_vfs->xOpen(base_vfs, name, file->real, flags, out_flags);
+
+  // `xClose` is called only if `pMethods` is set
+  if (file->real->pMethods == nullptr) {
+    if (file->db_name != nullptr) {
+      std::lock_guard<std::mutex> lock(registry_mu);
+      registry->erase(file->db_name);
+    }
+    file->~StatsFile();
+    f->pMethods = nullptr;
+    return rc;
+  }
+
+  f->pMethods = &io_methods[std::min(file->real->pMethods->iVersion, 3)];
+  return rc;
+}
+
+void InitMethods() {
+  sqlite3_io_methods m = {
+      3,
+      Close,
+      Read,
+      Write,
+      Truncate,
+      Sync,
+      FileSize,
+      Lock,
+      Unlock,
+      CheckReservedLock,
+      FileControl,
+      SectorSize,
+      DeviceCharacteristics,
+      ShmMap,
+      ShmLock,
+      ShmBarrier,
+      ShmUnmap,
+      Fetch,
+      Unfetch,
+  };
+  for (int version = 1; version <= 3; version++) {
+    io_methods[version] = m;
+    io_methods[version].iVersion = version;
+  }
+  io_methods[0] = io_methods[1];
+}
+
+void CopyStats(const AtomicOpStats& from, IoStatsVfs::OpStats* to) {
+  to->count = from.count.load(std::memory_order_relaxed);
+  to->bytes = from.bytes.load(std::memory_order_relaxed);
+  to->total_us = from.total_us.load(std::memory_order_relaxed);
+  for (int i = 0; i < IoStatsVfs::kBuckets; i++) {
+    to->histogram[i] = from.histogram[i].load(std::memory_order_relaxed);
+  }
+}
+
+}  // namespace
+
+int IoStatsVfs::Register() {
+  static std::once_flag once;
+  static int rc = SQLITE_OK;
+
+  std::call_once(once, [] {
+    base_vfs = sqlite3_vfs_find(nullptr);
+    if (base_vfs == nullptr) {
+      rc = SQLITE_ERROR;
+      return;
+    }
+
+    InitMethods();
+
+    InitShimVfs(&iostats_vfs, base_vfs);
+    iostats_vfs.szOsFile = kFileSize + base_vfs->szOsFile;
+    iostats_vfs.zName = kName;
+    iostats_vfs.xOpen = Open;
+
+    rc = sqlite3_vfs_register(&iostats_vfs, 0);
+  });
+
+  return rc;
+}
+
+bool IoStatsVfs::GetStats(sqlite3* db, Stats* stats) {
+  sqlite3_file* f = nullptr;
+  int rc = sqlite3_file_control(db, "main", SQLITE_FCNTL_FILE_POINTER, &f);
+  if (rc != SQLITE_OK || f == nullptr || f->pMethods < &io_methods[0] ||
+      f->pMethods > &io_methods[3]) {
+    return false;
+  }
+
+  auto file = Cast(f);
+  for (int type = 0; type < kFileTypeCount; type++) {
+    const FileStats* source =
+        type == kTemp ? process_stats : file->stats.get();
+    for (int op = 0; op < kOpCount; op++) {
+      CopyStats(source->ops[type][op], &stats->ops[type][op]);
+    }
+  }
+  return true;
+}
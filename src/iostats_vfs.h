@@ -0,0 +1,54 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_IOSTATS_VFS_H_
+#define SRC_IOSTATS_VFS_H_
+
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+// A pass-through VFS shim around the default VFS that counts I/O calls and
+// records their latency histograms.
+//
+// The main database file, its WAL, rollback journal and shared memory are
+// accounted to the connection that opened the main database file. Temporary
+// files (temp databases, sorter and statement journals) can't be attributed to
+// a connection and are accounted process-wide.
+//
+// Counters are relaxed atomics and timings use the monotonic clock, which
+// keeps the overhead at a few tens of nanoseconds per call.
+class IoStatsVfs {
+ public:
+  static constexpr const char* kName = "signal-iostats";
+
+  enum FileType { kMain, kWal, kJournal, kShm, kTemp, kFileTypeCount };
+  enum Op { kRead, kWrite, kSync, kLock, kOpCount };
+
+  // Bucket 0 counts calls faster than 1us, bucket `i` calls that took
+  // [2^(i-1), 2^i) us. The last bucket is open-ended.
+  static constexpr int kBuckets = 24;
+
+  struct OpStats {
+    uint64_t count;
+
+    // Reads and writes only
+    uint64_t bytes;
+
+    uint64_t total_us;
+    uint64_t histogram[kBuckets];
+  };
+
+  struct Stats {
+    OpStats ops[kFileTypeCount][kOpCount];
+  };
+
+  // Registers the VFS (as non-default). Safe to call multiple times.
+  static int Register();
+
+  // Returns `false` if the main database of `db` wasn't opened with this VFS.
+  // `kTemp` counters are process-wide.
+  static bool GetStats(sqlite3* db, Stats* stats);
+};
+
+#endif  // SRC_IOSTATS_VFS_H_
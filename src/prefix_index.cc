@@ -0,0 +1,294 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "prefix_index.h"
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+#include "addon.h"
+
+namespace {
+
+// Kept to read the counts again
+constexpr char kVocabTable[] = "temp.signal_prefix_index_vocab";
+
+// More dirty terms than this (or a quarter of all terms) are read with all
+// others, reading them one by one would be slower
+constexpr size_t kMaxDirtyTerms = 256;
+
+}  // namespace
+
+int PrefixIndex::Feed::AddToken(void* feed_ptr,
+                                int flags,
+                                const char* token,
+                                int length,
+                                int start,
+                                int end) {
+  auto feed = static_cast<Feed*>(feed_ptr);
+  feed->index->pending_.emplace(token, static_cast<size_t>(length));
+  return feed->callback(feed->ctx, flags, token, length, start, end);
+}
+
+PrefixIndex::PrefixIndex() : nodes_(1, Node{0, 0, 0, 0, {}}) {}
+
+int PrefixIndex::CommitHook(void* index_ptr) {
+  static_cast<PrefixIndex*>(index_ptr)->EndTransaction();
+
+  // Never turns the commit into a rollback
+  return 0;
+}
+
+void PrefixIndex::RollbackHook(void* index_ptr) {
+  static_cast<PrefixIndex*>(index_ptr)->EndTransaction();
+}
+
+void PrefixIndex::EndTransaction() {
+  if (!is_stale_) {
+    dirty_.insert(pending_.begin(), pending_.end());
+    if (dirty_.size() > std::max(kMaxDirtyTerms, term_count_ / 4)) {
+      is_stale_ = true;
+      dirty_.clear();
+    }
+  }
+  pending_.clear();
+}
+
+int PrefixIndex::Build(sqlite3* handle,
+                       const std::string& table,
+                       std::string* error) {
+  std::string drop = std::string("DROP TABLE IF EXISTS ") + kVocabTable;
+  std::string create = std::string("CREATE VIRTUAL TABLE ") + kVocabTable +
+                       " USING fts5vocab(main, " + QuoteIdentifier(table) +
+                       ", 'row')";
+  int r = sqlite3_exec(handle, drop.c_str(), nullptr, nullptr, nullptr);
+  if (r == SQLITE_OK) {
+    r = sqlite3_exec(handle, create.c_str(), nullptr, nullptr, nullptr);
+  }
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+    return r;
+  }
+
+  r = Load(handle, error);
+  if (r != SQLITE_OK) {
+    sqlite3_exec(handle, drop.c_str(), nullptr, nullptr, nullptr);
+  }
+  return r;
+}
+
+int PrefixIndex::Refresh(sqlite3* handle, std::string* error) {
+  int data_version;
+  int r = QueryInt(handle, "PRAGMA data_version", &data_version);
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+    return r;
+  }
+  if (is_stale_ || data_version != data_version_) {
+    return Load(handle, error);
+  }
+  if (dirty_.empty()) {
+    return SQLITE_OK;
+  }
+
+  sqlite3_stmt* stmt = nullptr;
+  std::string select =
+      std::string("SELECT cnt FROM ") + kVocabTable + " WHERE term = ?1";
+  r = sqlite3_prepare_v2(handle, select.c_str(), select.size(), &stmt,
+                         nullptr);
+  auto iter = dirty_.begin();
+  while (r == SQLITE_OK && iter != dirty_.end()) {
+    sqlite3_bind_text(stmt, 1, iter->data(), iter->size(), SQLITE_STATIC);
+
+    // Terms that are gone have no row
+    uint64_t count = 0;
+    r = sqlite3_step(stmt);
+    if (r == SQLITE_ROW) {
+      count = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+      r = SQLITE_OK;
+    } else if (r == SQLITE_DONE) {
+      r = SQLITE_OK;
+    }
+    sqlite3_reset(stmt);
+
+    if (r == SQLITE_OK) {
+      Set(iter->data(), iter->size(), count);
+      iter = dirty_.erase(iter);
+    }
+  }
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+  }
+  sqlite3_finalize(stmt);
+  return r;
+}
+
+int PrefixIndex::Load(sqlite3* handle, std::string* error) {
+  nodes_.assign(1, Node{0, 0, 0, 0, {}});
+  term_count_ = 0;
+  dirty_.clear();
+
+  // Until all terms are read
+  is_stale_ = true;
+
+  int r = QueryInt(handle, "PRAGMA data_version", &data_version_);
+  sqlite3_stmt* stmt = nullptr;
+  std::string select = std::string("SELECT term, cnt FROM ") + kVocabTable;
+  if (r == SQLITE_OK) {
+    r = sqlite3_prepare_v2(handle, select.c_str(), select.size(), &stmt,
+                           nullptr);
+  }
+  if (r == SQLITE_OK) {
+    while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+      auto term = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+      int length = sqlite3_column_bytes(stmt, 0);
+      Set(term, static_cast<size_t>(length),
+          static_cast<uint64_t>(sqlite3_column_int64(stmt, 1)));
+    }
+    if (r == SQLITE_DONE) {
+      r = SQLITE_OK;
+    }
+  }
+  if (r != SQLITE_OK) {
+    *error = SqliteErrorMessage(handle);
+  }
+  sqlite3_finalize(stmt);
+
+  is_stale_ = r != SQLITE_OK;
+  return r;
+}
+
+void PrefixIndex::Set(const char* term, size_t length, uint64_t count) {
+  if (length == 0) {
+    return;
+  }
+
+  uint32_t node = 0;
+  for (size_t i = 0; i < length; i++) {
+    auto byte = static_cast<uint8_t>(term[i]);
+    auto& children = nodes_[node].children;
+    auto iter = std::lower_bound(
+        children.begin(), children.end(), byte,
+        [this](uint32_t child, uint8_t b) { return nodes_[child].byte < b; });
+    if (iter != children.end() && nodes_[*iter].byte == byte) {
+      node = *iter;
+      continue;
+    }
+
+    // Terms without occurrences aren't added
+    if (count == 0) {
+      return;
+    }
+
+    auto child = static_cast<uint32_t>(nodes_.size());
+    children.insert(iter, child);
+    nodes_.push_back(Node{0, 0, node, byte, {}});
+    node = child;
+  }
+
+  uint64_t old_count = nodes_[node].count;
+  if (count == old_count) {
+    return;
+  }
+  if (old_count == 0) {
+    term_count_++;
+  } else if (count == 0) {
+    term_count_--;
+  }
+  nodes_[node].count = count;
+
+  // The maximum of an ancestor only has to be compared against a higher
+  // count, but computed again from its children after a lower one
+  while (true) {
+    uint64_t max = count;
+    if (count < old_count) {
+      max = nodes_[node].count;
+      for (auto child : nodes_[node].children) {
+        max = std::max(max, nodes_[child].max);
+      }
+    } else if (nodes_[node].max >= max) {
+      break;
+    }
+    if (nodes_[node].max == max) {
+      break;
+    }
+    nodes_[node].max = max;
+    if (node == 0) {
+      break;
+    }
+    node = nodes_[node].parent;
+  }
+}
+
+std::vector<PrefixIndex::Completion> PrefixIndex::Complete(
+    const std::string& prefix,
+    size_t limit) const {
+  std::vector<Completion> result;
+
+  uint32_t node = 0;
+  for (char c : prefix) {
+    auto byte = static_cast<uint8_t>(c);
+    const auto& children = nodes_[node].children;
+    auto iter = std::lower_bound(
+        children.begin(), children.end(), byte,
+        [this](uint32_t child, uint8_t b) { return nodes_[child].byte < b; });
+    if (iter == children.end() || nodes_[*iter].byte != byte) {
+      return result;
+    }
+    node = *iter;
+  }
+
+  // Subtrees by their highest count and terms by their count. A term comes
+  // before a subtree with the same count, which can't contain a better one.
+  struct Candidate {
+    uint64_t count;
+    bool is_term;
+    uint32_t node;
+
+    bool operator<(const Candidate& other) const {
+      if (count != other.count) {
+        return count < other.count;
+      }
+      if (is_term != other.is_term) {
+        return !is_term;
+      }
+      return node > other.node;
+    }
+  };
+
+  std::priority_queue<Candidate> queue;
+  if (nodes_[node].max > 0) {
+    queue.push({nodes_[node].max, false, node});
+  }
+  while (!queue.empty() && result.size() < limit) {
+    auto candidate = queue.top();
+    queue.pop();
+
+    if (candidate.is_term) {
+      result.push_back({Term(candidate.node), candidate.count});
+      continue;
+    }
+
+    const auto& current = nodes_[candidate.node];
+    if (current.count > 0) {
+      queue.push({current.count, true, candidate.node});
+    }
+    for (auto child : current.children) {
+      // Subtrees of terms that are gone
+      if (nodes_[child].max > 0) {
+        queue.push({nodes_[child].max, false, child});
+      }
+    }
+  }
+  return result;
+}
+
+std::string PrefixIndex::Term(uint32_t node) const {
+  std::string term;
+  for (; node != 0; node = nodes_[node].parent) {
+    term.push_back(static_cast<char>(nodes_[node].byte));
+  }
+  std::reverse(term.begin(), term.end());
+  return term;
+}
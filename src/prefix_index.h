@@ -0,0 +1,112 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_PREFIX_INDEX_H_
+#define SRC_PREFIX_INDEX_H_
+
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "sqlite3.h"
+
+// Terms of an FTS5 table and their number of occurrences in a trie, for
+// autocompletion without prefix queries.
+//
+// The counts are read from a temporary `fts5vocab` table created by `Build`,
+// which stays around to keep them exact. The tokens of the documents that the
+// table's `signal_tokenizer` indexes or deletes on this connection are
+// collected through `Feed`. Once their transaction ends (`CommitHook`,
+// `RollbackHook`) the terms are marked dirty, and `Refresh` reads their
+// counts again. Commits of other connections change `PRAGMA data_version`,
+// and make `Refresh` read all terms again.
+//
+// Every node keeps the highest count of its subtree, so that `Complete`
+// visits the nodes best first and stops after `limit` terms.
+class PrefixIndex {
+ public:
+  using TokenCallback = int (*)(void*, int, const char*, int, int, int);
+
+  struct Completion {
+    std::string term;
+    uint64_t count;
+  };
+
+  // Passes the tokens of a document to `callback` and collects them in
+  // `index` until the transaction ends
+  struct Feed {
+    PrefixIndex* index;
+    void* ctx;
+    TokenCallback callback;
+
+    static int AddToken(void* feed_ptr,
+                        int flags,
+                        const char* token,
+                        int length,
+                        int start,
+                        int end);
+  };
+
+  PrefixIndex();
+
+  // `table` is the unquoted name of the FTS5 table. Sets `error` on failure.
+  int Build(sqlite3* handle, const std::string& table, std::string* error);
+
+  // Reads the counts of the dirty terms, or of all terms if other
+  // connections committed since. Sets `error` on failure.
+  int Refresh(sqlite3* handle, std::string* error);
+
+  // Most frequent terms starting with `prefix`, most frequent first
+  std::vector<Completion> Complete(const std::string& prefix,
+                                   size_t limit) const;
+
+  inline size_t term_count() const { return term_count_; }
+
+  // Hooks of the connection feeding the index, with the index as argument
+  static int CommitHook(void* index_ptr);
+  static void RollbackHook(void* index_ptr);
+
+ private:
+  struct Node {
+    // Occurrences of the term ending at this node
+    uint64_t count;
+
+    // Highest `count` of the subtree
+    uint64_t max;
+
+    uint32_t parent;
+    uint8_t byte;
+
+    // Indices of the children in `nodes_`, ordered by byte
+    std::vector<uint32_t> children;
+  };
+
+  // Reads all terms into an empty trie
+  int Load(sqlite3* handle, std::string* error);
+
+  void Set(const char* term, size_t length, uint64_t count);
+
+  // The terms of a transaction are read again, whether it committed or not
+  void EndTransaction();
+
+  std::string Term(uint32_t node) const;
+
+  // `nodes_[0]` is the root
+  std::vector<Node> nodes_;
+  size_t term_count_ = 0;
+
+  // Terms fed in the current transaction
+  std::unordered_set<std::string> pending_;
+
+  // Terms whose counts may have changed since they were read
+  std::unordered_set<std::string> dirty_;
+
+  // All terms have to be read again
+  bool is_stale_ = false;
+
+  // `PRAGMA data_version` as of the last `Load`
+  int data_version_ = 0;
+};
+
+#endif  // SRC_PREFIX_INDEX_H_
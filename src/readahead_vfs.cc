@@ -0,0 +1,530 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "readahead_vfs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "vfs_shim.h"
+
+namespace {
+
+// Consecutive sequential reads before the prefetch kicks in
+constexpr int kSequentialThreshold = 2;
+
+// Upper bound of `PRAGMA readahead_pages`
+constexpr int kMaxDepth = 1024;
+
+// Prefetch threads shared by all files
+constexpr int kThreadCount = 2;
+
+sqlite3_vfs* base_vfs = nullptr;
+sqlite3_vfs readahead_vfs;
+
+// Indexed by the `iVersion` of the underlying file's methods so that we never
+// advertise methods that the underlying file doesn't have.
+sqlite3_io_methods io_methods[4];
+
+struct ReadaheadFile {
+  sqlite3_file base;
+  sqlite3_file* real;
+  bool is_main;
+
+  // Guards all fields below
+  std::mutex mu;
+  std::condition_variable cv;
+
+  // Configured depth in pages, zero disables the prefetch.
+  int depth = 0;
+
+  // Size of the most recent read, i.e. the page size for the main database.
+  int unit = 0;
+
+  // End of the last read and the count of reads that started where the
+  // previous one ended.
+  sqlite3_int64 next_offset = -1;
+  int sequential = 0;
+
+  // Prefetched data starting at `window_offset`
+  std::vector<uint8_t> window;
+  sqlite3_int64 window_offset = 0;
+
+  // In-flight prefetch. Its result is dropped if `generation` changes while it
+  // is running.
+  bool pending = false;
+  sqlite3_int64 pending_offset = 0;
+  int pending_len = 0;
+  uint64_t generation = 0;
+
+  // `mmap_size` of the underlying file. The prefetch is off while it is
+  // positive, as reads are then served from a mapping that can be remapped or
+  // unmapped under a running prefetch.
+  sqlite3_int64 mmap_size = 0;
+
+  ReadaheadVfs::Stats stats{};
+
+  inline sqlite3_int64 window_end() const {
+    return window_offset + static_cast<sqlite3_int64>(window.size());
+  }
+
+  // Drop the prefetched data. Has to be called on anything that could change
+  // the file contents or let another connection change them.
+  void Invalidate() {
+    generation++;
+    sequential = 0;
+    DropWindow();
+  }
+
+  // Has to be called before anything that could unmap, shrink or overwrite the
+  // range that the in-flight prefetch reads.
+  void WaitForPrefetch(std::unique_lock<std::mutex>* lock) {
+    cv.wait(*lock, [this] { return !pending; });
+  }
+
+  void DropWindow() {
+    if (window.empty()) {
+      return;
+    }
+    auto unread = window_end() - std::max(window_offset, next_offset);
+    if (unread > 0 && unit > 0) {
+      stats.wasted_pages += unread / unit;
+    }
+    window.clear();
+  }
+};
+
+constexpr int kFileSize =
+    (sizeof(ReadaheadFile) + alignof(max_align_t) - 1) &
+    ~(alignof(max_align_t) - 1);
+
+inline ReadaheadFile* Cast(sqlite3_file* f) {
+  return reinterpret_cast<ReadaheadFile*>(f);
+}
+
+//
+// Prefetch thread pool
+//
+
+class PrefetchPool {
+ public:
+  // Never destroyed: the threads live until the process exits.
+  static PrefetchPool* Get() {
+    static PrefetchPool* pool = new PrefetchPool();
+    return pool;
+  }
+
+  void Schedule(ReadaheadFile* file,
+                uint64_t generation,
+                sqlite3_int64 offset,
+                int len) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      jobs_.push_back({file, generation, offset, len});
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  struct Job {
+    ReadaheadFile* file;
+    uint64_t generation;
+    sqlite3_int64 offset;
+    int len;
+  };
+
+  PrefetchPool() {
+    for (int i = 0; i < kThreadCount; i++) {
+      std::thread([this] { Run(); }).detach();
+    }
+  }
+
+  void Run() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this] { return !jobs_.empty(); });
+        job = jobs_.front();
+        jobs_.pop_front();
+      }
+      Prefetch(job);
+    }
+  }
+
+  // The file stays alive while `pending` is set, see `Close()`. Reading from
+  // the underlying file concurrently with the connection's thread is fine for
+  // the unix and win32 VFSes as they use positional reads.
+  static void Prefetch(const Job& job) {
+    auto file = job.file;
+    auto real = file->real;
+
+    std::vector<uint8_t> data;
+    sqlite3_int64 size = 0;
+    int rc = real->pMethods->xFileSize(real, &size);
+    auto len = std::min(static_cast<sqlite3_int64>(job.len), size - job.offset);
+    if (rc == SQLITE_OK && len > 0) {
+      data.resize(static_cast<size_t>(len));
+      rc = real->pMethods->xRead(real, data.data(), static_cast<int>(len),
+                                 job.offset);
+    }
+
+    std::lock_guard<std::mutex> lock(file->mu);
+    if (rc == SQLITE_OK && !data.empty() && file->unit > 0) {
+      auto pages = data.size() / file->unit;
+      file->stats.prefetched_pages += pages;
+
+      if (job.generation != file->generation) {
+        file->stats.wasted_pages += pages;
+      } else if (!file->window.empty() && file->window_end() == job.offset &&
+                 file->next_offset >= file->window_offset &&
+                 file->next_offset < job.offset) {
+        // Keep the unread tail of the current window
+        std::vector<uint8_t> merged(
+            file->window.begin() + (file->next_offset - file->window_offset),
+            file->window.end());
+        merged.insert(merged.end(), data.begin(), data.end());
+        file->window.swap(merged);
+        file->window_offset = file->next_offset;
+      } else {
+        file->DropWindow();
+        file->window.swap(data);
+        file->window_offset = job.offset;
+      }
+    }
+    file->pending = false;
+    file->cv.notify_all();
+  }
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<Job> jobs_;
+};
+
+// Called with `file->mu` held after every read of the main database.
+void MaybePrefetch(ReadaheadFile* file) {
+  if (file->pending || file->sequential < kSequentialThreshold ||
+      file->unit <= 0) {
+    return;
+  }
+
+  sqlite3_int64 span = static_cast<sqlite3_int64>(file->depth) * file->unit;
+  sqlite3_int64 start = file->next_offset;
+
+  // Continue after the current window once half of it was consumed.
+  if (!file->window.empty() && file->next_offset >= file->window_offset &&
+      file->next_offset < file->window_end()) {
+    if (file->window_end() - file->next_offset > span / 2) {
+      return;
+    }
+    start = file->window_end();
+  }
+
+  file->pending = true;
+  file->pending_offset = start;
+  file->pending_len = static_cast<int>(span);
+  PrefetchPool::Get()->Schedule(file, file->generation, start,
+                                file->pending_len);
+}
+
+//
+// sqlite3_io_methods
+//
+
+int Close(sqlite3_file* f) {
+  auto file = Cast(f);
+  {
+    std::unique_lock<std::mutex> lock(file->mu);
+    file->WaitForPrefetch(&lock);
+  }
+  int rc = file->real->pMethods->xClose(file->real);
+  file->~ReadaheadFile();
+  return rc;
+}
+
+int Read(sqlite3_file* f, void* buf, int amt, sqlite3_int64 offset) {
+  auto file = Cast(f);
+  auto real = file->real;
+  if (!file->is_main) {
+    return real->pMethods->xRead(real, buf, amt, offset);
+  }
+
+  std::unique_lock<std::mutex> lock(file->mu);
+  if (file->depth == 0 || file->mmap_size > 0) {
+    lock.unlock();
+    return real->pMethods->xRead(real, buf, amt, offset);
+  }
+
+  file->stats.reads++;
+
+  // Wait for the in-flight prefetch if it is going to have our data.
+  if (file->pending && offset >= file->pending_offset &&
+      offset + amt <= file->pending_offset + file->pending_len) {
+    file->cv.wait(lock, [file] { return !file->pending; });
+  }
+
+  bool hit = offset >= file->window_offset &&
+             offset + amt <= file->window_end() && !file->window.empty();
+  if (hit) {
+    memcpy(buf, file->window.data() + (offset - file->window_offset), amt);
+    file->stats.hits++;
+  }
+
+  if (offset == file->next_offset) {
+    file->sequential++;
+  } else {
+    file->sequential = 0;
+  }
+  file->next_offset = offset + amt;
+  file->unit = amt;
+
+  MaybePrefetch(file);
+  if (hit) {
+    return SQLITE_OK;
+  }
+
+  lock.unlock();
+  return real->pMethods->xRead(real, buf, amt, offset);
+}
+
+void InvalidateMain(ReadaheadFile* file) {
+  if (!file->is_main) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(file->mu);
+  file->Invalidate();
+}
+
+// Unlike `InvalidateMain` also waits for the in-flight prefetch. Only needed
+// where the file itself changes, not on lock changes.
+void QuiesceMain(ReadaheadFile* file) {
+  if (!file->is_main) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(file->mu);
+  file->Invalidate();
+  file->WaitForPrefetch(&lock);
+}
+
+int Write(sqlite3_file* f, const void* buf, int amt, sqlite3_int64 offset) {
+  auto file = Cast(f);
+  QuiesceMain(file);
+  return file->real->pMethods->xWrite(file->real, buf, amt, offset);
+}
+
+int Truncate(sqlite3_file* f, sqlite3_int64 size) {
+  auto file = Cast(f);
+  QuiesceMain(file);
+  return file->real->pMethods->xTruncate(file->real, size);
+}
+
+int Sync(sqlite3_file* f, int flags) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xSync(real, flags);
+}
+
+int FileSize(sqlite3_file* f, sqlite3_int64* size) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xFileSize(real, size);
+}
+
+int Lock(sqlite3_file* f, int level) {
+  auto file = Cast(f);
+  InvalidateMain(file);
+  return file->real->pMethods->xLock(file->real, level);
+}
+
+int Unlock(sqlite3_file* f, int level) {
+  auto file = Cast(f);
+  InvalidateMain(file);
+  return file->real->pMethods->xUnlock(file->real, level);
+}
+
+int CheckReservedLock(sqlite3_file* f, int* out) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xCheckReservedLock(real, out);
+}
+
+int FileControl(sqlite3_file* f, int op, void* arg) {
+  auto file = Cast(f);
+  if (op == SQLITE_FCNTL_PRAGMA && file->is_main) {
+    auto args = static_cast<char**>(arg);
+    if (sqlite3_stricmp(args[1], "readahead_pages") == 0) {
+      std::lock_guard<std::mutex> lock(file->mu);
+      if (args[2] != nullptr) {
+        int depth = atoi(args[2]);
+        if (depth < 0 || depth > kMaxDepth) {
+          args[0] = sqlite3_mprintf("readahead_pages must be between 0 and %d",
+                                    kMaxDepth);
+          return SQLITE_ERROR;
+        }
+        file->depth = depth;
+        file->Invalidate();
+      }
+      args[0] = sqlite3_mprintf("%d", file->depth);
+      return SQLITE_OK;
+    }
+  }
+  if (op == SQLITE_FCNTL_MMAP_SIZE && file->is_main) {
+    QuiesceMain(file);
+    int rc = file->real->pMethods->xFileControl(file->real, op, arg);
+
+    // The underlying file reports its current (clamped) size for -1
+    sqlite3_int64 size = -1;
+    if (rc == SQLITE_OK &&
+        file->real->pMethods->xFileControl(file->real, op, &size) ==
+            SQLITE_OK) {
+      std::lock_guard<std::mutex> lock(file->mu);
+      file->mmap_size = size;
+    }
+    return rc;
+  }
+  return file->real->pMethods->xFileControl(file->real, op, arg);
+}
+
+int SectorSize(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xSectorSize(real);
+}
+
+int DeviceCharacteristics(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xDeviceCharacteristics(real);
+}
+
+int ShmMap(sqlite3_file* f, int page, int size, int extend, void volatile** p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xShmMap(real, page, size, extend, p);
+}
+
+int ShmLock(sqlite3_file* f, int offset, int n, int flags) {
+  auto file = Cast(f);
+
+  // WAL read transactions start and end with shm locks rather than file locks.
+  InvalidateMain(file);
+  return file->real->pMethods->xShmLock(file->real, offset, n, flags);
+}
+
+void ShmBarrier(sqlite3_file* f) {
+  auto real = Cast(f)->real;
+  real->pMethods->xShmBarrier(real);
+}
+
+int ShmUnmap(sqlite3_file* f, int delete_flag) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xShmUnmap(real, delete_flag);
+}
+
+int Fetch(sqlite3_file* f, sqlite3_int64 offset, int amt, void** p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xFetch(real, offset, amt, p);
+}
+
+int Unfetch(sqlite3_file* f, sqlite3_int64 offset, void* p) {
+  auto real = Cast(f)->real;
+  return real->pMethods->xUnfetch(real, offset, p);
+}
+
+//
+// sqlite3_vfs
+//
+
+int Open(sqlite3_vfs* vfs,
+         sqlite3_filename name,
+         sqlite3_file* f,
+         int flags,
+         int* out_flags) {
+  auto file = new (f) ReadaheadFile();
+  file->real =
+      reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(f) + kFileSize);
+  file->is_main = (flags & SQLITE_OPEN_MAIN_DB) != 0;
+
+  int rc = base_vfs->xOpen(base_vfs, name, file->real, flags, out_flags);
+
+  // `xClose` is called only if `pMethods` is set
+  if (file->real->pMethods == nullptr) {
+    file->~ReadaheadFile();
+    f->pMethods = nullptr;
+    return rc;
+  }
+
+  f->pMethods = &io_methods[std::min(file->real->pMethods->iVersion, 3)];
+  return rc;
+}
+
+void InitMethods() {
+  sqlite3_io_methods m = {
+      3,
+      Close,
+      Read,
+      Write,
+      Truncate,
+      Sync,
+      FileSize,
+      Lock,
+      Unlock,
+      CheckReservedLock,
+      FileControl,
+      SectorSize,
+      DeviceCharacteristics,
+      ShmMap,
+      ShmLock,
+      ShmBarrier,
+      ShmUnmap,
+      Fetch,
+      Unfetch,
+  };
+  for (int version = 1; version <= 3; version++) {
+    io_methods[version] = m;
+    io_methods[version].iVersion = version;
+  }
+  io_methods[0] = io_methods[1];
+}
+
+}  // namespace
+
+int ReadaheadVfs::Register() {
+  static std::once_flag once;
+  static int rc = SQLITE_OK;
+
+  std::call_once(once, [] {
+    base_vfs = sqlite3_vfs_find(nullptr);
+    if (base_vfs == nullptr) {
+      rc = SQLITE_ERROR;
+      return;
+    }
+
+    InitMethods();
+
+    InitShimVfs(&readahead_vfs, base_vfs);
+    readahead_vfs.szOsFile = kFileSize + base_vfs->szOsFile;
+    readahead_vfs.zName = kName;
+    readahead_vfs.xOpen = Open;
+
+    rc = sqlite3_vfs_register(&readahead_vfs, 0);
+  });
+
+  return rc;
+}
+
+bool ReadaheadVfs::GetStats(sqlite3* db, Stats* stats) {
+  sqlite3_file* f = nullptr;
+  int rc = sqlite3_file_control(db, "main", SQLITE_FCNTL_FILE_POINTER, &f);
+  if (rc != SQLITE_OK || f == nullptr || f->pMethods < &io_methods[0] ||
+      f->pMethods > &io_methods[3]) {
+    return false;
+  }
+
+  auto file = Cast(f);
+  std::lock_guard<std::mutex> lock(file->mu);
+  *stats = file->stats;
+  return true;
+}
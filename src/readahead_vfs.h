@@ -0,0 +1,47 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_READAHEAD_VFS_H_
+#define SRC_READAHEAD_VFS_H_
+
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+// A VFS shim around the default VFS that detects sequential reads of the main
+// database file and prefetches the following pages on a background thread.
+//
+// SQLCipher decrypts pages inside the pager, after they were read through the
+// VFS, so the prefetched data is still ciphertext. What gets overlapped with
+// decryption and VDBE work is the I/O.
+//
+// The prefetch depth (in pages) is configured per connection with
+// `PRAGMA readahead_pages = N`. Zero (the default) disables the prefetch, and
+// so does a positive `PRAGMA mmap_size`.
+class ReadaheadVfs {
+ public:
+  static constexpr const char* kName = "signal-readahead";
+
+  struct Stats {
+    // Reads of the main database file
+    uint64_t reads;
+
+    // Reads served from the prefetch buffer
+    uint64_t hits;
+
+    // Pages read by the prefetch thread
+    uint64_t prefetched_pages;
+
+    // Prefetched pages dropped without being read (invalidated by a write or
+    // a lock change, or sequential access stopped)
+    uint64_t wasted_pages;
+  };
+
+  // Registers the VFS (as non-default). Safe to call multiple times.
+  static int Register();
+
+  // Returns `false` if the main database of `db` wasn't opened with this VFS.
+  static bool GetStats(sqlite3* db, Stats* stats);
+};
+
+#endif  // SRC_READAHEAD_VFS_H_
@@ -0,0 +1,212 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "rekey.h"
+
+#include <stdio.h>
+#include <utility>
+
+// Delay before retrying a step when the source is locked
+static constexpr int kBusyDelayMs = 10;
+
+RekeyWorker::RekeyWorker(Napi::Env env,
+                         Napi::External<Database> db,
+                         ConnectionConfig config,
+                         std::string key,
+                         int pages_per_step,
+                         Napi::Function on_progress)
+    : Napi::AsyncProgressWorker<uint64_t>(env),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      db_ref_(Napi::Persistent(db)),
+      config_(std::move(config)),
+      key_(std::move(key)),
+      new_path_(config_.path + "-rekey"),
+      // A step of no pages would never finish the copy
+      pages_per_step_(pages_per_step > 0 ? pages_per_step
+                                         : kDefaultPagesPerStep) {
+  if (!on_progress.IsEmpty() && on_progress.IsFunction()) {
+    on_progress_ = Napi::Persistent(on_progress);
+  }
+}
+
+RekeyWorker::RekeyWorker(RekeyWorker* previous)
+    : Napi::AsyncProgressWorker<uint64_t>(previous->Env()),
+      deferred_(previous->deferred_),
+      db_ref_(std::move(previous->db_ref_)),
+      on_progress_(std::move(previous->on_progress_)),
+      config_(previous->config_),
+      key_(previous->key_),
+      new_path_(previous->new_path_),
+      pages_per_step_(previous->pages_per_step_),
+      pass_(previous->pass_ + 1),
+      source_(previous->source_) {
+  previous->source_ = nullptr;
+}
+
+RekeyWorker::~RekeyWorker() {
+  SecureZero(key_.data(), key_.size());
+  SecureZero(raw_key_.data(), raw_key_.size());
+
+  if (source_ != nullptr) {
+    sqlite3_close(source_);
+  }
+}
+
+void RekeyWorker::Execute(const ExecutionProgress& progress) {
+  std::string error;
+  if (source_ == nullptr &&
+      config_.Open(&source_, SQLITE_OPEN_READONLY, nullptr, &error) !=
+          SQLITE_OK) {
+    SetError(error);
+    return;
+  }
+
+  // Compared against before the swap. Changes made after this point restart
+  // the copy.
+  int r = QueryInt(source_, "PRAGMA data_version", &data_version_);
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(source_));
+    return;
+  }
+
+  // Leftovers of an interrupted rekey or of the previous pass
+  remove(new_path_.c_str());
+  remove((new_path_ + "-journal").c_str());
+
+  sqlite3* dest;
+  r = sqlite3_open_v2(new_path_.c_str(), &dest,
+                      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+  if (r != SQLITE_OK) {
+    SetError(FormatString("sqlite open error: %s", sqlite3_errstr(r)));
+    sqlite3_close(dest);
+    return;
+  }
+
+  r = sqlite3_extended_result_codes(dest, 1);
+  if (r == SQLITE_OK) {
+    r = sqlite3_key_v2(dest, "main", key_.data(), key_.size());
+  }
+  if (r == SQLITE_OK && !config_.cipher_settings.empty()) {
+    r = sqlite3_exec(dest, config_.cipher_settings.c_str(), nullptr, nullptr,
+                     nullptr);
+  }
+  if (r == SQLITE_OK) {
+    // The reopened connection uses the raw key, so that the key isn't derived
+    // again on the JS thread.
+    if (IsRawKey(key_)) {
+      raw_key_ = key_;
+    } else {
+      r = DeriveRawKey(dest, &raw_key_);
+    }
+  }
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(dest));
+    sqlite3_close(dest);
+    return;
+  }
+  if (raw_key_.empty()) {
+    SetError("Failed to derive the new key");
+    sqlite3_close(dest);
+    return;
+  }
+
+  sqlite3_backup* backup = sqlite3_backup_init(dest, "main", source_, "main");
+  if (backup == nullptr) {
+    SetError(SqliteErrorMessage(dest));
+    sqlite3_close(dest);
+    return;
+  }
+
+  do {
+    r = sqlite3_backup_step(backup, pages_per_step_);
+    if (r == SQLITE_OK || r == SQLITE_DONE) {
+      uint64_t total = sqlite3_backup_pagecount(backup);
+      uint64_t data[2] = {total - sqlite3_backup_remaining(backup), total};
+      progress.Send(data, 2);
+    } else if (r == SQLITE_BUSY || r == SQLITE_LOCKED) {
+      sqlite3_sleep(kBusyDelayMs);
+      r = SQLITE_OK;
+    }
+  } while (r == SQLITE_OK);
+
+  // Errors of `sqlite3_backup_step()` are reported on the destination
+  sqlite3_backup_finish(backup);
+  if (r != SQLITE_DONE) {
+    SetError(SqliteErrorMessage(dest));
+  }
+  sqlite3_close(dest);
+}
+
+void RekeyWorker::OnProgress(const uint64_t* data, size_t count) {
+  if (on_progress_.IsEmpty() || count != 2) {
+    return;
+  }
+
+  auto env = Env();
+  Napi::HandleScope scope(env);
+  on_progress_.Call({Napi::Number::New(env, static_cast<double>(data[0])),
+                     Napi::Number::New(env, static_cast<double>(data[1]))});
+}
+
+void RekeyWorker::OnOK() {
+  auto env = Env();
+  Database* db = db_ref_.Value().Data();
+
+  if (db->handle() == nullptr) {
+    Cleanup();
+    deferred_.Reject(Napi::Error::New(env, "Database closed").Value());
+    return;
+  }
+
+  // Started since the copy began. Waiting for it to end would take another
+  // pass at best.
+  if (db->is_in_transaction()) {
+    Cleanup();
+    deferred_.Reject(
+        Napi::Error::New(env, "Cannot rekey the database in a transaction")
+            .Value());
+    return;
+  }
+
+  // The main connection is only used on this thread, so nothing can change
+  // between this check and the swap.
+  int version;
+  int r = QueryInt(source_, "PRAGMA data_version", &version);
+  if (r != SQLITE_OK) {
+    Cleanup();
+    deferred_.Reject(
+        Napi::Error::New(env, SqliteErrorMessage(source_)).Value());
+    return;
+  }
+  if (version != data_version_) {
+    if (pass_ >= kMaxPasses) {
+      Cleanup();
+      deferred_.Reject(
+          Napi::Error::New(env, "Database kept changing during rekey").Value());
+      return;
+    }
+    auto next = new RekeyWorker(this);
+    next->Queue();
+    return;
+  }
+
+  sqlite3_close(source_);
+  source_ = nullptr;
+
+  if (!db->ReplaceFile(env, new_path_, std::move(raw_key_))) {
+    Cleanup();
+    deferred_.Reject(env.GetAndClearPendingException().Value());
+    return;
+  }
+  deferred_.Resolve(env.Undefined());
+}
+
+void RekeyWorker::OnError(const Napi::Error& e) {
+  Cleanup();
+  deferred_.Reject(e.Value());
+}
+
+void RekeyWorker::Cleanup() {
+  remove(new_path_.c_str());
+  remove((new_path_ + "-journal").c_str());
+}
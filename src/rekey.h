@@ -0,0 +1,72 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_REKEY_H_
+#define SRC_REKEY_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "addon.h"
+#include "napi.h"
+#include "sqlite3.h"
+
+// Non-blocking alternative to `PRAGMA rekey`.
+//
+// The database is copied with the backup API, `pages_per_step` pages at a
+// time, from a side connection into a new file encrypted with the new key.
+// Locks are released between the steps so the database stays readable and
+// writable during the copy. Once the copy is complete, the main connection
+// is closed, the new file is renamed over the old one and the connection is
+// opened again (see `Database::ReplaceFile`). Only this last step runs on the
+// JS thread and its duration doesn't depend on the size of the database.
+//
+// If the database was written to during the copy, the copy is restarted (up
+// to `kMaxPasses` times in total).
+class RekeyWorker : public Napi::AsyncProgressWorker<uint64_t> {
+ public:
+  static constexpr int kDefaultPagesPerStep = 1024;
+
+  RekeyWorker(Napi::Env env,
+              Napi::External<Database> db,
+              ConnectionConfig config,
+              std::string key,
+              int pages_per_step,
+              Napi::Function on_progress);
+  ~RekeyWorker();
+
+  inline Napi::Promise Promise() { return deferred_.Promise(); }
+
+ protected:
+  void Execute(const ExecutionProgress& progress) override;
+  void OnProgress(const uint64_t* data, size_t count) override;
+  void OnOK() override;
+  void OnError(const Napi::Error& e) override;
+
+ private:
+  static constexpr int kMaxPasses = 3;
+
+  // Continues with another pass
+  RekeyWorker(RekeyWorker* previous);
+
+  void Cleanup();
+
+  Napi::Promise::Deferred deferred_;
+  Napi::Reference<Napi::External<Database>> db_ref_;
+  Napi::FunctionReference on_progress_;
+  ConnectionConfig config_;
+  std::string key_;
+  std::string new_path_;
+  int pages_per_step_;
+  int pass_ = 1;
+
+  // Side connection used as the backup source. Kept open until the swap to
+  // check that the database didn't change since the start of the copy.
+  sqlite3* source_ = nullptr;
+  int data_version_ = 0;
+
+  // Raw key of the new file
+  std::string raw_key_;
+};
+
+#endif  // SRC_REKEY_H_
@@ -0,0 +1,283 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "snapshot.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // !defined(_WIN32)
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif  // defined(__linux__)
+
+namespace {
+
+constexpr size_t kCopyChunkSize = 1 << 20;
+
+#if !defined(_WIN32)
+
+bool CopyData(int from, int to) {
+#if defined(__linux__)
+#if defined(FICLONE)
+  // Shares the extents of the source on copy-on-write file systems
+  if (ioctl(to, FICLONE, from) == 0) {
+    return true;
+  }
+#endif  // defined(FICLONE)
+
+#if defined(__NR_copy_file_range)
+  while (true) {
+    auto n = syscall(__NR_copy_file_range, from, nullptr, to, nullptr,
+                     kCopyChunkSize, 0);
+    if (n == 0) {
+      return true;
+    }
+    if (n > 0) {
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+
+    // Not supported for these files, the rest is copied from the current
+    // offsets below
+    if (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+        errno == EOPNOTSUPP) {
+      break;
+    }
+    return false;
+  }
+#endif  // defined(__NR_copy_file_range)
+#endif  // defined(__linux__)
+
+  std::vector<char> buffer(kCopyChunkSize);
+  while (true) {
+    auto n = read(from, buffer.data(), buffer.size());
+    if (n == 0) {
+      return true;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    for (ssize_t written = 0; written < n;) {
+      auto w = write(to, buffer.data() + written, n - written);
+      if (w < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      written += w;
+    }
+  }
+}
+
+// Sets `exists` to `false` (and succeeds) if `from` doesn't exist
+bool CopyFileContents(const std::string& from_path,
+                      const std::string& to_path,
+                      bool* exists,
+                      std::string* error) {
+  int from = open(from_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (from < 0) {
+    if (errno == ENOENT) {
+      *exists = false;
+      return true;
+    }
+    *error = FormatString("Failed to open %s: %s", from_path.c_str(),
+                          strerror(errno));
+    return false;
+  }
+  *exists = true;
+
+  struct stat st;
+  int to = -1;
+  if (fstat(from, &st) == 0) {
+    to = open(to_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+              st.st_mode & 0777);
+  }
+  if (to < 0) {
+    *error = FormatString("Failed to create %s: %s", to_path.c_str(),
+                          strerror(errno));
+    close(from);
+    return false;
+  }
+
+  bool is_done = CopyData(from, to) && fsync(to) == 0;
+  if (!is_done) {
+    *error = FormatString("Failed to copy %s: %s", from_path.c_str(),
+                          strerror(errno));
+  }
+  close(to);
+  close(from);
+  return is_done;
+}
+
+#else  // defined(_WIN32)
+
+bool CopyFileContents(const std::string& from_path,
+                      const std::string& to_path,
+                      bool* exists,
+                      std::string* error) {
+  FILE* from = fopen(from_path.c_str(), "rb");
+  if (from == nullptr) {
+    if (errno == ENOENT) {
+      *exists = false;
+      return true;
+    }
+    *error = FormatString("Failed to open %s: %s", from_path.c_str(),
+                          strerror(errno));
+    return false;
+  }
+  *exists = true;
+
+  FILE* to = fopen(to_path.c_str(), "wb");
+  if (to == nullptr) {
+    *error = FormatString("Failed to create %s: %s", to_path.c_str(),
+                          strerror(errno));
+    fclose(from);
+    return false;
+  }
+
+  std::vector<char> buffer(kCopyChunkSize);
+  bool is_done = true;
+  while (is_done) {
+    size_t n = fread(buffer.data(), 1, buffer.size(), from);
+    if (n == 0) {
+      is_done = ferror(from) == 0;
+      break;
+    }
+    is_done = fwrite(buffer.data(), 1, n, to) == n;
+  }
+  is_done = fclose(to) == 0 && is_done;
+  fclose(from);
+  if (!is_done) {
+    *error = FormatString("Failed to copy %s: %s", from_path.c_str(),
+                          strerror(errno));
+  }
+  return is_done;
+}
+
+#endif  // !defined(_WIN32)
+
+}  // namespace
+
+SnapshotWorker::SnapshotWorker(Napi::Env env,
+                               ConnectionConfig config,
+                               std::string dest_path)
+    : Napi::AsyncWorker(env),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      config_(std::move(config)),
+      dest_path_(std::move(dest_path)),
+      temp_path_(dest_path_ + "-snapshot") {}
+
+void SnapshotWorker::Execute() {
+  sqlite3* source;
+  std::string error;
+  if (config_.Open(&source, SQLITE_OPEN_READONLY, nullptr, &error) !=
+      SQLITE_OK) {
+    SetError(error);
+    return;
+  }
+
+  // Leftovers of an interrupted snapshot
+  Cleanup();
+
+  bool has_wal = false;
+  bool is_done = CopyFiles(source, &has_wal);
+  sqlite3_close(source);
+  if (!is_done || (has_wal && !CheckpointCopy())) {
+    return;
+  }
+
+  // Otherwise they would be replayed on top of the snapshot
+  remove((dest_path_ + "-wal").c_str());
+  remove((dest_path_ + "-shm").c_str());
+
+  if (rename(temp_path_.c_str(), dest_path_.c_str()) != 0) {
+    SetError(FormatString("Failed to replace the snapshot file: %s",
+                          strerror(errno)));
+  }
+}
+
+bool SnapshotWorker::CopyFiles(sqlite3* source, bool* has_wal) {
+  int count;
+  int r = sqlite3_exec(source, "BEGIN", nullptr, nullptr, nullptr);
+  if (r == SQLITE_OK) {
+    r = QueryInt(source, "SELECT count(*) FROM sqlite_schema", &count);
+  }
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(source));
+    return false;
+  }
+
+  std::string error;
+  bool exists;
+  bool is_done = CopyFileContents(config_.path, temp_path_, &exists, &error);
+  if (is_done && IsWalMode(source)) {
+    is_done = CopyFileContents(config_.path + "-wal", temp_path_ + "-wal",
+                               has_wal, &error);
+  }
+
+  sqlite3_exec(source, "COMMIT", nullptr, nullptr, nullptr);
+  if (!is_done) {
+    SetError(error);
+  }
+  return is_done;
+}
+
+bool SnapshotWorker::CheckpointCopy() {
+  ConnectionConfig config = config_;
+  config.path = temp_path_;
+
+  sqlite3* handle;
+  std::string error;
+  if (config.Open(&handle, SQLITE_OPEN_READWRITE, nullptr, &error) !=
+      SQLITE_OK) {
+    SetError(error);
+    return false;
+  }
+
+  // The first read recovers the copied WAL. Closing the only connection
+  // removes the WAL once checkpointed.
+  int count;
+  int r = QueryInt(handle, "SELECT count(*) FROM sqlite_schema", &count);
+  if (r == SQLITE_OK) {
+    r = sqlite3_wal_checkpoint_v2(handle, "main", SQLITE_CHECKPOINT_TRUNCATE,
+                                  nullptr, nullptr);
+  }
+  if (r != SQLITE_OK) {
+    SetError(SqliteErrorMessage(handle));
+  }
+  sqlite3_close(handle);
+  return r == SQLITE_OK;
+}
+
+void SnapshotWorker::OnOK() {
+  deferred_.Resolve(Env().Undefined());
+}
+
+void SnapshotWorker::OnError(const Napi::Error& e) {
+  Cleanup();
+  deferred_.Reject(e.Value());
+}
+
+void SnapshotWorker::Cleanup() {
+  remove(temp_path_.c_str());
+  remove((temp_path_ + "-wal").c_str());
+  remove((temp_path_ + "-shm").c_str());
+}
@@ -0,0 +1,54 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_SNAPSHOT_H_
+#define SRC_SNAPSHOT_H_
+
+#include <string>
+
+#include "addon.h"
+#include "napi.h"
+#include "sqlite3.h"
+
+// Copies the files of the database as they are, without decrypting and
+// encrypting the pages like the backup API does, so the copy has the same
+// key. Runs on a worker thread.
+//
+// A side connection keeps a read transaction open during the copy. In WAL
+// mode this prevents checkpoints from copying frames that are newer than its
+// snapshot into the database file and writers from restarting the WAL, so
+// the database file followed by the WAL (which is copied second) always
+// contains a complete state of the database: frames that were checkpointed
+// during the copy are still in the WAL and are replayed over the copied
+// pages. The copied WAL is then checkpointed into the copy. In rollback
+// journal modes the read transaction blocks writers for the duration of the
+// copy.
+//
+// On Linux the files are cloned (`FICLONE`) on file systems supporting it and
+// copied with `copy_file_range()` otherwise, both without passing the data
+// through user space.
+class SnapshotWorker : public Napi::AsyncWorker {
+ public:
+  SnapshotWorker(Napi::Env env, ConnectionConfig config, std::string dest_path);
+
+  inline Napi::Promise Promise() { return deferred_.Promise(); }
+
+ protected:
+  void Execute() override;
+  void OnOK() override;
+  void OnError(const Napi::Error& e) override;
+
+ private:
+  // Returns `false` and calls `SetError` on failure
+  bool CopyFiles(sqlite3* source, bool* has_wal);
+  bool CheckpointCopy();
+
+  void Cleanup();
+
+  Napi::Promise::Deferred deferred_;
+  ConnectionConfig config_;
+  std::string dest_path_;
+  std::string temp_path_;
+};
+
+#endif  // SRC_SNAPSHOT_H_
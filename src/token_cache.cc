@@ -0,0 +1,132 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "token_cache.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "signal-tokenizer.h"
+#include "sqlite3.h"
+
+namespace {
+
+// Cached queries per connection
+constexpr size_t kCapacity = 64;
+
+// Longer queries (e.g. pasted text) are tokenized without the cache
+constexpr int kMaxLength = 4096;
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+}  // namespace
+
+int TokenCache::Entry::Replay(void* ctx, TokenCallback callback) const {
+  for (const auto& token : tokens) {
+    int r = callback(ctx, token.flags, data.data() + token.offset,
+                     token.length, token.start, token.end);
+    if (r != SQLITE_OK) {
+      return r;
+    }
+  }
+  return SQLITE_OK;
+}
+
+int TokenCache::AddToken(void* suffix_ptr,
+                         int flags,
+                         const char* token,
+                         int length,
+                         int start,
+                         int end) {
+  auto suffix = static_cast<Suffix*>(suffix_ptr);
+  auto entry = suffix->entry;
+  entry->tokens.push_back({static_cast<uint32_t>(entry->data.size()), length,
+                           flags, start + suffix->base, end + suffix->base});
+  entry->data.append(token, length);
+  return SQLITE_OK;
+}
+
+int TokenCache::Tokenize(void* ctx,
+                         int flags,
+                         const char* text,
+                         int length,
+                         TokenCallback callback) {
+  if (length > kMaxLength) {
+    stats_.misses++;
+    stats_.tokenized_bytes += length;
+    return signal_fts5_tokenize(nullptr, ctx, flags, text, length, callback);
+  }
+
+  std::string key(1, static_cast<char>(flags));
+  key.append(text, length);
+
+  auto iter = index_.find(key);
+  if (iter != index_.end()) {
+    stats_.hits++;
+    entries_.splice(entries_.begin(), entries_, iter->second);
+    return iter->second->Replay(ctx, callback);
+  }
+
+  stats_.misses++;
+  Entry entry;
+  int r = Fill(&entry, flags, text, length);
+  if (r != SQLITE_OK) {
+    return r;
+  }
+  entry.key = key;
+
+  if (entries_.size() == kCapacity) {
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+  entries_.push_front(std::move(entry));
+  index_.emplace(std::move(key), entries_.begin());
+  return entries_.front().Replay(ctx, callback);
+}
+
+int TokenCache::Fill(Entry* entry, int flags, const char* text, int length) {
+  // Query with the longest common prefix
+  const Entry* base = nullptr;
+  size_t prefix = 0;
+  for (const auto& other : entries_) {
+    if (other.key[0] != static_cast<char>(flags)) {
+      continue;
+    }
+    const char* other_text = other.key.data() + 1;
+    size_t max = std::min(other.key.size() - 1, static_cast<size_t>(length));
+    size_t i = 0;
+    while (i < max && other_text[i] == text[i]) {
+      i++;
+    }
+    if (i > prefix) {
+      prefix = i;
+      base = &other;
+    }
+  }
+
+  // Tokens ending before the last whitespace of the prefix are kept
+  size_t start = 0;
+  for (size_t i = prefix; i > 0; i--) {
+    if (IsSpace(text[i - 1])) {
+      start = i - 1;
+      break;
+    }
+  }
+  if (base != nullptr && start > 0) {
+    for (const auto& token : base->tokens) {
+      if (token.end > static_cast<int>(start)) {
+        break;
+      }
+      entry->tokens.push_back(token);
+      entry->tokens.back().offset = static_cast<uint32_t>(entry->data.size());
+      entry->data.append(base->data, token.offset, token.length);
+    }
+  }
+
+  Suffix suffix = {entry, static_cast<int>(start)};
+  stats_.tokenized_bytes += length - start;
+  return signal_fts5_tokenize(nullptr, &suffix, flags, text + start,
+                              length - static_cast<int>(start), &AddToken);
+}
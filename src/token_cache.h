@@ -0,0 +1,85 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_TOKEN_CACHE_H_
+#define SRC_TOKEN_CACHE_H_
+
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tokens of the last queries tokenized by `signal_tokenizer` on a connection,
+// so that search-as-you-type doesn't tokenize the whole query again on every
+// keystroke.
+//
+// Queries are keyed by their bytes and FTS5 flags. A query that isn't cached
+// reuses the tokens of the cached query with the longest common prefix up to
+// the last whitespace before the first change, and only the rest is
+// tokenized. Whitespace always separates tokens, so the tokens are the same
+// as if the whole query was tokenized.
+class TokenCache {
+ public:
+  using TokenCallback = int (*)(void*, int, const char*, int, int, int);
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+
+    // Bytes passed to `signal_fts5_tokenize`
+    uint64_t tokenized_bytes;
+  };
+
+  // `xTokenize` of a query
+  int Tokenize(void* ctx,
+               int flags,
+               const char* text,
+               int length,
+               TokenCallback callback);
+
+  inline Stats stats() const { return stats_; }
+
+ private:
+  struct Token {
+    uint32_t offset;
+    int length;
+    int flags;
+    int start;
+    int end;
+  };
+
+  struct Entry {
+    // `flags` followed by the query
+    std::string key;
+
+    // Tokens back to back, `Token::offset` is the start in `data`
+    std::string data;
+    std::vector<Token> tokens;
+
+    int Replay(void* ctx, TokenCallback callback) const;
+  };
+
+  // Tokens of `text + base` added to `entry`
+  struct Suffix {
+    Entry* entry;
+    int base;
+  };
+
+  static int AddToken(void* suffix_ptr,
+                      int flags,
+                      const char* token,
+                      int length,
+                      int start,
+                      int end);
+
+  int Fill(Entry* entry, int flags, const char* text, int length);
+
+  // Most recently used first
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+  Stats stats_ = {};
+};
+
+#endif  // SRC_TOKEN_CACHE_H_
@@ -0,0 +1,77 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "vfs_shim.h"
+
+void InitShimVfs(sqlite3_vfs* shim, sqlite3_vfs* base) {
+  *shim = *base;
+  shim->pNext = nullptr;
+  shim->pAppData = base;
+
+  shim->xDelete = [](sqlite3_vfs* vfs, const char* name, int sync_dir) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xDelete(base, name, sync_dir);
+  };
+  shim->xAccess = [](sqlite3_vfs* vfs, const char* name, int flags, int* out) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xAccess(base, name, flags, out);
+  };
+  shim->xFullPathname = [](sqlite3_vfs* vfs, const char* name, int n,
+                           char* out) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xFullPathname(base, name, n, out);
+  };
+  shim->xDlOpen = [](sqlite3_vfs* vfs, const char* name) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xDlOpen(base, name);
+  };
+  shim->xDlError = [](sqlite3_vfs* vfs, int n, char* out) {
+    auto base = ShimBaseVfs(vfs);
+    base->xDlError(base, n, out);
+  };
+  shim->xDlSym = [](sqlite3_vfs* vfs, void* handle, const char* symbol) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xDlSym(base, handle, symbol);
+  };
+  shim->xDlClose = [](sqlite3_vfs* vfs, void* handle) {
+    auto base = ShimBaseVfs(vfs);
+    base->xDlClose(base, handle);
+  };
+  shim->xRandomness = [](sqlite3_vfs* vfs, int n, char* out) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xRandomness(base, n, out);
+  };
+  shim->xSleep = [](sqlite3_vfs* vfs, int microseconds) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xSleep(base, microseconds);
+  };
+  shim->xCurrentTime = [](sqlite3_vfs* vfs, double* out) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xCurrentTime(base, out);
+  };
+  shim->xGetLastError = [](sqlite3_vfs* vfs, int n, char* out) {
+    auto base = ShimBaseVfs(vfs);
+    return base->xGetLastError(base, n, out);
+  };
+  if (base->iVersion >= 2) {
+    shim->xCurrentTimeInt64 = [](sqlite3_vfs* vfs, sqlite3_int64* out) {
+      auto base = ShimBaseVfs(vfs);
+      return base->xCurrentTimeInt64(base, out);
+    };
+  }
+  if (base->iVersion >= 3) {
+    shim->xSetSystemCall = [](sqlite3_vfs* vfs, const char* name,
+                              sqlite3_syscall_ptr ptr) {
+      auto base = ShimBaseVfs(vfs);
+      return base->xSetSystemCall(base, name, ptr);
+    };
+    shim->xGetSystemCall = [](sqlite3_vfs* vfs, const char* name) {
+      auto base = ShimBaseVfs(vfs);
+      return base->xGetSystemCall(base, name);
+    };
+    shim->xNextSystemCall = [](sqlite3_vfs* vfs, const char* name) {
+      auto base = ShimBaseVfs(vfs);
+      return base->xNextSystemCall(base, name);
+    };
+  }
+}
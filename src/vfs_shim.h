@@ -0,0 +1,20 @@
+// Copyright 2025 Signal Messenger, LLC
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#ifndef SRC_VFS_SHIM_H_
+#define SRC_VFS_SHIM_H_
+
+#include "sqlite3.h"
+
+// Initializes `shim` as a copy of `base` with all VFS methods (except `xOpen`)
+// forwarded to `base`. `base` is stored in `pAppData`.
+//
+// The caller sets `zName`, `szOsFile` and `xOpen`.
+void InitShimVfs(sqlite3_vfs* shim, sqlite3_vfs* base);
+
+// Returns the VFS that `shim` forwards to
+inline sqlite3_vfs* ShimBaseVfs(sqlite3_vfs* shim) {
+  return static_cast<sqlite3_vfs*>(shim->pAppData);
+}
+
+#endif  // SRC_VFS_SHIM_H_
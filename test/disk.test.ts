@@ -1,7 +1,7 @@
-import { mkdtemp, rm } from 'node:fs/promises';
+import { mkdtemp, open, rm } from 'node:fs/promises';
 import { tmpdir } from 'node:os';
 import { join } from 'node:path';
-import { expect, test, beforeEach, afterEach } from 'vitest';
+import { expect, test, vi, beforeEach, afterEach } from 'vitest';
 
 import Database from '../lib/index.js';
 
@@ -65,3 +65,704 @@ test.each([[false], [true]])('ciphertext=%j', (ciphertext) => {
 
   expect(row).toEqual({ name: 'Adam', value: 'Sandler' });
 });
+
+test('openAsync with key', async () => {
+  const path = join(dir, 'async.sqlite');
+
+  const first = await Database.openAsync(path, {
+    key: 'hello world',
+    cipherSettings: { kdf_iter: 1000 },
+  });
+  first.exec('CREATE TABLE t (value TEXT NOT NULL)');
+  first.prepare('INSERT INTO t (value) VALUES (?)').run(['encrypted']);
+  first.close();
+
+  await expect(
+    Database.openAsync(path, {
+      key: 'wrong key',
+      cipherSettings: { kdf_iter: 1000 },
+    }),
+  ).rejects.toThrowError('file is not a database');
+
+  const second = await Database.openAsync(path, {
+    key: 'hello world',
+    cipherSettings: { kdf_iter: 1000 },
+  });
+  expect(second.prepare('SELECT value FROM t', { pluck: true }).get()).toEqual(
+    'encrypted',
+  );
+  second.close();
+});
+
+test('exportRawKey and rawKey', async () => {
+  const path = join(dir, 'raw.sqlite');
+
+  const first = await Database.openAsync(path, { key: 'hello world' });
+  const rawKey = first.exportRawKey();
+  expect(rawKey).toMatch(/^x'[0-9a-f]{96}'$/);
+  first.exec('CREATE TABLE t (value TEXT NOT NULL)');
+  first.prepare('INSERT INTO t (value) VALUES (?)').run(['raw']);
+  first.close();
+
+  const second = await Database.openAsync(path, { rawKey });
+  expect(second.exportRawKey()).toEqual(rawKey);
+  expect(second.prepare('SELECT value FROM t', { pluck: true }).get()).toEqual(
+    'raw',
+  );
+  second.close();
+});
+
+test('verifyIntegrity', async () => {
+  const path = join(dir, 'integrity.sqlite');
+
+  const writer = await Database.openAsync(path, { key: 'hello world' });
+  writer.exec('CREATE TABLE t (b BLOB NOT NULL)');
+  const insert = writer.prepare('INSERT INTO t (b) VALUES (?)');
+  writer.transaction(() => {
+    for (let i = 0; i < 500; i += 1) {
+      insert.run([Buffer.alloc(1024, i)]);
+    }
+  })();
+
+  const progress = new Array<number>();
+  expect(
+    await writer.verifyIntegrity({
+      threads: 4,
+      onProgress: (checked) => progress.push(checked),
+    }),
+  ).toEqual([]);
+  expect(progress.at(-1)).toBeGreaterThan(0);
+
+  // Capped at the number of CPUs
+  expect(await writer.verifyIntegrity({ threads: 2 ** 40 })).toEqual([]);
+  writer.close();
+
+  // Flip a byte in the third page
+  const file = await open(path, 'r+');
+  try {
+    await file.write(Buffer.from([0xff]), 0, 1, 2 * 4096 + 100);
+  } finally {
+    await file.close();
+  }
+
+  const reader = await Database.openAsync(path, { key: 'hello world' });
+  expect(await reader.verifyIntegrity({ threads: 2 })).toEqual([3]);
+  reader.close();
+});
+
+test('rekeyAsync', async () => {
+  const path = join(dir, 'rekey.sqlite');
+
+  const first = await Database.openAsync(path, { key: 'old key' });
+  first.exec('CREATE TABLE t (b BLOB NOT NULL)');
+  const insert = first.prepare('INSERT INTO t (b) VALUES (?)');
+  first.transaction(() => {
+    for (let i = 0; i < 500; i += 1) {
+      insert.run([Buffer.alloc(1024, i)]);
+    }
+  })();
+  const select = first.prepare('SELECT count(*) FROM t', { pluck: true });
+
+  const progress = new Array<number>();
+  const rekey = first.rekeyAsync('new key', {
+    pagesPerStep: 16,
+    onProgress: (copied) => progress.push(copied),
+  });
+
+  // Readable during the copy
+  expect(select.get()).toEqual(500);
+  await rekey;
+
+  await expect(
+    first.rekeyAsync('new key', { pagesPerStep: 2 ** 32 }),
+  ).rejects.toThrowError('Invalid pagesPerStep option');
+
+  expect(progress.at(-1)).toBeGreaterThan(0);
+  expect(select.get()).toEqual(500);
+  insert.run([Buffer.alloc(1)]);
+  first.close();
+
+  await expect(
+    Database.openAsync(path, { key: 'old key' }),
+  ).rejects.toThrowError('file is not a database');
+
+  const second = await Database.openAsync(path, { key: 'new key' });
+  expect(second.prepare('SELECT count(*) FROM t', { pluck: true }).get()).toEqual(
+    501,
+  );
+  second.close();
+});
+
+test('rekeyAsync in a transaction', async () => {
+  const path = join(dir, 'rekey-transaction.sqlite');
+
+  const db = await Database.openAsync(path, { key: 'old key' });
+  db.exec('CREATE TABLE t (a INTEGER NOT NULL)');
+  db.exec('BEGIN');
+  db.exec('INSERT INTO t (a) VALUES (1)');
+
+  // Closing the connection would roll back the transaction
+  await expect(db.rekeyAsync('new key')).rejects.toThrowError(
+    'Cannot rekey the database in a transaction',
+  );
+  db.exec('COMMIT');
+  expect(db.prepare('SELECT count(*) FROM t', { pluck: true }).get()).toEqual(
+    1,
+  );
+
+  // The rest of the rows would be read from the start on the new connection
+  db.exec('INSERT INTO t (a) VALUES (2)');
+  const stmt = db.prepare('SELECT a FROM t ORDER BY a', { pluck: true });
+  expect(stmt.stepFor({ vmSteps: 1 }).done).toEqual(false);
+  await expect(db.rekeyAsync('new key')).rejects.toThrowError(
+    'Cannot rekey the database while a statement runs',
+  );
+  db.close();
+
+  const reopened = await Database.openAsync(path, { key: 'old key' });
+  expect(
+    reopened.prepare('SELECT count(*) FROM t', { pluck: true }).get(),
+  ).toEqual(1);
+  reopened.close();
+});
+
+test('backup', async () => {
+  const path = join(dir, 'backup-source.sqlite');
+
+  const source = await Database.openAsync(path, { key: 'hello world' });
+  source.pragma('journal_mode = WAL');
+  source.exec('CREATE TABLE t (b BLOB NOT NULL)');
+  const insert = source.prepare('INSERT INTO t (b) VALUES (?)');
+  source.transaction(() => {
+    for (let i = 0; i < 500; i += 1) {
+      insert.run([Buffer.alloc(1024, i)]);
+    }
+  })();
+
+  const progress = new Array<[number, number]>();
+  await source.backup(join(dir, 'same-key.sqlite'), {
+    pagesPerStep: 16,
+    onProgress: (copied, total) => {
+      // Writable during the copy, the backup is a snapshot
+      if (progress.length === 0) {
+        insert.run([Buffer.alloc(1)]);
+      }
+      progress.push([copied, total]);
+    },
+  });
+
+  expect(progress.length).toBeGreaterThan(1);
+  const [copied, total] = progress.at(-1) ?? [];
+  expect(copied).toEqual(total);
+
+  await source.backup(join(dir, 'new-key.sqlite'), { key: 'other key' });
+  await source.backup(join(dir, 'plaintext.sqlite'), { key: null });
+  await expect(source.backup(path)).rejects.toThrowError(
+    "Can't back up the database onto itself",
+  );
+  await expect(
+    source.backup(join(dir, 'invalid.sqlite'), { pagesPerStep: 2 ** 32 }),
+  ).rejects.toThrowError('Invalid pagesPerStep option');
+  await expect(
+    source.backup(join(dir, 'invalid.sqlite'), { sleepMs: 2 ** 31 }),
+  ).rejects.toThrowError('Invalid sleepMs option');
+  source.close();
+
+  const count = (backupDb: Database) =>
+    backupDb.prepare('SELECT count(*) FROM t', { pluck: true }).get();
+
+  const sameKey = await Database.openAsync(join(dir, 'same-key.sqlite'), {
+    key: 'hello world',
+  });
+  expect(count(sameKey)).toEqual(500);
+  sameKey.close();
+
+  const newKey = await Database.openAsync(join(dir, 'new-key.sqlite'), {
+    key: 'other key',
+  });
+  expect(count(newKey)).toEqual(501);
+  newKey.close();
+
+  const plaintext = new Database(join(dir, 'plaintext.sqlite'));
+  expect(count(plaintext)).toEqual(501);
+  plaintext.close();
+});
+
+test('snapshotTo', async () => {
+  const path = join(dir, 'snapshot-source.sqlite');
+
+  const source = await Database.openAsync(path, { key: 'hello world' });
+  source.pragma('journal_mode = WAL');
+  source.pragma('wal_autocheckpoint = 0');
+  source.exec('CREATE TABLE t (b BLOB NOT NULL)');
+  const insert = source.prepare('INSERT INTO t (b) VALUES (?)');
+  for (let i = 0; i < 100; i += 1) {
+    insert.run([Buffer.alloc(1024, i)]);
+  }
+
+  // Half of the rows are only in the WAL
+  source.pragma('wal_checkpoint(PASSIVE)');
+  for (let i = 0; i < 100; i += 1) {
+    insert.run([Buffer.alloc(1024, i)]);
+  }
+
+  const snapshotPath = join(dir, 'snapshot.sqlite');
+  await source.snapshotTo(snapshotPath);
+  await expect(source.snapshotTo(path)).rejects.toThrowError(
+    "Can't snapshot the database onto itself",
+  );
+  source.close();
+
+  const snapshot = await Database.openAsync(snapshotPath, {
+    key: 'hello world',
+  });
+  expect(
+    snapshot.prepare('SELECT count(*) FROM t', { pluck: true }).get(),
+  ).toEqual(200);
+  expect(snapshot.pragma('integrity_check', { simple: true })).toEqual('ok');
+  snapshot.close();
+});
+
+test('backupIncremental', async () => {
+  const path = join(dir, 'incremental-source.sqlite');
+  const manifestPath = join(dir, 'incremental.manifest');
+  const fullPath = join(dir, 'incremental-0.delta');
+  const deltaPath = join(dir, 'incremental-1.delta');
+  const restoredPath = join(dir, 'incremental-restored.sqlite');
+
+  const source = await Database.openAsync(path, { key: 'hello world' });
+  source.pragma('journal_mode = WAL');
+  source.exec('CREATE TABLE t (id INTEGER PRIMARY KEY, b BLOB NOT NULL)');
+  const insert = source.prepare('INSERT INTO t (b) VALUES (?)');
+  for (let i = 0; i < 200; i += 1) {
+    insert.run([Buffer.alloc(1024, i)]);
+  }
+
+  const full = await source.backupIncremental(fullPath, manifestPath);
+  expect(full.changedPages).toEqual(full.pageCount);
+
+  // Only the changed pages are in the WAL, and in the delta
+  source.prepare('UPDATE t SET b = ? WHERE id = 100').run([Buffer.alloc(10)]);
+  const delta = await source.backupIncremental(deltaPath, manifestPath);
+  expect(delta.changedPages).toBeGreaterThan(0);
+  expect(delta.changedPages).toBeLessThan(10);
+  source.close();
+
+  await Database.applyBackupDelta(restoredPath, fullPath);
+  await Database.applyBackupDelta(restoredPath, deltaPath);
+  await expect(
+    Database.applyBackupDelta(restoredPath, deltaPath),
+  ).rejects.toThrowError("Backup delta doesn't match the target");
+
+  const restored = await Database.openAsync(restoredPath, {
+    key: 'hello world',
+  });
+  expect(
+    restored
+      .prepare('SELECT length(b) FROM t WHERE id = 100', { pluck: true })
+      .get(),
+  ).toEqual(10);
+  expect(
+    restored.prepare('SELECT count(*) FROM t', { pluck: true }).get(),
+  ).toEqual(200);
+  expect(restored.pragma('integrity_check', { simple: true })).toEqual('ok');
+  restored.close();
+});
+
+test('rebuildFts', () => {
+  db.pragma('journal_mode = WAL');
+  db.initTokenizer();
+  db.exec(`
+    CREATE VIRTUAL TABLE fts USING fts5(
+      body,
+      id UNINDEXED,
+      tokenize = 'signal_tokenizer'
+    );
+  `);
+  const insert = db.prepare('INSERT INTO fts (body, id) VALUES (?, ?)');
+  db.transaction(() => {
+    for (let i = 0; i < 1000; i += 1) {
+      insert.run([`message ${i} word${i % 7}`, i]);
+    }
+  })();
+
+  expect(db.rebuildFts('fts', { threads: 2 })).toEqual({
+    cachedValues: 1000,
+    inlineValues: 0,
+  });
+  const match = db.prepare(
+    'SELECT count(*) FROM fts WHERE fts MATCH ?',
+    { pluck: true },
+  );
+  expect(match.get(['word3'])).toEqual(143);
+  db.exec(`INSERT INTO fts (fts, rank) VALUES ('integrity-check', 1)`);
+
+  expect(db.rebuildFts('fts', { threads: 2 ** 40 })).toEqual({
+    cachedValues: 1000,
+    inlineValues: 0,
+  });
+
+  // Rows written by the open transaction aren't seen by the threads
+  db.transaction(() => {
+    insert.run(['uncommitted message', 1000]);
+    const stats = db.rebuildFts('fts');
+    expect(stats.cachedValues).toEqual(1000);
+    expect(stats.inlineValues).toEqual(1);
+  })();
+  expect(match.get(['uncommitted'])).toEqual(1);
+});
+
+test('queueWrite', async () => {
+  const path = join(dir, 'queue.sqlite');
+
+  const first = await Database.openAsync(path, { key: 'hello world' });
+  first.pragma('journal_mode = WAL');
+  first.exec('CREATE TABLE t (id INTEGER PRIMARY KEY, name TEXT UNIQUE)');
+
+  // Another connection shares the same queue
+  const second = new Database(path);
+  second.pragma(`key = "x'${first.exportRawKey().slice(2, -1)}'"`);
+
+  const writes = new Array<Promise<void>>();
+  for (let i = 0; i < 50; i += 1) {
+    const db = i % 2 === 0 ? first : second;
+    writes.push(
+      db.queueWrite([
+        ['INSERT INTO t (name) VALUES (?)', [`a${i}`]],
+        ['INSERT INTO t (name) VALUES ($name)', { name: `b${i}` }],
+      ]),
+    );
+  }
+
+  // Fails as a whole without affecting the rest of the group
+  const failing = first.queueWrite([
+    "INSERT INTO t (name) VALUES ('c')",
+    "INSERT INTO t (name) VALUES ('a0')",
+  ]);
+
+  // Rolls back the whole transaction, the rest of the group is retried
+  const rollback = first.queueWrite([
+    "INSERT OR ROLLBACK INTO t (name) VALUES ('b0')",
+  ]);
+  const more = second.queueWrite(["INSERT INTO t (name) VALUES ('d')"]);
+
+  await Promise.all(writes);
+  await more;
+  await expect(failing).rejects.toThrowError('UNIQUE constraint failed');
+  await expect(rollback).rejects.toThrowError('UNIQUE constraint failed');
+
+  const count = first.prepare('SELECT count(*) FROM t', { pluck: true });
+  expect(count.get()).toEqual(101);
+  second.close();
+  first.close();
+});
+
+test('queueWrite into an FTS table', async () => {
+  const path = join(dir, 'queue-fts.sqlite');
+
+  const db = await Database.openAsync(path, { key: 'hello world' });
+  db.initTokenizer();
+  db.exec(`
+    CREATE VIRTUAL TABLE fts USING fts5(
+      body,
+      tokenize = 'signal_tokenizer prefix_index'
+    );
+  `);
+  expect(db.buildPrefixIndex('fts')).toEqual(0);
+
+  await db.queueWrite(["INSERT INTO fts (body) VALUES ('hello world')"]);
+  expect(
+    db
+      .prepare("SELECT count(*) FROM fts WHERE fts MATCH 'hello'", {
+        pluck: true,
+      })
+      .get(),
+  ).toEqual(1);
+
+  // Written by the connection of the queue
+  expect(db.completePrefix('hel')).toEqual([{ term: 'hello', count: 1 }]);
+  db.close();
+});
+
+test('transaction mode', () => {
+  db.pragma('journal_mode = WAL');
+  db.exec('CREATE TABLE t (a INTEGER)');
+
+  const other = new Database(join(dir, 'db.sqlite'));
+  const insert = other.prepare('INSERT INTO t (a) VALUES (1)');
+
+  // Deferred transactions don't lock until the first write
+  db.transaction(() => {
+    insert.run();
+  })();
+
+  // Immediate transactions take the write lock right away
+  db.transaction(
+    () => {
+      expect(() => insert.run()).toThrowError('database is locked');
+    },
+    { mode: 'immediate' },
+  )();
+
+  other.close();
+});
+
+test('busyTimeout', () => {
+  db.pragma('journal_mode = WAL');
+  db.exec('CREATE TABLE t (a INTEGER)');
+
+  const other = new Database(join(dir, 'db.sqlite'), {
+    busyTimeout: { timeoutMs: 50, initialDelayMs: 1, maxDelayMs: 10 },
+  });
+  const insert = other.prepare('INSERT INTO t (a) VALUES (1)');
+
+  db.transaction(
+    () => {
+      expect(() => insert.run()).toThrowError('database is locked');
+    },
+    { mode: 'immediate' },
+  )();
+  insert.run();
+
+  const stats = other.busyStats();
+  expect(stats.waits).toEqual(1);
+  expect(stats.timeouts).toEqual(1);
+  expect(stats.retries).toBeGreaterThan(1);
+  expect(stats.totalWaitMicros).toBeGreaterThanOrEqual(25_000);
+  expect(stats.maxWaitMicros).toEqual(stats.totalWaitMicros);
+  other.close();
+});
+
+test('checkpointer', async () => {
+  db.pragma('journal_mode = WAL');
+  db.exec('CREATE TABLE t (b BLOB)');
+
+  const other = new Database(join(dir, 'db.sqlite'), {
+    checkpointer: { frames: 10, idleMs: 50 },
+  });
+  const insert = other.prepare('INSERT INTO t (b) VALUES (?)');
+  for (let i = 0; i < 100; i += 1) {
+    insert.run([Buffer.alloc(1024, i)]);
+  }
+
+  let stats = other.checkpointStats();
+  expect(stats.walFrames).toBeGreaterThan(0);
+  expect(stats.walBytes).toBeGreaterThan(stats.walFrames * 1024);
+
+  // The WAL is truncated once idle
+  await vi.waitFor(
+    () => {
+      stats = other.checkpointStats();
+      expect(stats.truncate).toEqual(1);
+    },
+    { timeout: 10_000 },
+  );
+  expect(stats.passive + stats.restart + stats.starved).toBeGreaterThan(0);
+  expect(stats.truncate).toEqual(1);
+  expect(stats.walFrames).toEqual(0);
+  expect(stats.checkpointedFrames).toBeGreaterThanOrEqual(100);
+  expect(stats.maxMicros).toBeGreaterThanOrEqual(stats.lastMicros);
+  expect(stats.errors).toEqual(0);
+  other.close();
+});
+
+test('startDeferredIndexing', async () => {
+  db.pragma('journal_mode = WAL');
+  db.initTokenizer();
+  db.exec(`
+    CREATE TABLE messages (id INTEGER PRIMARY KEY, body TEXT NOT NULL);
+    CREATE VIRTUAL TABLE messages_fts USING fts5(
+      body,
+      tokenize = 'signal_tokenizer'
+    );
+  `);
+  db.startDeferredIndexing('messages_fts', {
+    content: 'messages',
+    batchSize: 50,
+    delayMs: 10,
+    intervalMs: 50,
+    mergePages: 16,
+  });
+  db.exec(`
+    CREATE TRIGGER messages_on_insert AFTER INSERT ON messages BEGIN
+      INSERT INTO messages_fts_queue (rowid) VALUES (new.id);
+    END;
+  `);
+
+  const insert = db.prepare('INSERT INTO messages (body) VALUES (?)');
+  db.transaction(() => {
+    for (let i = 0; i < 120; i += 1) {
+      insert.run([`hello ${i}`]);
+    }
+  })();
+
+  // Not indexed by the writer
+  const match = db.prepare(
+    `SELECT count(*) FROM messages_fts WHERE messages_fts MATCH 'hello'`,
+    { pluck: true },
+  );
+  expect(match.get()).toEqual(0);
+
+  // The stats are updated after each batch commits
+  const stats = await vi.waitFor(
+    () => {
+      expect(match.get()).toEqual(120);
+      const current = db.indexingStats();
+      expect(current.indexedRows).toEqual(120);
+      expect(current.queueDepth).toEqual(0);
+      return current;
+    },
+    { timeout: 10_000 },
+  );
+  expect(stats.lagMs).toEqual(0);
+  expect(stats.batches).toBeGreaterThanOrEqual(3);
+  expect(stats.maxMicros).toBeGreaterThanOrEqual(stats.lastMicros);
+  expect(stats.errors).toEqual(0);
+
+  expect(() =>
+    db.startDeferredIndexing('missing', { content: 'messages' }),
+  ).toThrowError('no such table: missing');
+});
+
+test('startFtsMerger', async () => {
+  db.pragma('journal_mode = WAL');
+  db.initTokenizer();
+  db.exec(`
+    CREATE VIRTUAL TABLE fts USING fts5(
+      body,
+      tokenize = 'signal_tokenizer'
+    );
+    INSERT INTO fts (fts, rank) VALUES ('automerge', 0);
+  `);
+
+  // A segment per transaction
+  const insert = db.prepare('INSERT INTO fts (body) VALUES (?)');
+  for (let i = 0; i < 40; i += 1) {
+    insert.run([`hello ${i}`]);
+  }
+  const before = db.ftsStructure('fts');
+  expect(before.segments).toEqual(40);
+  expect(before.levels[0].segments).toEqual(40);
+
+  db.startFtsMerger('fts', { idleMs: 20, budgetMs: 5 });
+  // Merging may still go on, so the stats and the structure are checked
+  // together until they agree
+  const stats = await vi.waitFor(
+    () => {
+      const current = db.ftsMergeStats();
+      expect(current.steps).toBeGreaterThan(0);
+      expect(current.structure.segments).toBeLessThan(before.segments);
+      expect(current.structure).toEqual(db.ftsStructure('fts'));
+      return current;
+    },
+    { timeout: 10_000 },
+  );
+  expect(stats.errors).toEqual(0);
+  expect(stats.pagesPerStep).toBeGreaterThan(0);
+  expect(stats.maxMicros).toBeGreaterThanOrEqual(stats.lastMicros);
+
+  expect(
+    db.prepare(`SELECT count(*) FROM fts WHERE fts MATCH 'hello'`, {
+      pluck: true,
+    }).get(),
+  ).toEqual(40);
+  db.exec(`INSERT INTO fts (fts) VALUES ('integrity-check')`);
+
+  expect(() => db.startFtsMerger('missing')).toThrowError(
+    'no such table: missing',
+  );
+  expect(() => db.ftsMergeStats()).toThrowError('FTS merger is not enabled');
+});
+
+test('readaheadPages', () => {
+  const path = join(dir, 'readahead.sqlite');
+
+  const writer = new Database(path);
+  writer.exec('CREATE TABLE t (b BLOB NOT NULL)');
+  const insert = writer.prepare('INSERT INTO t (b) VALUES (?)');
+  writer.transaction(() => {
+    for (let i = 0; i < 2000; i += 1) {
+      insert.run([Buffer.alloc(1024, i)]);
+    }
+  })();
+  writer.close();
+
+  const reader = new Database(path, { readaheadPages: 16 });
+  expect(reader.pragma('readahead_pages', { simple: true })).toEqual('16');
+  expect(
+    reader.prepare('SELECT sum(length(b)) FROM t', { pluck: true }).get(),
+  ).toEqual(2000 * 1024);
+
+  const stats = reader.readaheadStats();
+  expect(stats.reads).toBeGreaterThan(0);
+  expect(stats.hits).toBeGreaterThan(0);
+  expect(stats.prefetchedPages).toBeGreaterThanOrEqual(stats.hits);
+  reader.close();
+
+  const mapped = new Database(path, { readaheadPages: 16 });
+  mapped.pragma('mmap_size = 268435456');
+  expect(
+    mapped.prepare('SELECT sum(length(b)) FROM t', { pluck: true }).get(),
+  ).toEqual(2000 * 1024);
+  expect(mapped.readaheadStats().prefetchedPages).toEqual(0);
+  mapped.close();
+});
+
+test('ioUring', () => {
+  const path = join(dir, 'io-uring.sqlite');
+
+  const writer = new Database(path, { ioUring: true });
+  writer.pragma('journal_mode = WAL');
+  writer.pragma('synchronous = FULL');
+  writer.pragma('wal_autocheckpoint = 0');
+  writer.exec('CREATE TABLE t (b BLOB NOT NULL)');
+
+  const reader = new Database(path, { ioUring: true });
+  const count = reader.prepare('SELECT count(*) FROM t', { pluck: true });
+
+  const insert = writer.prepare('INSERT INTO t (b) VALUES (?)');
+  for (let i = 0; i < 100; i += 1) {
+    insert.run([Buffer.alloc(100, i)]);
+
+    // Commits are visible to other connections right away
+    expect(count.get()).toEqual(i + 1);
+  }
+  writer.transaction(() => {
+    for (let i = 0; i < 1000; i += 1) {
+      insert.run([Buffer.alloc(4000, i)]);
+    }
+  })();
+
+  writer.pragma('wal_checkpoint(TRUNCATE)');
+  reader.close();
+  writer.close();
+
+  const check = new Database(path);
+  expect(check.pragma('integrity_check', { simple: true })).toEqual('ok');
+  expect(
+    check.prepare('SELECT count(*) FROM t', { pluck: true }).get(),
+  ).toEqual(1100);
+  check.close();
+});
+
+test('ioStats', () => {
+  const db = new Database(join(dir, 'io-stats.sqlite'), { ioStats: true });
+  db.pragma('journal_mode = WAL');
+  db.exec('CREATE TABLE t (b BLOB NOT NULL)');
+  const insert = db.prepare('INSERT INTO t (b) VALUES (?)');
+  for (let i = 0; i < 10; i += 1) {
+    insert.run([Buffer.alloc(1024, i)]);
+  }
+
+  const { main, wal, shm } = db.ioStats();
+  expect(main.reads.count).toBeGreaterThan(0);
+  expect(main.locks.count).toBeGreaterThan(0);
+  expect(wal.writes.count).toBeGreaterThanOrEqual(10);
+  expect(wal.writes.bytes).toBeGreaterThan(10 * 1024);
+  expect(wal.syncs.count).toBeGreaterThan(0);
+  expect(shm.locks.count).toBeGreaterThan(0);
+
+  const { count, histogram } = wal.writes;
+  expect(histogram.reduce((a, b) => a + b)).toEqual(count);
+  db.close();
+});
@@ -306,6 +306,249 @@ test('invalid database path', () => {
   expect(() => new Database(123 as any)).toThrowError('Invalid database path');
 });
 
+test('openAsync', async () => {
+  const asyncDb = await Database.openAsync(':memory:');
+  expect(asyncDb.prepare('SELECT 1', { pluck: true }).get()).toEqual(1);
+  asyncDb.close();
+});
+
+test('openAsync with failing options', async () => {
+  // The opened connection is closed by the constructor
+  await expect(
+    Database.openAsync(':memory:', { checkpointer: {} }),
+  ).rejects.toThrowError('Not supported for in-memory databases');
+});
+
+test('invalid openAsync key', async () => {
+  await expect(Database.openAsync(':memory:', { key: '' })).rejects.toThrowError(
+    'Invalid key',
+  );
+});
+
+test('exportRawKey without key', () => {
+  expect(() => db.exportRawKey()).toThrowError('Raw key is not available');
+});
+
+test('invalid openAsync raw key', async () => {
+  await expect(
+    Database.openAsync(':memory:', { rawKey: "x'abba'" }),
+  ).rejects.toThrowError('Invalid raw key');
+});
+
+test('readaheadStats without readahead', () => {
+  expect(() => db.readaheadStats()).toThrowError('Read-ahead is not enabled');
+});
+
+test('verifyIntegrity without key', () => {
+  expect(() => db.verifyIntegrity()).toThrowError('Raw key is not available');
+});
+
+test('rekeyAsync of in-memory database', async () => {
+  await expect(db.rekeyAsync('key')).rejects.toThrowError(
+    'Not supported for in-memory databases',
+  );
+});
+
+test('queueWrite on in-memory database', () => {
+  expect(() => db.queueWrite(['SELECT 1'])).toThrowError(
+    'Not supported for in-memory databases',
+  );
+});
+
+test('invalid writeQueue', () => {
+  const maxWrites = new Database(':memory:', {
+    writeQueue: { maxWrites: 2 ** 32 },
+  });
+  expect(() => maxWrites.queueWrite(['SELECT 1'])).toThrowError(
+    'Invalid maxWrites option',
+  );
+  maxWrites.close();
+
+  const windowMs = new Database(':memory:', {
+    writeQueue: { windowMs: 2 ** 31 },
+  });
+  expect(() => windowMs.queueWrite(['SELECT 1'])).toThrowError(
+    'Invalid windowMs option',
+  );
+  windowMs.close();
+});
+
+test('busyStats without busyTimeout', () => {
+  expect(() => db.busyStats()).toThrowError('Busy handler is not enabled');
+});
+
+test('invalid busyTimeout', () => {
+  expect(
+    () => new Database(':memory:', { busyTimeout: { timeoutMs: -1 } }),
+  ).toThrowError('Invalid busyTimeout');
+  expect(
+    () => new Database(':memory:', { busyTimeout: { timeoutMs: 2 ** 31 } }),
+  ).toThrowError('Invalid busyTimeout');
+  expect(
+    () =>
+      new Database(':memory:', {
+        busyTimeout: { timeoutMs: 100, initialDelayMs: 0 },
+      }),
+  ).toThrowError('Invalid busyTimeout');
+});
+
+test('checkpointer on in-memory database', () => {
+  expect(
+    () => new Database(':memory:', { checkpointer: { frames: 100 } }),
+  ).toThrowError('Not supported for in-memory databases');
+  expect(() => db.checkpointStats()).toThrowError(
+    'Checkpointer is not enabled',
+  );
+});
+
+test('invalid checkpointer', () => {
+  expect(
+    () => new Database(':memory:', { checkpointer: { frames: 0 } }),
+  ).toThrowError('Invalid checkpointer');
+  expect(
+    () =>
+      new Database(':memory:', { checkpointer: { restartFrames: 2 ** 31 } }),
+  ).toThrowError('Invalid checkpointer');
+});
+
+test('serialize and deserialize', () => {
+  const buffer = db.serialize();
+  expect(buffer.length).toBeGreaterThan(0);
+
+  const copy = new Database();
+  copy.deserialize(buffer);
+  expect(copy.prepare('SELECT * FROM t').all()).toEqual(rows);
+  copy.exec("INSERT INTO t (a, b) VALUES (4, 'abc')");
+  expect(copy.serialize().length).toEqual(buffer.length);
+  copy.close();
+
+  const readonly = new Database();
+  const select = readonly.prepare('SELECT count(*) FROM sqlite_schema', {
+    pluck: true,
+  });
+  expect(select.get()).toEqual(0);
+  readonly.deserialize(buffer, { readonly: true });
+  expect(select.get()).toEqual(1);
+  expect(() => readonly.exec('DELETE FROM t')).toThrowError(
+    'attempt to write a readonly database',
+  );
+
+  // The buffer is copied
+  const modified = new Uint8Array(buffer);
+  readonly.deserialize(modified, { readonly: true });
+  modified.fill(0);
+  expect(readonly.prepare('SELECT * FROM t').all()).toEqual(rows);
+  readonly.close();
+
+  const empty = new Database();
+  expect(empty.serialize().length).toEqual(0);
+  empty.close();
+
+  expect(() => db.deserialize([] as unknown as Buffer)).toThrowError(
+    'Invalid buffer',
+  );
+});
+
+test('query timeout', () => {
+  const stmt = db.prepare(
+    `WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c)
+     SELECT count(*) FROM c`,
+    { pluck: true },
+  );
+  expect(() => stmt.get([], { timeoutMs: 50 })).toThrowError(
+    'Query timed out after 50ms',
+  );
+
+  // The connection is usable afterwards
+  expect(db.prepare('SELECT 1', { pluck: true }).get()).toEqual(1);
+  expect(() =>
+    db.prepare('SELECT 1').get([], { timeoutMs: 2 ** 31 }),
+  ).toThrowError('Invalid timeoutMs option');
+  expect(
+    db.prepare('SELECT 2', { pluck: true }).all([], { timeoutMs: 1000 }),
+  ).toEqual([2]);
+});
+
+test('interrupt', () => {
+  const id = db.interruptId;
+
+  // Nothing is running, the next query is not affected
+  expect(Database.interrupt(id)).toEqual(true);
+  expect(db.prepare('SELECT 1', { pluck: true }).get()).toEqual(1);
+
+  const other = new Database();
+  const otherId = other.interruptId;
+  expect(otherId).not.toEqual(id);
+  other.close();
+  expect(Database.interrupt(otherId)).toEqual(false);
+});
+
+test('stepFor', () => {
+  const stmt = db.prepare(
+    `WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c LIMIT $n)
+     SELECT x FROM c`,
+    { pluck: true },
+  );
+
+  const result = [];
+  let calls = 0;
+  let done = false;
+  let params: { n: number } | undefined = { n: 1000 };
+  while (!done) {
+    const slice = stmt.stepFor({ vmSteps: 100 }, params);
+    params = undefined;
+    result.push(...slice.rows);
+    done = slice.done;
+    calls += 1;
+  }
+  expect(calls).toBeGreaterThan(1);
+  expect(result).toEqual(stmt.all({ n: 1000 }));
+
+  // Unfinished iteration is abandoned by other methods
+  expect(stmt.stepFor({ vmSteps: 1 }, { n: 10 })).toEqual({
+    rows: [1],
+    done: false,
+  });
+  expect(stmt.get({ n: 5 })).toEqual(1);
+  expect(stmt.stepFor({ budgetMs: 1000 }, { n: 3 })).toEqual({
+    rows: [1, 2, 3],
+    done: true,
+  });
+});
+
+test('stepFor with rows', () => {
+  const stmt = db.prepare('SELECT * FROM t ORDER BY a');
+  expect(stmt.stepFor({ vmSteps: 1 })).toEqual({
+    rows: [rows[0]],
+    done: false,
+  });
+  expect(stmt.stepFor({ budgetMs: 1000 })).toEqual({
+    rows: rows.slice(1),
+    done: true,
+  });
+});
+
+test('invalid stepFor budget', () => {
+  const stmt = db.prepare('SELECT 1');
+  expect(() => stmt.stepFor({})).toThrowError(
+    'Either budgetMs or vmSteps must be set',
+  );
+  expect(() => stmt.stepFor({ vmSteps: 0 })).toThrowError('Invalid vmSteps');
+  expect(() => stmt.stepFor({ budgetMs: -1 })).toThrowError(
+    'Invalid budgetMs',
+  );
+});
+
+test('ioUring with readaheadPages', () => {
+  expect(
+    () => new Database(':memory:', { ioUring: true, readaheadPages: 8 }),
+  ).toThrowError('readaheadPages and ioUring are mutually exclusive');
+});
+
+test('ioStats without option', () => {
+  expect(() => db.ioStats()).toThrowError('I/O stats are not enabled');
+});
+
 test('invalid exec query', () => {
   // eslint-disable-next-line @typescript-eslint/no-explicit-any
   expect(() => db.exec(123 as any)).toThrowError('Invalid sql argument');
@@ -380,6 +623,44 @@ describe('transaction', () => {
       db.prepare('SELECT b FROM t WHERE a IS 42', { pluck: true }).get(),
     ).toEqual('success');
   });
+
+  test('nested rollback releases the savepoint', () => {
+    db.transaction(() => {
+      for (let i = 0; i < 3; i += 1) {
+        expect(() =>
+          db.transaction(() => {
+            db.prepare(`INSERT INTO t (a, b) VALUES (${i}, 'fail')`).run();
+            throw new Error('rollback');
+          })(),
+        ).toThrowError('rollback');
+      }
+      db.prepare(`INSERT INTO t (a, b) VALUES (42, 'success')`).run();
+    })();
+
+    expect(db.prepare('SELECT count(*) FROM t', { pluck: true }).get()).toEqual(
+      1,
+    );
+  });
+
+  test('immediate mode', () => {
+    db.transaction(
+      () => {
+        db.prepare(`INSERT INTO t (a, b) VALUES (42, 'success')`).run();
+      },
+      { mode: 'immediate' },
+    )();
+
+    expect(
+      db.prepare('SELECT b FROM t WHERE a IS 42', { pluck: true }).get(),
+    ).toEqual('success');
+  });
+
+  test('invalid mode', () => {
+    expect(() =>
+      // eslint-disable-next-line @typescript-eslint/no-explicit-any
+      db.transaction(() => {}, { mode: 'shared' as any }),
+    ).toThrowError('Invalid transaction mode');
+  });
 });
 
 test('single-copy strings', () => {
@@ -458,14 +739,277 @@ test('tokenizer setup after close', () => {
   db = new Database();
 });
 
+test('rebuildFts', () => {
+  expect(() => db.rebuildFts('fts')).toThrowError(
+    'Tokenizer is not initialized',
+  );
+
+  db.initTokenizer();
+  db.exec(`
+    CREATE VIRTUAL TABLE fts USING fts5(body, tokenize = 'signal_tokenizer');
+    INSERT INTO fts (body) VALUES ('hello world'), ('hello.there');
+  `);
+
+  // Tokenized by FTS5 for in-memory databases
+  expect(db.rebuildFts('fts', { threads: 2 })).toEqual({
+    cachedValues: 0,
+    inlineValues: 2,
+  });
+  expect(
+    db
+      .prepare(`SELECT count(*) FROM fts WHERE fts MATCH 'hello'`, {
+        pluck: true,
+      })
+      .get(),
+  ).toEqual(2);
+
+  expect(() => db.rebuildFts('fts', { threads: 0 })).toThrowError(
+    'Invalid threads option',
+  );
+  expect(() => db.rebuildFts('missing')).toThrowError('no such table');
+});
+
+test('searchFts', () => {
+  expect(() => db.searchFts('fts', 'hello')).toThrowError(
+    'Tokenizer is not initialized',
+  );
+
+  db.initTokenizer();
+  db.exec(`
+    CREATE VIRTUAL TABLE fts USING fts5(
+      subject,
+      body,
+      tokenize = 'signal_tokenizer'
+    );
+  `);
+  const insert = db.prepare('INSERT INTO fts (subject, body) VALUES (?, ?)');
+  db.transaction(() => {
+    for (let i = 0; i < 200; i += 1) {
+      insert.run([
+        i % 7 === 0 ? 'hello' : 'other',
+        `${'word '.repeat(i % 13)}hello ${i % 3 === 0 ? 'hello' : ''}`,
+      ]);
+    }
+  })();
+
+  const expected = db
+    .prepare(
+      `SELECT rowid, bm25(fts, 5.0) AS score FROM fts
+        WHERE fts MATCH 'hello' ORDER BY score, rowid LIMIT 10`,
+    )
+    .all();
+  const { rowids, scores } = db.searchFts('fts', 'hello', {
+    limit: 10,
+    weights: [5],
+  });
+  expect(Array.from(rowids)).toEqual(expected.map(({ rowid }) => rowid));
+  expect(Array.from(scores)).toEqual(expected.map(({ score }) => score));
+
+  expect(db.searchFts('fts', 'missing').rowids.length).toEqual(0);
+  expect(db.searchFts('fts', 'hello', { limit: 500 }).rowids.length).toEqual(
+    200,
+  );
+
+  expect(() => db.searchFts('fts', 'hello', { limit: 0 })).toThrowError(
+    'Invalid limit option',
+  );
+  expect(() =>
+    db.searchFts('fts', 'hello', { weights: ['1' as unknown as number] }),
+  ).toThrowError('Invalid weights option');
+  expect(() => db.searchFts('missing', 'hello')).toThrowError(
+    'no such table',
+  );
+});
+
+test('completePrefix', () => {
+  expect(() => db.completePrefix('a')).toThrowError(
+    'Prefix index is not built',
+  );
+
+  db.initTokenizer();
+  db.exec(`
+    CREATE VIRTUAL TABLE names USING fts5(
+      name,
+      tokenize = 'signal_tokenizer prefix_index'
+    );
+    INSERT INTO names (name) VALUES
+      ('Alice Smith'), ('Alice Jones'), ('Alan Smith'), ('Bob Smithers');
+  `);
+  expect(db.buildPrefixIndex('names')).toEqual(6);
+
+  expect(db.completePrefix('Al')).toEqual([
+    { term: 'alice', count: 2 },
+    { term: 'alan', count: 1 },
+  ]);
+  expect(db.completePrefix('Bob SMI', 1)).toEqual([
+    { term: 'smith', count: 2 },
+  ]);
+  expect(db.completePrefix('x')).toEqual([]);
+  expect(db.completePrefix('')).toEqual([]);
+
+  // Updated as rows are indexed
+  db.exec(`
+    INSERT INTO names (name) VALUES
+      ('Alan Turing'), ('Alan Kay'), ('Alan Parsons');
+  `);
+  expect(db.completePrefix('al')).toEqual([
+    { term: 'alan', count: 4 },
+    { term: 'alice', count: 2 },
+  ]);
+
+  // Not counted if the transaction rolls back
+  const insert = db.prepare('INSERT INTO names (name) VALUES (?)');
+  expect(() =>
+    db.transaction(() => {
+      insert.run(['Alice Cooper']);
+      throw new Error('rollback');
+    })(),
+  ).toThrowError('rollback');
+  expect(db.completePrefix('alice')).toEqual([{ term: 'alice', count: 2 }]);
+  expect(db.completePrefix('coo')).toEqual([]);
+
+  // Old terms of updated and deleted rows aren't suggested anymore
+  db.exec(`
+    UPDATE names SET name = 'Alina Smith' WHERE name = 'Alice Smith';
+    DELETE FROM names WHERE name LIKE 'Alan %';
+  `);
+  expect(db.completePrefix('al')).toEqual([
+    { term: 'alice', count: 1 },
+    { term: 'alina', count: 1 },
+  ]);
+  expect(db.completePrefix('tur')).toEqual([]);
+
+  expect(() => db.completePrefix('al', 0)).toThrowError('Invalid limit');
+  expect(() => db.buildPrefixIndex('missing')).toThrowError('no such');
+});
+
+test('startDeferredIndexing', () => {
+  expect(() =>
+    db.startDeferredIndexing('fts', { content: 't', batchSize: 0 }),
+  ).toThrowError('Invalid deferred indexing options');
+  expect(() =>
+    db.startDeferredIndexing('fts', { content: 't', batchSize: 2 ** 32 }),
+  ).toThrowError('Invalid deferred indexing options');
+  expect(() =>
+    db.startDeferredIndexing('fts', { content: 't', intervalMs: 2 ** 32 }),
+  ).toThrowError('Invalid deferred indexing options');
+  expect(() => db.startDeferredIndexing('fts', { content: 't' })).toThrowError(
+    'Not supported for in-memory databases',
+  );
+  expect(() => db.indexingStats()).toThrowError(
+    'Deferred indexing is not enabled',
+  );
+});
+
+test('startFtsMerger', () => {
+  expect(() => db.startFtsMerger('fts', { idleMs: 0 })).toThrowError(
+    'Invalid FTS merger options',
+  );
+  expect(() => db.startFtsMerger('fts', { budgetMs: 2 ** 32 })).toThrowError(
+    'Invalid FTS merger options',
+  );
+  expect(() => db.startFtsMerger('fts')).toThrowError(
+    'Not supported for in-memory databases',
+  );
+  expect(() => db.ftsMergeStats()).toThrowError('FTS merger is not enabled');
+});
+
+test('ftsStructure', () => {
+  db.initTokenizer();
+  db.exec(`
+    CREATE VIRTUAL TABLE fts USING fts5(body, tokenize = 'signal_tokenizer');
+    INSERT INTO fts (body) VALUES ('hello');
+    INSERT INTO fts (body) VALUES ('world');
+  `);
+  expect(db.ftsStructure('fts')).toEqual({
+    segments: 2,
+    levels: [{ segments: 2, merging: 0, pages: 2 }],
+  });
+  expect(() => db.ftsStructure('missing')).toThrowError(
+    'no such table: missing_data',
+  );
+});
+
 test('signalTokenize', () => {
   expect(db.signalTokenize('a b c')).toEqual(['a', 'b', 'c']);
 });
 
+test('signalTokenizeQuery', () => {
+  expect(() => db.signalTokenizeQuery('a')).toThrowError(
+    'Tokenizer is not initialized',
+  );
+  db.initTokenizer();
+
+  const query = 'Hello wörld, how are you';
+  for (let i = 1; i <= query.length; i += 1) {
+    const value = query.slice(0, i);
+    expect(db.signalTokenizeQuery(value)).toEqual(db.signalTokenize(value));
+  }
+  expect(db.signalTokenizeQuery('Hello wörld, who')).toEqual(
+    db.signalTokenize('Hello wörld, who'),
+  );
+
+  const { misses, tokenizedBytes } = db.tokenCacheStats();
+  expect(db.signalTokenizeQuery(query)).toEqual(db.signalTokenize(query));
+  expect(db.tokenCacheStats()).toEqual({
+    hits: 1,
+    misses,
+    tokenizedBytes,
+  });
+
+  // Prefixes were only tokenized from their last whitespace
+  expect(tokenizedBytes).toBeLessThan(
+    (query.length * (query.length + 1)) / 2,
+  );
+
+  db.exec(`
+    CREATE VIRTUAL TABLE fts USING fts5(body, tokenize = 'signal_tokenizer');
+    INSERT INTO fts (body) VALUES ('hello world');
+  `);
+  expect(
+    db
+      .prepare(`SELECT count(*) FROM fts WHERE fts MATCH 'hello world'`, {
+        pluck: true,
+      })
+      .get(),
+  ).toEqual(1);
+  expect(db.tokenCacheStats().misses).toBeGreaterThan(misses);
+});
+
 test('signalTokenize dot', () => {
   expect(db.signalTokenize('a.b.c')).toEqual(['a', 'b', 'c']);
 });
 
+test('signalTokenizeBatch', () => {
+  const { tokens, offsets, boundaries } = db.signalTokenizeBatch([
+    'a b',
+    '',
+    'hello.world',
+  ]);
+  const words = Array.from(offsets.subarray(1), (end, i) =>
+    tokens.subarray(offsets[i], end).toString(),
+  );
+  expect(words).toEqual(['a', 'b', 'hello', 'world']);
+  expect(Array.from(boundaries)).toEqual([0, 2, 2, 4]);
+});
+
+test('signalTokenizeRanges', () => {
+  // Offsets are in UTF-16 code units, after a surrogate pair
+  const value = 'ab 😀 cd';
+  const { ranges, boundaries } = db.signalTokenizeRanges(['x', value]);
+  expect(boundaries[0]).toEqual(0);
+  expect(boundaries[1]).toEqual(1);
+  expect(value.slice(ranges[2], ranges[3])).toEqual('ab');
+  expect(value.slice(ranges.at(-2), ranges.at(-1))).toEqual('cd');
+});
+
+test('invalid argument for signalTokenizeBatch', () => {
+  // eslint-disable-next-line @typescript-eslint/no-explicit-any
+  expect(() => db.signalTokenizeBatch(['a', 1] as any)).toThrowError(
+    'Invalid values',
+  );
+});
+
 test('invalid argument for signalTokenize', () => {
   // eslint-disable-next-line @typescript-eslint/no-explicit-any
   expect(() => db.signalTokenize(123 as any)).toThrowError('Invalid value');